@@ -0,0 +1,298 @@
+/*
+ * 200_bench_suite.c – Cycle-accurate microbenchmark suite for RISC OS Phoenix
+ * Times the hot kernel paths with cntpct_el0 and prints one machine-readable
+ * BENCH line per benchmark so CI can diff releases:
+ *
+ *     BENCH name=<bench> iters=<n> min=<cycles> median=<cycles> p99=<cycles>
+ *
+ * Covered: spinlock acquire/release, context switch (yield), pipe round
+ * trip, 4KB block read, TCP echo round trip, Wimp event dispatch.
+ * The suite is a kernel task, compiled in by "make bench" (which sets
+ * CONFIG_BENCH) and launched from kernel.c once the FS stack is up.
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "vfs.h"
+#include "pipe.h"
+#include "blockdriver.h"
+#include "wimp.h"
+#include "net.h"
+#include <string.h>
+
+#define BENCH_ITERS     1024    // Fixed so CI numbers compare run to run
+#define BENCH_WARMUP    64      // Discarded – caches, predictors, lazy init
+
+static uint64_t samples[BENCH_ITERS];
+
+/* Generic counter-timer, constant rate, immune to DVFS unlike PMU
+ * cycle counters. The isb orders it against the measured section. */
+static inline uint64_t bench_cycles(void)
+{
+    uint64_t c;
+    __asm__ volatile("isb; mrs %0, cntpct_el0" : "=r"(c) :: "memory");
+    return c;
+}
+
+/* Insertion sort – n is small and the array is nearly random anyway */
+static void bench_sort(uint64_t *v, int n)
+{
+    for (int i = 1; i < n; i++) {
+        uint64_t key = v[i];
+        int j = i - 1;
+        while (j >= 0 && v[j] > key) {
+            v[j + 1] = v[j];
+            j--;
+        }
+        v[j + 1] = key;
+    }
+}
+
+static void bench_report(const char *name, int iters)
+{
+    bench_sort(samples, iters);
+    debug_print("BENCH name=%s iters=%d min=%llu median=%llu p99=%llu\n",
+                name, iters,
+                samples[0],
+                samples[iters / 2],
+                samples[(iters * 99) / 100]);
+}
+
+static void bench_skip(const char *name, const char *why)
+{
+    debug_print("BENCH name=%s skipped=1 reason=%s\n", name, why);
+}
+
+/* ---- 1. Spinlock acquire + release (spinlock.c) ---------------------- */
+
+static spinlock_t bench_lock;
+
+static void bench_spinlock(void)
+{
+    spinlock_init(&bench_lock);
+    for (int i = -BENCH_WARMUP; i < BENCH_ITERS; i++) {
+        uint64_t t0 = bench_cycles();
+        spin_lock(&bench_lock);
+        spin_unlock(&bench_lock);
+        uint64_t t1 = bench_cycles();
+        if (i >= 0) samples[i] = t1 - t0;
+    }
+    bench_report("spinlock", BENCH_ITERS);
+}
+
+/* ---- 2. Context switch via yield (sched.c) --------------------------- */
+
+static void bench_yield_peer(void)
+{
+    while (1) {
+        yield();    // Ping-pongs with the bench task on the same core
+    }
+}
+
+static void bench_context_switch(void)
+{
+    /* Same priority, pinned to our core so every yield really switches.
+     * Each sample covers two switches (out and back) – CI tracks the
+     * round trip, which is what a pipeline of tasks actually pays. */
+    task_create("BenchYield", bench_yield_peer, 10, (1ULL << get_cpu_id()));
+
+    for (int i = -BENCH_WARMUP; i < BENCH_ITERS; i++) {
+        uint64_t t0 = bench_cycles();
+        yield();
+        uint64_t t1 = bench_cycles();
+        if (i >= 0) samples[i] = t1 - t0;
+    }
+    bench_report("context_switch", BENCH_ITERS);
+}
+
+/* ---- 3. Pipe round trip (pipe.c) ------------------------------------- */
+
+static file_t *bench_ping_rd, *bench_ping_wr;   // Bench -> echo
+static file_t *bench_pong_rd, *bench_pong_wr;   // Echo -> bench
+
+static void bench_pipe_echo(void)
+{
+    char c;
+    while (1) {
+        if (vfs_read(bench_ping_rd, &c, 1) == 1)
+            vfs_write(bench_pong_wr, &c, 1);
+    }
+}
+
+static void bench_pipe_rtt(void)
+{
+    int ping[2], pong[2];
+    if (pipe(ping) < 0 || pipe(pong) < 0) {
+        bench_skip("pipe_rtt", "pipe_failed");
+        return;
+    }
+
+    /* The echo task gets fresh (empty) fd tables, so hand it the
+     * file_t pointers directly – both ends live in the kernel anyway */
+    bench_ping_rd = (file_t *)current_task->files[ping[0]];
+    bench_ping_wr = (file_t *)current_task->files[ping[1]];
+    bench_pong_rd = (file_t *)current_task->files[pong[0]];
+    bench_pong_wr = (file_t *)current_task->files[pong[1]];
+
+    task_create("BenchPipeEcho", bench_pipe_echo, 10, (1ULL << get_cpu_id()));
+
+    char c = 'p';
+    for (int i = -BENCH_WARMUP; i < BENCH_ITERS; i++) {
+        uint64_t t0 = bench_cycles();
+        vfs_write(bench_ping_wr, &c, 1);
+        vfs_read(bench_pong_rd, &c, 1);
+        uint64_t t1 = bench_cycles();
+        if (i >= 0) samples[i] = t1 - t0;
+    }
+    bench_report("pipe_rtt", BENCH_ITERS);
+}
+
+/* ---- 4. 4KB block read (blockdriver.c) ------------------------------- */
+
+static uint8_t bench_buf[4096] __attribute__((aligned(4096)));
+
+static void bench_block_read(void)
+{
+    blockdev_t *dev = blockdev_get("nvme", 0);
+    if (!dev) dev = blockdev_get("mmc", 0);
+    if (!dev || !dev->block_size) {
+        bench_skip("block_read_4k", "no_blockdev");
+        return;
+    }
+
+    uint32_t count = 4096 / dev->block_size;
+    for (int i = -BENCH_WARMUP; i < BENCH_ITERS; i++) {
+        /* Stride the LBA so the device cache and the page cache can't
+         * turn this into a pure memcpy benchmark */
+        uint64_t lba = ((uint64_t)(i < 0 ? 0 : i) * 64) % (1 << 20);
+        uint64_t t0 = bench_cycles();
+        ssize_t n = blockdev_read(dev, lba, count, bench_buf);
+        uint64_t t1 = bench_cycles();
+        if (n < 0) {
+            bench_skip("block_read_4k", "read_failed");
+            return;
+        }
+        if (i >= 0) samples[i] = t1 - t0;
+    }
+    bench_report("block_read_4k", BENCH_ITERS);
+}
+
+/* ---- 5. TCP echo round trip (tcp.c) ---------------------------------- */
+
+#define BENCH_TCP_PORT  7777
+#define BENCH_TCP_MSG   64
+
+static volatile int bench_tcp_listening;
+
+static void bench_tcp_echo_server(void)
+{
+    int fd = socket_create(AF_INET, SOCK_STREAM, 0);
+    socket_t *sock = socket_get(fd);
+    while (!sock) { task_block(TASK_BLOCKED); schedule(); }
+
+    sockaddr_in_t addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = BENCH_TCP_PORT;
+    addr.sin_addr = 0;                          // Any
+    socket_bind(sock, (sockaddr_t *)&addr, sizeof(addr));
+    socket_listen(sock, 1);
+    __atomic_store_n(&bench_tcp_listening, 1, __ATOMIC_RELEASE);
+
+    int cfd = socket_accept(sock, NULL, NULL);
+    socket_t *conn = socket_get(cfd);
+    char buf[BENCH_TCP_MSG];
+    while (conn) {
+        ssize_t n = socket_recv(conn, buf, sizeof(buf), 0);
+        if (n <= 0) break;
+        socket_send(conn, buf, n, 0);
+    }
+    while (1) { task_block(TASK_BLOCKED); schedule(); }
+}
+
+static void bench_tcp_rtt(void)
+{
+    task_create("BenchTcpEcho", bench_tcp_echo_server, 10, 0);
+    while (!__atomic_load_n(&bench_tcp_listening, __ATOMIC_ACQUIRE))
+        yield();
+
+    int fd = socket_create(AF_INET, SOCK_STREAM, 0);
+    socket_t *sock = socket_get(fd);
+    if (!sock) {
+        bench_skip("tcp_echo_rtt", "socket_failed");
+        return;
+    }
+
+    sockaddr_in_t addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = BENCH_TCP_PORT;
+    addr.sin_addr = 0x0100007F;                 // 127.0.0.1
+    if (socket_connect(sock, (sockaddr_t *)&addr, sizeof(addr)) < 0) {
+        bench_skip("tcp_echo_rtt", "connect_failed");
+        return;
+    }
+
+    char msg[BENCH_TCP_MSG];
+    memset(msg, 'e', sizeof(msg));
+    for (int i = -BENCH_WARMUP; i < BENCH_ITERS; i++) {
+        uint64_t t0 = bench_cycles();
+        socket_send(sock, msg, sizeof(msg), 0);
+        ssize_t n = socket_recv(sock, msg, sizeof(msg), 0);
+        uint64_t t1 = bench_cycles();
+        if (n <= 0) {
+            bench_skip("tcp_echo_rtt", "echo_failed");
+            return;
+        }
+        if (i >= 0) samples[i] = t1 - t0;
+    }
+    bench_report("tcp_echo_rtt", BENCH_ITERS);
+}
+
+/* ---- 6. Wimp event dispatch (event.c) -------------------------------- */
+
+static void bench_wimp_dispatch(void)
+{
+    wimp_event_t ev, out;
+
+    /* Redraw-type payload but an unhandled type code, so Wimp_Poll
+     * returns it to us instead of a registered handler swallowing it */
+    memset(&ev, 0, sizeof(ev));
+    ev.type = 31;
+
+    for (int i = -BENCH_WARMUP; i < BENCH_ITERS; i++) {
+        uint64_t t0 = bench_cycles();
+        wimp_enqueue_event(&ev);
+        int type = Wimp_Poll(0, &out);
+        uint64_t t1 = bench_cycles();
+        if (type != ev.type) {
+            bench_skip("wimp_dispatch", "event_lost");
+            return;
+        }
+        if (i >= 0) samples[i] = t1 - t0;
+    }
+    bench_report("wimp_dispatch", BENCH_ITERS);
+}
+
+/* ---------------------------------------------------------------------- */
+
+void bench_suite_task(void)
+{
+    debug_print("Phoenix benchmark suite – %d iters, %d warmup each\n",
+                BENCH_ITERS, BENCH_WARMUP);
+
+    bench_spinlock();
+    bench_context_switch();
+    bench_pipe_rtt();
+    bench_block_read();
+    bench_tcp_rtt();
+    bench_wimp_dispatch();
+
+    debug_print("PASS: benchmark suite complete\n");
+
+    /* Done – park like a finished init task */
+    while (1) {
+        task_block(TASK_BLOCKED);
+        schedule();
+    }
+}
@@ -14,16 +14,31 @@
 
 #define BROWSER_TITLE   "NetSurf64"
 #define MAX_URL_LEN     512
-#define MAX_PAGE_SIZE   (4 * 1024 * 1024)  // 4MB page limit
+#define FETCH_CHUNK     4096            // Socket read / parse unit
+#define SPILL_PATH      "/tmp/netsurf-spill"
+
+/* Tokenizer states – the parser is resumable, so a tag or text run
+ * split across two socket reads picks up exactly where it stopped */
+#define HTML_TEXT   0
+#define HTML_TAG    1
 
 typedef struct browser_window {
     window_t *win;
     char url[MAX_URL_LEN];
-    char *html_content;
-    uint32_t html_size;
-    uint32_t *render_buffer;   // GPU texture for page rendering
+    file_t *spill;              // Whole page streamed to the VFS – no RAM cap
+    uint32_t html_size;         // Bytes received so far
+    uint32_t *render_buffer;    // GPU texture for page rendering
     int width, height;
     int scroll_y;
+
+    /* Resumable tokenizer + layout cursor */
+    int tok_state;
+    char tag[64];
+    int tag_len;
+    char text[256];
+    int text_len;
+    int cur_x, cur_y;
+    int fold_painted;           // First paint already requested
 } browser_window_t;
 
 static browser_window_t *active_browser = NULL;
@@ -58,8 +73,89 @@ void browser_create_window(void)
     debug_print("NetSurf64 window created\n");
 }
 
-/* Simple HTTP GET using PhoenixNet sockets */
-int browser_fetch_url(const char *url, char **out_data, uint32_t *out_size)
+/* Layout constants for the minimal renderer */
+#define GLYPH_W     8
+#define LINE_H      18
+#define MARGIN      20
+
+static void browser_newline(browser_window_t *b)
+{
+    b->cur_x = MARGIN;
+    b->cur_y += LINE_H;
+}
+
+/* Flush the accumulated text run at the layout cursor, wrapping at the
+ * window edge. Drawing goes through the glyph atlas, so repeated
+ * characters cost quads, not rasterization. */
+static void browser_flush_text(browser_window_t *b)
+{
+    if (b->text_len == 0) return;
+    b->text[b->text_len] = '\0';
+
+    if (b->cur_x + b->text_len * GLYPH_W > b->width - MARGIN)
+        browser_newline(b);
+
+    gpu_draw_text(b->cur_x, b->cur_y - b->scroll_y, b->text, 0x00000000);
+    b->cur_x += b->text_len * GLYPH_W;
+    b->text_len = 0;
+}
+
+/* A complete tag – block-level tags move the cursor to a fresh line */
+static void browser_handle_tag(browser_window_t *b)
+{
+    char *t = b->tag;
+    if (*t == '/') t++;         // Closing tags break lines the same way
+
+    if (strcmp(t, "p") == 0 || strcmp(t, "br") == 0 ||
+        strcmp(t, "div") == 0 || strcmp(t, "li") == 0 ||
+        strcmp(t, "tr") == 0 || t[0] == 'h') {
+        browser_flush_text(b);
+        browser_newline(b);
+    }
+}
+
+/* Resumable tokenizer – consumes one chunk straight off the socket.
+ * All state lives in browser_window_t, so a tag name or text run that
+ * straddles a chunk boundary continues seamlessly with the next read. */
+static void browser_parse_chunk(browser_window_t *b, const char *data,
+                                size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+
+        if (b->tok_state == HTML_TAG) {
+            if (c == '>') {
+                b->tag[b->tag_len] = '\0';
+                browser_handle_tag(b);
+                b->tag_len = 0;
+                b->tok_state = HTML_TEXT;
+            } else if (b->tag_len < (int)sizeof(b->tag) - 1 &&
+                       c != ' ') {
+                b->tag[b->tag_len++] = c;
+            }
+            continue;
+        }
+
+        if (c == '<') {
+            browser_flush_text(b);
+            b->tok_state = HTML_TAG;
+        } else if (c == '\n' || c == '\r') {
+            /* Source line breaks are soft – treat as a space */
+            if (b->text_len > 0 && b->text_len < (int)sizeof(b->text) - 1)
+                b->text[b->text_len++] = ' ';
+        } else {
+            if (b->text_len >= (int)sizeof(b->text) - 1)
+                browser_flush_text(b);
+            b->text[b->text_len++] = c;
+        }
+    }
+}
+
+/* Streaming HTTP GET: every chunk is spilled to the VFS (lifting the
+ * old 4MB in-RAM page cap) and fed to the tokenizer immediately, so
+ * above-the-fold content paints while the rest of the page is still
+ * on the wire. */
+static int browser_fetch_stream(browser_window_t *b, const char *url)
 {
     if (strncmp(url, "http://", 7) != 0) {
         debug_print("Only http:// supported\n");
@@ -88,60 +184,59 @@ int browser_fetch_url(const char *url, char **out_data, uint32_t *out_size)
 
     send(sock, request, strlen(request), 0);
 
-    char *buffer = kmalloc(MAX_PAGE_SIZE);
-    if (!buffer) {
-        socket_close(sock);
-        return -1;
-    }
-
-    ssize_t total = 0;
-    while (total < MAX_PAGE_SIZE) {
-        ssize_t n = recv(sock, buffer + total, MAX_PAGE_SIZE - total, 0);
+    char chunk[FETCH_CHUNK];
+    while (1) {
+        ssize_t n = recv(sock, chunk, sizeof(chunk), 0);
         if (n <= 0) break;
-        total += n;
-    }
 
-    socket_close(sock);
+        if (b->spill)
+            vfs_write(b->spill, chunk, n);
+        b->html_size += n;
 
-    *out_data = buffer;
-    *out_size = total;
+        browser_parse_chunk(b, chunk, n);
 
-    debug_print("Fetched %u bytes from %s\n", total, url);
-    return 0;
-}
-
-/* Simple HTML renderer (stub) */
-static void browser_render_page(void)
-{
-    if (!active_browser || !active_browser->html_content) return;
-
-    // Clear to white
-    gpu_clear_texture(active_browser->render_buffer, 0xFFFFFFFF);
+        /* First paint as soon as the fold is full (or the transfer is
+         * short); afterwards only repaint while new content is still
+         * landing above the fold */
+        if (!b->fold_painted && b->cur_y - b->scroll_y > b->height) {
+            b->fold_painted = 1;
+            wimp_redraw_request(b->win, NULL);
+        } else if (!b->fold_painted) {
+            wimp_redraw_request(b->win, NULL);
+        }
+    }
 
-    // Very basic text rendering (stub)
-    gpu_draw_text(20, 50, "NetSurf64 - Welcome to the Web!", 0x00000000);
-    gpu_draw_text(20, 80, active_browser->url, 0x0000FF00);
+    socket_close(sock);
+    browser_flush_text(b);
+    wimp_redraw_request(b->win, NULL);
 
-    // In real version: parse HTML, render with GPU shaders
-    // For now: placeholder
+    debug_print("Fetched %u bytes from %s\n", b->html_size, url);
+    return 0;
 }
 
 /* Load URL */
 void browser_load_url(const char *url)
 {
-    if (!active_browser) return;
-
-    strncpy(active_browser->url, url, MAX_URL_LEN-1);
-
-    char *data = NULL;
-    uint32_t size = 0;
-
-    if (browser_fetch_url(url, &data, &size) == 0) {
-        active_browser->html_content = data;
-        active_browser->html_size = size;
-        browser_render_page();
-        wimp_redraw_request(active_browser->win, NULL);
-    }
+    browser_window_t *b = active_browser;
+    if (!b) return;
+
+    strncpy(b->url, url, MAX_URL_LEN-1);
+
+    /* Reset page state for the new document */
+    if (b->spill) vfs_close(b->spill);
+    b->spill = vfs_open(SPILL_PATH, O_CREAT | O_TRUNC | O_RDWR);
+    b->html_size = 0;
+    b->tok_state = HTML_TEXT;
+    b->tag_len = b->text_len = 0;
+    b->cur_x = MARGIN;
+    b->cur_y = MARGIN + 40;     // Below the URL header
+    b->scroll_y = 0;
+    b->fold_painted = 0;
+
+    gpu_clear_texture(b->render_buffer, 0xFFFFFFFF);
+    gpu_draw_text(MARGIN, MARGIN, b->url, 0x0000FF00);
+
+    browser_fetch_stream(b, url);
 }
 
 /* Handle mouse events */
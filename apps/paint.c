@@ -20,10 +20,19 @@
 #define TOOL_FILL       6
 #define TOOL_TEXT       7
 
+/* Canvas is tiled: drawing marks touched tiles dirty and only those
+ * tiles upload per frame as partial texture updates. A pencil dot
+ * moves one 256KB tile to the GPU, not the whole canvas. */
+#define PAINT_TILE       256
+#define PAINT_TILES_MAX  1024           // 8K x 8K canvas at 256px tiles
+
 typedef struct paint_window {
     window_t *win;
-    uint32_t *canvas;           // GPU texture backing store (RGBA)
+    struct gpu_texture *texture;        // On-GPU canvas
+    uint32_t *canvas;                   // CPU-side pixels (RGBA)
     int width, height;
+    int tiles_x, tiles_y;
+    uint64_t tile_dirty[PAINT_TILES_MAX / 64];
     int current_tool;
     int color;                  // Current drawing color
     int brush_size;
@@ -33,6 +42,10 @@ typedef struct paint_window {
 
 static paint_window_t *active_paint = NULL;
 
+/* Staging buffer for one tile's pixels, packed to tile stride for the
+ * partial upload. Single Paint task, so one static buffer is enough. */
+static uint32_t tile_stage[PAINT_TILE * PAINT_TILE];
+
 /* Create new Paint window */
 void paint_create_window(void)
 {
@@ -47,23 +60,82 @@ void paint_create_window(void)
     if (!win) return;
 
     paint_window_t *paint = kmalloc(sizeof(paint_window_t));
+    memset(paint, 0, sizeof(paint_window_t));
     paint->win = win;
     paint->width = 700;
     paint->height = 500;
+    paint->tiles_x = (paint->width + PAINT_TILE - 1) / PAINT_TILE;
+    paint->tiles_y = (paint->height + PAINT_TILE - 1) / PAINT_TILE;
     paint->current_tool = TOOL_PENCIL;
     paint->color = 0xFF000000;      // Black
     paint->brush_size = 4;
     paint->dragging = 0;
 
-    // Allocate canvas (RGBA)
-    paint->canvas = gpu_create_texture(paint->width, paint->height);
-    gpu_clear_texture(paint->canvas, 0xFFFFFFFF);  // White background
+    // CPU-side canvas plus GPU texture (RGBA)
+    paint->canvas = kmalloc(paint->width * paint->height * 4);
+    for (int i = 0; i < paint->width * paint->height; i++)
+        paint->canvas[i] = 0xFFFFFFFF;              // White background
+    paint->texture = gpu_create_texture(paint->width, paint->height);
+    gpu_clear_texture(paint->texture, 0xFFFFFFFF);
 
     active_paint = paint;
 
     debug_print("Paint64 window created\n");
 }
 
+/* Dirty-tile bookkeeping */
+static void paint_mark_dirty(paint_window_t *paint, int x, int y)
+{
+    int tile = (y / PAINT_TILE) * paint->tiles_x + (x / PAINT_TILE);
+    paint->tile_dirty[tile / 64] |= 1ULL << (tile % 64);
+}
+
+/* Upload every dirty tile as a partial texture update and hand the
+ * damaged area to the Wimp as a redraw clip. Clean tiles never touch
+ * the bus. */
+static void paint_flush_dirty(paint_window_t *paint)
+{
+    int dx0 = paint->width, dy0 = paint->height, dx1 = 0, dy1 = 0;
+    int any = 0;
+
+    for (int ty = 0; ty < paint->tiles_y; ty++) {
+        for (int tx = 0; tx < paint->tiles_x; tx++) {
+            int tile = ty * paint->tiles_x + tx;
+            if (!(paint->tile_dirty[tile / 64] & (1ULL << (tile % 64))))
+                continue;
+            paint->tile_dirty[tile / 64] &= ~(1ULL << (tile % 64));
+
+            int x0 = tx * PAINT_TILE, y0 = ty * PAINT_TILE;
+            int w = paint->width - x0;
+            int h = paint->height - y0;
+            if (w > PAINT_TILE) w = PAINT_TILE;
+            if (h > PAINT_TILE) h = PAINT_TILE;
+
+            /* Repack the tile rows to tile stride for the upload */
+            for (int row = 0; row < h; row++)
+                memcpy(&tile_stage[row * w],
+                       &paint->canvas[(y0 + row) * paint->width + x0],
+                       w * 4);
+
+            gpu_texture_update(paint->texture, x0, y0, w, h, tile_stage);
+
+            if (x0 < dx0) dx0 = x0;
+            if (y0 < dy0) dy0 = y0;
+            if (x0 + w > dx1) dx1 = x0 + w;
+            if (y0 + h > dy1) dy1 = y0 + h;
+            any = 1;
+        }
+    }
+
+    if (any) {
+        bbox_t clip = {
+            paint->win->def.x0 + dx0, paint->win->def.y0 + dy0,
+            paint->win->def.x0 + dx1, paint->win->def.y0 + dy1
+        };
+        wimp_redraw_request(paint->win, &clip);
+    }
+}
+
 /* GPU drawing routines */
 static void paint_draw_pixel(int x, int y, uint32_t color)
 {
@@ -71,6 +143,7 @@ static void paint_draw_pixel(int x, int y, uint32_t color)
     if (x < 0 || x >= active_paint->width || y < 0 || y >= active_paint->height) return;
 
     active_paint->canvas[y * active_paint->width + x] = color;
+    paint_mark_dirty(active_paint, x, y);
 }
 
 static void paint_draw_line(int x0, int y0, int x1, int y1)
@@ -89,6 +162,66 @@ static void paint_draw_line(int x0, int y0, int x1, int y1)
     }
 }
 
+/* Scanline span flood fill. The worklist is an explicit span stack,
+ * not recursion – a per-pixel recursive fill on a large canvas blows
+ * the 16KB kernel stack long before it finishes. Each entry is a
+ * filled parent span; scanning the rows above and below it finds the
+ * child spans to fill next. */
+#define FILL_STACK_MAX  4096
+
+typedef struct fill_span {
+    int x0, x1, y;
+} fill_span_t;
+
+static fill_span_t fill_stack[FILL_STACK_MAX];
+
+static void paint_fill(int x, int y, uint32_t color)
+{
+    paint_window_t *paint = active_paint;
+    if (!paint) return;
+    if (x < 0 || x >= paint->width || y < 0 || y >= paint->height) return;
+
+    uint32_t target = paint->canvas[y * paint->width + x];
+    if (target == color) return;
+
+    int sp = 0;
+    fill_stack[sp++] = (fill_span_t){x, x, y};
+
+    while (sp > 0) {
+        fill_span_t s = fill_stack[--sp];
+        uint32_t *row = &paint->canvas[s.y * paint->width];
+
+        /* Grow the seed into a full span of target pixels */
+        int x0 = s.x0;
+        while (x0 > 0 && row[x0 - 1] == target) x0--;
+        int x1 = s.x1;
+        while (x1 < paint->width - 1 && row[x1 + 1] == target) x1++;
+
+        for (int i = x0; i <= x1; i++)
+            row[i] = color;
+
+        /* Every tile the span crosses, not just its endpoints */
+        for (int i = x0; i <= x1; i += PAINT_TILE)
+            paint_mark_dirty(paint, i, s.y);
+        paint_mark_dirty(paint, x1, s.y);
+
+        /* Seed one entry per run of target pixels above and below */
+        for (int dy = -1; dy <= 1; dy += 2) {
+            int ny = s.y + dy;
+            if (ny < 0 || ny >= paint->height) continue;
+            uint32_t *nrow = &paint->canvas[ny * paint->width];
+
+            for (int i = x0; i <= x1; i++) {
+                if (nrow[i] != target) continue;
+                int run = i;
+                while (i <= x1 && nrow[i] == target) i++;
+                if (sp < FILL_STACK_MAX)
+                    fill_stack[sp++] = (fill_span_t){run, i - 1, ny};
+            }
+        }
+    }
+}
+
 /* Handle mouse events */
 void paint_handle_mouse(wimp_mouse_t *mouse)
 {
@@ -107,13 +240,15 @@ void paint_handle_mouse(wimp_mouse_t *mouse)
             active_paint->last_x = x;
             active_paint->last_y = y;
             active_paint->dragging = 1;
+        } else if (active_paint->current_tool == TOOL_FILL) {
+            paint_fill(x, y, active_paint->color);
         }
     } else {
         active_paint->dragging = 0;
     }
 
-    // Redraw window
-    wimp_redraw_request(active_paint->win, NULL);
+    // Upload dirty tiles and request redraw of the damaged area only
+    paint_flush_dirty(active_paint);
 }
 
 /* Handle key events */
@@ -125,6 +260,7 @@ void paint_handle_key(wimp_key_t *key)
         case '1': active_paint->current_tool = TOOL_PENCIL; break;
         case '2': active_paint->current_tool = TOOL_LINE; break;
         case '3': active_paint->current_tool = TOOL_RECT; break;
+        case '4': active_paint->current_tool = TOOL_FILL; break;
         case 'c': active_paint->color = 0xFFFF0000; break;  // Red
         case 'b': active_paint->color = 0xFF0000FF; break;  // Blue
     }
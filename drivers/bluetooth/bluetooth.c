@@ -118,4 +118,292 @@ static _kernel_oserror *bt_download_firmware(bt_priv_t *priv) {
             uint8_t plen = 5 + chunk;
             uint8_t cmd[9+248];
             cmd[0]=0x01; cmd[1]=0x17; cmd[2]=0xfc; cmd[3]=plen;
-            cmd[4]=0; cmd
\ No newline at end of file
+            cmd[4]=0; cmd[5]=addr&0xFF; cmd[6]=(addr>>8)&0xFF;
+            cmd[7]=(addr>>16)&0xFF; cmd[8]=(addr>>24)&0xFF;
+            for (int i = 0; i < chunk; i++) cmd[9+i] = hexbyte(p + i*2);
+            _swix(SDIODriver_WriteBytes, _INR(0,5), priv->func, 0, cmd, 9 + chunk, SDIO_INCREMENT_ADDRESS);
+            p += chunk*2; pos += chunk; addr += chunk;
+        }
+        while (*p && *p!='\n') p++; if (*p) p++;
+    }
+    free(buf);
+
+    uint8_t launch[] = {0x01,0x4e,0xfc,0x04,0xff,0xff,0xff,0xff};
+    _swix(SDIODriver_WriteBytes, _INR(0,5), priv->func, 0, launch, 8, SDIO_INCREMENT_ADDRESS);
+    debug_print("Firmware downloaded\n");
+    return NULL;
+}
+
+/* HCI packet pool.
+ *
+ * Every event and ACL packet used to be kmalloc'd and parsed inside
+ * the SDIO interrupt, so a burst of connection events could exhaust
+ * the allocator and stall the transport. Packets now come from
+ * preallocated per-type free lists and the IRQ handler does nothing
+ * but copy the packet out of the SDIO FIFO and enqueue it; a worker
+ * task does the actual protocol work. */
+
+#define HCI_PKT_MAX      264     /* 4-byte header + 255-byte payload + slack */
+#define HCI_POOL_EVENTS  32
+#define HCI_POOL_ACL     64
+
+typedef struct hci_pkt {
+    struct hci_pkt *next;
+    uint8_t  type;               /* HCI_EVENT_PKT or HCI_ACL_DATA_PKT */
+    uint16_t len;
+    uint8_t  data[HCI_PKT_MAX];
+} hci_pkt_t;
+
+static hci_pkt_t *hci_free_evt, *hci_free_acl;
+static hci_pkt_t *hci_rx_head, *hci_rx_tail;
+static spinlock_t hci_pool_lock, hci_rx_lock;
+static task_t *bt_worker_task;
+static uint32_t hci_pool_empty;      /* Packets dropped for want of a pool slot */
+
+static int hci_pool_init(void) {
+    for (int i = 0; i < HCI_POOL_EVENTS + HCI_POOL_ACL; i++) {
+        hci_pkt_t *pkt = malloc(sizeof(hci_pkt_t));
+        if (!pkt) return -1;
+        if (i < HCI_POOL_EVENTS) { pkt->next = hci_free_evt; hci_free_evt = pkt; }
+        else                     { pkt->next = hci_free_acl; hci_free_acl = pkt; }
+    }
+    spinlock_init(&hci_pool_lock);
+    spinlock_init(&hci_rx_lock);
+    return 0;
+}
+
+static hci_pkt_t *hci_pkt_alloc(uint8_t type) {
+    unsigned long flags;
+    hci_pkt_t **list = (type == HCI_ACL_DATA_PKT) ? &hci_free_acl : &hci_free_evt;
+    hci_pkt_t *pkt;
+
+    spin_lock_irqsave(&hci_pool_lock, &flags);
+    pkt = *list;
+    if (pkt) *list = pkt->next;
+    else hci_pool_empty++;
+    spin_unlock_irqrestore(&hci_pool_lock, flags);
+    if (pkt) { pkt->type = type; pkt->next = NULL; }
+    return pkt;
+}
+
+static void hci_pkt_free(hci_pkt_t *pkt) {
+    unsigned long flags;
+    hci_pkt_t **list = (pkt->type == HCI_ACL_DATA_PKT) ? &hci_free_acl : &hci_free_evt;
+
+    spin_lock_irqsave(&hci_pool_lock, &flags);
+    pkt->next = *list;
+    *list = pkt;
+    spin_unlock_irqrestore(&hci_pool_lock, flags);
+}
+
+/* Credit-based ACL flow control.
+ *
+ * The controller advertises how many ACL buffers it has (Read Buffer
+ * Size) and returns slots through Number Of Completed Packets events.
+ * We track the credits ourselves so several packets can be in flight
+ * on the transport at once instead of sending one and blocking until
+ * its completion comes back. */
+
+static hci_pkt_t *acl_tx_head, *acl_tx_tail;   /* Waiting for a credit */
+static spinlock_t acl_tx_lock;
+
+static void bt_transport_write(bt_priv_t *priv, const uint8_t *d, size_t len) {
+    _swix(SDIODriver_WriteBytes, _INR(0,5), priv->func, 0, d, len, SDIO_INCREMENT_ADDRESS);
+}
+
+/* Push queued ACL packets while the controller has buffer slots */
+static void acl_tx_flush(bt_priv_t *priv) {
+    unsigned long flags;
+
+    for (;;) {
+        hci_pkt_t *pkt;
+        spin_lock_irqsave(&acl_tx_lock, &flags);
+        if (!acl_tx_head || priv->acl_credits <= 0) {
+            spin_unlock_irqrestore(&acl_tx_lock, flags);
+            break;
+        }
+        pkt = acl_tx_head;
+        acl_tx_head = pkt->next;
+        if (!acl_tx_head) acl_tx_tail = NULL;
+        priv->acl_credits--;
+        spin_unlock_irqrestore(&acl_tx_lock, flags);
+
+        bt_transport_write(priv, pkt->data, pkt->len);
+        hci_pkt_free(pkt);
+    }
+}
+
+/* Send an ACL packet: straight to the transport if a credit is free,
+ * otherwise parked until Number Of Completed Packets returns one. */
+static int bt_send_acl(bt_priv_t *priv, const uint8_t *data, size_t len) {
+    unsigned long flags;
+
+    if (len > HCI_PKT_MAX) return -1;   // Validate before taking a pool slot
+
+    hci_pkt_t *pkt = hci_pkt_alloc(HCI_ACL_DATA_PKT);
+    if (!pkt) return -1;
+
+    memcpy(pkt->data, data, len);
+    pkt->len = len;
+
+    spin_lock_irqsave(&acl_tx_lock, &flags);
+    if (acl_tx_tail) acl_tx_tail->next = pkt;
+    else acl_tx_head = pkt;
+    acl_tx_tail = pkt;
+    spin_unlock_irqrestore(&acl_tx_lock, flags);
+
+    acl_tx_flush(priv);
+    return 0;
+}
+
+/* Worker-side event handling – runs in task context, never in IRQ */
+static void bt_handle_event(bt_priv_t *priv, hci_pkt_t *pkt) {
+    uint8_t code = pkt->data[1];
+
+    if (code == 0x13) {                         /* Number Of Completed Packets */
+        uint8_t handles = pkt->data[3];
+        const uint8_t *e = &pkt->data[4];
+        unsigned long flags;
+
+        /* Credits are consumed under acl_tx_lock in acl_tx_flush, so
+         * they must be returned under it too */
+        spin_lock_irqsave(&acl_tx_lock, &flags);
+        for (int i = 0; i < handles; i++, e += 4) {
+            uint16_t completed = e[2] | (e[3] << 8);
+            priv->acl_credits += completed;
+        }
+        spin_unlock_irqrestore(&acl_tx_lock, flags);
+        acl_tx_flush(priv);
+        return;
+    }
+
+    if (code == 0x0E) {                         /* Command Complete */
+        uint16_t opcode = pkt->data[4] | (pkt->data[5] << 8);
+        if (opcode == 0x1005) {                 /* Read Buffer Size */
+            priv->acl_mtu = pkt->data[8] | (pkt->data[9] << 8);
+            priv->acl_pkts_max = pkt->data[11] | (pkt->data[12] << 8);
+            priv->acl_credits = priv->acl_pkts_max;
+            debug_print("ACL buffers: %d x %d bytes\n",
+                        priv->acl_pkts_max, priv->acl_mtu);
+        }
+        return;
+    }
+
+    /* Everything else lands in the event ring for the upper layers */
+    ring_write(&rx_ring, pkt->data, pkt->len);
+}
+
+/* Worker task: drains the IRQ handler's queue */
+static void bt_worker(void) {
+    while (1) {
+        hci_pkt_t *pkt;
+        unsigned long flags;
+
+        spin_lock_irqsave(&hci_rx_lock, &flags);
+        pkt = hci_rx_head;
+        if (pkt) {
+            hci_rx_head = pkt->next;
+            if (!hci_rx_head) hci_rx_tail = NULL;
+        }
+        spin_unlock_irqrestore(&hci_rx_lock, flags);
+
+        if (!pkt) {
+            task_block(TASK_BLOCKED);
+            schedule();
+            continue;
+        }
+
+        if (pkt->type == HCI_EVENT_PKT) bt_handle_event(g_priv, pkt);
+        else ring_write(&rx_ring, pkt->data, pkt->len);
+        hci_pkt_free(pkt);
+    }
+}
+
+/* SDIO interrupt: copy the packet out of the FIFO, enqueue, wake the
+ * worker. No parsing, no allocation beyond the pool pop. */
+static void bt_sdio_irq(sdio_func_t *func) {
+    bt_priv_t *priv = g_priv;
+    uint8_t hdr[4];
+    unsigned long flags;
+
+    _swix(SDIODriver_ReadBytes, _INR(0,5), func, 0, hdr, 4, SDIO_INCREMENT_ADDRESS);
+
+    uint8_t type = hdr[3];
+    size_t len = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16);
+    if (len < 4 || len > HCI_PKT_MAX) return;
+
+    hci_pkt_t *pkt = hci_pkt_alloc(type);
+    if (!pkt) {
+        /* Pool empty: drain and drop so the FIFO doesn't wedge */
+        uint8_t scratch[HCI_PKT_MAX];
+        _swix(SDIODriver_ReadBytes, _INR(0,5), func, 0, scratch, len - 4, SDIO_INCREMENT_ADDRESS);
+        return;
+    }
+
+    pkt->data[0] = type;
+    _swix(SDIODriver_ReadBytes, _INR(0,5), func, 0, pkt->data + 1, len - 4, SDIO_INCREMENT_ADDRESS);
+    pkt->len = len - 3;
+
+    spin_lock_irqsave(&hci_rx_lock, &flags);
+    if (hci_rx_tail) hci_rx_tail->next = pkt;
+    else hci_rx_head = pkt;
+    hci_rx_tail = pkt;
+    spin_unlock_irqrestore(&hci_rx_lock, flags);
+
+    if (bt_worker_task) task_wakeup(bt_worker_task);
+
+    (void)priv;
+}
+
+/* Probe: bring the controller up with the deferred-RX machinery */
+static _kernel_oserror *bt_probe(sdio_func_t *func) {
+    _kernel_oserror *err;
+
+    g_priv = malloc(sizeof(bt_priv_t));
+    if (!g_priv) return NULL;
+    memset(g_priv, 0, sizeof(bt_priv_t));
+    g_priv->func = func;
+
+    ring_init(&rx_ring, RX_RING_SIZE);
+    ring_init(&log_ring, LOG_RING_SIZE);
+    ring_init(&serial_ring, SERIAL_RING_SIZE);
+
+    if (hci_pool_init() < 0) return NULL;
+    spinlock_init(&acl_tx_lock);
+    bt_worker_task = task_create("BTWorker", bt_worker, 2, 0xF);
+
+    err = bt_download_firmware(g_priv);
+    if (err) return err;
+
+    _swix(SDIODriver_ClaimInterrupt, _INR(0,2)|_OUT(0),
+          func, bt_sdio_irq, g_priv, &g_priv->irq_handle);
+
+    /* HCI Reset, then learn the controller's ACL buffer pool */
+    uint8_t reset[] = {0x01, 0x03, 0x0C, 0x00};
+    bt_transport_write(g_priv, reset, sizeof(reset));
+    uint8_t read_buf_size[] = {0x01, 0x05, 0x10, 0x00};
+    bt_transport_write(g_priv, read_buf_size, sizeof(read_buf_size));
+
+    debug_print("BTSdioTypeA probed, worker + flow control up\n");
+    return NULL;
+}
+
+static void bt_remove(sdio_func_t *func) {
+    if (g_priv && g_priv->irq_handle)
+        _swix(SDIODriver_ReleaseInterrupt, _IN(0), g_priv->irq_handle);
+}
+
+sdio_driver_t bt_driver = {
+    .name = MODULE_TITLE,
+    .id_table = bt_id_table,
+    .probe = bt_probe,
+    .remove = bt_remove
+};
+
+/* Module init */
+_kernel_oserror *module_init(const char *arg, int podule)
+{
+    sdio_register_driver(&bt_driver);
+    debug_print("%s %s loaded\n", MODULE_TITLE, MODULE_VERSION);
+    return NULL;
+}
\ No newline at end of file
@@ -41,6 +41,9 @@ typedef struct bt_priv {
     uint8_t     pairing_mode;               /* 0=none, 1=Just-Works, 2=Legacy PIN */
     char        pin_code[16];               /* User-provided PIN for legacy */
     uint8_t     remote_bd_addr[6];          /* Remote device address during pairing */
+    volatile int acl_credits;               /* Free controller ACL buffer slots */
+    uint16_t    acl_mtu;                    /* Controller ACL packet size */
+    uint16_t    acl_pkts_max;               /* Controller ACL buffer count */
 } bt_priv_t;
 
 typedef struct sdio_device_id {
@@ -32,7 +32,11 @@ typedef struct drm_device {
 
 /* DRM functions */
 drm_device_t *drm_open(const char *device);  // e.g., "/dev/dri/card0"
+#ifdef VULKAN_H
+/* Only visible to TUs that pulled in the Vulkan headers first – the
+ * raster tier uses drm.h for modes alone and never creates a surface */
 int drm_create_surface(drm_device_t *dev, drm_mode_t *mode, VkSurfaceKHR *surface);
+#endif
 int drm_set_mode(drm_device_t *dev, drm_mode_t *mode);
 void drm_close(drm_device_t *dev);
 
@@ -9,8 +9,10 @@
 #include "vulkan.h"
 #include "drm.h"
 #include "wimp.h"
+#include "gpu.h"
 #include <GLES2/gl2.h>
 #include <EGL/egl.h>
+#include <string.h>
 
 /* ==================== Vulkan Globals ==================== */
 static VkInstance vk_instance;
@@ -23,9 +25,53 @@ static VkRenderPass render_pass;
 static VkPipeline blit_pipeline;
 static VkPipelineLayout pipeline_layout;
 static VkCommandPool cmd_pool;
-static VkCommandBuffer command_buffers[2];
-static VkSemaphore image_acquired, render_finished;
-static VkFramebuffer framebuffers[2];
+
+/* Mailbox triple buffering: three swapchain images, so the compositor
+ * always has a free image to render into while one scans out and one
+ * waits as the newest complete frame. The swapchain itself is created
+ * with VK_PRESENT_MODE_MAILBOX_KHR and GPU_SWAP_IMAGES images in
+ * gpu_init. */
+#define GPU_SWAP_IMAGES 3
+
+static VkFramebuffer framebuffers[GPU_SWAP_IMAGES];
+
+/* Frame ring – one primary command buffer per in-flight frame, gated
+ * by its own fence so recording frame N+2 waits for frame N to retire
+ * instead of idling the whole queue. Each slot carries its own
+ * semaphore pair; a shared pair would alias across frames in flight.
+ * Everything drawn in a frame is recorded here and submitted with a
+ * single vkQueueSubmit. */
+#define GPU_FRAME_RING  3
+
+typedef struct gpu_frame {
+    VkCommandBuffer cmd;
+    VkFence fence;
+    VkSemaphore acquire_sem;    // Swapchain image ready for this frame
+    VkSemaphore render_sem;     // Rendering done – safe to scan out
+} gpu_frame_t;
+
+static gpu_frame_t frame_ring[GPU_FRAME_RING];
+static int frame_index;
+static uint32_t frame_image;    // Swapchain image acquired for this frame
+
+/* Compositor batch – the whole visible window set as one instanced
+ * draw, kept in its own reusable secondary like per-window blits */
+static VkCommandBuffer comp_cmd;
+static int comp_cmd_valid;
+
+/* Present requests handed from the compositor to a dedicated task so
+ * gpu_frame_end never blocks on vsync. SPSC: the compositor produces,
+ * the present task consumes. */
+#define GPU_PRESENT_RING 8
+
+typedef struct present_req {
+    uint32_t image;
+    VkSemaphore wait;
+} present_req_t;
+
+static present_req_t present_ring[GPU_PRESENT_RING];
+static volatile uint32_t present_head, present_tail;
+static task_t *present_task;
 
 /* ==================== GLES Fallback Globals ==================== */
 static EGLDisplay egl_display;
@@ -38,6 +84,7 @@ static drm_device_t *drm_dev;
 static drm_mode_t current_mode = {3840, 2160, 120};
 
 static int use_vulkan = 1;
+static int use_soft = 0;    // Third tier: software raster into the DRM fb
 
 /* ==================== Embedded SPIR-V Shaders ==================== */
 
@@ -107,18 +154,87 @@ static const uint32_t frag_shader_spirv[] = {
     0x00000006,0x00000006,0x0003003E,0x0000000F,0x0000001B,0x000100FD,0x00010038
 };
 
-/* ==================== Vulkan Redraw ==================== */
-void vulkan_redraw_window(window_t *win)
+/* ==================== Damage Regions ==================== */
+
+/* Bounding box of a window's accumulated damage, clamped to the mode.
+ * An empty damage list means the whole window (legacy callers). */
+static void gpu_damage_bounds(window_t *win, VkRect2D *area)
 {
-    if (!win || !win->texture) return;
+    if (win->damage_count == 0) {
+        area->offset = (VkOffset2D){0, 0};
+        area->extent = (VkExtent2D){current_mode.width, current_mode.height};
+        return;
+    }
 
-    uint32_t image_index;
-    vkAcquireNextImageKHR(vk_device, vk_swapchain, UINT64_MAX,
-                          image_acquired, VK_NULL_HANDLE, &image_index);
+    bbox_t b = win->damage[0];
+    for (int i = 1; i < win->damage_count; i++) {
+        if (win->damage[i].x0 < b.x0) b.x0 = win->damage[i].x0;
+        if (win->damage[i].y0 < b.y0) b.y0 = win->damage[i].y0;
+        if (win->damage[i].x1 > b.x1) b.x1 = win->damage[i].x1;
+        if (win->damage[i].y1 > b.y1) b.y1 = win->damage[i].y1;
+    }
 
-    VkCommandBuffer cmd = command_buffers[image_index];
+    if (b.x0 < 0) b.x0 = 0;
+    if (b.y0 < 0) b.y0 = 0;
+    if (b.x1 > (int)current_mode.width)  b.x1 = current_mode.width;
+    if (b.y1 > (int)current_mode.height) b.y1 = current_mode.height;
+
+    area->offset = (VkOffset2D){b.x0, b.y0};
+    area->extent = (VkExtent2D){(uint32_t)(b.x1 - b.x0), (uint32_t)(b.y1 - b.y0)};
+}
+
+/* ==================== Frame Recording ==================== */
+
+/* Build the per-slot ring resources once the device and command pool
+ * exist. Fences are created signalled so the first pass through each
+ * slot does not wait on a frame that was never submitted. */
+static int gpu_frame_ring_init(void)
+{
+    for (int i = 0; i < GPU_FRAME_RING; i++) {
+        gpu_frame_t *f = &frame_ring[i];
+
+        if (vkAllocateCommandBuffers(vk_device, &(VkCommandBufferAllocateInfo){
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = cmd_pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1
+            }, &f->cmd) != VK_SUCCESS)
+            return -1;
+
+        if (vkCreateFence(vk_device, &(VkFenceCreateInfo){
+                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+                .flags = VK_FENCE_CREATE_SIGNALED_BIT
+            }, NULL, &f->fence) != VK_SUCCESS)
+            return -1;
+
+        VkSemaphoreCreateInfo sem = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
+        };
+        if (vkCreateSemaphore(vk_device, &sem, NULL, &f->acquire_sem) != VK_SUCCESS ||
+            vkCreateSemaphore(vk_device, &sem, NULL, &f->render_sem) != VK_SUCCESS)
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Open a frame: wait on this ring slot's fence (frames in flight, not
+ * queue idles), grab a swapchain image and start the render pass. All
+ * window blits for the frame are recorded before gpu_frame_end. */
+int gpu_frame_begin(void)
+{
+    if (!use_vulkan) return -1;
+
+    gpu_frame_t *f = &frame_ring[frame_index];
+    vkWaitForFences(vk_device, 1, &f->fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(vk_device, 1, &f->fence);
+
+    /* Mailbox mode: this returns the oldest free image immediately,
+     * it never waits for scanout to release one */
+    vkAcquireNextImageKHR(vk_device, vk_swapchain, UINT64_MAX,
+                          f->acquire_sem, VK_NULL_HANDLE, &frame_image);
 
-    vkBeginCommandBuffer(cmd, &(VkCommandBufferBeginInfo){
+    vkBeginCommandBuffer(f->cmd, &(VkCommandBufferBeginInfo){
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
     });
@@ -127,45 +243,234 @@ void vulkan_redraw_window(window_t *win)
     VkRenderPassBeginInfo rp_begin = {
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
         .renderPass = render_pass,
-        .framebuffer = framebuffers[image_index],
+        .framebuffer = framebuffers[frame_image],
         .renderArea = {{0, 0}, {current_mode.width, current_mode.height}},
         .clearValueCount = 1,
         .pClearValues = &clear
     };
 
-    vkCmdBeginRenderPass(cmd, &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, blit_pipeline);
+    /* The pass executes secondaries only – one per window */
+    vkCmdBeginRenderPass(f->cmd, &rp_begin,
+                         VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    return 0;
+}
+
+/* Record one window into the open frame. The window's blit lives in a
+ * secondary command buffer that survives across frames: static content
+ * replays last frame's recording, damaged content is re-recorded with
+ * one scissored quad per dirty rectangle. */
+void gpu_frame_record_window(window_t *win)
+{
+    if (!win || !win->texture) return;
+
+    VkCommandBuffer sec = (VkCommandBuffer)win->gpu_cmd;
+    if (!sec) {
+        vkAllocateCommandBuffers(vk_device, &(VkCommandBufferAllocateInfo){
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = cmd_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = 1
+        }, &sec);
+        win->gpu_cmd = sec;
+        win->gpu_cmd_valid = 0;
+    }
+
+    int damaged = win->damage_count > 0;
+    if (!win->gpu_cmd_valid || damaged) {
+        VkCommandBufferInheritanceInfo inherit = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+            .renderPass = render_pass,
+            .subpass = 0
+        };
+        vkBeginCommandBuffer(sec, &(VkCommandBufferBeginInfo){
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+            .pInheritanceInfo = &inherit
+        });
+
+        vkCmdBindPipeline(sec, VK_PIPELINE_BIND_POINT_GRAPHICS, blit_pipeline);
+        gpu_bind_texture(sec, win->texture);
 
-    gpu_bind_texture(cmd, win->texture);
-    vkCmdDraw(cmd, 6, 1, 0, 0);
+        if (win->damage_count == 0) {
+            VkRect2D area;
+            gpu_damage_bounds(win, &area);
+            vkCmdSetScissor(sec, 0, 1, &area);
+            vkCmdDraw(sec, 6, 1, 0, 0);
+        } else {
+            /* One scissored quad per dirty rectangle – only the
+             * damaged screen area is recomposited */
+            for (int i = 0; i < win->damage_count; i++) {
+                bbox_t *d = &win->damage[i];
+                VkRect2D sc = {
+                    {d->x0, d->y0},
+                    {(uint32_t)(d->x1 - d->x0), (uint32_t)(d->y1 - d->y0)}
+                };
+                vkCmdSetScissor(sec, 0, 1, &sc);
+                vkCmdDraw(sec, 6, 1, 0, 0);
+            }
+        }
 
-    vkCmdEndRenderPass(cmd);
-    vkEndCommandBuffer(cmd);
+        vkEndCommandBuffer(sec);
+        /* A damage-scissored recording is only right for this frame;
+         * force a full re-record next frame, which then persists until
+         * the window is damaged again */
+        win->gpu_cmd_valid = !damaged;
+        win->damage_count = 0;
+    }
+
+    vkCmdExecuteCommands(frame_ring[frame_index].cmd, 1, &sec);
+}
+
+/* Present worker – drains queued frames into vkQueuePresentKHR. In
+ * mailbox mode the newest complete frame replaces any older one still
+ * waiting for vsync, so a compositor hiccup never halves the frame
+ * rate to the next divisor of 120. */
+static void gpu_present_work(void)
+{
+    while (1) {
+        while (present_tail != present_head) {
+            present_req_t *r = &present_ring[present_tail % GPU_PRESENT_RING];
+
+            VkPresentInfoKHR present = {
+                .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+                .waitSemaphoreCount = 1,
+                .pWaitSemaphores = &r->wait,
+                .swapchainCount = 1,
+                .pSwapchains = &vk_swapchain,
+                .pImageIndices = &r->image
+            };
+            vkQueuePresentKHR(vk_queue, &present);
+
+            __atomic_store_n(&present_tail, present_tail + 1,
+                             __ATOMIC_RELEASE);
+        }
+
+        task_block(TASK_BLOCKED);
+        schedule();
+    }
+}
+
+/* Close the frame: one submit for everything recorded, fenced on this
+ * ring slot, then hand the image to the present task and return to
+ * recording the next frame without waiting on vsync */
+void gpu_frame_end(void)
+{
+    gpu_frame_t *f = &frame_ring[frame_index];
+
+    vkCmdEndRenderPass(f->cmd);
+    vkEndCommandBuffer(f->cmd);
 
     VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     VkSubmitInfo submit = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
         .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &image_acquired,
+        .pWaitSemaphores = &f->acquire_sem,
         .pWaitDstStageMask = &wait_stage,
         .commandBufferCount = 1,
-        .pCommandBuffers = &cmd,
+        .pCommandBuffers = &f->cmd,
         .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &render_finished
+        .pSignalSemaphores = &f->render_sem
     };
 
-    vkQueueSubmit(vk_queue, 1, &submit, VK_NULL_HANDLE);
+    vkQueueSubmit(vk_queue, 1, &submit, f->fence);
 
-    VkPresentInfoKHR present = {
-        .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &render_finished,
-        .swapchainCount = 1,
-        .pSwapchains = &vk_swapchain,
-        .pImageIndices = &image_index
-    };
+    if (present_task &&
+        present_head - present_tail < GPU_PRESENT_RING) {
+        present_ring[present_head % GPU_PRESENT_RING] =
+            (present_req_t){frame_image, f->render_sem};
+        __atomic_store_n(&present_head, present_head + 1,
+                         __ATOMIC_RELEASE);
+        task_wakeup(present_task);
+    } else {
+        /* No present task yet (early boot) or ring full – present here */
+        VkPresentInfoKHR present = {
+            .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &f->render_sem,
+            .swapchainCount = 1,
+            .pSwapchains = &vk_swapchain,
+            .pImageIndices = &frame_image
+        };
+        vkQueuePresentKHR(vk_queue, &present);
+    }
 
-    vkQueuePresentKHR(vk_queue, &present);
+    frame_index = (frame_index + 1) % GPU_FRAME_RING;
+}
+
+/* Record the visible window set, back to front, as a single instanced
+ * draw: textures bound as an array, one vkCmdDraw with n instances and
+ * the instance index selecting quad and texture. The recording is
+ * reused across frames until the compositor reports a scene change. */
+void gpu_frame_record_batch(window_t **wins, int n, int rerecord)
+{
+    if (n <= 0) return;
+
+    if (!comp_cmd)
+        vkAllocateCommandBuffers(vk_device, &(VkCommandBufferAllocateInfo){
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = cmd_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = 1
+        }, &comp_cmd);
+
+    if (rerecord || !comp_cmd_valid) {
+        VkCommandBufferInheritanceInfo inherit = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+            .renderPass = render_pass,
+            .subpass = 0
+        };
+        vkBeginCommandBuffer(comp_cmd, &(VkCommandBufferBeginInfo){
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+            .pInheritanceInfo = &inherit
+        });
+
+        vkCmdBindPipeline(comp_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, blit_pipeline);
+        gpu_bind_window_array(comp_cmd, wins, n);
+
+        VkRect2D full = {{0, 0}, {current_mode.width, current_mode.height}};
+        vkCmdSetScissor(comp_cmd, 0, 1, &full);
+        vkCmdDraw(comp_cmd, 6, n, 0, 0);
+
+        vkEndCommandBuffer(comp_cmd);
+        comp_cmd_valid = 1;
+
+        for (int i = 0; i < n; i++)
+            wins[i]->damage_count = 0;
+    }
+
+    vkCmdExecuteCommands(frame_ring[frame_index].cmd, 1, &comp_cmd);
+}
+
+/* Screen dimensions for the compositor's occlusion tests */
+void gpu_screen_size(int *w, int *h)
+{
+    *w = current_mode.width;
+    *h = current_mode.height;
+}
+
+/* Direct path for a full-screen window: a one-quad frame with none of
+ * the compositor's occlusion or batching work. Once the DRM layer
+ * grows plane support this becomes a scanout flip of win->texture with
+ * no render pass at all. */
+int gpu_scanout(window_t *win)
+{
+    if (!use_vulkan || !win || !win->texture) return -1;
+    if (gpu_frame_begin() != 0) return -1;
+    gpu_frame_record_window(win);
+    gpu_frame_end();
+    return 0;
+}
+
+/* ==================== Vulkan Redraw ==================== */
+
+/* Single-window legacy path – a one-window frame */
+void vulkan_redraw_window(window_t *win)
+{
+    if (!win || !win->texture) return;
+    if (gpu_frame_begin() != 0) return;
+    gpu_frame_record_window(win);
+    gpu_frame_end();
 }
 
 /* ==================== GLES Fallback Redraw ==================== */
@@ -173,36 +478,178 @@ void gles_redraw_window(window_t *win)
 {
     if (!win || !win->texture) return;
 
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     glBindTexture(GL_TEXTURE_2D, win->texture->gl_id);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    if (win->damage_count == 0) {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    } else {
+        /* GL origin is bottom-left – flip the scissor rects */
+        glEnable(GL_SCISSOR_TEST);
+        for (int i = 0; i < win->damage_count; i++) {
+            bbox_t *d = &win->damage[i];
+            glScissor(d->x0, current_mode.height - d->y1,
+                      d->x1 - d->x0, d->y1 - d->y0);
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+        glDisable(GL_SCISSOR_TEST);
+    }
 
     eglSwapBuffers(egl_display, egl_surface);
 }
 
+/* ==================== Textures ==================== */
+
+/* Every texture keeps a CPU-side pixel copy as its source of truth:
+ * the software tier composites from it, the GLES tier mirrors it into
+ * a GL texture, and the Vulkan tier stages from it at bind time. */
+struct gpu_texture *gpu_create_texture(int width, int height)
+{
+    if (width <= 0 || height <= 0) return NULL;
+
+    struct gpu_texture *tex = kmalloc(sizeof(*tex));
+    if (!tex) return NULL;
+    memset(tex, 0, sizeof(*tex));
+
+    tex->width = width;
+    tex->height = height;
+    tex->pixels = kmalloc((size_t)width * height * 4);
+    if (!tex->pixels) {
+        kfree(tex);
+        return NULL;
+    }
+    memset(tex->pixels, 0, (size_t)width * height * 4);
+
+    if (!use_vulkan && !use_soft) {
+        glGenTextures(1, &tex->gl_id);
+        glBindTexture(GL_TEXTURE_2D, tex->gl_id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, tex->pixels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    return tex;
+}
+
+/* Replace a rectangle of the texture with 32-bit pixels */
+void gpu_texture_update(struct gpu_texture *tex, int x, int y, int w, int h,
+                        const void *pixels)
+{
+    if (!tex || !tex->pixels || !pixels) return;
+    if (x < 0 || y < 0 || w <= 0 || h <= 0 ||
+        x + w > tex->width || y + h > tex->height) return;
+
+    const uint32_t *src = pixels;
+    for (int row = 0; row < h; row++)
+        memcpy(tex->pixels + (y + row) * tex->width + x,
+               src + row * w, (size_t)w * 4);
+
+    if (!use_vulkan && !use_soft && tex->gl_id) {
+        glBindTexture(GL_TEXTURE_2D, tex->gl_id);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h,
+                        GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+}
+
+void gpu_clear_texture(struct gpu_texture *tex, uint32_t color)
+{
+    if (!tex || !tex->pixels) return;
+
+    size_t n = (size_t)tex->width * tex->height;
+    for (size_t i = 0; i < n; i++)
+        tex->pixels[i] = color;
+
+    if (!use_vulkan && !use_soft && tex->gl_id) {
+        glBindTexture(GL_TEXTURE_2D, tex->gl_id);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex->width, tex->height,
+                        GL_RGBA, GL_UNSIGNED_BYTE, tex->pixels);
+    }
+}
+
+/* ==================== Immediate 2D Chrome ==================== */
+
+/* Menus, window furniture and text go through the software rasterizer,
+ * which no-ops harmlessly until its framebuffer is mapped. Chrome on
+ * the composited GPU tiers moves into window textures once the menu
+ * layer renders into its own windows. */
+void gpu_draw_rect(int x, int y, int w, int h, uint32_t color)
+{
+    raster_fill_rect(x, y, w, h, color);
+}
+
+/* Right-pointing submenu arrow */
+void gpu_draw_arrow(int x, int y)
+{
+    for (int i = 0; i < 5; i++)
+        raster_fill_rect(x + i, y + i, 1, 10 - 2 * i, 0xFF000000);
+}
+
+/* Batched textured quads – the glyph path. Source alpha is coverage;
+ * the draw colour supplies RGB, so one atlas serves every text colour. */
+void gpu_draw_quad_batch(struct gpu_texture *tex, const gpu_quad_t *quads,
+                         int n, uint32_t color)
+{
+    if (!tex || !tex->pixels) return;
+
+    for (int i = 0; i < n; i++) {
+        const gpu_quad_t *q = &quads[i];
+        raster_blit_tinted(q->dx0, q->dy0,
+                           tex->pixels + q->sy0 * tex->width + q->sx0,
+                           tex->width, q->sx1 - q->sx0, q->sy1 - q->sy0,
+                           color);
+    }
+}
+
 /* ==================== Unified Redraw Dispatcher ==================== */
 void gpu_redraw_window(window_t *win)
 {
     if (use_vulkan) {
         vulkan_redraw_window(win);
+    } else if (use_soft) {
+        raster_redraw_window(win);
     } else {
         gles_redraw_window(win);
     }
+
+    win->damage_count = 0;      // All accumulated damage now on screen
 }
 
 /* ==================== Module Init ==================== */
 _kernel_oserror *module_init(const char *arg, int podule)
 {
     if (gpu_init() != 0) {
+        /* Headless units without a working EGL stack still get a
+         * deterministic path: software raster into the DRM fb */
+        if (raster_probe() == 0) {
+            use_vulkan = 0;
+            use_soft = 1;
+            wimp_set_redraw_callback(gpu_redraw_window);
+            debug_print("GPU module loaded – software raster tier\n");
+            return NULL;
+        }
         debug_print("GPU acceleration disabled\n");
         return NULL;
     }
 
+    if (gpu_frame_ring_init() != 0) {
+        /* Device is up but the ring could not be built – fall back to
+         * the GLES tier rather than faulting on the first frame */
+        use_vulkan = 0;
+        wimp_set_redraw_callback(gpu_redraw_window);
+        debug_print("GPU module loaded – frame ring failed, GLES tier\n");
+        return NULL;
+    }
+
+    /* Present off the compositor's back – core 0 with the Wimp */
+    present_task = task_create("GPUPresent", gpu_present_work, 1, (1ULL << 0));
+
     wimp_set_redraw_callback(gpu_redraw_window);
     debug_print("GPU module loaded – hardware acceleration active\n");
     return NULL;
@@ -0,0 +1,195 @@
+/*
+ * raster.c – 2D software rasterizer for RISC OS Phoenix
+ * Third rendering tier behind Vulkan and GLES: fill, blit and copy
+ * straight into the DRM framebuffer for headless/diagnostic units
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "memops.h"
+#include "wimp.h"
+#include "drm.h"
+#include <string.h>
+
+/* The kernel builds with -mgeneral-regs-only, so these kernels use
+ * paired 64-bit general-register loads/stores (two pixels per op,
+ * unrolled) rather than 128-bit vectors. Each operation is a single
+ * routine so NEON variants can slot in behind the same entry points
+ * if FP state handling ever lands – the structure mirrors memops.c. */
+
+static uint32_t *raster_fb;
+static int raster_w, raster_h;
+static int raster_pitch;        // In pixels, not bytes
+
+int raster_init(uint32_t *fb, int w, int h, int pitch)
+{
+    if (!fb) return -1;
+    raster_fb = fb;
+    raster_w = w;
+    raster_h = h;
+    raster_pitch = pitch;
+    debug_print("Raster: software tier active (%dx%d)\n", w, h);
+    return 0;
+}
+
+/* Probe the DRM device for a dumb framebuffer to scan out */
+int raster_probe(void)
+{
+    drm_device_t *dev = drm_open("/dev/dri/card0");
+    if (!dev) return -1;
+
+    drm_mode_t *mode = &dev->current_mode;
+    if (drm_set_mode(dev, mode) != 0) return -1;
+
+    uint32_t *fb = drm_map_framebuffer(dev);
+    if (!fb) return -1;
+
+    return raster_init(fb, mode->width, mode->height, mode->width);
+}
+
+/* Solid fill – two pixels per 64-bit store, four stores per loop */
+void raster_fill_rect(int x, int y, int w, int h, uint32_t color)
+{
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > raster_w) w = raster_w - x;
+    if (y + h > raster_h) h = raster_h - y;
+    if (w <= 0 || h <= 0) return;
+
+    uint64_t pair = ((uint64_t)color << 32) | color;
+
+    for (int row = 0; row < h; row++) {
+        uint32_t *p = raster_fb + (y + row) * raster_pitch + x;
+        int n = w;
+
+        if ((uintptr_t)p & 7) { *p++ = color; n--; }
+
+        uint64_t *p64 = (uint64_t *)p;
+        while (n >= 8) {
+            p64[0] = pair; p64[1] = pair;
+            p64[2] = pair; p64[3] = pair;
+            p64 += 4;
+            n -= 8;
+        }
+        while (n >= 2) { *p64++ = pair; n -= 2; }
+
+        if (n) *(uint32_t *)p64 = color;
+    }
+}
+
+/* Opaque rectangle copy within the framebuffer – row-wise through the
+ * wide memcpy dispatch in memops.c */
+void raster_copy_rect(int dx, int dy, int sx, int sy, int w, int h)
+{
+    if (w <= 0 || h <= 0) return;
+
+    if (dy <= sy) {
+        for (int row = 0; row < h; row++)
+            memcpy(raster_fb + (dy + row) * raster_pitch + dx,
+                   raster_fb + (sy + row) * raster_pitch + sx, w * 4);
+    } else {
+        /* Overlapping downward move – copy bottom-up */
+        for (int row = h - 1; row >= 0; row--)
+            memcpy(raster_fb + (dy + row) * raster_pitch + dx,
+                   raster_fb + (sy + row) * raster_pitch + sx, w * 4);
+    }
+}
+
+/* One source-over blend: dst = src.a*src + (1-src.a)*dst */
+static inline uint32_t blend_px(uint32_t src, uint32_t dst)
+{
+    uint32_t a = src >> 24;
+    if (a == 255) return src;
+    if (a == 0)   return dst;
+    uint32_t na = 255 - a;
+
+    uint32_t rb = ((src & 0x00FF00FF) * a + (dst & 0x00FF00FF) * na) >> 8;
+    uint32_t g  = ((src & 0x0000FF00) * a + (dst & 0x0000FF00) * na) >> 8;
+    return 0xFF000000 | (rb & 0x00FF00FF) | (g & 0x0000FF00);
+}
+
+/* Textured blit with per-pixel alpha. Rows move through 64-bit pairs;
+ * fully opaque and fully transparent pairs short-circuit, which covers
+ * nearly every pixel of real window content. */
+void raster_blit_a(int dx, int dy, const uint32_t *src, int src_pitch,
+                   int w, int h)
+{
+    if (dx < 0) { src -= dx; w += dx; dx = 0; }
+    if (dy < 0) { src -= dy * src_pitch; h += dy; dy = 0; }
+    if (dx + w > raster_w) w = raster_w - dx;
+    if (dy + h > raster_h) h = raster_h - dy;
+    if (w <= 0 || h <= 0) return;
+
+    for (int row = 0; row < h; row++) {
+        const uint32_t *s = src + row * src_pitch;
+        uint32_t *d = raster_fb + (dy + row) * raster_pitch + dx;
+        int n = w;
+
+        while (n >= 2) {
+            uint64_t sp;
+            memcpy(&sp, s, 8);
+            if ((sp & 0xFF000000FF000000ULL) == 0xFF000000FF000000ULL) {
+                memcpy(d, &sp, 8);          // Both opaque – straight store
+            } else if (sp & 0xFF000000FF000000ULL) {
+                d[0] = blend_px((uint32_t)sp, d[0]);
+                d[1] = blend_px((uint32_t)(sp >> 32), d[1]);
+            }                               // Both transparent – skip
+            s += 2; d += 2; n -= 2;
+        }
+        if (n)
+            *d = blend_px(*s, *d);
+    }
+}
+
+/* Coverage blit: the source's alpha channel gates how much of 'color'
+ * lands on each destination pixel – the glyph path's tinted draw, so
+ * one atlas serves every text colour */
+void raster_blit_tinted(int dx, int dy, const uint32_t *src, int src_pitch,
+                        int w, int h, uint32_t color)
+{
+    if (dx < 0) { src -= dx; w += dx; dx = 0; }
+    if (dy < 0) { src -= dy * src_pitch; h += dy; dy = 0; }
+    if (dx + w > raster_w) w = raster_w - dx;
+    if (dy + h > raster_h) h = raster_h - dy;
+    if (w <= 0 || h <= 0) return;
+
+    uint32_t rgb = color & 0x00FFFFFF;
+
+    for (int row = 0; row < h; row++) {
+        const uint32_t *s = src + row * src_pitch;
+        uint32_t *d = raster_fb + (dy + row) * raster_pitch + dx;
+
+        for (int col = 0; col < w; col++) {
+            uint32_t a = s[col] >> 24;
+            if (a)
+                d[col] = blend_px((a << 24) | rgb, d[col]);
+        }
+    }
+}
+
+/* Composite one window's damaged regions from its CPU-side pixels */
+void raster_redraw_window(window_t *win)
+{
+    if (!raster_fb || !win || !win->texture || !win->texture->pixels)
+        return;
+
+    struct gpu_texture *tex = win->texture;
+
+    if (win->damage_count == 0) {
+        raster_blit_a(win->def.x0, win->def.y0, tex->pixels,
+                      tex->width, tex->width, tex->height);
+        return;
+    }
+
+    for (int i = 0; i < win->damage_count; i++) {
+        bbox_t *d = &win->damage[i];
+        int sx = d->x0 - win->def.x0;
+        int sy = d->y0 - win->def.y0;
+        if (sx < 0) sx = 0;
+        if (sy < 0) sy = 0;
+
+        raster_blit_a(d->x0, d->y0,
+                      tex->pixels + sy * tex->width + sx, tex->width,
+                      d->x1 - d->x0, d->y1 - d->y0);
+    }
+}
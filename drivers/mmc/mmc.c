@@ -1,84 +1,128 @@
 /*
  * mmc.c – MMC/SD Host Driver for RISC OS Phoenix
  * Supports SD/MMC/eMMC on Raspberry Pi (BCM2711/2712 SDHCI)
+ * ADMA2 descriptor DMA with PIO fallback
  * Integrates with SDIO for Bluetooth/WiFi
  * Author: R Andrews Grok 4 – 06 Feb 2026
  */
 
 #include "kernel.h"
 #include "mmc.h"
-#include "blockdev.h"
+#include "blockdriver.h"
+#include "irq.h"
 #include <stdint.h>
 #include <string.h>
 
-#define SDHCI_BASE      0xFE340000ULL  // Pi 5 SDHCI
-#define SDHCI_BLOCK_SIZE 512
+#define SDHCI_BLOCK_BYTES 512
 
-typedef struct mmc_ctrl {
-    void       *regs;
-    uint32_t   caps;
-    uint32_t   caps2;
-    int        irq_vector;
-    blockdev_t *bdev;
-    uint64_t   capacity;
-} mmc_ctrl_t;
+/* mmc_ctrl_t and register offsets live in mmc.h */
+
+/* Response registers beyond R0 */
+#define SDHCI_RESPONSE1         0x14
+#define SDHCI_RESPONSE2         0x18
+#define SDHCI_RESPONSE3         0x1C
+
+/* Capability bits */
+#define SDHCI_CAP_ADMA2         (1u << 19)
+
+/* Interrupt status bits */
+#define SDHCI_INT_CMD_DONE      (1u << 0)
+#define SDHCI_INT_XFER_DONE     (1u << 1)
+#define SDHCI_INT_DMA           (1u << 3)
+#define SDHCI_INT_ERROR         (1u << 15)
+#define SDHCI_INT_ADMA_ERROR    (1u << 25)
+
+/* Transfer mode bits (low half of the 32-bit mode+command write) */
+#define SDHCI_TRNS_DMA          (1u << 0)
+#define SDHCI_TRNS_BLK_CNT_EN   (1u << 1)
+#define SDHCI_TRNS_AUTO_CMD12   (1u << 2)
+#define SDHCI_TRNS_READ         (1u << 4)
+#define SDHCI_TRNS_MULTI        (1u << 5)
+
+/* ADMA2 descriptor attributes */
+#define ADMA2_VALID             0x0001
+#define ADMA2_END               0x0002
+#define ADMA2_TRAN              0x0020
+
+#define MMC_ADMA_MAX_DESC       64
+#define MMC_ADMA_MAX_CHUNK      0xF000      /* Per-descriptor byte cap, 4K aligned */
+
+/* 32-bit ADMA2 descriptor – the BCM SDHCI does not do the 64-bit
+ * variant, so DMA buffers must sit in the low 4GB (true for the
+ * kernel heap on the Pi's memory map) */
+typedef struct adma2_desc {
+    uint16_t attr;
+    uint16_t len;
+    uint32_t addr;
+} __attribute__((packed)) adma2_desc_t;
 
 static mmc_ctrl_t *mmc_ctrl;
 
-/* SDHCI registers */
-#define SDHCI_DMA_ADDRESS       0x00
-#define SDHCI_BLOCK_SIZE        0x04
-#define SDHCI_BLOCK_COUNT       0x06
-#define SDHCI_ARGUMENT          0x08
-#define SDHCI_TRANSFER_MODE     0x0C
-#define SDHCI_COMMAND           0x0E
-#define SDHCI_RESPONSE0         0x10
-#define SDHCI_BUFFER            0x20
-#define SDHCI_PRESENT_STATE     0x24
-#define SDHCI_HOST_CONTROL      0x28
-#define SDHCI_POWER_CONTROL     0x29
-#define SDHCI_BLOCK_GAP_CONTROL 0x2A
-#define SDHCI_WAKE_UP_CONTROL   0x2B
-#define SDHCI_CLOCK_CONTROL     0x2C
-#define SDHCI_TIMEOUT_CONTROL   0x2E
-#define SDHCI_SOFTWARE_RESET    0x2F
-#define SDHCI_INT_STATUS        0x30
-#define SDHCI_INT_ENABLE        0x34
-#define SDHCI_SIGNAL_ENABLE     0x38
-#define SDHCI_CAPABILITIES      0x40
-#define SDHCI_CAPABILITIES2     0x44
-
-/* Commands */
-#define CMD_GO_IDLE_STATE       0
-#define CMD_SEND_IF_COND        8
-#define CMD_APP_CMD             55
-#define CMD_ACMD41              41
-#define CMD_SEND_CSD            9
-#define CMD_READ_SINGLE_BLOCK   17
-#define CMD_WRITE_SINGLE_BLOCK  24
+static inline uint32_t readl(void *addr) { return *(volatile uint32_t*)addr; }
+static inline void writel(uint32_t val, void *addr) { *(volatile uint32_t*)addr = val; }
+static inline uint8_t readb(void *addr) { return *(volatile uint8_t*)addr; }
+static inline void writeb(uint8_t val, void *addr) { *(volatile uint8_t*)addr = val; }
+
+static int mmc_send_cmd(int cmd, uint32_t arg, int flags);
+static void mmc_irq_handler(int vector, void *private);
+ssize_t mmc_block_read(blockdev_t *bdev, uint64_t lba, uint32_t count, void *buf);
+ssize_t mmc_block_write(blockdev_t *bdev, uint64_t lba, uint32_t count, const void *buf);
+int mmc_submit_bio(blockdev_t *bdev, bio_t *bio);
+
+/* Two ops tables: ADMA2 controllers get the async submit hook, PIO
+ * ones stay on the sync fallback in blockdev_dispatch */
+static blockdev_ops_t mmc_pio_ops = {
+    .read  = mmc_block_read,
+    .write = mmc_block_write,
+};
+
+static blockdev_ops_t mmc_adma2_ops = {
+    .read   = mmc_block_read,
+    .write  = mmc_block_write,
+    .submit = mmc_submit_bio,
+};
 
 /* MMC init */
 static int mmc_init_controller(void) {
     mmc_ctrl = kmalloc(sizeof(mmc_ctrl_t));
     if (!mmc_ctrl) return -1;
+    memset(mmc_ctrl, 0, sizeof(*mmc_ctrl));
 
     mmc_ctrl->regs = ioremap(SDHCI_BASE, 0x1000);
     if (!mmc_ctrl->regs) goto fail;
 
     mmc_ctrl->caps = readl(mmc_ctrl->regs + SDHCI_CAPABILITIES);
     mmc_ctrl->caps2 = readl(mmc_ctrl->regs + SDHCI_CAPABILITIES2);
+    spinlock_init(&mmc_ctrl->lock);
 
     // Reset host
-    writel(0x07, mmc_ctrl->regs + SDHCI_SOFTWARE_RESET);
-    while (readl(mmc_ctrl->regs + SDHCI_SOFTWARE_RESET) & 0x07);
+    writeb(0x07, mmc_ctrl->regs + SDHCI_SOFTWARE_RESET);
+    while (readb(mmc_ctrl->regs + SDHCI_SOFTWARE_RESET) & 0x07);
 
     // Power on
-    writel(0x0F, mmc_ctrl->regs + SDHCI_POWER_CONTROL);
+    writeb(0x0F, mmc_ctrl->regs + SDHCI_POWER_CONTROL);
 
     // Clock enable
     writel(0x01, mmc_ctrl->regs + SDHCI_CLOCK_CONTROL);
     while (!(readl(mmc_ctrl->regs + SDHCI_CLOCK_CONTROL) & 0x02));
 
+    // Descriptor DMA when the caps allow it, else stay on PIO
+    if (mmc_ctrl->caps & SDHCI_CAP_ADMA2) {
+        mmc_ctrl->adma_table = kmalloc(MMC_ADMA_MAX_DESC * sizeof(adma2_desc_t));
+        if (mmc_ctrl->adma_table) {
+            mmc_ctrl->adma2 = 1;
+            // DMA select = ADMA2 (host control bits 4:3 = 10b)
+            uint8_t hc = readb(mmc_ctrl->regs + SDHCI_HOST_CONTROL);
+            writeb((hc & ~0x18) | 0x10, mmc_ctrl->regs + SDHCI_HOST_CONTROL);
+        }
+    }
+
+    // Completion + error interrupts
+    uint32_t ints = SDHCI_INT_CMD_DONE | SDHCI_INT_XFER_DONE |
+                    SDHCI_INT_ERROR | SDHCI_INT_ADMA_ERROR;
+    writel(ints, mmc_ctrl->regs + SDHCI_INT_ENABLE);
+    writel(ints, mmc_ctrl->regs + SDHCI_SIGNAL_ENABLE);
+
     // Send CMD0
     mmc_send_cmd(CMD_GO_IDLE_STATE, 0, 0);
 
@@ -109,12 +153,13 @@ static int mmc_init_controller(void) {
     if (!bdev) goto fail;
 
     bdev->private = mmc_ctrl;
-    bdev->read = mmc_block_read;
-    bdev->write = mmc_block_write;
+    bdev->ops = mmc_ctrl->adma2 ? &mmc_adma2_ops : &mmc_pio_ops;
 
     mmc_ctrl->bdev = bdev;
 
-    debug_print("MMC: %ld GB card detected\n", mmc_ctrl->capacity * 512 / (1000*1000*1000));
+    debug_print("MMC: %ld GB card detected (%s)\n",
+                mmc_ctrl->capacity * 512 / (1000*1000*1000),
+                mmc_ctrl->adma2 ? "ADMA2" : "PIO");
     return 0;
 
 fail:
@@ -123,17 +168,202 @@ fail:
     return -1;
 }
 
-/* Send MMC command */
+/* Send MMC command (no data phase) */
 static int mmc_send_cmd(int cmd, uint32_t arg, int flags) {
     writel(arg, mmc_ctrl->regs + SDHCI_ARGUMENT);
-    writel((cmd << 8) | flags, mmc_ctrl->regs + SDHCI_COMMAND);
+    writel(((cmd << 8) | flags) << 16, mmc_ctrl->regs + SDHCI_TRANSFER_MODE);
 
     // Wait for completion
-    while (!(readl(mmc_ctrl->regs + SDHCI_INT_STATUS) & 0x01));
-    writel(0x01, mmc_ctrl->regs + SDHCI_INT_STATUS);
+    while (!(readl(mmc_ctrl->regs + SDHCI_INT_STATUS) & SDHCI_INT_CMD_DONE));
+    writel(SDHCI_INT_CMD_DONE, mmc_ctrl->regs + SDHCI_INT_STATUS);
 
     return 0;
 }
 
-/* Block read */
-ssize_t mmc_block_read(blockdev_t
\ No newline at end of file
+/* Build the ADMA2 descriptor chain from a scatter list. Chunks cap at
+ * 60KB per descriptor; the last one carries the END attribute. */
+static int mmc_adma_build(mmc_ctrl_t *ctrl, bio_seg_t *segs, int nr_segs)
+{
+    adma2_desc_t *desc = (adma2_desc_t*)ctrl->adma_table;
+    int n = 0;
+
+    for (int i = 0; i < nr_segs; i++) {
+        uint64_t addr = virt_to_phys(segs[i].buf);
+        uint32_t left = segs[i].blocks * SDHCI_BLOCK_BYTES;
+
+        while (left) {
+            uint32_t chunk = left > MMC_ADMA_MAX_CHUNK ? MMC_ADMA_MAX_CHUNK : left;
+            if (n >= MMC_ADMA_MAX_DESC) return -1;
+
+            desc[n].attr = ADMA2_VALID | ADMA2_TRAN;
+            desc[n].len = chunk;
+            desc[n].addr = (uint32_t)addr;
+            n++;
+
+            addr += chunk;
+            left -= chunk;
+        }
+    }
+
+    desc[n - 1].attr |= ADMA2_END;
+    return n;
+}
+
+/* Kick one DMA transfer: descriptors are already built, the interrupt
+ * handler finishes it. Exactly one transfer outstanding at a time. */
+static void mmc_dma_start(mmc_ctrl_t *ctrl, uint64_t lba, uint32_t blocks, int write)
+{
+    writel(virt_to_phys(ctrl->adma_table), ctrl->regs + SDHCI_DMA_ADDRESS);
+    writel(SDHCI_BLOCK_BYTES | (blocks << 16), ctrl->regs + SDHCI_BLOCK_SIZE);
+
+    uint32_t mode = SDHCI_TRNS_DMA | SDHCI_TRNS_BLK_CNT_EN;
+    int cmd;
+    if (blocks > 1) {
+        mode |= SDHCI_TRNS_MULTI | SDHCI_TRNS_AUTO_CMD12;
+        cmd = write ? CMD_WRITE_MULTIPLE_BLOCK : CMD_READ_MULTIPLE_BLOCK;
+    } else {
+        cmd = write ? CMD_WRITE_SINGLE_BLOCK : CMD_READ_SINGLE_BLOCK;
+    }
+    if (!write) mode |= SDHCI_TRNS_READ;
+
+    writel(lba, ctrl->regs + SDHCI_ARGUMENT);
+    writel((((cmd << 8) | 0x30) << 16) | mode, ctrl->regs + SDHCI_TRANSFER_MODE);
+}
+
+/* Transfer-complete interrupt: retire whatever is outstanding */
+static void mmc_irq_handler(int vector, void *private) {
+    mmc_ctrl_t *ctrl = mmc_ctrl;
+    if (!ctrl) return;
+
+    uint32_t is = readl(ctrl->regs + SDHCI_INT_STATUS);
+    writel(is, ctrl->regs + SDHCI_INT_STATUS);  // Ack
+
+    if (!(is & (SDHCI_INT_XFER_DONE | SDHCI_INT_ERROR | SDHCI_INT_ADMA_ERROR)))
+        return;
+
+    int status = (is & (SDHCI_INT_ERROR | SDHCI_INT_ADMA_ERROR)) ? -1 : 0;
+
+    bio_t *bio = ctrl->cur_bio;
+    if (bio) {
+        ctrl->cur_bio = NULL;
+        bio_complete(bio, status);
+    } else {
+        ctrl->xfer_status = status;
+        __atomic_store_n(&ctrl->xfer_done, 1, __ATOMIC_RELEASE);
+        if (ctrl->waiter) task_wakeup(ctrl->waiter);
+    }
+}
+
+/* PIO fallback – word loop through the buffer register, one block
+ * command per block. Slow, but works before/without ADMA2. */
+static ssize_t mmc_pio_rw(mmc_ctrl_t *ctrl, uint64_t lba, uint32_t count,
+                          void *buf, int write)
+{
+    uint32_t *words = buf;
+
+    for (uint32_t blk = 0; blk < count; blk++) {
+        writel(SDHCI_BLOCK_BYTES | (1 << 16), ctrl->regs + SDHCI_BLOCK_SIZE);
+
+        if (write) {
+            for (int i = 0; i < SDHCI_BLOCK_BYTES / 4; i++) {
+                writel(*words++, ctrl->regs + SDHCI_BUFFER);
+            }
+            mmc_send_cmd(CMD_WRITE_SINGLE_BLOCK, lba + blk, 0x10);  // Data enable
+        } else {
+            mmc_send_cmd(CMD_READ_SINGLE_BLOCK, lba + blk, 0x10);
+            for (int i = 0; i < SDHCI_BLOCK_BYTES / 4; i++) {
+                *words++ = readl(ctrl->regs + SDHCI_BUFFER);
+            }
+        }
+    }
+    return count * SDHCI_BLOCK_BYTES;
+}
+
+/* Sync read/write – one DMA transfer, sleep until the IRQ lands */
+static ssize_t mmc_block_rw(blockdev_t *bdev, uint64_t lba, uint32_t count,
+                            void *buf, int write)
+{
+    mmc_ctrl_t *ctrl = bdev->private;
+
+    if (!ctrl->adma2) {
+        return mmc_pio_rw(ctrl, lba, count, buf, write);
+    }
+
+    unsigned long flags;
+    spin_lock_irqsave(&ctrl->lock, &flags);
+
+    bio_seg_t seg = { .buf = buf, .blocks = count };
+    if (mmc_adma_build(ctrl, &seg, 1) < 0) {
+        spin_unlock_irqrestore(&ctrl->lock, flags);
+        return mmc_pio_rw(ctrl, lba, count, buf, write);
+    }
+
+    ctrl->cur_bio = NULL;
+    ctrl->xfer_done = 0;
+    ctrl->waiter = current_task;
+    mmc_dma_start(ctrl, lba, count, write);
+
+    spin_unlock_irqrestore(&ctrl->lock, flags);
+
+    while (!__atomic_load_n(&ctrl->xfer_done, __ATOMIC_ACQUIRE)) {
+        task_block(TASK_BLOCKED);
+        schedule();
+    }
+
+    ctrl->waiter = NULL;
+    return ctrl->xfer_status == 0 ? (ssize_t)(count * SDHCI_BLOCK_BYTES) : -1;
+}
+
+ssize_t mmc_block_read(blockdev_t *bdev, uint64_t lba, uint32_t count, void *buf)
+{
+    return mmc_block_rw(bdev, lba, count, buf, 0);
+}
+
+ssize_t mmc_block_write(blockdev_t *bdev, uint64_t lba, uint32_t count, const void *buf)
+{
+    return mmc_block_rw(bdev, lba, count, (void*)buf, 1);
+}
+
+/* Async submission – the whole scatter list becomes one descriptor
+ * chain and one multi-block command; the IRQ handler fires bio->done */
+int mmc_submit_bio(blockdev_t *bdev, bio_t *bio)
+{
+    mmc_ctrl_t *ctrl = bdev->private;
+    unsigned long flags;
+
+    /* Single-slot host: wait for the outstanding transfer to retire.
+     * The elevator keeps its queue sorted behind us meanwhile. */
+    spin_lock_irqsave(&ctrl->lock, &flags);
+    while (ctrl->cur_bio || ctrl->waiter) {
+        spin_unlock_irqrestore(&ctrl->lock, flags);
+        yield();
+        spin_lock_irqsave(&ctrl->lock, &flags);
+    }
+
+    uint32_t blocks = 0;
+    for (int i = 0; i < bio->nr_segs; i++) {
+        blocks += bio->segs[i].blocks;
+    }
+
+    if (mmc_adma_build(ctrl, bio->segs, bio->nr_segs) < 0) {
+        spin_unlock_irqrestore(&ctrl->lock, flags);
+        return -1;
+    }
+
+    ctrl->cur_bio = bio;
+    mmc_dma_start(ctrl, bio->lba, blocks, bio->op == BIO_WRITE);
+
+    spin_unlock_irqrestore(&ctrl->lock, flags);
+    return 0;
+}
+
+/* Module init */
+_kernel_oserror *module_init(const char *arg, int podule)
+{
+    if (mmc_init_controller() == 0) {
+        irq_set_handler(MMC_IRQ_VECTOR, mmc_irq_handler, NULL);
+        irq_unmask(MMC_IRQ_VECTOR);
+    }
+    debug_print("MMC driver loaded\n");
+    return NULL;
+}
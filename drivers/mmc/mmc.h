@@ -8,6 +8,10 @@
 #define MMC_H
 
 #include <stdint.h>
+#include "blockdriver.h"    /* blockdev_t, bio_t */
+
+/* spinlock_t and task_t come from kernel.h, which every TU includes
+ * first – same convention as blockdriver.h itself */
 
 #define SDHCI_BASE      0xFE340000ULL  // Pi 5 SDHCI
 
@@ -18,6 +22,15 @@ typedef struct mmc_ctrl {
     int        irq_vector;
     blockdev_t *bdev;
     uint64_t   capacity;
+
+    /* ADMA2 descriptor DMA – one transfer outstanding at a time */
+    int         adma2;          /* Caps advertise ADMA2, table in use */
+    uint8_t    *adma_table;     /* Descriptor chain, rebuilt per transfer */
+    spinlock_t  lock;
+    bio_t      *cur_bio;        /* Async owner of the transfer, or NULL */
+    volatile int xfer_done;     /* Sync completion flag */
+    int          xfer_status;
+    task_t      *waiter;
 } mmc_ctrl_t;
 
 /* SDHCI registers */
@@ -50,7 +63,9 @@ typedef struct mmc_ctrl {
 #define CMD_ACMD41              41
 #define CMD_SEND_CSD            9
 #define CMD_READ_SINGLE_BLOCK   17
+#define CMD_READ_MULTIPLE_BLOCK 18
 #define CMD_WRITE_SINGLE_BLOCK  24
+#define CMD_WRITE_MULTIPLE_BLOCK 25
 
 /* MMC IRQ vector (example) */
 #define MMC_IRQ_VECTOR          0x20
@@ -6,9 +6,12 @@
  */
 
 #include "kernel.h"
-#include "blockdev.h"
+#include "blockdriver.h"
+#include "page_alloc.h"
+#include "irq.h"
 #include "pci.h"
 #include "nvme.h"
+#include "timer.h"
 #include <stdint.h>
 #include <string.h>
 
@@ -17,6 +20,88 @@
 #define NVME_ADMIN_Q        0
 #define NVME_IO_Q_START     1
 
+/* Submission queue entry (64 bytes) */
+typedef struct {
+    uint8_t     opcode;
+    uint8_t     flags;
+    uint16_t    command_id;
+    uint32_t    nsid;
+    uint64_t    reserved;
+    uint64_t    mptr;
+    uint64_t    prp1;
+    uint64_t    prp2;
+    uint32_t    cdw10;
+    uint32_t    cdw11;
+    uint32_t    cdw12;
+    uint32_t    cdw13;
+    uint32_t    cdw14;
+    uint32_t    cdw15;
+} nvme_cmd_t;
+
+/* Completion queue entry */
+typedef struct {
+    uint32_t    command_specific;
+    uint32_t    reserved;
+    uint16_t    sq_head;
+    uint16_t    sq_id;
+    uint16_t    command_id;
+    uint16_t    status_phase;
+} nvme_cqe_t;
+
+/* PRP list pages: 512 64-bit entries per page, chained through the
+ * last entry when a command spans more than one list. 8 chained pages
+ * bound a single command at ~16MB of payload, far past anything the
+ * block layer builds. */
+#define NVME_PRP_PER_LIST   (PAGE_SIZE / 8)
+#define NVME_PRP_MAX_LISTS  8
+
+/* In-flight command context, indexed by command_id */
+typedef struct {
+    int         in_use;
+    bio_t      *bio;            // Async request, or...
+    task_t     *waiter;         // ...task sleeping on a sync command
+    volatile int done;
+    int         status;
+    uint64_t    prp_lists[NVME_PRP_MAX_LISTS];  // PRP list pages (phys)
+    int         nr_prp_lists;
+} nvme_cmd_ctx_t;
+
+/* Per-queue state with interrupt support. One SQ/CQ pair per CPU:
+ * only the owning core ever touches sq_tail/cq_head and the context
+ * table, so the submission path needs no lock at all – just local
+ * IRQs off while the tail is advanced. */
+typedef struct {
+    void       *sq_base;
+    void       *cq_base;
+    uint16_t    depth;
+    uint16_t    sq_tail;
+    uint16_t    cq_head;
+    uint16_t    cq_phase;
+    uint32_t   *db_sq;
+    uint32_t   *db_cq;
+    int         irq_vector;
+    int         cpu;            // Owning core (MSI-X routed here)
+    nvme_cmd_ctx_t ctx[NVME_QUEUE_DEPTH];
+    uint16_t    next_cid;
+    int         active;
+    /* Hybrid polling state: moving average of completion latency and
+     * how often the poll path won vs. had to fall back to sleeping */
+    uint64_t    avg_lat_ns;
+    uint64_t    poll_hits;
+    uint64_t    poll_misses;
+} nvme_queue_t;
+
+/* Dataset Management range descriptor (spec figure: 16 bytes each) */
+typedef struct nvme_dsm_range {
+    uint32_t cattr;             /* Context attributes (unused) */
+    uint32_t nlb;               /* Length in logical blocks */
+    uint64_t slba;              /* Starting LBA */
+} nvme_dsm_range_t;
+
+#define NVME_DSM_MAX_RANGES 256
+
+static task_t *nvme_trim_task;
+
 /* NVMe controller state */
 typedef struct nvme_ctrl {
     void       *regs;
@@ -35,11 +120,33 @@ typedef struct nvme_ctrl {
     timer_t     watchdog;
     int         reset_count;
     blockdev_t *bdev;
+    pci_dev_t  *pdev;
+    struct nvme_dsm_range *dsm_ranges;  /* Pending deallocate batch */
+    struct nvme_dsm_range *dsm_shadow;  /* Batch currently on the wire */
+    int         dsm_count;
+    spinlock_t  dsm_lock;
 } nvme_ctrl_t;
 
 static nvme_ctrl_t *nvme_controllers[8];
 static int nvme_count = 0;
 
+static void nvme_watchdog(timer_t *timer);
+
+/* Block-layer entry points (defined below) */
+ssize_t nvme_block_read(blockdev_t *bdev, uint64_t lba, uint32_t count, void *buf);
+ssize_t nvme_block_write(blockdev_t *bdev, uint64_t lba, uint32_t count, const void *buf);
+int nvme_submit_bio(blockdev_t *bdev, bio_t *bio);
+int nvme_trim(blockdev_t *bdev, uint64_t lba, uint64_t count);
+int nvme_write_zeroes(blockdev_t *bdev, uint64_t lba, uint64_t count);
+
+static blockdev_ops_t nvme_bdev_ops = {
+    .read         = nvme_block_read,
+    .write        = nvme_block_write,
+    .submit       = nvme_submit_bio,
+    .trim         = nvme_trim,
+    .write_zeroes = nvme_write_zeroes,
+};
+
 /* NVMe registers (offsets from BAR0) */
 #define NVME_REG_CAP     0x0000
 #define NVME_REG_VS      0x0008
@@ -54,30 +161,6 @@ static int nvme_count = 0;
 /* Queue doorbell stride */
 #define NVME_DB_STRIDE(cap) (1 << ((cap >> 32) & 0xF))
 
-/* Completion queue entry */
-typedef struct {
-    uint32_t    command_specific;
-    uint32_t    reserved;
-    uint16_t    sq_head;
-    uint16_t    sq_id;
-    uint16_t    command_id;
-    uint16_t    status_phase;
-} nvme_cqe_t;
-
-/* Per-queue state with interrupt support */
-typedef struct {
-    void       *sq_base;
-    void       *cq_base;
-    uint16_t    sq_tail;
-    uint16_t    cq_head;
-    uint16_t    cq_phase;
-    uint32_t   *db_sq;
-    uint32_t   *db_cq;
-    int         irq_vector;
-    task_t     *waiting_task;   // Task blocked on this queue
-    int         active;
-} nvme_queue_t;
-
 /* Error codes from NVME spec */
 #define NVME_SC_SUCCESS                 0x00
 #define NVME_SC_INVALID_OPCODE          0x01
@@ -95,6 +178,7 @@ static int nvme_init_controller(pci_dev_t *pdev)
     if (!ctrl) return -1;
     memset(ctrl, 0, sizeof(*ctrl));
 
+    ctrl->pdev = pdev;
     ctrl->regs_phys = pci_bar_start(pdev, 0);
     ctrl->regs = ioremap(ctrl->regs_phys, 0x10000);
     if (!ctrl->regs) goto fail;
@@ -104,7 +188,7 @@ static int nvme_init_controller(pci_dev_t *pdev)
     ctrl->page_size = 1 << (12 + ((ctrl->cap >> 48) & 0xF));
 
     ctrl->state = CTRL_ALIVE;
-    timer_init(&ctrl->watchdog, nvme_watchdog, ctrl);
+    timer_setup(&ctrl->watchdog, nvme_watchdog, ctrl);
     timer_schedule(&ctrl->watchdog, 1000);
 
     // Reset controller
@@ -132,9 +216,15 @@ static int nvme_init_controller(pci_dev_t *pdev)
     if (!bdev) goto fail;
 
     bdev->private = ctrl;
-    bdev->read = nvme_block_read;
-    bdev->write = nvme_block_write;
-    bdev->trim = nvme_trim;
+    bdev->ops = &nvme_bdev_ops;
+    bdev->iosched = IOSCHED_NONE;   // Deep per-CPU queues – the drive sorts better than we can
+
+    ctrl->dsm_ranges = kmalloc(NVME_DSM_MAX_RANGES * sizeof(nvme_dsm_range_t));
+    ctrl->dsm_shadow = kmalloc(NVME_DSM_MAX_RANGES * sizeof(nvme_dsm_range_t));
+    ctrl->dsm_count = 0;
+    spinlock_init(&ctrl->dsm_lock);
+    if (!nvme_trim_task)
+        nvme_trim_task = task_create("NVMeTrim", nvme_trim_work, 0, ~0ULL);
 
     ctrl->bdev = bdev;
     nvme_controllers[nvme_count++] = ctrl;
@@ -149,74 +239,569 @@ fail:
     return -1;
 }
 
-/* Create admin + I/O queues */
-static int nvme_create_queues(nvme_ctrl_t *ctrl)
+#define KERNEL_VIRT_BASE    0xFFFF000000000000ULL
+
+/* Post one command on the admin queue and poll for its completion.
+ * Only used at init time, before interrupts are wired up. */
+static int nvme_admin_cmd_sync(nvme_ctrl_t *ctrl, nvme_cmd_t *cmd)
 {
-    // ... (full implementation from previous messages)
+    nvme_queue_t *q = &ctrl->queues[NVME_ADMIN_Q];
+
+    cmd->command_id = q->next_cid++;
+    memcpy((uint8_t*)q->sq_base + q->sq_tail * sizeof(nvme_cmd_t),
+           cmd, sizeof(nvme_cmd_t));
+    q->sq_tail = (q->sq_tail + 1) % q->depth;
+    writel(q->sq_tail, q->db_sq);
+
+    nvme_cqe_t *cqe = (nvme_cqe_t*)q->cq_base + q->cq_head;
+    while ((cqe->status_phase & 1) != q->cq_phase);
+
+    int status = (cqe->status_phase >> 1) & 0xFF;
+    if (++q->cq_head == q->depth) {
+        q->cq_head = 0;
+        q->cq_phase ^= 1;
+    }
+    writel(q->cq_head, q->db_cq);
+
+    return status == NVME_SC_SUCCESS ? 0 : -1;
 }
 
 /* Create one queue (admin or I/O) */
 static int nvme_create_queue(nvme_ctrl_t *ctrl, int qid, int depth, int admin)
 {
-    // ... (full implementation from previous messages)
+    nvme_queue_t *q = &ctrl->queues[qid];
+    memset(q, 0, sizeof(*q));
+    q->depth = depth;
+    q->cq_phase = 1;
+
+    /* 128 x 64B commands = 8KB SQ, 128 x 16B entries = 2KB CQ */
+    uint64_t sq_phys = phys_alloc_pages(1);
+    uint64_t cq_phys = phys_alloc_page();
+    if (!sq_phys || !cq_phys) return -1;
+
+    q->sq_base = (void*)(sq_phys + KERNEL_VIRT_BASE);
+    q->cq_base = (void*)(cq_phys + KERNEL_VIRT_BASE);
+
+    uint32_t stride = NVME_DB_STRIDE(ctrl->cap);
+    q->db_sq = ctrl->regs + 0x1000 + (2 * qid) * stride * 4;
+    q->db_cq = ctrl->regs + 0x1000 + (2 * qid + 1) * stride * 4;
+
+    if (admin) {
+        writel(((depth - 1) << 16) | (depth - 1), ctrl->regs + NVME_REG_AQA);
+        writeq(sq_phys, ctrl->regs + NVME_REG_ASQ);
+        writeq(cq_phys, ctrl->regs + NVME_REG_ACQ);
+    } else {
+        /* CQ first (the SQ create references it), interrupts enabled
+         * on this queue's own MSI-X vector */
+        nvme_cmd_t cmd = {0};
+        cmd.opcode = 0x05;          // Create I/O CQ
+        cmd.prp1 = cq_phys;
+        cmd.cdw10 = ((depth - 1) << 16) | qid;
+        cmd.cdw11 = ((uint32_t)qid << 16) | 3;    // IEN | physically contiguous
+        if (nvme_admin_cmd_sync(ctrl, &cmd) != 0) return -1;
+
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.opcode = 0x01;          // Create I/O SQ
+        cmd.prp1 = sq_phys;
+        cmd.cdw10 = ((depth - 1) << 16) | qid;
+        cmd.cdw11 = ((uint32_t)qid << 16) | 1;    // Bound to CQ qid
+        if (nvme_admin_cmd_sync(ctrl, &cmd) != 0) return -1;
+    }
+
+    q->active = 1;
+    return 0;
 }
 
-/* Submit I/O using per-CPU queue */
-static int nvme_io_submit(int qid, uint8_t opcode, uint64_t lba, uint16_t count,
-                          void *buffer, int write)
+/* Create admin queue plus one I/O queue pair per CPU, each owned by
+ * exactly one core – no submission lock anywhere */
+static int nvme_create_queues(nvme_ctrl_t *ctrl)
 {
-    // ... (full implementation from previous messages)
+    if (nvme_create_queue(ctrl, NVME_ADMIN_Q, 64, 1) != 0) return -1;
+
+    int want = nr_cpus;
+    if (want > (int)ctrl->max_queues) want = ctrl->max_queues;
+    if (want > NVME_MAX_QUEUES - 1) want = NVME_MAX_QUEUES - 1;
+
+    /* Ask the controller for that many queue pairs (Set Features,
+     * Number of Queues) – it may grant fewer */
+    nvme_cmd_t cmd = {0};
+    cmd.opcode = 0x09;              // Set Features
+    cmd.cdw10 = 0x07;               // Number of Queues
+    cmd.cdw11 = ((want - 1) << 16) | (want - 1);
+    nvme_admin_cmd_sync(ctrl, &cmd);
+
+    for (int cpu = 0; cpu < want; cpu++) {
+        int qid = NVME_IO_Q_START + cpu;
+        if (nvme_create_queue(ctrl, qid, NVME_QUEUE_DEPTH, 0) != 0) {
+            want = cpu;
+            break;
+        }
+        ctrl->queues[qid].cpu = cpu;
+        ctrl->queues[qid].irq_vector = NVME_IRQ_BASE + qid;
+    }
+
+    ctrl->num_queues = want;
+    debug_print("NVMe: %d per-CPU I/O queue pairs (depth %d)\n",
+                want, NVME_QUEUE_DEPTH);
+    return want > 0 ? 0 : -1;
 }
 
-/* Block device read/write using per-CPU queue */
-ssize_t nvme_block_read(blockdev_t *bdev, uint64_t lba, uint32_t count, void *buf)
+/* The calling CPU's own queue */
+static inline nvme_queue_t *nvme_local_queue(nvme_ctrl_t *ctrl)
 {
-    int qid = get_cpu_id() % nvme_ctrl->num_queues;
-    nvme_cmd_t cmd = {0};
+    return &ctrl->queues[NVME_IO_Q_START + (get_cpu_id() % ctrl->num_queues)];
+}
 
-    cmd.opcode = 0x02;  // READ
-    cmd.nsid = 1;
-    cmd.cdw10 = lba & 0xFFFFFFFF;
-    cmd.cdw11 = lba >> 32;
-    cmd.cdw12 = count - 1;
-    cmd.prp1 = virt_to_phys(buf);
+#define KERNEL_VIRT_BASE    0xFFFF000000000000ULL
+
+/* Return a command's chained PRP list pages to the buddy */
+static void nvme_prp_free(nvme_cmd_ctx_t *ctx)
+{
+    for (int i = 0; i < ctx->nr_prp_lists; i++)
+        phys_free_page(ctx->prp_lists[i]);
+    ctx->nr_prp_lists = 0;
+}
+
+/* Build the PRP data pointers for one command from a scatter list of
+ * segments. One or two pages use prp1/prp2 directly; anything larger
+ * gets PRP list pages, chained through their last entry. Segments are
+ * taken page by page, so physically discontiguous page-cache pages go
+ * to the device as they are – no bounce copy.
+ *
+ * PRP alignment rules: every data pointer after the first must start
+ * on a page boundary, and only the last may end short of one. A
+ * scatter list violating that (odd user buffers) returns -1 and the
+ * caller falls back to one command per segment. */
+static int nvme_build_prps(nvme_cmd_ctx_t *ctx, nvme_cmd_t *cmd,
+                           const bio_seg_t *segs, int nsegs)
+{
+    int total_pages = 0;
+
+    for (int i = 0; i < nsegs; i++) {
+        uint64_t start = (uint64_t)segs[i].buf;
+        uint64_t len = (uint64_t)segs[i].blocks * 512;
+
+        if (i > 0 && (start & ~PAGE_MASK)) return -1;
+        if (i < nsegs - 1 && ((start + len) & ~PAGE_MASK)) return -1;
+        total_pages += ((start & ~PAGE_MASK) + len + PAGE_SIZE - 1) / PAGE_SIZE;
+    }
+
+    uint64_t *list = NULL;
+    int idx = 0, emitted = 0;
+
+    for (int i = 0; i < nsegs; i++) {
+        uint64_t va = (uint64_t)segs[i].buf;
+        uint64_t end = va + (uint64_t)segs[i].blocks * 512;
+
+        while (va < end) {
+            uint64_t phys = virt_to_phys((void *)va);
+
+            if (emitted == 0) {
+                cmd->prp1 = phys;
+            } else if (total_pages == 2) {
+                cmd->prp2 = phys;       /* Two pages: no list needed */
+            } else {
+                if (!list || (idx == NVME_PRP_PER_LIST - 1 &&
+                              total_pages - emitted > 1)) {
+                    /* Need a (further) list page; chain from the last
+                     * entry of the previous one */
+                    if (ctx->nr_prp_lists == NVME_PRP_MAX_LISTS) {
+                        nvme_prp_free(ctx);
+                        return -1;
+                    }
+                    uint64_t lp = phys_alloc_page();
+                    if (!lp) {
+                        nvme_prp_free(ctx);
+                        return -1;
+                    }
+                    if (list) list[idx] = lp;
+                    else cmd->prp2 = lp;
+                    ctx->prp_lists[ctx->nr_prp_lists++] = lp;
+                    list = (uint64_t *)(lp + KERNEL_VIRT_BASE);
+                    idx = 0;
+                }
+                list[idx++] = phys;
+            }
+            emitted++;
+            va = (va & PAGE_MASK) + PAGE_SIZE;
+        }
+    }
+    return 0;
+}
 
-    nvme_submit_cmd(qid, &cmd, current_task);
-    return count * 512;
+/* Submit one command on the local CPU's queue. Lock-free: the queue
+ * belongs to this core, so masking local IRQs against our own
+ * completion handler is the only protection needed. Returns the
+ * command context for the caller to fill in (bio or waiter).
+ * 'sgbio', when given, supplies a scatter list gathered into one
+ * command via PRPs; otherwise 'buffer' is a single contiguous run. */
+static nvme_cmd_ctx_t *nvme_io_submit(nvme_ctrl_t *ctrl, uint8_t opcode,
+                                      uint64_t lba, uint16_t count, void *buffer,
+                                      bio_t *sgbio)
+{
+    nvme_queue_t *q = nvme_local_queue(ctrl);
+    unsigned long daif;
+
+    __asm__ volatile ("mrs %0, daif; msr daifset, #2" : "=r"(daif));
+
+    /* Find a free command id – depth slots, so this terminates unless
+     * the queue is genuinely full */
+    uint16_t cid = q->next_cid;
+    int tries = 0;
+    while (q->ctx[cid].in_use) {
+        cid = (cid + 1) % q->depth;
+        if (++tries == q->depth) {
+            __asm__ volatile ("msr daif, %0" :: "r"(daif));
+            return NULL;    // Queue full – caller retries or fails
+        }
+    }
+    q->next_cid = (cid + 1) % q->depth;
+
+    nvme_cmd_ctx_t *ctx = &q->ctx[cid];
+    ctx->in_use = 1;
+    ctx->bio = NULL;
+    ctx->waiter = NULL;
+    ctx->done = 0;
+    ctx->status = 0;
+    ctx->nr_prp_lists = 0;
+
+    nvme_cmd_t *cmd = (nvme_cmd_t*)q->sq_base + q->sq_tail;
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->opcode = opcode;
+    cmd->command_id = cid;
+    cmd->nsid = ctrl->ns_id;
+
+    if (sgbio) {
+        if (nvme_build_prps(ctx, cmd, sgbio->segs, sgbio->nr_segs) != 0) {
+            ctx->in_use = 0;    /* Unmergeable scatter list – caller
+                                 * falls back to per-segment commands */
+            __asm__ volatile ("msr daif, %0" :: "r"(daif));
+            return NULL;
+        }
+    } else if (buffer) {
+        bio_seg_t seg = { .buf = buffer, .blocks = count };
+        if (nvme_build_prps(ctx, cmd, &seg, 1) != 0) {
+            ctx->in_use = 0;
+            __asm__ volatile ("msr daif, %0" :: "r"(daif));
+            return NULL;
+        }
+    }
+
+    cmd->cdw10 = lba & 0xFFFFFFFF;
+    cmd->cdw11 = lba >> 32;
+    cmd->cdw12 = count - 1;
+
+    q->sq_tail = (q->sq_tail + 1) % q->depth;
+    writel(q->sq_tail, q->db_sq);
+
+    __asm__ volatile ("msr daif, %0" :: "r"(daif));
+    return ctx;
+}
+
+/* Block device read/write – one command on the local CPU's queue,
+ * sleep until the queue's interrupt (routed to this core) wakes us */
+static ssize_t nvme_block_rw(blockdev_t *bdev, uint64_t lba, uint32_t count,
+                             void *buf, int write)
+{
+    nvme_ctrl_t *ctrl = bdev->private;
+
+    nvme_cmd_ctx_t *ctx = nvme_io_submit(ctrl, write ? 0x01 : 0x02,
+                                         lba, count, buf, NULL);
+    if (!ctx) return -1;
+    ctx->waiter = current_task;
+
+    while (!__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE)) {
+        task_block(TASK_BLOCKED);
+        schedule();
+    }
+
+    int status = ctx->status;
+    ctx->in_use = 0;
+    return status == 0 ? (ssize_t)(count * 512) : -1;
+}
+
+ssize_t nvme_block_read(blockdev_t *bdev, uint64_t lba, uint32_t count, void *buf)
+{
+    return nvme_block_rw(bdev, lba, count, buf, 0);
 }
 
 ssize_t nvme_block_write(blockdev_t *bdev, uint64_t lba, uint32_t count, const void *buf)
 {
-    int qid = get_cpu_id() % nvme_ctrl->num_queues;
-    nvme_cmd_t cmd = {0};
+    return nvme_block_rw(bdev, lba, count, (void*)buf, 1);
+}
 
-    cmd.opcode = 0x01;  // WRITE
-    cmd.nsid = 1;
-    cmd.cdw10 = lba & 0xFFFFFFFF;
-    cmd.cdw11 = lba >> 32;
-    cmd.cdw12 = count - 1;
-    cmd.prp1 = virt_to_phys((void*)buf);
+/* Async submission. The whole bio goes out as a single command when
+ * its scatter list gathers into one PRP chain (page-cache pages
+ * always do – disk to cache with zero copies and one CQE). Segments
+ * whose alignment breaks the PRP rules fall back to one command per
+ * segment, as before; the completion handler fires bio->done when the
+ * last CQE arrives either way. */
+int nvme_submit_bio(blockdev_t *bdev, bio_t *bio)
+{
+    nvme_ctrl_t *ctrl = bdev->private;
+    uint64_t lba = bio->lba;
+    uint8_t opcode = (bio->op == BIO_WRITE) ? 0x01 : 0x02;
+
+    uint64_t total_blocks = 0;
+    for (int i = 0; i < bio->nr_segs; i++)
+        total_blocks += bio->segs[i].blocks;
+
+    if (total_blocks && total_blocks < 65536) {     /* 16-bit NLB */
+        nvme_cmd_ctx_t *ctx = nvme_io_submit(ctrl, opcode, lba,
+                                             total_blocks, NULL, bio);
+        if (ctx) {
+            bio->inflight = 1;
+            ctx->bio = bio;
+            goto submitted;
+        }
+        /* Unmergeable or queue full – take the per-segment path */
+    }
+
+    bio->inflight = bio->nr_segs;
+
+    for (int i = 0; i < bio->nr_segs; i++) {
+        nvme_cmd_ctx_t *ctx = nvme_io_submit(ctrl, opcode, lba,
+                                             bio->segs[i].blocks,
+                                             bio->segs[i].buf, NULL);
+        if (!ctx) {
+            /* Queue full mid-bio: fail the whole request once the
+             * already-submitted segments drain */
+            bio->status = -1;
+            if (__atomic_sub_fetch(&bio->inflight, bio->nr_segs - i,
+                                   __ATOMIC_ACQ_REL) == 0) {
+                bio_complete(bio, -1);
+            }
+            return 0;
+        }
+        ctx->bio = bio;
+        lba += bio->segs[i].blocks;
+    }
+
+submitted:
+
+    /* High-priority request: reap the completions ourselves instead
+     * of waiting for the vector to fire. Hybrid: doze away half the
+     * expected latency (per-queue moving average) with yields, then
+     * spin on the CQ with IRQs masked so the vector handler does not
+     * drain it under our feet. On Gen4 drives this skips ~10us of
+     * interrupt wakeup per 4KB read. */
+    if (bio->flags & BIO_FLAG_POLL) {
+        nvme_queue_t *q = nvme_local_queue(ctrl);
+        uint64_t start = get_time_ns();
+        uint64_t doze = q->avg_lat_ns / 2;
+
+        while (doze && get_time_ns() - start < doze) {
+            if (!__atomic_load_n(&bio->inflight, __ATOMIC_ACQUIRE)) break;
+            yield();
+        }
+        while (__atomic_load_n(&bio->inflight, __ATOMIC_ACQUIRE)) {
+            unsigned long daif;
+            __asm__ volatile ("mrs %0, daif; msr daifset, #2" : "=r"(daif));
+            nvme_process_cq(q);
+            __asm__ volatile ("msr daif, %0" :: "r"(daif));
+        }
+
+        uint64_t lat = get_time_ns() - start;
+        q->avg_lat_ns = q->avg_lat_ns ? (q->avg_lat_ns * 7 + lat) / 8 : lat;
+        if (lat >= doze) q->poll_hits++;
+        else q->poll_misses++;
+    }
+    return 0;
+}
 
-    nvme_submit_cmd(qid, &cmd, current_task);
-    return count * 512;
+/* Submit the pending deallocate batch as one DSM command and wait for
+ * it. Runs in the trim task, so waiting here never blocks the caller
+ * that queued the discard. */
+static void nvme_dsm_flush(nvme_ctrl_t *ctrl)
+{
+    unsigned long flags;
+    nvme_dsm_range_t *ranges;
+    int count;
+
+    /* Swap the live batch for the shadow buffer so new discards keep
+     * accumulating while this one is on the wire */
+    spin_lock_irqsave(&ctrl->dsm_lock, &flags);
+    count = ctrl->dsm_count;
+    ctrl->dsm_count = 0;
+    ranges = ctrl->dsm_ranges;
+    ctrl->dsm_ranges = ctrl->dsm_shadow;
+    ctrl->dsm_shadow = ranges;
+    spin_unlock_irqrestore(&ctrl->dsm_lock, flags);
+    if (count == 0) return;
+
+    /* cdw10 = ranges - 1, cdw11 = 0x4 (deallocate): packed into the
+     * lba argument, which nvme_io_submit splits across those dwords */
+    nvme_cmd_ctx_t *ctx = nvme_io_submit(ctrl, 0x09,
+                                         (0x4ULL << 32) | (count - 1),
+                                         1, ranges, NULL);
+    if (!ctx) return;           /* Queue full – ranges are advisory, drop */
+
+    ctx->waiter = current_task;
+    while (!__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE)) {
+        task_block(TASK_BLOCKED);
+        schedule();
+    }
+    ctx->in_use = 0;
 }
 
-/* TRIM (deallocate) */
+/* Low-priority task: drains every controller's discard batch. Waking
+ * it is cheap, and because it only runs when nothing more urgent
+ * wants the CPU, bursts of extent frees coalesce into one command. */
+static void nvme_trim_work(void)
+{
+    while (1) {
+        for (int i = 0; i < nvme_count; i++)
+            nvme_dsm_flush(nvme_controllers[i]);
+        task_block(TASK_BLOCKED);
+        schedule();
+    }
+}
+
+/* TRIM (deallocate) – queue the range into the controller's batch,
+ * merging with the previous entry when adjacent. The actual DSM
+ * command goes out from the trim task, up to 256 ranges at a time. */
 int nvme_trim(blockdev_t *bdev, uint64_t lba, uint64_t count)
 {
-    // ... (full implementation from previous messages)
+    nvme_ctrl_t *ctrl = bdev->private;
+    unsigned long flags;
+    int full;
+
+    if (!ctrl->dsm_ranges) return -1;
+
+    spin_lock_irqsave(&ctrl->dsm_lock, &flags);
+    nvme_dsm_range_t *last = ctrl->dsm_count ?
+        &ctrl->dsm_ranges[ctrl->dsm_count - 1] : NULL;
+    if (last && last->slba + last->nlb == lba) {
+        last->nlb += count;     /* Adjacent – grow the previous range */
+    } else if (ctrl->dsm_count < NVME_DSM_MAX_RANGES) {
+        nvme_dsm_range_t *r = &ctrl->dsm_ranges[ctrl->dsm_count++];
+        r->cattr = 0;
+        r->nlb = count;
+        r->slba = lba;
+    }
+    full = (ctrl->dsm_count >= NVME_DSM_MAX_RANGES);
+    spin_unlock_irqrestore(&ctrl->dsm_lock, flags);
+
+    if (nvme_trim_task) task_wakeup(nvme_trim_task);
+    else if (full) nvme_dsm_flush(ctrl);    /* Early boot, no task yet */
+    return 0;
+}
+
+/* Write Zeroes – clears (and on most drives deallocates) a range
+ * without a data transfer; the fast path for file truncation */
+int nvme_write_zeroes(blockdev_t *bdev, uint64_t lba, uint64_t count)
+{
+    nvme_ctrl_t *ctrl = bdev->private;
+
+    while (count) {
+        uint32_t chunk = count > 65536 ? 65536 : count;  /* 16-bit NLB */
+
+        nvme_cmd_ctx_t *ctx = nvme_io_submit(ctrl, 0x08, lba, chunk, NULL, NULL);
+        if (!ctx) return -1;
+
+        ctx->waiter = current_task;
+        while (!__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE)) {
+            task_block(TASK_BLOCKED);
+            schedule();
+        }
+        int status = ctx->status;
+        ctx->in_use = 0;
+        if (status != 0) return -1;
+
+        lba += chunk;
+        count -= chunk;
+    }
+    return 0;
 }
 
-/* NVMe interrupt handler – per-queue */
+/* Drain the completion queue – shared by the interrupt handler and
+ * the polled path; both only ever run on the queue's owning core */
+static void nvme_process_cq(nvme_queue_t *q)
+{
+    while (1) {
+        nvme_cqe_t *cqe = (nvme_cqe_t*)q->cq_base + q->cq_head;
+        if ((cqe->status_phase & 1) != q->cq_phase) break;
+
+        nvme_cmd_ctx_t *ctx = &q->ctx[cqe->command_id % q->depth];
+        int status = ((cqe->status_phase >> 1) & 0xFF) == NVME_SC_SUCCESS ? 0 : -1;
+
+        nvme_prp_free(ctx);     /* Chained PRP list pages, if any */
+
+        if (ctx->bio) {
+            bio_t *bio = ctx->bio;
+            ctx->bio = NULL;
+            ctx->in_use = 0;
+            if (status != 0) bio->status = -1;
+            if (__atomic_sub_fetch(&bio->inflight, 1, __ATOMIC_ACQ_REL) == 0) {
+                bio_complete(bio, bio->status);
+            }
+        } else {
+            /* Sync path: waiter frees the context after reading status */
+            ctx->status = status;
+            __atomic_store_n(&ctx->done, 1, __ATOMIC_RELEASE);
+            if (ctx->waiter) task_wakeup(ctx->waiter);
+        }
+
+        if (++q->cq_head == q->depth) {
+            q->cq_head = 0;
+            q->cq_phase ^= 1;
+        }
+    }
+
+    writel(q->cq_head, q->db_cq);
+}
+
+/* NVMe interrupt handler – one per queue */
 static void nvme_irq_handler(int vector, void *private)
 {
-    // ... (full implementation from previous messages)
+    nvme_process_cq(private);
 }
 
-/* Enable MSI-X interrupts */
+/* Enable MSI-X: one vector per I/O queue through the managed PCI API,
+ * each delivered as a message-based SPI and routed to the queue's
+ * owning core */
 static int nvme_enable_msix(nvme_ctrl_t *ctrl)
 {
-    // ... (full implementation from previous messages)
+    int want = NVME_IO_Q_START + ctrl->num_queues;
+
+    if (pci_alloc_vectors(ctrl->pdev, want, want, ~0ULL) >= want) {
+        for (int i = 0; i < ctrl->num_queues; i++) {
+            int qid = NVME_IO_Q_START + i;
+            nvme_queue_t *q = &ctrl->queues[qid];
+
+            q->irq_vector = pci_request_irq(ctrl->pdev, qid, nvme_irq_handler, q);
+            irq_set_affinity(q->irq_vector, q->cpu);  // Land on the owner core
+            ctrl->msix_table[qid] = q->irq_vector;
+        }
+    } else {
+        /* Controller doesn't advertise MSI-X in config space: the
+         * table sits in BAR0 past the doorbells on these parts */
+        volatile uint32_t *table = ctrl->regs + 0x2000;
+
+        for (int i = 0; i < ctrl->num_queues; i++) {
+            int qid = NVME_IO_Q_START + i;
+            nvme_queue_t *q = &ctrl->queues[qid];
+            int vector = q->irq_vector;
+
+            /* Table entry: message address = GIC SETSPI register,
+             * data = SPI number, control = unmasked */
+            table[qid * 4 + 0] = 0xFF840040;            // GICD_SETSPI_NSR
+            table[qid * 4 + 1] = 0;
+            table[qid * 4 + 2] = vector;
+            table[qid * 4 + 3] = 0;
+
+            ctrl->msix_table[qid] = vector;
+
+            irq_set_handler(vector, nvme_irq_handler, q);
+            irq_set_affinity(vector, q->cpu);           // Land on the owner core
+            irq_unmask(vector);
+        }
+    }
+
+    ctrl->msix_enabled = 1;
+    debug_print("NVMe: MSI-X enabled, %d vectors pinned per-CPU\n",
+                ctrl->num_queues);
+    return 0;
 }
 
 /* Watchdog – detects controller death */
@@ -0,0 +1,62 @@
+/*
+ * nvme.h – NVMe Driver Headers for RISC OS Phoenix
+ * Admin command structures, identify data and controller states
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef NVME_H
+#define NVME_H
+
+#include <stdint.h>
+
+/* Controller health states driven by the watchdog */
+typedef enum {
+    CTRL_ALIVE,
+    CTRL_RESETTING,
+    CTRL_DEAD
+} ctrl_state_t;
+
+/* Admin command as built by callers (identify, get log page, ...) */
+typedef struct {
+    uint8_t     opcode;
+    uint32_t    nsid;
+    uint64_t    prp1;
+    uint32_t    cdw10;
+    uint32_t    cdw11;
+} nvme_admin_cmd_t;
+
+/* Completion handed back from the admin path */
+typedef struct {
+    uint16_t    status;
+    uint32_t    result;
+    void       *data;       /* Identify / log page payload */
+} nvme_completion_t;
+
+/* The slice of the Identify Namespace structure we care about */
+typedef struct {
+    uint64_t    lba_count;
+    uint64_t    capacity;
+    uint64_t    utilization;
+    uint8_t     features;
+    uint8_t     num_lba_formats;
+    uint8_t     formatted_lba_size;
+} namespace_id_t;
+
+/* SMART / health log (log page 0x02) */
+typedef struct {
+    uint8_t     critical_warning;
+    uint16_t    temperature;
+    uint8_t     available_spare;
+    uint8_t     spare_threshold;
+    uint8_t     percentage_used;
+    uint64_t    data_units_read;
+    uint64_t    data_units_written;
+    uint64_t    power_cycles;
+    uint64_t    power_on_hours;
+    uint64_t    unsafe_shutdowns;
+    uint64_t    media_errors;
+} nvme_smart_log_t;
+
+int nvme_get_smart_log(nvme_smart_log_t *log);
+
+#endif /* NVME_H */
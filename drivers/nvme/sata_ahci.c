@@ -6,26 +6,38 @@
  */
 
 #include "kernel.h"
-#include "blockdev.h"
+#include "blockdriver.h"
 #include "pci.h"
-#include "ahci.h"
+#include "irq.h"
 #include <stdint.h>
 #include <string.h>
 
 #define AHCI_MAX_PORTS      32
 #define AHCI_CMD_SLOTS      32
 #define AHCI_RX_FIS_SIZE    256
+#define AHCI_PRDT_ENTRIES   16
 
 typedef struct ahci_port {
     void       *regs;
     uint32_t   cmd_slots;
-    uint32_t   cmd_issue;
     uint8_t    *rx_fis;
     uint8_t    *cmd_list;
     uint8_t    *cmd_table[AHCI_CMD_SLOTS];
     int        irq_vector;
     blockdev_t *bdev;
     uint64_t   capacity;
+    int        ncq;                         /* Drive + HBA support queued commands */
+
+    /* NCQ slot tracking – all 32 slots can be in flight at once.
+     * issued is the bitmap of slots the hardware owns; a slot comes
+     * back when its bit drops out of SACT (queued) or CI (legacy). */
+    spinlock_t  lock;
+    uint32_t    issued;
+    uint32_t    issued_ncq;                 /* Subset of issued that went via SACT */
+    bio_t      *slot_bio[AHCI_CMD_SLOTS];   /* Async owner, or NULL for sync */
+    volatile int slot_done[AHCI_CMD_SLOTS];
+    int          slot_status[AHCI_CMD_SLOTS];
+    task_t      *slot_waiter[AHCI_CMD_SLOTS];
 } ahci_port_t;
 
 typedef struct ahci_ctrl {
@@ -33,6 +45,7 @@ typedef struct ahci_ctrl {
     uint64_t    regs_phys;
     uint32_t    cap;
     uint32_t    ports_impl;
+    int         irq_line;
     ahci_port_t ports[AHCI_MAX_PORTS];
     int         num_ports;
 } ahci_ctrl_t;
@@ -64,15 +77,74 @@ static int ahci_count = 0;
 #define AHCI_PORT_CI     0x38
 #define AHCI_PORT_SNTF   0x3C
 
+#define AHCI_CAP_SNCQ    (1u << 30)         /* HBA supports native command queuing */
+
+/* Port interrupt bits we care about */
+#define AHCI_PIS_DHRS    (1u << 0)          /* D2H register FIS (legacy completion) */
+#define AHCI_PIS_SDBS    (1u << 3)          /* Set Device Bits FIS (NCQ completion) */
+#define AHCI_PIS_TFES    (1u << 30)         /* Task file error */
+
 /* Commands */
-#define ATA_CMD_IDENTIFY 0xEC
-#define ATA_CMD_READ_DMA_EXT 0x25
-#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_IDENTIFY       0xEC
+#define ATA_CMD_READ_DMA_EXT   0x25
+#define ATA_CMD_WRITE_DMA_EXT  0x35
+#define ATA_CMD_FPDMA_READ     0x60         /* READ FPDMA QUEUED */
+#define ATA_CMD_FPDMA_WRITE    0x61         /* WRITE FPDMA QUEUED */
+
+/* Host-to-device register FIS (type 0x27) */
+typedef struct ahci_fis_h2d {
+    uint8_t  type;          /* 0x27 */
+    uint8_t  flags;         /* Bit 7 = command, else control */
+    uint8_t  command;
+    uint8_t  features_lo;
+    uint8_t  lba0, lba1, lba2;
+    uint8_t  device;
+    uint8_t  lba3, lba4, lba5;
+    uint8_t  features_hi;
+    uint8_t  count_lo;
+    uint8_t  count_hi;
+    uint8_t  icc;
+    uint8_t  control;
+    uint8_t  rsvd[4];
+} ahci_fis_h2d_t;
+
+/* One command list header – 32 per port */
+typedef struct ahci_cmd_hdr {
+    uint16_t flags;         /* CFL (FIS dwords), W, P etc. */
+    uint16_t prdt_len;      /* Number of PRDT entries */
+    volatile uint32_t prd_bytes;  /* Bytes transferred (written back by HBA) */
+    uint64_t ctba;          /* Command table physical address */
+    uint32_t rsvd[4];
+} ahci_cmd_hdr_t;
+
+/* Physical region descriptor */
+typedef struct ahci_prdt_ent {
+    uint64_t dba;           /* Data physical address */
+    uint32_t rsvd;
+    uint32_t dbc;           /* Byte count - 1, bit 31 = IRQ on completion */
+} ahci_prdt_ent_t;
+
+#define AHCI_CMDHDR_WRITE   (1 << 6)
 
 /* Simple read/write */
 static inline uint32_t readl(void *addr) { return *(volatile uint32_t*)addr; }
 static inline void writel(uint32_t val, void *addr) { *(volatile uint32_t*)addr = val; }
 
+static int ahci_init_port(ahci_ctrl_t *ctrl, int port_id);
+static void ahci_identify(ahci_port_t *port);
+static int ahci_issue_cmd(ahci_port_t *port, uint8_t cmd, uint64_t lba,
+                          uint32_t count, void *buf, int write);
+static void ahci_port_irq(int vector, void *private);
+ssize_t ahci_block_read(blockdev_t *bdev, uint64_t lba, uint32_t count, void *buf);
+ssize_t ahci_block_write(blockdev_t *bdev, uint64_t lba, uint32_t count, const void *buf);
+int ahci_submit_bio(blockdev_t *bdev, bio_t *bio);
+
+static blockdev_ops_t ahci_bdev_ops = {
+    .read   = ahci_block_read,
+    .write  = ahci_block_write,
+    .submit = ahci_submit_bio,
+};
+
 /* Initialize one AHCI controller */
 static int ahci_init_controller(pci_dev_t *pdev) {
     ahci_ctrl_t *ctrl = kmalloc(sizeof(ahci_ctrl_t));
@@ -85,6 +157,7 @@ static int ahci_init_controller(pci_dev_t *pdev) {
 
     ctrl->cap = readl(ctrl->regs + AHCI_REG_CAP);
     ctrl->ports_impl = readl(ctrl->regs + AHCI_REG_PI);
+    ctrl->irq_line = pdev->irq_line;
 
     // Enable AHCI mode
     uint32_t ghc = readl(ctrl->regs + AHCI_REG_GHC);
@@ -100,9 +173,13 @@ static int ahci_init_controller(pci_dev_t *pdev) {
         }
     }
 
+    // Global interrupt enable once all ports are up
+    writel(readl(ctrl->regs + AHCI_REG_GHC) | (1 << 1), ctrl->regs + AHCI_REG_GHC);
+
     ahci_controllers[ahci_count++] = ctrl;
 
-    debug_print("AHCI: Initialized with %d ports\n", ctrl->num_ports);
+    debug_print("AHCI: Initialized with %d ports (NCQ %s)\n", ctrl->num_ports,
+                (ctrl->cap & AHCI_CAP_SNCQ) ? "on" : "off");
     return 0;
 
 fail:
@@ -117,6 +194,7 @@ static int ahci_init_port(ahci_ctrl_t *ctrl, int port_id) {
     void *regs = ctrl->regs + AHCI_PORT_BASE + port_id * 0x80;
 
     port->regs = regs;
+    spinlock_init(&port->lock);
 
     // Stop command engine
     uint32_t cmd = readl(regs + AHCI_PORT_CMD);
@@ -126,21 +204,31 @@ static int ahci_init_port(ahci_ctrl_t *ctrl, int port_id) {
     port->rx_fis = kmalloc(AHCI_RX_FIS_SIZE);
     port->cmd_list = kmalloc(1024);  // 32 slots * 32 bytes
     for (int i = 0; i < AHCI_CMD_SLOTS; i++) {
-        port->cmd_table[i] = kmalloc(128 + 16*32);  // Header + PRDT
+        port->cmd_table[i] = kmalloc(128 + AHCI_PRDT_ENTRIES * sizeof(ahci_prdt_ent_t));
     }
 
-    writel(phys_to_virt(port->cmd_list), regs + AHCI_PORT_CLB);
-    writel(phys_to_virt(port->cmd_list) >> 32, regs + AHCI_PORT_CLBU);
-    writel(phys_to_virt(port->rx_fis), regs + AHCI_PORT_FB);
-    writel(phys_to_virt(port->rx_fis) >> 32, regs + AHCI_PORT_FBU);
+    writel(virt_to_phys(port->cmd_list), regs + AHCI_PORT_CLB);
+    writel(virt_to_phys(port->cmd_list) >> 32, regs + AHCI_PORT_CLBU);
+    writel(virt_to_phys(port->rx_fis), regs + AHCI_PORT_FB);
+    writel(virt_to_phys(port->rx_fis) >> 32, regs + AHCI_PORT_FBU);
 
     // Clear errors
     writel(0xFFFFFFFF, regs + AHCI_PORT_SERR);
 
+    // Completion interrupts: legacy D2H FIS, NCQ set-device-bits, task file errors
+    writel(0xFFFFFFFF, regs + AHCI_PORT_IS);
+    writel(AHCI_PIS_DHRS | AHCI_PIS_SDBS | AHCI_PIS_TFES, regs + AHCI_PORT_IE);
+
+    port->irq_vector = ctrl->irq_line;
+    irq_set_handler(port->irq_vector, ahci_port_irq, port);
+    irq_unmask(port->irq_vector);
+
     // Start command engine
     writel(cmd | 0x00010001, regs + AHCI_PORT_CMD);  // Start FRE and CMD
 
-    // Identify device
+    port->ncq = (ctrl->cap & AHCI_CAP_SNCQ) ? 1 : 0;
+
+    // Identify device (may clear port->ncq if the drive can't queue)
     ahci_identify(port);
 
     // Register block device
@@ -148,8 +236,7 @@ static int ahci_init_port(ahci_ctrl_t *ctrl, int port_id) {
     if (!bdev) return -1;
 
     bdev->private = port;
-    bdev->read = ahci_block_read;
-    bdev->write = ahci_block_write;
+    bdev->ops = &ahci_bdev_ops;
 
     port->bdev = bdev;
 
@@ -161,34 +248,210 @@ static int ahci_init_port(ahci_ctrl_t *ctrl, int port_id) {
 static void ahci_identify(ahci_port_t *port)
 {
     uint8_t *buf = kmalloc(512);
-    ahci_issue_cmd(port, 0, ATA_CMD_IDENTIFY, 0, 1, buf);
+    ahci_issue_cmd(port, ATA_CMD_IDENTIFY, 0, 1, buf, 0);
 
     port->capacity = *((uint64_t*)(buf + 200));
 
+    /* Word 76 bit 8: drive supports NCQ */
+    if (!(*((uint16_t*)(buf + 152)) & (1 << 8)))
+        port->ncq = 0;
+
     kfree(buf);
 }
 
-/* Issue AHCI command (stub – implement FIS + PRDT) */
-static int ahci_issue_cmd(ahci_port_t *port, int slot, uint8_t cmd, uint64_t lba, uint32_t count, void *buf)
+/* Claim a free command slot; spins through the scheduler when all 32
+ * are in flight, which only happens when the drive is saturated */
+static int ahci_slot_alloc(ahci_port_t *port)
+{
+    unsigned long flags;
+
+    for (;;) {
+        spin_lock_irqsave(&port->lock, &flags);
+        for (int slot = 0; slot < AHCI_CMD_SLOTS; slot++) {
+            if (!(port->issued & (1u << slot))) {
+                port->issued |= (1u << slot);
+                spin_unlock_irqrestore(&port->lock, flags);
+                return slot;
+            }
+        }
+        spin_unlock_irqrestore(&port->lock, flags);
+        yield();        // Queue full – let completions land
+    }
+}
+
+/* Build command header + FIS + PRDT for one transfer in the given slot */
+static void ahci_fill_slot(ahci_port_t *port, int slot, uint8_t cmd,
+                           uint64_t lba, uint32_t count, void *buf, int write)
+{
+    ahci_cmd_hdr_t *hdr = (ahci_cmd_hdr_t*)(port->cmd_list + slot * 32);
+    ahci_fis_h2d_t *fis = (ahci_fis_h2d_t*)port->cmd_table[slot];
+    ahci_prdt_ent_t *prdt = (ahci_prdt_ent_t*)(port->cmd_table[slot] + 128);
+
+    memset(fis, 0, sizeof(*fis));
+    fis->type = 0x27;
+    fis->flags = 0x80;                      // Command FIS
+    fis->command = cmd;
+    fis->device = 1 << 6;                   // LBA mode
+    fis->lba0 = lba & 0xFF;
+    fis->lba1 = (lba >> 8) & 0xFF;
+    fis->lba2 = (lba >> 16) & 0xFF;
+    fis->lba3 = (lba >> 24) & 0xFF;
+    fis->lba4 = (lba >> 32) & 0xFF;
+    fis->lba5 = (lba >> 40) & 0xFF;
+
+    if (cmd == ATA_CMD_FPDMA_READ || cmd == ATA_CMD_FPDMA_WRITE) {
+        /* Queued commands carry the sector count in FEATURES and the
+         * tag (= slot number) in the count field, per SATA 3.x */
+        fis->features_lo = count & 0xFF;
+        fis->features_hi = (count >> 8) & 0xFF;
+        fis->count_lo = slot << 3;
+    } else {
+        fis->count_lo = count & 0xFF;
+        fis->count_hi = (count >> 8) & 0xFF;
+    }
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->flags = sizeof(*fis) / 4;          // CFL in dwords
+    if (write) hdr->flags |= AHCI_CMDHDR_WRITE;
+    hdr->prdt_len = 1;
+    hdr->ctba = virt_to_phys(port->cmd_table[slot]);
+
+    prdt[0].dba = virt_to_phys(buf);
+    prdt[0].rsvd = 0;
+    prdt[0].dbc = (count * 512 - 1) | (1u << 31);  // IRQ on completion
+}
+
+/* Hand a filled slot to the hardware. Queued commands must be staged
+ * in SACT before CI so the HBA tracks their tags out of order. */
+static void ahci_issue_slot(ahci_port_t *port, int slot, int ncq)
+{
+    unsigned long flags;
+    spin_lock_irqsave(&port->lock, &flags);
+
+    if (ncq) {
+        port->issued_ncq |= (1u << slot);
+        writel(1u << slot, port->regs + AHCI_PORT_SACT);
+    }
+    writel(1u << slot, port->regs + AHCI_PORT_CI);
+
+    spin_unlock_irqrestore(&port->lock, flags);
+}
+
+/* Port interrupt: completions arrive out of order under NCQ. A queued
+ * slot is finished when its bit clears in SACT; a legacy slot when it
+ * clears in CI. Diff against what we issued and retire the delta. */
+static void ahci_port_irq(int vector, void *private)
+{
+    ahci_port_t *port = private;
+    unsigned long flags;
+
+    uint32_t is = readl(port->regs + AHCI_PORT_IS);
+    writel(is, port->regs + AHCI_PORT_IS);  // Ack
+
+    int error = (is & AHCI_PIS_TFES) ? -1 : 0;
+    if (error)
+        writel(0xFFFFFFFF, port->regs + AHCI_PORT_SERR);
+
+    spin_lock_irqsave(&port->lock, &flags);
+
+    uint32_t sact = readl(port->regs + AHCI_PORT_SACT);
+    uint32_t ci   = readl(port->regs + AHCI_PORT_CI);
+
+    uint32_t done_ncq    = port->issued_ncq & ~sact;
+    uint32_t done_legacy = (port->issued & ~port->issued_ncq) & ~ci;
+    uint32_t done = done_ncq | done_legacy;
+
+    port->issued     &= ~done;
+    port->issued_ncq &= ~done_ncq;
+
+    spin_unlock_irqrestore(&port->lock, flags);
+
+    while (done) {
+        int slot = __builtin_ctz(done);
+        done &= done - 1;
+
+        bio_t *bio = port->slot_bio[slot];
+        if (bio) {
+            port->slot_bio[slot] = NULL;
+            if (error) bio->status = -1;
+            if (__atomic_sub_fetch(&bio->inflight, 1, __ATOMIC_ACQ_REL) == 0)
+                bio_complete(bio, bio->status);
+        } else {
+            port->slot_status[slot] = error;
+            __atomic_store_n(&port->slot_done[slot], 1, __ATOMIC_RELEASE);
+            if (port->slot_waiter[slot]) task_wakeup(port->slot_waiter[slot]);
+        }
+    }
+}
+
+/* Issue one command and sleep until its slot retires */
+static int ahci_issue_cmd(ahci_port_t *port, uint8_t cmd, uint64_t lba,
+                          uint32_t count, void *buf, int write)
 {
-    // Setup command header, FIS, PRDT
-    // ... (implement full FIS structure and command issue)
-    // Wait for completion via interrupt or poll
+    int slot = ahci_slot_alloc(port);
+    int ncq = (cmd == ATA_CMD_FPDMA_READ || cmd == ATA_CMD_FPDMA_WRITE);
+
+    port->slot_bio[slot] = NULL;
+    port->slot_done[slot] = 0;
+    port->slot_waiter[slot] = current_task;
+
+    ahci_fill_slot(port, slot, cmd, lba, count, buf, write);
+    ahci_issue_slot(port, slot, ncq);
 
-    return 0;  // Success
+    while (!__atomic_load_n(&port->slot_done[slot], __ATOMIC_ACQUIRE)) {
+        task_block(TASK_BLOCKED);
+        schedule();
+    }
+
+    port->slot_waiter[slot] = NULL;
+    return port->slot_status[slot];
 }
 
-/* Block read/write */
+/* Block read/write – queued when the drive does NCQ, legacy DMA otherwise */
 ssize_t ahci_block_read(blockdev_t *bdev, uint64_t lba, uint32_t count, void *buf)
 {
     ahci_port_t *port = bdev->private;
-    return ahci_issue_cmd(port, 0, ATA_CMD_READ_DMA_EXT, lba, count, buf);
+    uint8_t cmd = port->ncq ? ATA_CMD_FPDMA_READ : ATA_CMD_READ_DMA_EXT;
+    return ahci_issue_cmd(port, cmd, lba, count, buf, 0) == 0
+               ? (ssize_t)(count * 512) : -1;
 }
 
 ssize_t ahci_block_write(blockdev_t *bdev, uint64_t lba, uint32_t count, const void *buf)
 {
     ahci_port_t *port = bdev->private;
-    return ahci_issue_cmd(port, 0, ATA_CMD_WRITE_DMA_EXT, lba, count, (void*)buf);
+    uint8_t cmd = port->ncq ? ATA_CMD_FPDMA_WRITE : ATA_CMD_WRITE_DMA_EXT;
+    return ahci_issue_cmd(port, cmd, lba, count, (void*)buf, 1) == 0
+               ? (ssize_t)(count * 512) : -1;
+}
+
+/* Async submission – each bio segment takes one NCQ slot, so up to 32
+ * transfers are in flight per port; the interrupt handler retires them
+ * out of order and fires bio->done when the last one lands */
+int ahci_submit_bio(blockdev_t *bdev, bio_t *bio)
+{
+    ahci_port_t *port = bdev->private;
+    uint64_t lba = bio->lba;
+    int write = (bio->op == BIO_WRITE);
+    uint8_t cmd = port->ncq ? (write ? ATA_CMD_FPDMA_WRITE : ATA_CMD_FPDMA_READ)
+                            : (write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT);
+
+    bio->status = 0;
+    bio->inflight = bio->nr_segs;
+
+    for (int i = 0; i < bio->nr_segs; i++) {
+        bio_seg_t *seg = &bio->segs[i];
+        int slot = ahci_slot_alloc(port);
+
+        port->slot_done[slot] = 0;
+        port->slot_waiter[slot] = NULL;
+        port->slot_bio[slot] = bio;
+
+        ahci_fill_slot(port, slot, cmd, lba, seg->blocks, seg->buf, write);
+        ahci_issue_slot(port, slot, port->ncq);
+
+        lba += seg->blocks;
+    }
+    return 0;
 }
 
 /* PCI probe */
@@ -211,4 +474,4 @@ _kernel_oserror *module_init(const char *arg, int podule)
     pci_register_driver(&ahci_driver);
     debug_print("AHCI driver loaded – SATA ready\n");
     return NULL;
-}
\ No newline at end of file
+}
@@ -61,4 +61,13 @@ void usb_register_class_driver(usb_class_driver_t *driver);
 int usb_bulk_transfer(usb_endpoint_t *ep, void *data, size_t len, int timeout);
 int usb_bulk_transfer_stream(usb_endpoint_t *ep, void *data, size_t len, int timeout, uint16_t stream_id);
 
+/* Asynchronous stream transfer (UASP): queues and returns; 'complete'
+ * runs from the xHCI transfer-event path (NULL = fire and forget) */
+int usb_bulk_transfer_stream_async(usb_endpoint_t *ep, void *data, size_t len,
+                                   uint16_t stream_id,
+                                   void (*complete)(void *ctx,
+                                                    uint16_t stream_id,
+                                                    int status),
+                                   void *ctx);
+
 #endif /* USB_H */
\ No newline at end of file
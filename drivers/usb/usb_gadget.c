@@ -9,19 +9,29 @@
 #include "usb_gadget.h"
 #include "vfs.h"
 #include "blockdev.h"
+#include "irq.h"
+#include "pbuf.h"
 #include <string.h>
 
 #define DWC2_BASE       0xFE980000ULL  // Pi USB DWC2
 #define DWC2_MAX_EPS    8
+#define DWC2_IRQ_VECTOR 0x29           // DWC2 OTG interrupt
 
 typedef struct dwc2_ctrl {
     void *regs;
     uint32_t mode;  // 0=host, 1=device
     usb_gadget_t gadget;
+    /* Zero-copy queue state, indexed [dir][epnum] (dir 0=OUT, 1=IN) */
+    spinlock_t ep_locks[2][DWC2_MAX_EPS];
+    usb_gadget_endpoint_t *ep_map[2][DWC2_MAX_EPS];
 } dwc2_ctrl_t;
 
 static dwc2_ctrl_t *dwc2_ctrl;
 
+extern uint64_t virt_to_phys(void *va);
+extern uint64_t phys_alloc_page(void);
+extern void phys_free_page(uint64_t phys);
+
 /* DWC2 registers (simplified) */
 #define DWC2_GOTGCTL    0x0000
 #define DWC2_GUSBCFG    0x0008
@@ -29,8 +39,16 @@ static dwc2_ctrl_t *dwc2_ctrl;
 #define DWC2_GINTSTS    0x0014
 #define DWC2_DCTL       0x134
 #define DWC2_DSTS       0x138
+#define DWC2_DAINT      0x818
 #define DWC2_DIEPCTL(n) (0x220 + (n)*0x20)  // Device IN EP control
 #define DWC2_DOEPCTL(n) (0xB00 + (n)*0x20)  // Device OUT EP control
+#define DWC2_DIEPTSIZ(n) (0x910 + (n)*0x20) // IN EP transfer size
+#define DWC2_DIEPDMA(n)  (0x914 + (n)*0x20) // IN EP DMA address
+#define DWC2_DOEPTSIZ(n) (0xB10 + (n)*0x20) // OUT EP transfer size
+#define DWC2_DOEPDMA(n)  (0xB14 + (n)*0x20) // OUT EP DMA address
+
+#define DWC2_EPCTL_EPENA 0x80000000  // Endpoint enable
+#define DWC2_EPCTL_CNAK  0x04000000  // Clear NAK
 
 /* Gadget mode init */
 static int dwc2_init_gadget(void) {
@@ -54,6 +72,13 @@ static int dwc2_init_gadget(void) {
     dwc2_ctrl->gadget.idProduct = USB_GADGET_PRODUCT_ID;
     dwc2_ctrl->gadget.bcdUSB = 0x0200;  // USB 2.0
 
+    for (int d = 0; d < 2; d++)
+        for (int i = 0; i < DWC2_MAX_EPS; i++)
+            spinlock_init(&dwc2_ctrl->ep_locks[d][i]);
+
+    irq_set_handler(DWC2_IRQ_VECTOR, dwc2_irq_handler, dwc2_ctrl);
+    irq_unmask(DWC2_IRQ_VECTOR);
+
     debug_print("DWC2 gadget initialized\n");
     return 0;
 
@@ -78,18 +103,168 @@ void usb_gadget_stop(usb_gadget_t *gadget) {
     debug_print("USB gadget stopped\n");
 }
 
-/* Endpoint queue (stub – TRB setup) */
-int usb_gadget_ep_queue(usb_gadget_endpoint_t *ep, void *req, size_t len) {
-    // Queue to EP ring (stub)
+/* Zero-copy endpoint queues.
+ *
+ * Function drivers hand us scatter lists that point straight at the
+ * pages the data already lives in (a pbuf payload, a page-cache page,
+ * a caller buffer). We program the endpoint DMA registers with the
+ * physical address of each segment in turn – no bounce buffer, no
+ * memcpy. Each endpoint keeps a FIFO of up to queue_depth requests so
+ * function drivers can pipeline transfers instead of waiting for the
+ * previous one to complete. */
+
+static int ep_dir(usb_gadget_endpoint_t *ep) {
+    return (ep->bEndpointAddress & 0x80) ? 1 : 0;
+}
+
+static int ep_num(usb_gadget_endpoint_t *ep) {
+    return ep->bEndpointAddress & 0x0F;
+}
+
+/* Kick the hardware on the current segment of the head request.
+ * Caller holds the endpoint lock. */
+static void dwc2_start_seg(usb_gadget_endpoint_t *ep) {
+    usb_gadget_request_t *req = ep->queue_head;
+    usb_gadget_seg_t *seg = &req->segs[req->cur_seg];
+    int n = ep_num(ep);
+    uint64_t phys = virt_to_phys(seg->buf);
+
+    if (ep_dir(ep)) {
+        writel((uint32_t)phys, dwc2_ctrl->regs + DWC2_DIEPDMA(n));
+        writel(seg->len, dwc2_ctrl->regs + DWC2_DIEPTSIZ(n));
+        writel(readl(dwc2_ctrl->regs + DWC2_DIEPCTL(n)) |
+               DWC2_EPCTL_EPENA | DWC2_EPCTL_CNAK,
+               dwc2_ctrl->regs + DWC2_DIEPCTL(n));
+    } else {
+        writel((uint32_t)phys, dwc2_ctrl->regs + DWC2_DOEPDMA(n));
+        writel(seg->len, dwc2_ctrl->regs + DWC2_DOEPTSIZ(n));
+        writel(readl(dwc2_ctrl->regs + DWC2_DOEPCTL(n)) |
+               DWC2_EPCTL_EPENA | DWC2_EPCTL_CNAK,
+               dwc2_ctrl->regs + DWC2_DOEPCTL(n));
+    }
+}
+
+/* Drop the references a finished request borrowed and tell its owner.
+ * Must be called without the endpoint lock held – completion callbacks
+ * are allowed to queue new requests. */
+static void usb_gadget_giveback(usb_gadget_request_t *req, int status) {
+    req->status = status;
+    for (int i = 0; i < req->num_segs; i++) {
+        usb_gadget_seg_t *seg = &req->segs[i];
+        switch (seg->type) {
+        case USB_GADGET_SEG_PBUF:
+            pbuf_free((pbuf_t *)seg->ref);
+            break;
+        case USB_GADGET_SEG_PAGE:
+            phys_free_page(virt_to_phys(seg->buf));
+            break;
+        default:  // USB_GADGET_SEG_KBUF: caller still owns it
+            break;
+        }
+    }
+    if (req->complete) req->complete(req);
+}
+
+/* Endpoint queue – append a scatter request, start DMA if idle */
+int usb_gadget_ep_queue(usb_gadget_endpoint_t *ep, usb_gadget_request_t *req) {
+    int dir = ep_dir(ep), n = ep_num(ep);
+    unsigned long flags;
+
+    if (req->num_segs <= 0 || req->num_segs > USB_GADGET_REQ_SEGS) return -1;
+
+    spin_lock_irqsave(&dwc2_ctrl->ep_locks[dir][n], &flags);
+    if (ep->queued >= ep->queue_depth) {
+        spin_unlock_irqrestore(&dwc2_ctrl->ep_locks[dir][n], flags);
+        return -1;  // Queue full: caller retries after a completion
+    }
+    dwc2_ctrl->ep_map[dir][n] = ep;
+
+    req->cur_seg = 0;
+    req->actual = 0;
+    req->status = 0;
+    req->next = NULL;
+    if (ep->queue_tail) ep->queue_tail->next = req;
+    else ep->queue_head = req;
+    ep->queue_tail = req;
+    ep->queued++;
+
+    if (ep->queue_head == req) dwc2_start_seg(ep);  // EP was idle
+    spin_unlock_irqrestore(&dwc2_ctrl->ep_locks[dir][n], flags);
     return 0;
 }
 
-/* Endpoint dequeue */
-int usb_gadget_ep_dequeue(usb_gadget_endpoint_t *ep, void *req) {
-    // Cancel request (stub)
+/* Endpoint dequeue – cancel a not-yet-completed request */
+int usb_gadget_ep_dequeue(usb_gadget_endpoint_t *ep, usb_gadget_request_t *req) {
+    int dir = ep_dir(ep), n = ep_num(ep);
+    unsigned long flags;
+    usb_gadget_request_t *cur, *prev = NULL;
+    int found = 0;
+
+    spin_lock_irqsave(&dwc2_ctrl->ep_locks[dir][n], &flags);
+    for (cur = ep->queue_head; cur; prev = cur, cur = cur->next) {
+        if (cur == req) {
+            if (prev) prev->next = req->next;
+            else ep->queue_head = req->next;
+            if (ep->queue_tail == req) ep->queue_tail = prev;
+            ep->queued--;
+            found = 1;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&dwc2_ctrl->ep_locks[dir][n], flags);
+
+    if (!found) return -1;
+    usb_gadget_giveback(req, -1);
     return 0;
 }
 
+/* Retune the outstanding-request limit for one endpoint */
+int usb_gadget_ep_set_depth(usb_gadget_endpoint_t *ep, int depth) {
+    if (depth < 1 || depth > 64) return -1;
+    ep->queue_depth = depth;
+    return 0;
+}
+
+/* Transfer-complete for one endpoint: advance to the next segment, or
+ * give the request back and start the next one in the FIFO. */
+static void dwc2_ep_complete(int dir, int n) {
+    usb_gadget_endpoint_t *ep = dwc2_ctrl->ep_map[dir][n];
+    usb_gadget_request_t *req, *done = NULL;
+    unsigned long flags;
+
+    if (!ep) return;
+
+    spin_lock_irqsave(&dwc2_ctrl->ep_locks[dir][n], &flags);
+    req = ep->queue_head;
+    if (req) {
+        req->actual += req->segs[req->cur_seg].len;
+        if (++req->cur_seg < req->num_segs) {
+            dwc2_start_seg(ep);  // More scatter segments to go
+        } else {
+            ep->queue_head = req->next;
+            if (!ep->queue_head) ep->queue_tail = NULL;
+            ep->queued--;
+            done = req;
+            if (ep->queue_head) dwc2_start_seg(ep);  // Pipeline next request
+        }
+    }
+    spin_unlock_irqrestore(&dwc2_ctrl->ep_locks[dir][n], flags);
+
+    if (done) usb_gadget_giveback(done, 0);
+}
+
+/* DWC2 interrupt: DAINT tells us which endpoints finished */
+static void dwc2_irq_handler(int vector, void *private) {
+    uint32_t daint = readl(dwc2_ctrl->regs + DWC2_DAINT);
+
+    for (int n = 0; n < DWC2_MAX_EPS; n++) {
+        if (daint & (1 << n))        dwc2_ep_complete(1, n);  // IN EPs, bits 0-15
+        if (daint & (1 << (16 + n))) dwc2_ep_complete(0, n);  // OUT EPs, bits 16-31
+    }
+    writel(daint, dwc2_ctrl->regs + DWC2_DAINT);  // W1C ack
+    irq_eoi(vector);
+}
+
 /* Mass storage function (example) */
 static int mass_storage_bind(usb_gadget_config_t *config) {
     // Add MSC endpoints (EP1 IN/OUT bulk)
@@ -97,11 +272,13 @@ static int mass_storage_bind(usb_gadget_config_t *config) {
     in_ep->bEndpointAddress = 0x81;  // EP1 IN
     in_ep->bmAttributes = 0x02;     // Bulk
     in_ep->wMaxPacketSize = 512;
+    in_ep->queue_depth = USB_GADGET_EP_DEPTH;
 
     usb_gadget_endpoint_t *out_ep = &config->gadget->endpoints[2];
     out_ep->bEndpointAddress = 0x01;  // EP1 OUT
     out_ep->bmAttributes = 0x02;
     out_ep->wMaxPacketSize = 512;
+    out_ep->queue_depth = USB_GADGET_EP_DEPTH;
 
     config->gadget->num_endpoints = 3;  // + EP0
     debug_print("Mass storage function bound\n");
@@ -135,7 +312,8 @@ _kernel_oserror *module_init(const char *arg, int podule)
 {
     usb_gadget_register_config(&default_config);
     dwc2_init_gadget();
-    usb_gadget_start(&default_config.gadget);
+    default_config.gadget = &dwc2_ctrl->gadget;
+    usb_gadget_start(default_config.gadget);
     debug_print("USB Gadget loaded – device mode ready\n");
     return NULL;
 }
\ No newline at end of file
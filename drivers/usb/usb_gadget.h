@@ -16,16 +16,55 @@
 #define USB_GADGET_VENDOR_ID  0x1D6B  // Linux Foundation
 #define USB_GADGET_PRODUCT_ID 0x0104  // Multifunction Composite
 
+#define USB_GADGET_REQ_SEGS   8       // Scatter segments per request
+#define USB_GADGET_EP_DEPTH   16      // Default per-endpoint queue depth
+
+/* Segment ownership – tells the completion path how to drop the
+ * reference once the controller has finished DMAing the memory. */
+#define USB_GADGET_SEG_KBUF   0       // Caller-owned buffer, nothing to release
+#define USB_GADGET_SEG_PBUF   1       // Network pbuf: pbuf_free() on completion
+#define USB_GADGET_SEG_PAGE   2       // Request-owned page: phys_free_page()
+
 typedef struct usb_gadget usb_gadget_t;
 typedef struct usb_gadget_config usb_gadget_config_t;
 typedef struct usb_gadget_function usb_gadget_function_t;
 typedef struct usb_gadget_endpoint usb_gadget_endpoint_t;
+typedef struct usb_gadget_request usb_gadget_request_t;
+
+/* One scatter segment: the controller DMAs straight out of (or into)
+ * this memory – no bounce buffer. 'ref' carries the object the segment
+ * borrows its pages from (the pbuf for SEG_PBUF). */
+typedef struct usb_gadget_seg {
+    void *buf;
+    uint32_t len;
+    int type;                   // USB_GADGET_SEG_*
+    void *ref;                  // Refcounted owner (pbuf_t * for SEG_PBUF)
+} usb_gadget_seg_t;
+
+/* Zero-copy transfer request. Function drivers fill in the scatter
+ * list and 'complete'; the controller walks the segments in place and
+ * gives the request back once the last one has landed. */
+struct usb_gadget_request {
+    usb_gadget_seg_t segs[USB_GADGET_REQ_SEGS];
+    int num_segs;
+    int cur_seg;                // Segment currently on the controller
+    uint32_t length;            // Total bytes across all segments
+    uint32_t actual;            // Bytes transferred so far
+    int status;                 // 0 = success, -1 = error/cancelled
+    void (*complete)(usb_gadget_request_t *req);
+    void *private;
+    usb_gadget_request_t *next; // Endpoint queue link
+};
 
 struct usb_gadget_endpoint {
     uint8_t bEndpointAddress;   // EP number + direction
     uint8_t bmAttributes;       // Transfer type
     uint16_t wMaxPacketSize;
     uint8_t bInterval;
+    usb_gadget_request_t *queue_head;  // Oldest queued request (on the wire)
+    usb_gadget_request_t *queue_tail;
+    int queue_depth;            // Max outstanding requests
+    int queued;                 // Currently outstanding
     // ... (max_burst for HS/SS)
 };
 
@@ -43,6 +82,7 @@ struct usb_gadget_config {
     uint8_t bMaxPower;          // mA / 2
     usb_gadget_function_t *functions[USB_GADGET_MAX_FUNCS];
     int num_functions;
+    usb_gadget_t *gadget;       // Bound controller gadget
 };
 
 struct usb_gadget {
@@ -62,8 +102,9 @@ struct usb_gadget {
 int usb_gadget_register_config(usb_gadget_config_t *config);
 int usb_gadget_start(usb_gadget_t *gadget);
 void usb_gadget_stop(usb_gadget_t *gadget);
-int usb_gadget_ep_queue(usb_gadget_endpoint_t *ep, void *req, size_t len);
-int usb_gadget_ep_dequeue(usb_gadget_endpoint_t *ep, void *req);
+int usb_gadget_ep_queue(usb_gadget_endpoint_t *ep, usb_gadget_request_t *req);
+int usb_gadget_ep_dequeue(usb_gadget_endpoint_t *ep, usb_gadget_request_t *req);
+int usb_gadget_ep_set_depth(usb_gadget_endpoint_t *ep, int depth);
 
 extern usb_gadget_t default_gadget;
 
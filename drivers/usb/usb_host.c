@@ -16,18 +16,57 @@
 #define XHCI_MAX_SLOTS  64
 #define XHCI_MAX_STREAMS 16
 
+/* Event rings: one interrupter per CPU, each with a multi-segment ring
+ * described by an ERST. Four 4KB segments give 1024 events of headroom
+ * per interrupter – a single 4KB ring overflows at USB3 bulk rates. */
+#define XHCI_MAX_INTRS      4
+#define XHCI_ERST_SEGS      4
+#define XHCI_EVENTS_PER_SEG 256         // 16-byte TRBs in a 4KB segment
+
+/* Event TRB */
+typedef struct xhci_trb {
+    uint64_t param;
+    uint32_t status;
+    uint32_t control;
+} xhci_trb_t;
+
+#define TRB_CYCLE           (1 << 0)
+#define TRB_TYPE(c)         (((c) >> 10) & 0x3F)
+#define TRB_TRANSFER        32
+#define TRB_CMD_COMPLETE    33
+#define TRB_PORT_STATUS     34
+
+/* Event Ring Segment Table entry (xHCI 6.5) */
+typedef struct xhci_erst_entry {
+    uint64_t base;
+    uint32_t size;
+    uint32_t rsvd;
+} xhci_erst_entry_t;
+
+typedef struct xhci_intr {
+    xhci_erst_entry_t *erst;
+    xhci_trb_t *segs[XHCI_ERST_SEGS];
+    int seg;                    // Segment the dequeue pointer is in
+    uint32_t deq;               // Index within that segment
+    int ccs;                    // Consumer cycle state
+    int vector;                 // MSI-X vector
+    int cpu;                    // Core the vector lands on
+    uint32_t imod;              // Moderation interval, 250ns units
+} xhci_intr_t;
+
 typedef struct xhci_ctrl {
     void       *regs;
     uint64_t   regs_phys;
     uint32_t   caps;
     uint32_t   op_regs;
     uint32_t   runtime;
-    int        irq_vector;
     usb_device_t devices[XHCI_MAX_SLOTS];
     int        num_devices;
     spinlock_t lock;
-    uint8_t    *event_ring;  // Event ring buffer
-    uint64_t   erp;          // Event ring producer
+    xhci_intr_t intrs[XHCI_MAX_INTRS];
+    int        num_intrs;
+    int        msix_enabled;
+    pci_dev_t  *pdev;
 } xhci_ctrl_t;
 
 static xhci_ctrl_t *xhci_ctrl;
@@ -45,18 +84,220 @@ static xhci_ctrl_t *xhci_ctrl;
 #define XHCI_CONFIG 0x10
 #define XHCI_PORTSC(n) (0x400 + (n)*0x10)
 
-#define XHCI_ERDP 0x38
-#define XHCI_EREP 0x44
+/* Per-interrupter runtime register set (xHCI 5.5.2) */
+#define XHCI_IR_BASE(i)     (0x20 + (i) * 0x20)
+#define XHCI_IMAN           0x00
+#define XHCI_IMOD           0x04
+#define XHCI_ERSTSZ         0x08
+#define XHCI_ERSTBA         0x10
+#define XHCI_ERDP           0x18
+
+#define IMAN_IP             (1 << 0)    // Interrupt pending (W1C)
+#define IMAN_IE             (1 << 1)    // Interrupt enable
+#define ERDP_EHB            (1 << 3)    // Event handler busy (W1C)
+
+/* Default moderation: 40us (160 x 250ns) batches completions at bulk
+ * rates without adding visible latency; interrupter 0 stays at zero so
+ * port changes and command completions land immediately */
+#define XHCI_IMOD_DEFAULT   160
 
 /* Commands */
 #define CMD_RUN         (1 << 0)
 #define CMD_HCRST       (1 << 1)
 
+static void xhci_enumerate(void);
+static void xhci_complete_pending(int dci, int status);
+
+/* Pending stream transfers awaiting their transfer events. A transfer
+ * event names its endpoint; the oldest pending entry on that endpoint
+ * completes, matching in-order delivery on a bulk pipe. UASP's queue
+ * depth rests on this path – the submitter never waits. */
+#define XHCI_PENDING_MAX    64
+
+typedef struct xhci_pending {
+    usb_endpoint_t *ep;
+    uint16_t stream_id;
+    void (*complete)(void *ctx, uint16_t stream_id, int status);
+    void *ctx;
+} xhci_pending_t;
+
+static xhci_pending_t xhci_pending[XHCI_PENDING_MAX];
+static spinlock_t xhci_pending_lock = SPINLOCK_INIT;
+
+/* Device context index as transfer events report the endpoint */
+static int xhci_ep_dci(usb_endpoint_t *ep)
+{
+    return ((ep->bEndpointAddress & 0x0F) << 1) |
+           ((ep->bEndpointAddress & 0x80) ? 1 : 0);
+}
+
+static void xhci_complete_pending(int dci, int status)
+{
+    void (*complete)(void *ctx, uint16_t stream_id, int status) = NULL;
+    void *ctx = NULL;
+    uint16_t stream_id = 0;
+    unsigned long flags;
+
+    spin_lock_irqsave(&xhci_pending_lock, &flags);
+    for (int i = 0; i < XHCI_PENDING_MAX; i++) {
+        if (xhci_pending[i].ep && xhci_ep_dci(xhci_pending[i].ep) == dci) {
+            complete = xhci_pending[i].complete;
+            ctx = xhci_pending[i].ctx;
+            stream_id = xhci_pending[i].stream_id;
+            xhci_pending[i].ep = NULL;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&xhci_pending_lock, flags);
+
+    if (complete)
+        complete(ctx, stream_id, status);
+}
+
+/* Set up one interrupter: allocate its ring segments and ERST, program
+ * the runtime registers, apply moderation */
+static void xhci_init_interrupter(xhci_ctrl_t *ctrl, int i)
+{
+    xhci_intr_t *intr = &ctrl->intrs[i];
+    void *ir = ctrl->regs + ctrl->runtime + XHCI_IR_BASE(i);
+
+    intr->erst = kmalloc(XHCI_ERST_SEGS * sizeof(xhci_erst_entry_t));
+    for (int s = 0; s < XHCI_ERST_SEGS; s++) {
+        intr->segs[s] = kmalloc(4096);
+        memset(intr->segs[s], 0, 4096);
+        intr->erst[s].base = virt_to_phys(intr->segs[s]);
+        intr->erst[s].size = XHCI_EVENTS_PER_SEG;
+        intr->erst[s].rsvd = 0;
+    }
+
+    intr->seg = 0;
+    intr->deq = 0;
+    intr->ccs = 1;
+    intr->cpu = i % MAX_CPUS;
+    intr->vector = XHCI_IRQ_BASE + i;
+    intr->imod = (i == 0) ? 0 : XHCI_IMOD_DEFAULT;
+
+    writel(XHCI_ERST_SEGS, ir + XHCI_ERSTSZ);
+    writeq(virt_to_phys(intr->erst), ir + XHCI_ERSTBA);
+    writeq(intr->erst[0].base, ir + XHCI_ERDP);
+    writel(intr->imod, ir + XHCI_IMOD);
+    writel(IMAN_IE, ir + XHCI_IMAN);
+}
+
+/* Retune moderation for an interrupter's workload: 0 for latency-bound
+ * devices (webcams, HID), higher for bulk storage that wants batched
+ * completions. 250ns units. */
+void xhci_set_imod(int interrupter, uint32_t imod)
+{
+    if (!xhci_ctrl || interrupter >= xhci_ctrl->num_intrs) return;
+    xhci_intr_t *intr = &xhci_ctrl->intrs[interrupter];
+    intr->imod = imod;
+    writel(imod, xhci_ctrl->regs + xhci_ctrl->runtime +
+                 XHCI_IR_BASE(interrupter) + XHCI_IMOD);
+}
+
+/* Drain one interrupter's event ring: follow the consumer cycle state
+ * across segments, toggling it after the last segment, then write back
+ * ERDP with EHB cleared */
+static void xhci_process_events(xhci_intr_t *intr)
+{
+    int handled = 0;
+
+    while (1) {
+        xhci_trb_t *trb = &intr->segs[intr->seg][intr->deq];
+        if ((trb->control & TRB_CYCLE) != (uint32_t)intr->ccs)
+            break;              // Producer hasn't written this one yet
+
+        switch (TRB_TYPE(trb->control)) {
+            case TRB_TRANSFER:
+                /* Endpoint DCI in control 20:16, completion code in
+                 * status 31:24 (1 = success, xHCI 6.4.5) */
+                xhci_complete_pending((trb->control >> 16) & 0x1F,
+                                      ((trb->status >> 24) & 0xFF) == 1 ? 0 : -1);
+                break;
+            case TRB_CMD_COMPLETE:
+                // Command-ring completion matching lives here
+                break;
+            case TRB_PORT_STATUS:
+                xhci_enumerate();
+                break;
+        }
+        handled++;
+
+        if (++intr->deq == XHCI_EVENTS_PER_SEG) {
+            intr->deq = 0;
+            if (++intr->seg == XHCI_ERST_SEGS) {
+                intr->seg = 0;
+                intr->ccs ^= 1;
+            }
+        }
+    }
+
+    if (handled) {
+        uint64_t erdp = intr->erst[intr->seg].base +
+                        intr->deq * sizeof(xhci_trb_t);
+        int i = (int)(intr - xhci_ctrl->intrs);
+        writeq(erdp | ERDP_EHB,
+               xhci_ctrl->regs + xhci_ctrl->runtime +
+               XHCI_IR_BASE(i) + XHCI_ERDP);
+    }
+}
+
+/* One handler instance per interrupter vector */
+static void xhci_irq_handler(int vector, void *private)
+{
+    xhci_intr_t *intr = private;
+    void *ir = xhci_ctrl->regs + xhci_ctrl->runtime +
+               XHCI_IR_BASE((int)(intr - xhci_ctrl->intrs));
+
+    writel(IMAN_IE | IMAN_IP, ir + XHCI_IMAN);      // Ack (IP is W1C)
+    xhci_process_events(intr);
+}
+
+/* Enable MSI-X: one vector per interrupter, spread across CPUs, same
+ * GIC message scheme as the NVMe driver. Devices can then be assigned
+ * to different interrupters so a UASP disk and a webcam never share an
+ * interrupt path. */
+static int xhci_enable_msix(xhci_ctrl_t *ctrl)
+{
+    if (pci_alloc_vectors(ctrl->pdev, ctrl->num_intrs, ctrl->num_intrs,
+                          ~0ULL) >= ctrl->num_intrs) {
+        for (int i = 0; i < ctrl->num_intrs; i++) {
+            xhci_intr_t *intr = &ctrl->intrs[i];
+
+            intr->vector = pci_request_irq(ctrl->pdev, i, xhci_irq_handler, intr);
+            irq_set_affinity(intr->vector, intr->cpu);
+        }
+    } else {
+        /* Controller doesn't advertise MSI-X in config space: the
+         * table sits in BAR0 past the doorbells on these parts */
+        volatile uint32_t *table = ctrl->regs + 0x2000;
+
+        for (int i = 0; i < ctrl->num_intrs; i++) {
+            xhci_intr_t *intr = &ctrl->intrs[i];
+
+            table[i * 4 + 0] = 0xFF840040;              // GICD_SETSPI_NSR
+            table[i * 4 + 1] = 0;
+            table[i * 4 + 2] = intr->vector;
+            table[i * 4 + 3] = 0;
+
+            irq_set_handler(intr->vector, xhci_irq_handler, intr);
+            irq_set_affinity(intr->vector, intr->cpu);
+            irq_unmask(intr->vector);
+        }
+    }
+
+    ctrl->msix_enabled = 1;
+    debug_print("xHCI: MSI-X enabled, %d interrupters\n", ctrl->num_intrs);
+    return 0;
+}
+
 /* xHCI init */
 static int xhci_init_controller(pci_dev_t *pdev) {
     xhci_ctrl = kmalloc(sizeof(xhci_ctrl_t));
     if (!xhci_ctrl) return -1;
 
+    xhci_ctrl->pdev = pdev;
     xhci_ctrl->regs_phys = pci_bar_start(pdev, 0);
     xhci_ctrl->regs = ioremap(xhci_ctrl->regs_phys, 0x10000);
     if (!xhci_ctrl->regs) goto fail;
@@ -70,9 +311,12 @@ static int xhci_init_controller(pci_dev_t *pdev) {
     writel(readl(xhci_ctrl->regs + XHCI_USBCMD) | CMD_HCRST, xhci_ctrl->regs + XHCI_USBCMD);
     while (readl(xhci_ctrl->regs + XHCI_USBCMD) & CMD_HCRST);
 
-    // Allocate event ring
-    xhci_ctrl->event_ring = kmalloc(4096);  // 1k events
-    memset(xhci_ctrl->event_ring, 0, 4096);
+    // Multi-segment event rings – one interrupter per CPU
+    xhci_ctrl->num_intrs = XHCI_MAX_INTRS;
+    for (int i = 0; i < xhci_ctrl->num_intrs; i++)
+        xhci_init_interrupter(xhci_ctrl, i);
+
+    xhci_enable_msix(xhci_ctrl);
 
     // Set page size
     writel(PAGE_SIZE, xhci_ctrl->regs + XHCI_PAGESIZE);
@@ -140,11 +384,40 @@ int usb_bulk_transfer_stream(usb_endpoint_t *ep, void *data, size_t len, int tim
     return len;
 }
 
-/* IRQ handler */
-static void xhci_irq_handler(int vector, void *private) {
-    // Read ERDP, process events (completion, port change)
-    // Enumerate on connect
-    xhci_enumerate();
+/* Asynchronous stream transfer: queue the TRB with the stream ID and
+ * return at once; 'complete' runs from the transfer-event path when
+ * the event for this endpoint arrives (NULL = fire and forget) */
+int usb_bulk_transfer_stream_async(usb_endpoint_t *ep, void *data, size_t len,
+                                   uint16_t stream_id,
+                                   void (*complete)(void *ctx,
+                                                    uint16_t stream_id,
+                                                    int status),
+                                   void *ctx)
+{
+    if (complete) {
+        unsigned long flags;
+        int slot = -1;
+
+        spin_lock_irqsave(&xhci_pending_lock, &flags);
+        for (int i = 0; i < XHCI_PENDING_MAX; i++) {
+            if (!xhci_pending[i].ep) {
+                xhci_pending[i].stream_id = stream_id;
+                xhci_pending[i].complete = complete;
+                xhci_pending[i].ctx = ctx;
+                xhci_pending[i].ep = ep;
+                slot = i;
+                break;
+            }
+        }
+        spin_unlock_irqrestore(&xhci_pending_lock, flags);
+
+        if (slot < 0)
+            return -1;          // Table full – caller throttles
+    }
+
+    // Queue transfer ring TRB with the stream ID, ring the doorbell
+    // (as above) – no completion poll here
+    return 0;
 }
 
 /* PCI probe */
@@ -164,9 +437,7 @@ static pci_driver_t xhci_driver = {
 _kernel_oserror *module_init(const char *arg, int podule)
 {
     pci_register_driver(&xhci_driver);
-    irq_set_handler(XHCI_IRQ_VECTOR, xhci_irq_handler, NULL);
-    irq_unmask(XHCI_IRQ_VECTOR);
-    xhci_enumerate();
+    xhci_enumerate();   // Interrupter vectors are wired during probe
     debug_print("USB Host (xHCI) loaded\n");
     return NULL;
 }
\ No newline at end of file
@@ -8,32 +8,50 @@
 
 #include "kernel.h"
 #include "blockdriver.h"
+#include "rcu.h"
+#include "slab.h"
 #include "vfs.h"
+#include "trace.h"
 #include <string.h>
 
-#define MAX_BLOCKDEVS   16
+/* The device table changes only at hotplug time but is consulted on
+ * every I/O dispatch, so readers go lock-free over an immutable RCU
+ * snapshot; registration publishes a fresh copy under the writer lock
+ * and rcu_free()s the old one. */
+static blockdev_snap_t *blockdev_snap;
 
-/* Global list of registered block devices */
-blockdev_t *blockdev_list[MAX_BLOCKDEVS];
-int blockdev_count = 0;
+static spinlock_t blockdev_write_lock = SPINLOCK_INIT;
 
-static spinlock_t blockdev_lock = SPINLOCK_INIT;
+/* Slab cache for async request descriptors */
+static slab_cache_t *bio_cache;
+
+/* Current immutable snapshot – valid until the next quiescent point */
+blockdev_snap_t *blockdev_snapshot(void)
+{
+    return rcu_dereference(blockdev_snap);
+}
 
 /* Register a new block device */
 blockdev_t *blockdev_register(const char *name, uint64_t size, uint32_t block_size)
 {
     unsigned long flags;
-    spin_lock_irqsave(&blockdev_lock, flags);
+    spin_lock_irqsave(&blockdev_write_lock, &flags);
+
+    blockdev_snap_t *old = blockdev_snap;
+    int count = old ? old->count : 0;
 
-    if (blockdev_count >= MAX_BLOCKDEVS) {
-        spin_unlock_irqrestore(&blockdev_lock, flags);
+    if (count >= MAX_BLOCKDEVS) {
+        spin_unlock_irqrestore(&blockdev_write_lock, flags);
         debug_print("BlockDriver: Maximum devices reached\n");
         return NULL;
     }
 
     blockdev_t *dev = kmalloc(sizeof(blockdev_t));
-    if (!dev) {
-        spin_unlock_irqrestore(&blockdev_lock, flags);
+    blockdev_snap_t *snap = kmalloc(sizeof(blockdev_snap_t));
+    if (!dev || !snap) {
+        spin_unlock_irqrestore(&blockdev_write_lock, flags);
+        kfree(dev);
+        kfree(snap);
         return NULL;
     }
 
@@ -41,59 +59,358 @@ blockdev_t *blockdev_register(const char *name, uint64_t size, uint32_t block_si
     dev->name[15] = '\0';
     dev->size = size;
     dev->block_size = block_size;
-    dev->unit = blockdev_count;
+    dev->unit = count;
     dev->private = NULL;
     dev->ops = NULL;
+    dev->iosched = IOSCHED_DEADLINE;    /* Drivers with deep HW queues
+                                           switch to IOSCHED_NONE */
+    dev->elv = NULL;
 
-    blockdev_list[blockdev_count++] = dev;
+    /* Copy-and-publish: readers see either the old or the new table */
+    memset(snap, 0, sizeof(*snap));
+    if (old) {
+        memcpy(snap->devs, old->devs, count * sizeof(blockdev_t *));
+    }
+    snap->devs[count] = dev;
+    snap->count = count + 1;
+    rcu_assign_pointer(blockdev_snap, snap);
+
+    spin_unlock_irqrestore(&blockdev_write_lock, flags);
 
-    spin_unlock_irqrestore(&blockdev_lock, flags);
+    if (old) {
+        rcu_free(old);
+    }
 
-    debug_print("BlockDriver: Registered %s (unit %d, %ld blocks)\n", 
+    debug_print("BlockDriver: Registered %s (unit %d, %ld blocks)\n",
                 name, dev->unit, size);
 
     return dev;
 }
 
-/* Get block device by name and unit number */
+/* Get block device by name and unit number – lock-free */
 blockdev_t *blockdev_get(const char *name, int unit)
 {
-    unsigned long flags;
-    spin_lock_irqsave(&blockdev_lock, flags);
+    blockdev_snap_t *snap = blockdev_snapshot();
+    if (!snap) return NULL;
 
-    for (int i = 0; i < blockdev_count; i++) {
-        blockdev_t *dev = blockdev_list[i];
+    for (int i = 0; i < snap->count; i++) {
+        blockdev_t *dev = snap->devs[i];
         if (dev == NULL) continue;
 
         if ((unit == -1 && strcmp(dev->name, name) == 0) ||
             (unit >= 0 && dev->unit == unit)) {
-            spin_unlock_irqrestore(&blockdev_lock, flags);
             return dev;
         }
     }
 
-    spin_unlock_irqrestore(&blockdev_lock, flags);
     return NULL;
 }
 
-/* Read from block device (VFS wrapper) */
+/* ==================== Async submission ==================== */
+
+bio_t *bio_alloc(void)
+{
+    if (!bio_cache) {
+        bio_cache = kmem_cache_create("bio", sizeof(bio_t), NULL);
+        if (!bio_cache) return NULL;
+    }
+
+    bio_t *bio = slab_alloc(bio_cache);
+    if (bio) memset(bio, 0, sizeof(*bio));
+    return bio;
+}
+
+void bio_free(bio_t *bio)
+{
+    if (bio) slab_free(bio_cache, bio);
+}
+
+static void elv_kick(blockdev_t *dev);
+static void elv_complete(blockdev_t *dev);
+
+/* Drivers call this exactly once per bio when the range has landed */
+void bio_complete(bio_t *bio, int status)
+{
+    bio->status = status;
+    __atomic_store_n(&bio->completed, 1, __ATOMIC_RELEASE);
+
+    trace_event(TRACE_EV_BIO_COMPLETE, bio, status);
+
+    if (bio->done) bio->done(bio, status);
+    if (bio->waiter) task_wakeup(bio->waiter);
+
+    /* Bios merged into this one share its fate */
+    bio_t *m = bio->merged;
+    bio->merged = NULL;
+    while (m) {
+        bio_t *next = m->next;
+        m->next = NULL;
+        bio_complete(m, status);
+        m = next;
+    }
+
+    /* A completed elevator dispatch frees a queue slot – refill it */
+    if ((bio->flags & BIO_FLAG_ELV) && bio->dev) {
+        elv_complete(bio->dev);
+        elv_kick(bio->dev);
+    }
+}
+
+/* Hand one request to the driver. Drivers with native queues (NVMe,
+ * AHCI) take it directly; everything else is emulated with the sync
+ * ops so callers never need to care. */
+static int blockdev_dispatch(bio_t *bio)
+{
+    blockdev_t *dev = bio->dev;
+
+    if (dev->ops->submit) {
+        return dev->ops->submit(dev, bio);
+    }
+
+    /* Fallback: run the segments synchronously, then complete */
+    uint64_t lba = bio->lba;
+    int status = 0;
+
+    for (int i = 0; i < bio->nr_segs && status == 0; i++) {
+        bio_seg_t *seg = &bio->segs[i];
+        ssize_t ret;
+
+        if (bio->op == BIO_WRITE) {
+            ret = dev->ops->write ? dev->ops->write(dev, lba, seg->blocks, seg->buf) : -1;
+        } else {
+            ret = dev->ops->read ? dev->ops->read(dev, lba, seg->blocks, seg->buf) : -1;
+        }
+        if (ret < 0) status = -1;
+        lba += seg->blocks;
+    }
+
+    bio_complete(bio, status);
+    return 0;
+}
+
+/* ==================== Deadline elevator ==================== */
+
+/* Scheduler stage between submit and driver dispatch. Requests wait
+ * on a LBA-sorted queue where contiguous neighbours are merged, and
+ * leave in sorted order – unless one has sat past its deadline, in
+ * which case it jumps the queue. Reads get a tight deadline because a
+ * task is usually blocked on them; writes are mostly page-cache
+ * write-back and can wait. */
+#define ELV_READ_DEADLINE_NS    (500ULL * 1000 * 1000)      /* 500 ms */
+#define ELV_WRITE_DEADLINE_NS   (5000ULL * 1000 * 1000)     /* 5 s */
+#define ELV_MAX_INFLIGHT        32
+
+typedef struct elevator {
+    spinlock_t  lock;
+    bio_t      *queue;          /* Singly linked, sorted by lba */
+    int         inflight;       /* Dispatched but not yet completed */
+} elevator_t;
+
+/* Total device blocks covered by a bio's segments */
+static uint32_t bio_blocks(bio_t *bio)
+{
+    uint32_t blocks = 0;
+    for (int i = 0; i < bio->nr_segs; i++) {
+        blocks += bio->segs[i].blocks;
+    }
+    return blocks;
+}
+
+/* Try to fold bio into an already-queued contiguous neighbour with the
+ * same direction. Returns 1 when absorbed; the absorbed bio is chained
+ * on q->merged and completes when q does. Caller holds elv->lock. */
+static int elv_try_merge(elevator_t *elv, bio_t *bio)
+{
+    uint32_t blocks = bio_blocks(bio);
+
+    for (bio_t *q = elv->queue; q; q = q->next) {
+        if (q->op != bio->op) continue;
+        if (q->nr_segs + bio->nr_segs > BIO_MAX_SEGS) continue;
+
+        if (q->lba + bio_blocks(q) == bio->lba) {
+            /* Back merge: bio extends q */
+            for (int i = 0; i < bio->nr_segs; i++) {
+                q->segs[q->nr_segs++] = bio->segs[i];
+            }
+        } else if (bio->lba + blocks == q->lba) {
+            /* Front merge: bio precedes q – shift and prepend */
+            for (int i = q->nr_segs - 1; i >= 0; i--) {
+                q->segs[i + bio->nr_segs] = q->segs[i];
+            }
+            for (int i = 0; i < bio->nr_segs; i++) {
+                q->segs[i] = bio->segs[i];
+            }
+            q->nr_segs += bio->nr_segs;
+            q->lba = bio->lba;
+        } else {
+            continue;
+        }
+
+        /* Merged request inherits the tighter deadline */
+        if (bio->expiry < q->expiry) q->expiry = bio->expiry;
+
+        bio->next = q->merged;
+        q->merged = bio;
+        return 1;
+    }
+    return 0;
+}
+
+/* Dispatch until the in-flight window is full: expired deadlines jump
+ * the queue, otherwise strict ascending-LBA order */
+static void elv_kick(blockdev_t *dev)
+{
+    elevator_t *elv = dev->elv;
+    unsigned long flags;
+
+    if (!elv) return;
+
+    spin_lock_irqsave(&elv->lock, &flags);
+
+    while (elv->queue && elv->inflight < ELV_MAX_INFLIGHT) {
+        uint64_t now = get_time_ns();
+        bio_t **link = &elv->queue;
+
+        for (bio_t **p = &elv->queue; *p; p = &(*p)->next) {
+            if ((*p)->expiry <= now) {
+                link = p;
+                break;
+            }
+        }
+
+        bio_t *bio = *link;
+        *link = bio->next;
+        bio->next = NULL;
+        bio->flags |= BIO_FLAG_ELV;
+        elv->inflight++;
+
+        /* Drop the lock to dispatch: the sync fallback completes
+         * inline and its bio_complete re-enters the elevator */
+        spin_unlock_irqrestore(&elv->lock, flags);
+        blockdev_dispatch(bio);
+        spin_lock_irqsave(&elv->lock, &flags);
+    }
+
+    spin_unlock_irqrestore(&elv->lock, flags);
+}
+
+/* Completion bookkeeping split out so bio_complete can run before the
+ * dispatch loop reacquires the lock */
+static void elv_complete(blockdev_t *dev)
+{
+    elevator_t *elv = dev->elv;
+    unsigned long flags;
+
+    spin_lock_irqsave(&elv->lock, &flags);
+    elv->inflight--;
+    spin_unlock_irqrestore(&elv->lock, flags);
+}
+
+/* Queue one request on the deadline elevator */
+static int elv_add(blockdev_t *dev, bio_t *bio)
+{
+    elevator_t *elv = dev->elv;
+    unsigned long flags;
+
+    if (!elv) {
+        elv = kmalloc(sizeof(elevator_t));
+        if (!elv) return blockdev_dispatch(bio);    /* Degrade, don't fail */
+        memset(elv, 0, sizeof(*elv));
+        spinlock_init(&elv->lock);
+        dev->elv = elv;
+    }
+
+    bio->expiry = get_time_ns() +
+                  (bio->op == BIO_READ ? ELV_READ_DEADLINE_NS
+                                       : ELV_WRITE_DEADLINE_NS);
+
+    spin_lock_irqsave(&elv->lock, &flags);
+
+    if (elv_try_merge(elv, bio)) {
+        spin_unlock_irqrestore(&elv->lock, flags);
+        return 0;
+    }
+
+    /* Sorted insert by first LBA */
+    bio_t **p = &elv->queue;
+    while (*p && (*p)->lba < bio->lba) {
+        p = &(*p)->next;
+    }
+    bio->next = *p;
+    *p = bio;
+
+    spin_unlock_irqrestore(&elv->lock, flags);
+
+    elv_kick(dev);
+    return 0;
+}
+
+/* Queue an async request through the device's scheduler stage */
+int blockdev_submit(bio_t *bio)
+{
+    blockdev_t *dev = bio->dev;
+
+    if (!dev || !dev->ops) return -1;
+
+    trace_event(TRACE_EV_BIO_SUBMIT, bio->lba, bio->op);
+
+    /* Polled bios bypass the elevator – the caller is spinning on
+     * latency and merging would only add to it */
+    if (dev->iosched == IOSCHED_NONE || (bio->flags & BIO_FLAG_POLL)) {
+        return blockdev_dispatch(bio);
+    }
+
+    return elv_add(dev, bio);
+}
+
+/* Submit a single-segment bio and sleep until it completes */
+static ssize_t blockdev_rw_sync(blockdev_t *dev, uint64_t lba, uint32_t count,
+                                void *buf, int op)
+{
+    bio_t *bio = bio_alloc();
+    if (!bio) return -1;
+
+    bio->dev = dev;
+    bio->op = op;
+    bio->lba = lba;
+    bio->nr_segs = 1;
+    bio->segs[0].buf = buf;
+    bio->segs[0].blocks = count;
+    bio->waiter = current_task;
+
+    if (blockdev_submit(bio) != 0) {
+        bio_free(bio);
+        return -1;
+    }
+
+    while (!__atomic_load_n(&bio->completed, __ATOMIC_ACQUIRE)) {
+        task_block(TASK_BLOCKED);
+        schedule();
+    }
+
+    int status = bio->status;
+    bio_free(bio);
+    return status == 0 ? (ssize_t)(count * dev->block_size) : -1;
+}
+
+/* Read from block device (VFS wrapper) – now a sync shim over submit */
 ssize_t blockdev_read(blockdev_t *dev, uint64_t lba, uint32_t count, void *buf)
 {
-    if (!dev || !dev->ops || !dev->ops->read) {
+    if (!dev || !dev->ops) {
         debug_print("BlockDriver: No read operation for %s\n", dev ? dev->name : "NULL");
         return -1;
     }
-    return dev->ops->read(dev, lba, count, buf);
+    return blockdev_rw_sync(dev, lba, count, buf, BIO_READ);
 }
 
 /* Write to block device */
 ssize_t blockdev_write(blockdev_t *dev, uint64_t lba, uint32_t count, const void *buf)
 {
-    if (!dev || !dev->ops || !dev->ops->write) {
+    if (!dev || !dev->ops) {
         debug_print("BlockDriver: No write operation for %s\n", dev ? dev->name : "NULL");
         return -1;
     }
-    return dev->ops->write(dev, lba, count, buf);
+    return blockdev_rw_sync(dev, lba, count, (void*)buf, BIO_WRITE);
 }
 
 /* TRIM / DISCARD */
@@ -105,6 +422,16 @@ int blockdev_trim(blockdev_t *dev, uint64_t lba, uint64_t count)
     return dev->ops->trim(dev, lba, count);
 }
 
+/* Write Zeroes – lets filesystems clear a range without pushing zero
+ * buffers through the data path; on SSDs it usually deallocates too */
+int blockdev_write_zeroes(blockdev_t *dev, uint64_t lba, uint64_t count)
+{
+    if (!dev || !dev->ops || !dev->ops->write_zeroes) {
+        return -1;
+    }
+    return dev->ops->write_zeroes(dev, lba, count);
+}
+
 /* Poll for I/O readiness */
 int blockdev_poll(blockdev_t *dev)
 {
@@ -13,6 +13,44 @@
 /* Block device structure */
 typedef struct blockdev blockdev_t;
 
+/* Asynchronous block request. Built by the submitter, handed to the
+ * driver via blockdev_submit(); the driver (or the sync fallback)
+ * calls bio->done exactly once when the whole LBA range has landed. */
+#define BIO_MAX_SEGS    8
+
+#define BIO_READ        0
+#define BIO_WRITE       1
+
+/* bio flags */
+#define BIO_FLAG_POLL   0x01    /* High priority: spin for completion
+                                   instead of waiting for the IRQ */
+#define BIO_FLAG_ELV    0x02    /* Internal: dispatched by the elevator,
+                                   completion must kick the next batch */
+
+typedef struct bio_seg {
+    void       *buf;            /* Data buffer for this segment */
+    uint32_t    blocks;         /* Length in device blocks */
+} bio_seg_t;
+
+typedef struct bio {
+    blockdev_t *dev;
+    int         op;             /* BIO_READ / BIO_WRITE */
+    int         flags;          /* BIO_FLAG_* */
+    uint64_t    lba;            /* First block of the range */
+    int         nr_segs;
+    bio_seg_t   segs[BIO_MAX_SEGS];
+    void      (*done)(struct bio *bio, int status);
+    void       *private;        /* For the done callback's owner */
+    int         status;         /* 0 on success */
+    volatile int inflight;      /* Driver-side pending segment count */
+    volatile int completed;
+    task_t     *waiter;         /* Task sleeping in blockdev_read/write */
+    struct bio *next;           /* Driver/elevator queue linkage */
+    uint64_t    expiry;         /* Elevator deadline (absolute ns) */
+    struct bio *merged;         /* Bios absorbed by front/back merging –
+                                   completed together with this one */
+} bio_t;
+
 /* Block device operations */
 typedef struct blockdev_ops {
     /* Read blocks from device */
@@ -21,9 +59,15 @@ typedef struct blockdev_ops {
     /* Write blocks to device */
     ssize_t (*write)(blockdev_t *dev, uint64_t lba, uint32_t count, const void *buf);
 
+    /* Queue an async request (optional – sync fallback used if NULL) */
+    int (*submit)(blockdev_t *dev, bio_t *bio);
+
     /* TRIM / DISCARD (deallocate blocks) */
     int (*trim)(blockdev_t *dev, uint64_t lba, uint64_t count);
 
+    /* Write Zeroes – deallocate-and-zero without moving data (optional) */
+    int (*write_zeroes)(blockdev_t *dev, uint64_t lba, uint64_t count);
+
     /* Poll for I/O readiness (optional) */
     int (*poll)(blockdev_t *dev);
 
@@ -31,6 +75,13 @@ typedef struct blockdev_ops {
     void (*close)(blockdev_t *dev);
 } blockdev_ops_t;
 
+/* I/O scheduler selection, per device. NONE is pass-through for
+ * devices with deep native queues (NVMe) where sorting and merging
+ * only burn CPU; DEADLINE merges contiguous ranges and dispatches in
+ * LBA order with an expiry bound so reads can't starve. */
+#define IOSCHED_NONE        0
+#define IOSCHED_DEADLINE    1
+
 /* Main block device descriptor */
 struct blockdev {
     char            name[16];       /* e.g. "nvme", "usb", "sata", "mmc" */
@@ -39,16 +90,36 @@ struct blockdev {
     int             unit;           /* Unit number (for multi-device) */
     void           *private;        /* Driver private data */
     blockdev_ops_t *ops;            /* Operations table */
+    int             iosched;        /* IOSCHED_* – drivers override at init */
+    void           *elv;            /* Elevator state (lazily allocated) */
 };
 
+#define MAX_BLOCKDEVS   16
+
+/* Immutable snapshot of the device table, published via RCU; readers
+ * iterate it without taking any lock */
+typedef struct {
+    int         count;
+    blockdev_t *devs[MAX_BLOCKDEVS];
+} blockdev_snap_t;
+
 /* Register a new block device */
 blockdev_t *blockdev_register(const char *name, uint64_t size, uint32_t block_size);
 
-/* Get block device by name and unit */
+/* Get block device by name and unit – lock-free RCU read */
 blockdev_t *blockdev_get(const char *name, int unit);
 
-/* Global list of registered block devices */
-extern blockdev_t *blockdev_list[];
-extern int blockdev_count;
+/* Current device table snapshot for iteration */
+blockdev_snap_t *blockdev_snapshot(void);
+
+/* Async submission API */
+bio_t *bio_alloc(void);
+void bio_free(bio_t *bio);
+int blockdev_submit(bio_t *bio);
+void bio_complete(bio_t *bio, int status);
+
+/* Discard / zeroing – both return -1 when the device can't do it */
+int blockdev_trim(blockdev_t *dev, uint64_t lba, uint64_t count);
+int blockdev_write_zeroes(blockdev_t *dev, uint64_t lba, uint64_t count);
 
 #endif /* BLOCKDRIVER_H */
\ No newline at end of file
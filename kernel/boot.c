@@ -67,6 +67,30 @@ void secondary_cpu_entry(void) {
     }
 }
 
+/* PSCI CPU_ON (SMC64 calling convention) */
+#define PSCI_CPU_ON 0xC4000003ULL
+
+static int psci_cpu_on(uint64_t mpidr, uint64_t entry) {
+    register uint64_t x0 __asm__("x0") = PSCI_CPU_ON;
+    register uint64_t x1 __asm__("x1") = mpidr;
+    register uint64_t x2 __asm__("x2") = entry;
+    register uint64_t x3 __asm__("x3") = 0;
+    __asm__ volatile ("smc #0" : "+r"(x0) : "r"(x1), "r"(x2), "r"(x3));
+    return (int)x0;
+}
+
+/* Kick every secondary core through firmware. Called as soon as the
+ * scheduler, GIC and timer are up, so per-CPU bring-up in
+ * secondary_cpu_entry() overlaps the rest of primary boot. */
+void smp_boot_secondaries(void) {
+    for (int cpu = 1; cpu < nr_cpus; cpu++) {
+        int ret = psci_cpu_on(cpu, (uint64_t)secondary_cpu_entry);
+        if (ret != 0) {
+            debug_print("PSCI: CPU %d failed to start (%d)\n", cpu, ret);
+        }
+    }
+}
+
 __attribute__((noreturn))
 void kernel_main(uint64_t dtb_ptr) {
     debug_print("RISC OS Phoenix kernel starting...\n");
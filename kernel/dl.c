@@ -7,17 +7,31 @@
 #include "kernel.h"
 #include "vfs.h"
 #include "elf64.h"
+#include "mmu.h"
 #include <string.h>
 
 #define MAX_LIBS  32
 
 typedef struct loaded_lib {
     char path[256];
+    uint64_t base;              /* Load bias */
     Elf64_Dyn *dynamic;
     Elf64_Sym *symtab;
     char *strtab;
     Elf64_Rela *rela;
+    uint64_t rela_count;
+    Elf64_Rela *jmprel;         /* PLT relocations (lazy-bound) */
+    uint64_t jmprel_count;
     uint64_t *got;
+
+    /* DT_GNU_HASH tables */
+    uint32_t gh_nbuckets;
+    uint32_t gh_symndx;         /* First hashed symbol index */
+    uint32_t gh_bloom_size;     /* Words, power of two */
+    uint32_t gh_bloom_shift;
+    uint64_t *gh_bloom;
+    uint32_t *gh_buckets;
+    uint32_t *gh_chain;
 } loaded_lib_t;
 
 static loaded_lib_t loaded_libs[MAX_LIBS];
@@ -29,6 +43,151 @@ uint64_t resolve_symbol(const char *name) {
     return 0;
 }
 
+/* The GNU symbol hash (dl_new_hash) */
+static uint32_t gnu_hash(const char *name) {
+    uint32_t h = 5381;
+    while (*name) h = h * 33 + (uint8_t)*name++;
+    return h;
+}
+
+/* Pull the lookup tables out of PT_DYNAMIC once at load time */
+static void dl_parse_dynamic(loaded_lib_t *lib) {
+    for (Elf64_Dyn *d = lib->dynamic; d->d_tag != DT_NULL; d++) {
+        switch (d->d_tag) {
+        case DT_SYMTAB:   lib->symtab = (Elf64_Sym*)(lib->base + d->d_un.d_ptr); break;
+        case DT_STRTAB:   lib->strtab = (char*)(lib->base + d->d_un.d_ptr); break;
+        case DT_RELA:     lib->rela = (Elf64_Rela*)(lib->base + d->d_un.d_ptr); break;
+        case DT_RELASZ:   lib->rela_count = d->d_un.d_val / sizeof(Elf64_Rela); break;
+        case DT_JMPREL:   lib->jmprel = (Elf64_Rela*)(lib->base + d->d_un.d_ptr); break;
+        case DT_PLTRELSZ: lib->jmprel_count = d->d_un.d_val / sizeof(Elf64_Rela); break;
+        case DT_PLTGOT:   lib->got = (uint64_t*)(lib->base + d->d_un.d_ptr); break;
+        case DT_GNU_HASH: {
+            uint32_t *gh = (uint32_t*)(lib->base + d->d_un.d_ptr);
+            lib->gh_nbuckets = gh[0];
+            lib->gh_symndx = gh[1];
+            lib->gh_bloom_size = gh[2];
+            lib->gh_bloom_shift = gh[3];
+            lib->gh_bloom = (uint64_t*)&gh[4];
+            lib->gh_buckets = (uint32_t*)&lib->gh_bloom[lib->gh_bloom_size];
+            lib->gh_chain = &lib->gh_buckets[lib->gh_nbuckets];
+            break;
+        }
+        }
+    }
+}
+
+/* GNU-hash lookup: two bits in the bloom filter reject most misses
+ * without touching the string table; hits walk one short chain.
+ * Falls back to a linear scan for objects without DT_GNU_HASH. */
+static Elf64_Sym *dl_lookup(loaded_lib_t *lib, const char *name) {
+    if (!lib->gh_nbuckets) {
+        for (Elf64_Sym *sym = lib->symtab; sym && sym->st_name; sym++) {
+            if (strcmp(lib->strtab + sym->st_name, name) == 0) return sym;
+        }
+        return NULL;
+    }
+
+    uint32_t h = gnu_hash(name);
+    uint64_t word = lib->gh_bloom[(h / 64) & (lib->gh_bloom_size - 1)];
+    uint64_t mask = (1ULL << (h % 64)) |
+                    (1ULL << ((h >> lib->gh_bloom_shift) % 64));
+    if ((word & mask) != mask) return NULL;      /* Definitely absent */
+
+    uint32_t i = lib->gh_buckets[h % lib->gh_nbuckets];
+    if (i < lib->gh_symndx) return NULL;
+
+    for (;; i++) {
+        uint32_t ch = lib->gh_chain[i - lib->gh_symndx];
+        if ((ch | 1) == (h | 1) &&
+            strcmp(lib->strtab + lib->symtab[i].st_name, name) == 0) {
+            return &lib->symtab[i];
+        }
+        if (ch & 1) break;                       /* End of chain */
+    }
+    return NULL;
+}
+
+/* Apply one relocation; the target page is already writable */
+static void dl_apply_one(loaded_lib_t *lib, Elf64_Rela *r) {
+    uint64_t *target = (uint64_t*)(lib->base + r->r_offset);
+    uint32_t type = ELF64_R_TYPE(r->r_info);
+
+    switch (type) {
+    case R_AARCH64_RELATIVE:
+        *target = lib->base + r->r_addend;
+        break;
+    case R_AARCH64_ABS64:
+    case R_AARCH64_GLOB_DAT: {
+        Elf64_Sym *sym = &lib->symtab[ELF64_R_SYM(r->r_info)];
+        uint64_t val = sym->st_shndx ? lib->base + sym->st_value
+                                     : resolve_symbol(lib->strtab + sym->st_name);
+        *target = val + r->r_addend;
+        break;
+    }
+    case R_AARCH64_JUMP_SLOT:
+        /* Lazy: leave the slot pointing at its PLT stub, just rebase
+         * it – the real target binds on first call in dl_fixup() */
+        *target += lib->base;
+        break;
+    }
+}
+
+/* Walk a relocation table page by page. Linkers emit relocations in
+ * offset order, so each page of the image is opened for writing
+ * exactly once, takes every relocation that lands in it, and goes
+ * back to read-only – instead of a protection flip and TLB flush per
+ * relocation. */
+static void dl_apply_rela(loaded_lib_t *lib, Elf64_Rela *rela, uint64_t count) {
+    uint64_t open_page = ~0ULL;
+
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t page = (lib->base + rela[i].r_offset) & ~(PAGE_SIZE - 1);
+        if (page != open_page) {
+            if (open_page != ~0ULL) {
+                mmu_map(current_task, open_page, PAGE_SIZE, PROT_READ | PROT_EXEC, 0);
+                mmu_tlb_invalidate_addr(open_page, PAGE_SIZE);
+            }
+            mmu_map(current_task, page, PAGE_SIZE, PROT_READ | PROT_WRITE, 0);
+            mmu_tlb_invalidate_addr(page, PAGE_SIZE);
+            open_page = page;
+        }
+        dl_apply_one(lib, &rela[i]);
+    }
+    if (open_page != ~0ULL) {
+        mmu_map(current_task, open_page, PAGE_SIZE, PROT_READ | PROT_EXEC, 0);
+        mmu_tlb_invalidate_addr(open_page, PAGE_SIZE);
+    }
+}
+
+/* First-call PLT binding. The trampoline installed in GOT[2] (the
+ * dl_plt_entry assembly stub) passes the library handle from GOT[1]
+ * and the relocation index, and jumps to whatever we return; the GOT
+ * slot is patched so later calls go direct. */
+uint64_t dl_fixup(loaded_lib_t *lib, uint64_t reloc_index) {
+    Elf64_Rela *r = &lib->jmprel[reloc_index];
+    Elf64_Sym *sym = &lib->symtab[ELF64_R_SYM(r->r_info)];
+    const char *name = lib->strtab + sym->st_name;
+
+    uint64_t val = sym->st_shndx ? lib->base + sym->st_value : 0;
+    if (!val) {
+        /* Search the other loaded objects, then the kernel exports */
+        for (int i = 0; i < num_libs && !val; i++) {
+            Elf64_Sym *s = dl_lookup(&loaded_libs[i], name);
+            if (s && s->st_shndx) val = loaded_libs[i].base + s->st_value;
+        }
+        if (!val) val = resolve_symbol(name);
+    }
+    if (!val) {
+        debug_print("dl: unresolved symbol %s\n", name);
+        return 0;
+    }
+
+    *(uint64_t*)(lib->base + r->r_offset) = val;   /* Bind for good */
+    return val;
+}
+
+extern void dl_plt_entry(void);     /* Assembly trampoline -> dl_fixup */
+
 /* dlopen – load shared library */
 void *dlopen(const char *filename, int flags) {
     if (!filename) return NULL;
@@ -48,6 +207,7 @@ void *dlopen(const char *filename, int flags) {
     }
 
     loaded_lib_t *lib = kmalloc(sizeof(loaded_lib_t));
+    memset(lib, 0, sizeof(*lib));
     strncpy(lib->path, filename, 255);
 
     // Parse PT_DYNAMIC (stub – simplified)
@@ -65,6 +225,20 @@ void *dlopen(const char *filename, int flags) {
 
     vfs_close(file);
 
+    /* Hash tables, eager data relocations (batched per page), and
+     * the lazy-binding hooks for everything routed through the PLT */
+    dl_parse_dynamic(lib);
+    if (lib->rela) {
+        dl_apply_rela(lib, lib->rela, lib->rela_count);
+    }
+    if (lib->jmprel) {
+        dl_apply_rela(lib, lib->jmprel, lib->jmprel_count);  /* Rebase stubs */
+    }
+    if (lib->got) {
+        lib->got[1] = (uint64_t)lib;
+        lib->got[2] = (uint64_t)dl_plt_entry;
+    }
+
     // Register library
     if (num_libs < MAX_LIBS) {
         loaded_libs[num_libs++] = *lib;
@@ -74,19 +248,13 @@ void *dlopen(const char *filename, int flags) {
     return lib;
 }
 
-/* dlsym – lookup symbol */
+/* dlsym – lookup symbol through the GNU hash tables */
 void *dlsym(void *handle, const char *symbol) {
     loaded_lib_t *lib = (loaded_lib_t*)handle;
     if (!lib) return NULL;
 
-    Elf64_Sym *sym = lib->symtab;
-    while (sym->st_name) {
-        if (strcmp(lib->strtab + sym->st_name, symbol) == 0) {
-            return (void*)sym->st_value;
-        }
-        sym++;
-    }
-    return NULL;
+    Elf64_Sym *sym = dl_lookup(lib, symbol);
+    return sym ? (void*)(lib->base + sym->st_value) : NULL;
 }
 
 /* dlclose – unload library */
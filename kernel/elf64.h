@@ -84,8 +84,19 @@ typedef struct {
 #define DT_REL          17
 #define DT_RELSZ        18
 #define DT_RELENT       19
+#define DT_PLTRELSZ     2
 #define DT_PLTREL       20
 #define DT_JMPREL       23
+#define DT_GNU_HASH     0x6FFFFEF5
+
+/* AArch64 relocation types */
+#define R_AARCH64_ABS64     257
+#define R_AARCH64_GLOB_DAT  1025
+#define R_AARCH64_JUMP_SLOT 1026
+#define R_AARCH64_RELATIVE  1027
+
+#define ELF64_R_SYM(i)      ((i) >> 32)
+#define ELF64_R_TYPE(i)     ((i) & 0xFFFFFFFF)
 
 typedef struct {
     int64_t d_tag;              // Dynamic entry type
@@ -102,7 +113,7 @@ typedef struct {
 
 typedef struct {
     uint64_t r_offset;          // Address offset
-    uint32_t r_type;            // Relocation type
+    uint64_t r_info;            // Symbol index (high) + relocation type (low)
     int64_t  r_addend;          // Constant addend
 } Elf64_Rela;
 
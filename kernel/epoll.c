@@ -0,0 +1,262 @@
+/*
+ * epoll.c – Readiness event queue for RISC OS Phoenix
+ * select() polls every fd on every call; this registers interest once
+ * and lets the producers push events when state actually changes
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "epoll.h"
+#include "vfs.h"
+#include "net.h"
+#include "slab.h"
+#include "timer.h"
+#include <string.h>
+
+#define MAX_EPOLLS      64
+
+/* One watched fd. Sits on two lists: the event object's item list and
+ * the target's watcher chain (where producers find it). */
+typedef struct epitem {
+    struct epoll_obj *ep;
+    int       fd;               /* Caller's key, echoed back in events */
+    uint32_t  interest;         /* Mask the caller asked for */
+    uint32_t  ready;            /* Latched events not yet collected */
+    void    **anchor;           /* Watcher chain this item hangs off */
+    struct epitem *watch_next;  /* Next watcher on the same target */
+    struct epitem *next;        /* Next item on the same event object */
+    struct epitem *ready_next;  /* Ready-list linkage */
+    int       queued;           /* On the ready list */
+} epitem_t;
+
+typedef struct epoll_obj {
+    int       used;
+    epitem_t *items;
+    epitem_t *ready_head;
+    epitem_t *ready_tail;
+    task_t   *waiter;           /* Task sleeping in epoll_wait */
+} epoll_obj_t;
+
+static epoll_obj_t epolls[MAX_EPOLLS];
+
+/* One lock covers all chains and ready lists. Producers take it for a
+ * few pointer moves; registration churn is rare. Lock order is always
+ * target lock (pipe/socket) first, epoll lock second. */
+static spinlock_t epoll_lock = SPINLOCK_INIT;
+
+/* Create an event object – returns its handle */
+int epoll_create(void) {
+    unsigned long flags;
+    spin_lock_irqsave(&epoll_lock, &flags);
+
+    for (int i = 0; i < MAX_EPOLLS; i++) {
+        if (!epolls[i].used) {
+            memset(&epolls[i], 0, sizeof(epoll_obj_t));
+            epolls[i].used = 1;
+            spin_unlock_irqrestore(&epoll_lock, flags);
+            return i;
+        }
+    }
+
+    spin_unlock_irqrestore(&epoll_lock, flags);
+    return -1;
+}
+
+/* Find the watcher anchor and current readiness for an fd. Files come
+ * first; fds that aren't files fall through to the socket table. */
+static void **epoll_resolve(int fd, uint32_t *ready_now) {
+    task_t *task = current_task;
+
+    if (task && fd >= 0 && fd < MAX_FD && task->files[fd]) {
+        file_t *file = task->files[fd];
+        if (ready_now) {
+            *ready_now = (file->f_ops && file->f_ops->poll)
+                             ? (uint32_t)file->f_ops->poll(file)
+                             : (POLLIN | POLLOUT);   /* Plain files: always ready */
+        }
+        return &file->watchers;
+    }
+
+    socket_t *sock = socket_get(fd);
+    if (sock) {
+        if (ready_now) *ready_now = socket_poll_ready(sock);
+        return socket_watch(sock);
+    }
+
+    return NULL;
+}
+
+/* Push an item onto its event object's ready list – epoll_lock held */
+static void epitem_mark_ready(epitem_t *item, uint32_t events) {
+    item->ready |= events;
+    if (!item->queued) {
+        item->queued = 1;
+        item->ready_next = NULL;
+        if (item->ep->ready_tail) item->ep->ready_tail->ready_next = item;
+        else item->ep->ready_head = item;
+        item->ep->ready_tail = item;
+    }
+    if (item->ep->waiter) {
+        task_wakeup(item->ep->waiter);
+        item->ep->waiter = NULL;
+    }
+}
+
+/* Register, modify or remove interest in one fd */
+int epoll_ctl(int epfd, int op, int fd, uint32_t events) {
+    if (epfd < 0 || epfd >= MAX_EPOLLS || !epolls[epfd].used) return -1;
+    epoll_obj_t *ep = &epolls[epfd];
+    unsigned long flags;
+
+    /* Poll the target before taking the epoll lock – the poll op takes
+     * the target's own lock and producers hold that when notifying */
+    uint32_t ready_now = 0;
+    void **anchor = epoll_resolve(fd, &ready_now);
+    if (!anchor) return -1;
+
+    if (op == EPOLL_CTL_ADD) {
+        epitem_t *item = kmalloc(sizeof(epitem_t));
+        if (!item) return -1;
+        memset(item, 0, sizeof(*item));
+        item->ep = ep;
+        item->fd = fd;
+        item->interest = events;
+        item->anchor = anchor;
+
+        spin_lock_irqsave(&epoll_lock, &flags);
+
+        item->next = ep->items;
+        ep->items = item;
+        item->watch_next = *anchor;
+        *anchor = item;
+
+        if (ready_now & events) {
+            epitem_mark_ready(item, ready_now & events);
+        }
+
+        spin_unlock_irqrestore(&epoll_lock, flags);
+        return 0;
+    }
+
+    spin_lock_irqsave(&epoll_lock, &flags);
+
+    /* Find the item for this fd */
+    epitem_t **ip = &ep->items;
+    while (*ip && (*ip)->fd != fd) ip = &(*ip)->next;
+    epitem_t *item = *ip;
+    if (!item) {
+        spin_unlock_irqrestore(&epoll_lock, flags);
+        return -1;
+    }
+
+    if (op == EPOLL_CTL_MOD) {
+        item->interest = events;
+        if (ready_now & events) {
+            epitem_mark_ready(item, ready_now & events);
+        }
+        spin_unlock_irqrestore(&epoll_lock, flags);
+        return 0;
+    }
+
+    if (op == EPOLL_CTL_DEL) {
+        *ip = item->next;
+
+        /* Off the target's watcher chain */
+        epitem_t **wp = (epitem_t**)item->anchor;
+        while (*wp && *wp != item) wp = &(*wp)->watch_next;
+        if (*wp) *wp = item->watch_next;
+
+        /* Off the ready list */
+        if (item->queued) {
+            epitem_t **rp = &ep->ready_head;
+            while (*rp && *rp != item) rp = &(*rp)->ready_next;
+            if (*rp) *rp = item->ready_next;
+            if (ep->ready_tail == item) {
+                ep->ready_tail = NULL;
+                for (epitem_t *r = ep->ready_head; r; r = r->ready_next)
+                    ep->ready_tail = r;
+            }
+        }
+
+        spin_unlock_irqrestore(&epoll_lock, flags);
+        kfree(item);
+        return 0;
+    }
+
+    spin_unlock_irqrestore(&epoll_lock, flags);
+    return -1;
+}
+
+static void epoll_timeout(timer_t *timer) {
+    task_wakeup((task_t*)timer->private);
+}
+
+/* Collect ready events, sleeping until at least one arrives or the
+ * timeout runs out. Only fds whose producers pushed are touched – no
+ * rescan of the watch set. */
+int epoll_wait(int epfd, epoll_event_t *events, int maxevents, int timeout_ms) {
+    if (epfd < 0 || epfd >= MAX_EPOLLS || !epolls[epfd].used) return -1;
+    if (maxevents <= 0) return -1;
+
+    epoll_obj_t *ep = &epolls[epfd];
+    unsigned long flags;
+    timer_t timer;
+    uint64_t deadline = 0;
+
+    if (timeout_ms > 0) {
+        deadline = get_time_ns() + timeout_ms * 1000000ULL;
+        timer_setup(&timer, epoll_timeout, current_task);
+        timer_schedule(&timer, timeout_ms);
+    }
+
+    spin_lock_irqsave(&epoll_lock, &flags);
+
+    while (!ep->ready_head) {
+        if (timeout_ms == 0 ||
+            (deadline && get_time_ns() >= deadline)) {
+            spin_unlock_irqrestore(&epoll_lock, flags);
+            if (timeout_ms > 0) timer_cancel(&timer);
+            return 0;
+        }
+
+        ep->waiter = current_task;
+        spin_unlock_irqrestore(&epoll_lock, flags);
+        task_block(TASK_BLOCKED);
+        schedule();
+        spin_lock_irqsave(&epoll_lock, &flags);
+    }
+
+    int n = 0;
+    while (ep->ready_head && n < maxevents) {
+        epitem_t *item = ep->ready_head;
+        ep->ready_head = item->ready_next;
+        if (!ep->ready_head) ep->ready_tail = NULL;
+
+        events[n].events = item->ready & item->interest;
+        events[n].fd = item->fd;
+        item->ready = 0;
+        item->queued = 0;
+        n++;
+    }
+
+    spin_unlock_irqrestore(&epoll_lock, flags);
+    if (timeout_ms > 0) timer_cancel(&timer);
+    return n;
+}
+
+/* Producer entry point: state changed on a watched target. Walks the
+ * target's watcher chain and queues every interested event object. */
+void epoll_notify(void **anchor, uint32_t events) {
+    if (!anchor || !*anchor) return;    /* Unwatched – the common case */
+
+    unsigned long flags;
+    spin_lock_irqsave(&epoll_lock, &flags);
+
+    for (epitem_t *item = *anchor; item; item = item->watch_next) {
+        if (events & item->interest) {
+            epitem_mark_ready(item, events & item->interest);
+        }
+    }
+
+    spin_unlock_irqrestore(&epoll_lock, flags);
+}
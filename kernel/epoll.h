@@ -0,0 +1,38 @@
+/*
+ * epoll.h – Readiness event queue for RISC OS Phoenix
+ * Register once, get pushed events – no per-call fd rescans
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef EPOLL_H
+#define EPOLL_H
+
+#include <stdint.h>
+
+/* Poll event bits (shared with f_ops->poll) */
+#ifndef POLLIN
+#define POLLIN      0x001
+#define POLLOUT     0x004
+#define POLLERR     0x008
+#define POLLHUP     0x010
+#endif
+
+#define EPOLL_CTL_ADD   1
+#define EPOLL_CTL_DEL   2
+#define EPOLL_CTL_MOD   3
+
+typedef struct epoll_event {
+    uint32_t events;
+    int      fd;
+} epoll_event_t;
+
+int epoll_create(void);
+int epoll_ctl(int epfd, int op, int fd, uint32_t events);
+int epoll_wait(int epfd, epoll_event_t *events, int maxevents, int timeout_ms);
+
+/* Producer side: push readiness onto every event queue watching the
+ * given chain anchor (file_t->watchers, socket watchers). Called at
+ * the moment state changes – pipe write, datagram arrival, etc. */
+void epoll_notify(void **anchor, uint32_t events);
+
+#endif /* EPOLL_H */
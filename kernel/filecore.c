@@ -8,7 +8,8 @@
 
 #include "kernel.h"
 #include "vfs.h"
-#include "blockdev.h"
+#include "blockdriver.h"
+#include "pagecache.h"
 #include <string.h>
 
 /* FileCore constants */
@@ -33,19 +34,79 @@ typedef struct {
     uint32_t sectors;
 } fcore_super_t;
 
+/* Hashed directory index: one probe instead of a linear scan over
+ * every entry. Built lazily on the first lookup in a directory,
+ * cached until a directory write invalidates it. */
+#define FCORE_HASH_BUCKETS   64
+#define FCORE_DIR_MAX_BLOCKS 64
+
+typedef struct fcore_hash_ent {
+    uint32_t hash;
+    uint32_t lba;           // Block holding the entry
+    uint16_t slot;          // Entry index within that block
+    struct fcore_hash_ent *next;
+} fcore_hash_ent_t;
+
+typedef struct {
+    uint32_t dir_lba;       // Directory this index describes
+    int      valid;
+    fcore_hash_ent_t *buckets[FCORE_HASH_BUCKETS];
+} fcore_dir_index_t;
+
+/* Contiguous run of sectors – files are lists of these instead of
+ * per-sector map entries, so big-file I/O stays sequential */
+#define FCORE_MAX_EXTENTS   16
+
+typedef struct {
+    uint32_t start;         // First sector of the run
+    uint32_t length;        // Sectors in the run
+} fcore_extent_t;
+
 /* FileCore private data */
 typedef struct {
     blockdev_t *dev;
     fcore_super_t super;
     uint32_t current_dir_lba;  // Current directory block
+    fcore_dir_index_t dir_index;  // Lazily built for current_dir_lba
+    uint8_t *free_map;         // One bit per sector, 1 = in use
 } fcore_fs_t;
 
+/* Per-open-file state: owning FS plus the file's extent list */
+typedef struct {
+    fcore_fs_t    *fs;
+    fcore_extent_t ext[FCORE_MAX_EXTENTS];
+    int            nr_ext;
+} fcore_inode_t;
+
+/* Sector allocation bitmap, 1 bit per sector */
+static inline int fcore_map_test(fcore_fs_t *fs, uint32_t sector) {
+    return fs->free_map[sector / 8] & (1 << (sector % 8));
+}
+
+static inline void fcore_map_set(fcore_fs_t *fs, uint32_t sector) {
+    fs->free_map[sector / 8] |= (1 << (sector % 8));
+}
+
+static inline void fcore_map_clear(fcore_fs_t *fs, uint32_t sector) {
+    fs->free_map[sector / 8] &= ~(1 << (sector % 8));
+}
+
+/* djb2 over the fixed 10-char name field */
+static uint32_t fcore_name_hash(const char *name) {
+    uint32_t h = 5381;
+    for (int i = 0; i < 10 && name[i]; i++) {
+        h = h * 33 + (uint8_t)name[i];
+    }
+    return h;
+}
+
 /* Ops for FileCore */
 file_ops_t fcore_ops = {
     .read = fcore_read,
     .write = fcore_write,
     .seek = fcore_seek,
-    .poll = NULL,  // Sync I/O
+    .poll = NULL,
+    .fsync = fcore_fsync,  // Writes are write-back via the page cache
     .close = fcore_close
 };
 
@@ -56,49 +117,194 @@ int fcore_mount(blockdev_t *dev, const char *mountpoint) {
 
     fs->dev = dev;
     fs->current_dir_lba = 0;  // Root dir
+    memset(&fs->dir_index, 0, sizeof(fs->dir_index));
 
     // Read superblock (stub – assume format known)
     vfs_block_read(dev, 0, 1, &fs->super);
 
+    /* In-memory sector allocation bitmap; the on-disk map at
+     * map_start seeds it (stub: start empty, metadata marked used) */
+    fs->free_map = kmalloc((fs->super.sectors + 7) / 8);
+    if (fs->free_map) {
+        memset(fs->free_map, 0, (fs->super.sectors + 7) / 8);
+        for (uint32_t s = 0; s < fs->super.data_start && s < fs->super.sectors; s++) {
+            fcore_map_set(fs, s);
+        }
+    }
+
     inode_t *root = vfs_alloc_inode();
     root->i_mode = S_IFDIR;
     root->private = fs;
-    root->f_ops = &fcore_ops;  // Dir ops
+    vfs_set_root(root);        // Path resolution starts here
 
     // Register mount (stub – add to VFS mount table)
     debug_print("FileCore mounted on %s at %s\n", dev->name, mountpoint);
     return 0;
 }
 
-/* Read from FileCore file */
+/* ==================== Extent allocator ==================== */
+
+/* Grab a contiguous run of up to 'want' sectors. Largest-run-first:
+ * one pass remembers the biggest free run seen, so files land in the
+ * emptiest stretch of the disk instead of the first hole. */
+static int fcore_alloc_extent(fcore_fs_t *fs, uint32_t want, fcore_extent_t *out) {
+    uint32_t best_start = 0, best_len = 0;
+    uint32_t run_start = 0, run_len = 0;
+
+    for (uint32_t s = fs->super.data_start; s < fs->super.sectors; s++) {
+        if (!fcore_map_test(fs, s)) {
+            if (run_len == 0) run_start = s;
+            run_len++;
+            if (run_len >= want) { best_start = run_start; best_len = run_len; break; }
+        } else {
+            if (run_len > best_len) { best_start = run_start; best_len = run_len; }
+            run_len = 0;
+        }
+    }
+    if (run_len > best_len) { best_start = run_start; best_len = run_len; }
+
+    if (best_len == 0) return -1;   // Disk full
+
+    out->start = best_start;
+    out->length = best_len < want ? best_len : want;
+    for (uint32_t s = out->start; s < out->start + out->length; s++) {
+        fcore_map_set(fs, s);
+    }
+    return 0;
+}
+
+/* Make sure the file has at least 'sectors' sectors allocated,
+ * growing the last extent in place when the disk allows */
+static int fcore_extend(inode_t *inode, uint32_t sectors) {
+    fcore_inode_t *fi = inode->private;
+    fcore_fs_t *fs = fi->fs;
+
+    uint32_t have = 0;
+    for (int i = 0; i < fi->nr_ext; i++) have += fi->ext[i].length;
+
+    while (have < sectors) {
+        fcore_extent_t ext;
+        if (fcore_alloc_extent(fs, sectors - have, &ext) != 0) return -1;
+
+        /* Merge when the new run continues the previous one */
+        fcore_extent_t *last = fi->nr_ext ? &fi->ext[fi->nr_ext - 1] : NULL;
+        if (last && last->start + last->length == ext.start) {
+            last->length += ext.length;
+        } else {
+            if (fi->nr_ext >= FCORE_MAX_EXTENTS) return -1;
+            fi->ext[fi->nr_ext++] = ext;
+        }
+        have += ext.length;
+    }
+    return 0;
+}
+
+/* Give a file's sectors back to the allocator. Each freed extent is
+ * passed to the device as a discard so the drive's garbage collector
+ * learns the blocks are dead; devices without TRIM get Write Zeroes
+ * instead, which at least keeps stale data from resurfacing. */
+static void fcore_free_extents(fcore_inode_t *fi) {
+    fcore_fs_t *fs = fi->fs;
+
+    for (int i = 0; i < fi->nr_ext; i++) {
+        fcore_extent_t *ext = &fi->ext[i];
+        for (uint32_t s = 0; s < ext->length; s++) {
+            fcore_map_clear(fs, ext->start + s);
+        }
+        if (blockdev_trim(fs->dev, ext->start, ext->length) != 0) {
+            blockdev_write_zeroes(fs->dev, ext->start, ext->length);
+        }
+    }
+    fi->nr_ext = 0;
+}
+
+/* Map a sector offset within the file to a device LBA, returning how
+ * many sectors remain contiguous from there */
+static int fcore_extent_map(fcore_inode_t *fi, uint32_t file_sector,
+                            uint32_t *lba, uint32_t *contig) {
+    uint32_t off = file_sector;
+    for (int i = 0; i < fi->nr_ext; i++) {
+        if (off < fi->ext[i].length) {
+            *lba = fi->ext[i].start + off;
+            *contig = fi->ext[i].length - off;
+            return 0;
+        }
+        off -= fi->ext[i].length;
+    }
+    return -1;
+}
+
+/* Read from FileCore file – one multi-block request per extent */
 ssize_t fcore_read(file_t *file, void *buf, size_t count) {
     inode_t *inode = file->f_inode;
-    fcore_fs_t *fs = inode->private;
+    fcore_inode_t *fi = inode->private;
+    uint32_t bs = fi->fs->dev->block_size;
+
+    uint32_t first = file->f_pos / bs;
+    uint32_t nsect = (file->f_pos % bs + count + bs - 1) / bs;
+    uint8_t *dst = buf;
+    ssize_t total = 0;
+
+    while (nsect > 0) {
+        uint32_t lba, contig;
+        if (fcore_extent_map(fi, first, &lba, &contig) != 0) break;
+        if (contig > nsect) contig = nsect;
 
-    // Read from data blocks (stub – compute LBA from dir entry)
-    uint64_t lba = inode->i_blocks * (fs->dev->block_size / 512);  // Example
-    return vfs_block_read(fs->dev, lba + file->f_pos / fs->dev->block_size,
-                          (file->f_pos + count + fs->dev->block_size - 1) / fs->dev->block_size,
-                          buf);
+        ssize_t got = vfs_block_read(fi->fs->dev, lba, contig, dst);
+        if (got < 0) break;
+
+        dst += got;
+        total += got;
+        first += contig;
+        nsect -= contig;
+    }
+
+    return total ? total : -1;
 }
 
-/* Write to FileCore file */
+/* Write to FileCore file – extends the extent list as needed */
 ssize_t fcore_write(file_t *file, const void *buf, size_t count) {
     inode_t *inode = file->f_inode;
-    fcore_fs_t *fs = inode->private;
+    fcore_inode_t *fi = inode->private;
+    uint32_t bs = fi->fs->dev->block_size;
+
+    uint32_t first = file->f_pos / bs;
+    uint32_t nsect = (file->f_pos % bs + count + bs - 1) / bs;
+
+    if (fcore_extend(inode, first + nsect) != 0) return -1;
+
+    const uint8_t *src = buf;
+    ssize_t total = 0;
 
-    // Write to data blocks (stub)
-    uint64_t lba = inode->i_blocks * (fs->dev->block_size / 512);
-    ssize_t written = vfs_block_write(fs->dev, lba + file->f_pos / fs->dev->block_size,
-                                      (file->f_pos + count + fs->dev->block_size - 1) / fs->dev->block_size,
-                                      buf);
+    while (nsect > 0) {
+        uint32_t lba, contig;
+        if (fcore_extent_map(fi, first, &lba, &contig) != 0) break;
+        if (contig > nsect) contig = nsect;
 
-    if (written > 0) {
-        inode->i_size += written;
-        inode->i_blocks += (written + fs->dev->block_size - 1) / fs->dev->block_size;
+        ssize_t put = vfs_block_write(fi->fs->dev, lba, contig, (void*)src);
+        if (put < 0) break;
+
+        src += put;
+        total += put;
+        first += contig;
+        nsect -= contig;
+    }
+
+    if (total > 0) {
+        inode->i_size += total;
+        inode->i_blocks += (total + bs - 1) / bs;
     }
 
-    return written;
+    return total ? total : -1;
+}
+
+/* fsync – push this device's dirty page-cache blocks to the medium.
+ * Normal writes stay write-back: the PageCacheFlush task batches and
+ * LBA-sorts them in the background. */
+int fcore_fsync(file_t *file) {
+    fcore_inode_t *fi = file->f_inode->private;
+    pagecache_sync(fi->fs->dev);
+    return 0;
 }
 
 /* Seek in FileCore file */
@@ -120,40 +326,127 @@ void fcore_close(file_t *file) {
     }
 }
 
+/* Throw the cached index away – any directory write does this */
+static void fcore_index_invalidate(fcore_fs_t *fs) {
+    fcore_dir_index_t *idx = &fs->dir_index;
+
+    for (int b = 0; b < FCORE_HASH_BUCKETS; b++) {
+        fcore_hash_ent_t *ent = idx->buckets[b];
+        while (ent) {
+            fcore_hash_ent_t *next = ent->next;
+            kfree(ent);
+            ent = next;
+        }
+        idx->buckets[b] = NULL;
+    }
+    idx->valid = 0;
+}
+
+/* One scan over the directory builds the whole index; every later
+ * lookup is a hash probe plus a single block read */
+static int fcore_index_build(fcore_fs_t *fs) {
+    fcore_dir_index_t *idx = &fs->dir_index;
+    int per_block = fs->dev->block_size / sizeof(fcore_dir_entry_t);
+    fcore_dir_entry_t *entries = kmalloc(fs->dev->block_size);
+    if (!entries) return -1;
+
+    fcore_index_invalidate(fs);
+    idx->dir_lba = fs->current_dir_lba;
+
+    for (int blk = 0; blk < FCORE_DIR_MAX_BLOCKS; blk++) {
+        uint32_t lba = fs->current_dir_lba + blk;
+        if (vfs_block_read(fs->dev, lba, 1, entries) < 0) break;
+
+        int end = 0;
+        for (int i = 0; i < per_block; i++) {
+            if (entries[i].name[0] == '\0') { end = 1; break; }  // Terminator
+
+            uint32_t hash = fcore_name_hash(entries[i].name);
+            fcore_hash_ent_t *ent = kmalloc(sizeof(fcore_hash_ent_t));
+            if (!ent) { kfree(entries); return -1; }
+
+            ent->hash = hash;
+            ent->lba = lba;
+            ent->slot = i;
+            ent->next = idx->buckets[hash % FCORE_HASH_BUCKETS];
+            idx->buckets[hash % FCORE_HASH_BUCKETS] = ent;
+        }
+        if (end) break;
+    }
+
+    kfree(entries);
+    idx->valid = 1;
+    return 0;
+}
+
 /* Update directory entry with file type/size */
 static void update_dir_entry(inode_t *inode) {
-    fcore_fs_t *fs = inode->private;
+    fcore_fs_t *fs = ((fcore_inode_t*)inode->private)->fs;
 
     // Read dir block, update entry (stub)
     fcore_dir_entry_t entry;
     // ... compute entry LBA, read, update load_addr with file_type, size
     vfs_block_write(fs->dev, entry_lba, 1, &entry);
+
+    fcore_index_invalidate(fs);     // Entry moved/changed – index is stale
 }
 
-/* Open FileCore file – parse dir entry for type */
+/* Open FileCore file – hash probe on the directory index */
 file_t *fcore_open(fcore_fs_t *fs, const char *name, int flags) {
-    // Read current dir block
-    fcore_dir_entry_t entries[32];  // Stub size
-    vfs_block_read(fs->dev, fs->current_dir_lba, 1, entries);
-
-    for (int i = 0; i < 32; i++) {
-        if (strncmp((char*)entries[i].name, name, 10) == 0) {
-            inode_t *inode = vfs_alloc_inode();
-            inode->i_mode = entries[i].dir_type == 0xFF ? S_IFDIR : S_IFREG;
-            inode->i_size = *(uint32_t*)entries[i].size;
-            inode->file_type = *(uint16_t*)entries[i].load_addr & 0xFFF;  // Extract type
-            inode->private = fs;
-
-            file_t *file = vfs_alloc_file();
-            file->f_inode = inode;
-            file->f_pos = 0;
-            file->f_flags = flags;
-            file->f_ops = &fcore_ops;
-
-            return file;
+    fcore_dir_index_t *idx = &fs->dir_index;
+
+    if (!idx->valid || idx->dir_lba != fs->current_dir_lba) {
+        if (fcore_index_build(fs) != 0) return NULL;
+    }
+
+    uint32_t hash = fcore_name_hash(name);
+    fcore_dir_entry_t *entries = kmalloc(fs->dev->block_size);
+    if (!entries) return NULL;
+
+    for (fcore_hash_ent_t *ent = idx->buckets[hash % FCORE_HASH_BUCKETS];
+         ent; ent = ent->next) {
+        if (ent->hash != hash) continue;
+
+        /* Probable match – one block read to confirm the name */
+        if (vfs_block_read(fs->dev, ent->lba, 1, entries) < 0) continue;
+        fcore_dir_entry_t *e = &entries[ent->slot];
+        if (strncmp(e->name, name, 10) != 0) continue;   // Hash collision
+
+        inode_t *inode = vfs_alloc_inode();
+        inode->i_mode = e->dir_type == 0xFF ? S_IFDIR : S_IFREG;
+        inode->i_size = *(uint32_t*)e->size;
+        inode->file_type = *(uint16_t*)e->load_addr & 0xFFF;  // Extract type
+
+        fcore_inode_t *fi = kmalloc(sizeof(fcore_inode_t));
+        if (!fi) { kfree(entries); return NULL; }
+        memset(fi, 0, sizeof(*fi));
+        fi->fs = fs;
+        /* Existing files: the dir entry's exec field holds the first
+         * extent (start, length) until the on-disk map is reworked */
+        fi->ext[0].start = *(uint32_t*)e->exec_addr;
+        fi->ext[0].length = (inode->i_size + fs->dev->block_size - 1)
+                            / fs->dev->block_size;
+        fi->nr_ext = fi->ext[0].length ? 1 : 0;
+        inode->private = fi;
+
+        /* Truncation drops the old extents straight into the discard
+         * path – no zero-filled writes through the page cache */
+        if ((flags & O_TRUNC) && inode->i_mode == S_IFREG) {
+            fcore_free_extents(fi);
+            inode->i_size = 0;
         }
+
+        file_t *file = vfs_alloc_file();
+        file->f_inode = inode;
+        file->f_pos = 0;
+        file->f_flags = flags;
+        file->f_ops = &fcore_ops;
+
+        kfree(entries);
+        return file;
     }
 
+    kfree(entries);
     return NULL;
 }
 
@@ -180,8 +473,9 @@ int fcore_exec(const char *path) {
 _kernel_oserror *module_init(const char *arg, int podule)
 {
     // Auto-mount on block devices (stub)
-    for (int i = 0; i < blockdev_count; i++) {
-        fcore_mount(blockdev_list[i], "/");
+    blockdev_snap_t *snap = blockdev_snapshot();
+    for (int i = 0; snap && i < snap->count; i++) {
+        fcore_mount(snap->devs[i], "/");
     }
     debug_print("FileCore loaded\n");
     return NULL;
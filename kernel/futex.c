@@ -0,0 +1,117 @@
+/*
+ * futex.c – Fast userspace mutexes for RISC OS Phoenix
+ * Hash table of wait queues keyed by physical address; the kernel is
+ * only entered on contention, uncontended locks are a userland CAS
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "futex.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include <string.h>
+
+#define KERNEL_VIRT_BASE    0xFFFF000000000000ULL
+
+#define FUTEX_HASH_BUCKETS  256
+
+/* Keys are physical addresses so tasks sharing a page (threads, shm)
+ * meet on the same queue regardless of where it's mapped */
+typedef struct futex_waiter {
+    uint64_t key;
+    task_t  *task;
+    struct futex_waiter *next;
+} futex_waiter_t;
+
+typedef struct {
+    futex_waiter_t *head;
+    spinlock_t      lock;
+} futex_bucket_t;
+
+static futex_bucket_t futex_table[FUTEX_HASH_BUCKETS];
+
+static inline futex_bucket_t *futex_bucket(uint64_t key) {
+    /* Word-aligned keys – fold the useful bits down */
+    uint64_t h = (key >> 2) * 0x9E3779B97F4A7C15ULL;
+    return &futex_table[(h >> 56) & (FUTEX_HASH_BUCKETS - 1)];
+}
+
+/* Resolve the word's address to its physical key. Kernel-half
+ * addresses are linear-mapped, so they translate directly and meet
+ * user mappings of the same page on the same queue. */
+static uint64_t futex_key(uint32_t *uaddr) {
+    uint64_t va = (uint64_t)uaddr;
+    if (va >= KERNEL_VIRT_BASE) return va - KERNEL_VIRT_BASE;
+    return mmu_virt_to_phys(current_task, va);
+}
+
+/* Sleep while *uaddr == val. The value check happens under the bucket
+ * lock, so a wake between the user's failed CAS and the wait here
+ * cannot be lost. */
+int futex_wait(uint32_t *uaddr, uint32_t val) {
+    uint64_t key = futex_key(uaddr);
+    if (!key) return -1;
+
+    futex_bucket_t *bucket = futex_bucket(key);
+    futex_waiter_t waiter = { .key = key, .task = current_task };
+
+    unsigned long flags;
+    spin_lock_irqsave(&bucket->lock, &flags);
+
+    if (__atomic_load_n(uaddr, __ATOMIC_ACQUIRE) != val) {
+        spin_unlock_irqrestore(&bucket->lock, flags);
+        return -1;      /* Lock word moved – caller retries its CAS */
+    }
+
+    waiter.next = bucket->head;
+    bucket->head = &waiter;
+
+    /* Go blocked while still holding the bucket lock: a futex_wake
+     * that runs the moment we drop it finds TASK_BLOCKED and re-queues
+     * us, so the wake cannot fall in the gap before schedule(). */
+    current_task->state = TASK_BLOCKED;
+
+    spin_unlock_irqrestore(&bucket->lock, flags);
+    schedule();
+
+    /* Woken – futex_wake unlinked us. A wakeup from elsewhere (signal,
+     * timer) leaves us queued, so unlink ourselves if still present. */
+    spin_lock_irqsave(&bucket->lock, &flags);
+    for (futex_waiter_t **p = &bucket->head; *p; p = &(*p)->next) {
+        if (*p == &waiter) {
+            *p = waiter.next;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&bucket->lock, flags);
+
+    return 0;
+}
+
+/* Wake up to n waiters on uaddr */
+int futex_wake(uint32_t *uaddr, int n) {
+    uint64_t key = futex_key(uaddr);
+    if (!key) return 0;
+
+    futex_bucket_t *bucket = futex_bucket(key);
+    int woken = 0;
+
+    unsigned long flags;
+    spin_lock_irqsave(&bucket->lock, &flags);
+
+    futex_waiter_t **p = &bucket->head;
+    while (*p && woken < n) {
+        if ((*p)->key == key) {
+            futex_waiter_t *w = *p;
+            *p = w->next;           /* Unlink before waking – w is on
+                                       the sleeper's stack */
+            task_wakeup(w->task);
+            woken++;
+        } else {
+            p = &(*p)->next;
+        }
+    }
+
+    spin_unlock_irqrestore(&bucket->lock, flags);
+    return woken;
+}
@@ -0,0 +1,19 @@
+/*
+ * futex.h – Fast userspace mutex interface for RISC OS Phoenix
+ * Wait/wake on a 32-bit user word; uncontended locks stay in userland
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <stdint.h>
+
+/* Sleep while *uaddr still equals val. Returns 0 after a wakeup, -1
+ * when the value already changed (caller should retry its CAS). */
+int futex_wait(uint32_t *uaddr, uint32_t val);
+
+/* Wake up to n tasks waiting on uaddr. Returns the number woken. */
+int futex_wake(uint32_t *uaddr, int n);
+
+#endif /* FUTEX_H */
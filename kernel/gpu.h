@@ -0,0 +1,31 @@
+/*
+ * gpu.h – GPU texture and immediate-draw API for RISC OS Phoenix
+ * Implemented across the Vulkan/GLES/software tiers in drivers/gpu
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef GPU_H
+#define GPU_H
+
+#include "wimp.h"
+
+int gpu_init(void);
+void gpu_redraw_window(window_t *win);
+
+/* Window and atlas backing textures. The CPU-side pixel copy is the
+ * source of truth on every tier: the GLES tier mirrors it into gl_id,
+ * the software tier composites from it directly, and the Vulkan tier
+ * stages from it when the texture is bound. */
+struct gpu_texture *gpu_create_texture(int width, int height);
+void gpu_clear_texture(struct gpu_texture *tex, uint32_t color);
+void gpu_texture_update(struct gpu_texture *tex, int x, int y, int w, int h,
+                        const void *pixels);
+
+/* Immediate 2D chrome – menus, window furniture and glyph batches.
+ * These draw through the software rasterizer's framebuffer. */
+void gpu_draw_rect(int x, int y, int w, int h, uint32_t color);
+void gpu_draw_arrow(int x, int y);
+void gpu_draw_quad_batch(struct gpu_texture *tex, const gpu_quad_t *quads,
+                         int n, uint32_t color);
+
+#endif /* GPU_H */
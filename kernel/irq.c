@@ -6,6 +6,7 @@
 
 #include "kernel.h"
 #include "spinlock.h"
+#include "mmu.h"
 #include <stdint.h>
 
 #define GIC_DIST_BASE   0xFF841000ULL  // Pi 5 GIC distributor
@@ -22,6 +23,7 @@
 #define GICD_IPRIORITYR(n) (0x0400 + (n)*4)
 #define GICD_ITARGETSR(n) (0x0800 + (n)*4)
 #define GICD_ICFGR(n)     (0x0C00 + (n)*4)
+#define GICD_IROUTER(n)   (0x6000 + (n)*8)
 
 #define GICR_CTLR       0x0000
 #define GICR_WAKER      0x0014
@@ -51,6 +53,13 @@ static spinlock_t irq_lock = SPINLOCK_INIT;
 /* Per-CPU GIC redistributor */
 static void *gic_redist[MAX_CPUS];
 
+/* Reschedule IPI coalescing: one SGI in flight per target core is
+ * enough – schedule() picks up everything queued meanwhile anyway */
+static volatile uint32_t resched_inflight[MAX_CPUS];
+static volatile uint32_t need_resched[MAX_CPUS];
+uint64_t ipi_resched_sent[MAX_CPUS];
+uint64_t ipi_resched_suppressed[MAX_CPUS];
+
 /* Initialize GICv3 distributor (core 0 only) */
 static void gic_dist_init(void) {
     void *dist = ioremap(GIC_DIST_BASE, PAGE_SIZE);
@@ -145,6 +154,18 @@ void irq_unmask(int vector)
     }
 }
 
+/* Route an SPI to one core via GICv3 affinity routing. MSI-X capable
+ * devices (NVMe) use this to land each queue's vector on the CPU that
+ * owns the queue, so completions never cross cores. */
+void irq_set_affinity(int vector, int cpu)
+{
+    if (vector < 32) return;    // SGIs/PPIs are per-core already
+
+    void *dist = ioremap(GIC_DIST_BASE, PAGE_SIZE);
+    /* Affinity level 0 = core number on the Pi 5 (single cluster) */
+    writeq((uint64_t)cpu, dist + GICD_IROUTER(vector));
+}
+
 /* EOI (End of Interrupt) */
 void irq_eoi(int vector)
 {
@@ -175,6 +196,13 @@ void irq_handler(void)
     }
 
     writel(iar, redist + GICR_EOIR0);
+
+    /* Interrupt exit: run any reschedule that was coalesced while the
+     * handler was busy */
+    int cpu = get_cpu_id();
+    if (__atomic_exchange_n(&need_resched[cpu], 0, __ATOMIC_ACQ_REL)) {
+        schedule();
+    }
 }
 
 /* Send IPI to target CPUs */
@@ -183,6 +211,16 @@ void send_ipi(uint64_t target_cpus, int ipi_id, uint64_t arg)
     // Target_cpus = bitmask (1 << cpu_id)
     for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
         if (target_cpus & (1ULL << cpu)) {
+            if (ipi_id == IPI_RESCHEDULE) {
+                /* Coalesce: skip the SGI if one is already in flight */
+                if (__atomic_exchange_n(&resched_inflight[cpu], 1,
+                                        __ATOMIC_ACQ_REL)) {
+                    ipi_resched_suppressed[cpu]++;
+                    continue;
+                }
+                ipi_resched_sent[cpu]++;
+            }
+
             // SGI to target CPU
             uint64_t val = (1ULL << 40) | ((uint64_t)cpu << 16) | ipi_id;
             __asm__ volatile ("msr sgi1r_el1, %0" :: "r"(val));
@@ -196,16 +234,15 @@ void ipi_handler(int ipi_id, uint64_t arg)
 {
     switch (ipi_id) {
         case IPI_TLB_SHOOTDOWN:
-            if (arg == 0) {
-                __asm__ volatile ("tlbi vmalle1\n dsb ish\n isb");
-            } else {
-                __asm__ volatile ("tlbi vae1, %0\n dsb ish\n isb" :: "r"(arg >> PAGE_SHIFT));
-            }
-            debug_print("IPI: TLB shootdown on CPU %d for 0x%llx\n", get_cpu_id(), arg);
+            /* Apply the initiator's batched VA list (or full flush) */
+            mmu_shootdown_ipi();
             break;
 
         case IPI_RESCHEDULE:
-            schedule();
+            /* Open the gate for the next sender first, then defer the
+             * actual schedule() to interrupt exit */
+            __atomic_store_n(&resched_inflight[get_cpu_id()], 0, __ATOMIC_RELEASE);
+            __atomic_store_n(&need_resched[get_cpu_id()], 1, __ATOMIC_RELEASE);
             break;
 
         // Add more IPIs as needed
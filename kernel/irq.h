@@ -12,6 +12,8 @@
 #define TIMER_IRQ_VECTOR  0x1F  // Example vector for timer
 #define MMC_IRQ_VECTOR    0x20  // MMC/SD interrupt
 #define NVME_IRQ_BASE     0x30  // Base for NVMe MSIX vectors
+#define XHCI_IRQ_BASE     0x40  // Base for xHCI interrupter MSIX vectors
+#define PCI_MSIX_IRQ_BASE 0x50  // Pool for managed MSI-X (pci_alloc_vectors)
 
 typedef void (*irq_handler_t)(int vector, void *private);
 
@@ -19,10 +21,15 @@ void irq_init(void);
 void irq_set_handler(int vector, irq_handler_t handler, void *private);
 void irq_unmask(int vector);
 void irq_eoi(int vector);
+void irq_set_affinity(int vector, int cpu);
 
 void send_ipi(uint64_t target_cpus, int ipi_id, uint64_t arg);
 void ipi_handler(int ipi_id, uint64_t arg);
 
+/* Reschedule IPI coalescing counters (sent vs suppressed, per target) */
+extern uint64_t ipi_resched_sent[];
+extern uint64_t ipi_resched_suppressed[];
+
 #define IPI_TLB_SHOOTDOWN 1
 #define IPI_RESCHEDULE    2
 
@@ -5,6 +5,12 @@
  */
 
 #include "kernel.h"
+#include "page_alloc.h"
+#include "slab.h"
+#include "pagecache.h"
+#include "memops.h"
+#include "vdso.h"
+#include "trace.h"
 
 extern void sched_init(void);
 extern void irq_init(void);
@@ -16,10 +22,79 @@ extern void net_init(void);
 extern void wimp_init(void);
 extern void register_default_handlers(void);
 
+extern void smp_boot_secondaries(void);
+
 /* Global kernel state */
 int nr_cpus = 1;
 task_t *current_task = NULL;
 
+/* Init-task ordering: a stage publishes its flag with release
+ * semantics when it finishes; dependents poll before starting */
+static volatile int storage_ready;
+static volatile int fs_ready;
+
+static void init_wait(volatile int *flag) {
+    while (!__atomic_load_n(flag, __ATOMIC_ACQUIRE)) {
+        yield();
+    }
+}
+
+/* Init tasks never return – park the finished one for good */
+static void init_done(void) {
+    while (1) {
+        task_block(TASK_BLOCKED);
+        schedule();
+    }
+}
+
+static void init_storage_work(void) {
+    pci_scan_bus();             // Scan PCI devices (NVMe, xHCI, etc.)
+    __atomic_store_n(&storage_ready, 1, __ATOMIC_RELEASE);
+    init_done();
+}
+
+static void init_fs_work(void) {
+    init_wait(&storage_ready);  // FileCore mounts the probed devices
+    vfs_init();
+    pagecache_init();           // Block-layer page cache + flusher
+    filecore_init();            // RISC OS FileCore
+#ifdef CONFIG_SCHED_STATS
+    sched_stats_vfs_init();     // Proc:SchedStats scrape node
+#endif
+    trace_vfs_init();           // Proc:Trace ring drain node
+    __atomic_store_n(&fs_ready, 1, __ATOMIC_RELEASE);
+    init_done();
+}
+
+static void init_net_work(void) {
+    init_wait(&storage_ready);  // The NIC sits behind the same bus scan
+    net_init();                 // PhoenixNet TCP/IP stack
+    init_done();
+}
+
+#ifdef CONFIG_BENCH
+extern void bench_suite_task(void);
+
+/* Bench image only: kick the suite once everything it times is up */
+static void init_bench_work(void) {
+    init_wait(&fs_ready);
+    task_create("BenchSuite", bench_suite_task, 10, 0);
+    init_done();
+}
+#endif
+
+static void init_ui_work(void) {
+    /* No storage dependency: the Wimp polls while drives still probe */
+    wimp_init();
+    task_create("Wimp", wimp_task, 0, (1ULL << 0));   // Pin to core 0
+
+    /* The apps open files, so hold them until the FS stack is up */
+    init_wait(&fs_ready);
+    task_create("Paint64", paint_task, 10, 0);
+    task_create("NetSurf64", netsurf_task, 10, 0);
+    init_done();
+}
+
 /* Main kernel entry point */
 __attribute__((noreturn))
 void kernel_main(uint64_t dtb_ptr)
@@ -34,25 +109,40 @@ void kernel_main(uint64_t dtb_ptr)
     debug_print("Detected %d CPU cores\n", nr_cpus);
 
     /* 2. Initialize core subsystems */
+    memops_init();              // Pick wide copy/checksum variants
+
+    /* Hand all RAM above the kernel image/heap to the buddy allocator.
+     * 16MB..1GB is safe on every Pi 5 variant until the device tree
+     * memory node is parsed properly. */
+    page_alloc_init(16ULL << 20, (1ULL << 30) - (16ULL << 20));
+    kmem_init();                // kmalloc size-class slab caches
     mmu_init();                 // Memory Management Unit + protection
+    rcu_init();                 // Read-copy-update grace periods
+    task_caches_init();         // Slab caches for task structs/kernel stacks
     sched_init();               // Multi-core scheduler
     irq_init();                 // GICv3 interrupt controller
     timer_init();               // ARM Generic Timer
-
-    /* 3. Device & bus initialization */
-    pci_scan_bus();             // Scan PCI devices (NVMe, xHCI, etc.)
-
-    /* 4. Filesystem & VFS */
-    vfs_init();
-    filecore_init();            // RISC OS FileCore
-
-    /* 5. Networking */
-    net_init();                 // PhoenixNet TCP/IP stack
-
-    /* 6. User Interface */
-    wimp_init();
-
-    /* 7. Default signal handlers */
+    vdso_init();                // Userspace timestamp fast path
+
+    /* 3. Release the secondary cores. sched_init_cpu/irq_init/
+     * timer_init_cpu run concurrently on each of them while the
+     * primary carries on below. */
+    smp_boot_secondaries();
+
+    /* 4. Everything off the critical path becomes an init task.
+     * Only the console, timer and scheduler were needed to get here;
+     * storage probing, the filesystem stack, networking and the
+     * desktop each come up on whatever core is free, ordered by the
+     * ready flags in the workers below. */
+    task_create("InitStorage", init_storage_work, 5, 0);
+    task_create("InitFS", init_fs_work, 5, 0);
+    task_create("InitNet", init_net_work, 5, 0);
+    task_create("InitUI", init_ui_work, 5, 0);
+#ifdef CONFIG_BENCH
+    task_create("InitBench", init_bench_work, 5, 0);
+#endif
+
+    /* 5. Default signal handlers – cheap, stays synchronous */
     register_default_handlers();
 
     debug_print("\n");
@@ -75,17 +165,10 @@ void kernel_main(uint64_t dtb_ptr)
     }
 }
 
-/* Example init process */
+/* Example init process – the desktop is launched by InitUI now */
 void init_process(void)
 {
-    debug_print("Init process started – launching desktop...\n");
-
-    /* Start Wimp desktop task */
-    task_create("Wimp", wimp_task, 0, (1ULL << 0));  // Pin to core 0
-
-    /* Start example apps */
-    task_create("Paint64", paint_task, 10, 0);
-    task_create("NetSurf64", netsurf_task, 10, 0);
+    debug_print("Init process started\n");
 
     /* Idle loop */
     while (1) {
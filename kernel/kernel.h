@@ -25,8 +25,16 @@ typedef int32_t pid_t;
 #define TASK_MIN_PRIORITY   0
 #define TASK_MAX_PRIORITY   255
 
+/* O(1) runqueue: one bucket per priority, 256-bit find-first-set bitmap */
+#define SCHED_PRIO_LEVELS   (TASK_MAX_PRIORITY - TASK_MIN_PRIORITY + 1)
+#define SCHED_BITMAP_WORDS  (SCHED_PRIO_LEVELS / 64)
+
 #define IPI_RESCHEDULE      2
 
+/* Comment out to compile the scheduler statistics out of the hot path */
+#define CONFIG_SCHED_STATS  1
+#define SCHED_LAT_BUCKETS   20   /* log2 us buckets: <1us .. >512ms */
+
 /* ELF constants */
 #define EI_CLASS            4
 #define EI_DATA             5
@@ -46,8 +54,27 @@ typedef int32_t pid_t;
 #define PROT_WRITE          2
 #define PROT_EXEC           4
 
+/* mmap flags */
+#define MAP_PRIVATE         0x02
+#define MAP_ANONYMOUS       0x20
+#define MAP_FAILED          ((void *)-1)
+
 #define SEEK_SET            0
 
+/* Virtual memory area – one per mmap()ed or ELF-loaded region.
+ * Pages are not populated up front: the data abort handler faults them
+ * in and reads file-backed contents through the VFS only when touched. */
+typedef struct vma {
+    struct vma  *next;
+    uint64_t     start;
+    uint64_t     end;
+    int          prot;
+    int          flags;
+    void        *file;          /* file_t*, NULL for anonymous */
+    uint64_t     file_off;      /* Offset of 'start' within the file */
+    uint64_t     file_len;      /* Bytes backed by the file (rest zero-fill) */
+} vma_t;
+
 /* Spinlock */
 typedef struct {
     uint32_t value;
@@ -55,6 +82,19 @@ typedef struct {
 
 #define SPINLOCK_INIT {0}
 
+/* MCS queued spinlock – each waiter spins on its own node with WFE, so
+ * contended locks stop bouncing one cache line across all cores */
+typedef struct mcs_node {
+    struct mcs_node *next;
+    volatile uint32_t locked;
+} mcs_node_t;
+
+typedef struct {
+    mcs_node_t *tail;
+} mcs_lock_t;
+
+#define MCS_LOCK_INIT {0}
+
 /* Signal State */
 typedef struct signal_state {
     void (*handlers[32])(int);
@@ -62,6 +102,7 @@ typedef struct signal_state {
     uint64_t blocked;
     uint64_t old_mask;
     uint64_t sigreturn_sp;
+    void    *sigfd;         // signalfd queue draining these signals, if any
 } signal_state_t;
 
 /* Task Structure */
@@ -96,17 +137,40 @@ struct task {
     void           *files[MAX_FD];
     void           *cwd;
     signal_state_t  signal_state;
+    uint64_t        wakeup_ns;      // When task_wakeup() queued us (stats)
+    vma_t          *vma_list;       // Demand-paged regions
+    uint64_t        mmap_next;      // Next free address for mmap(NULL, ...)
 };
 
+#ifdef CONFIG_SCHED_STATS
+/* Per-CPU scheduler statistics – scraped via the Proc:SchedStats node */
+typedef struct {
+    uint64_t ctx_switches;
+    uint64_t preemptions;
+    uint64_t wakeups;
+    uint64_t wakeup_samples;
+    uint64_t wakeup_lat_total_ns;
+    uint64_t wakeup_lat_max_ns;
+    uint64_t wakeup_lat_hist[SCHED_LAT_BUCKETS];
+} sched_stats_t;
+#endif
+
 /* Scheduler structure */
 typedef struct {
     task_t     *current;
     task_t     *idle_task;
-    task_t     *runqueue_head;
-    task_t     *runqueue_tail;
-    spinlock_t  lock;
+    task_t     *prio_head[SCHED_PRIO_LEVELS];   // One FIFO bucket per priority
+    task_t     *prio_tail[SCHED_PRIO_LEVELS];
+    uint64_t    prio_bitmap[SCHED_BITMAP_WORDS]; // Bit set = bucket non-empty
+    mcs_lock_t  lock;
     int         cpu_id;
+    int         nr_ready;                        // Tasks currently queued
     uint64_t    schedule_count;
+    uint64_t    steal_count;                     // Tasks stolen from other CPUs
+    uint64_t    stolen_count;                    // Tasks other CPUs took from us
+#ifdef CONFIG_SCHED_STATS
+    sched_stats_t stats;
+#endif
 } cpu_sched_t;
 
 extern cpu_sched_t cpu_sched[MAX_CPUS];   // SINGLE extern
@@ -117,12 +181,17 @@ void debug_print(const char *fmt, ...);
 
 void sched_init(void);
 void sched_init_cpu(int cpu_id);
+#ifdef CONFIG_SCHED_STATS
+void sched_stats_vfs_init(void);
+#endif
 void schedule(void);
 void yield(void);
 void task_block(task_state_t state);
 void task_wakeup(task_t *task);
 
+void task_caches_init(void);
 task_t *task_create(const char *name, void (*entry)(void), int priority, uint64_t cpu_affinity);
+void task_destroy(task_t *task);
 int fork(void);
 int execve(const char *pathname, char *const argv[], char *const envp[]);
 pid_t wait(int *wstatus);
@@ -131,6 +200,10 @@ pid_t waitpid(pid_t pid, int *wstatus, int options);
 void mmu_init(void);
 void mmu_init_task(task_t *task);
 int mmu_map(task_t *task, uint64_t virt, uint64_t size, int prot, int guard);
+int mmu_map_huge(task_t *task, uint64_t virt, uint64_t size, int prot);
+vma_t *vma_create(task_t *task, uint64_t start, uint64_t length, int prot,
+                  void *file, uint64_t file_off, uint64_t file_len);
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
 int mmu_duplicate_pagetable(task_t *parent, task_t *child);
 void mmu_free_usermemory(task_t *task);
 void mmu_free_pagetable(task_t *task);
@@ -138,8 +211,12 @@ void mmu_free_pagetable(task_t *task);
 void timer_init(void);
 void timer_init_cpu(void);
 void timer_tick(void);
+void timer_program_next(int cpu);
+void timer_resume_tick(int cpu);
+uint64_t get_time_ns(void);
 
 void irq_init(void);
+void rcu_init(void);
 
 void device_tree_parse(uint64_t dtb_ptr);
 int detect_nr_cpus(void);
@@ -0,0 +1,182 @@
+/*
+ * memops.c – Arch-optimized bulk memory and checksum routines
+ * At 10GbE line rate a byte-wise checksum saturates a core, so the RX
+ * hot path (ip_checksum, udp_checksum, tcp_checksum) and every payload
+ * copy route through here instead.
+ *
+ * The kernel builds with -mgeneral-regs-only: taking NEON registers in
+ * EL1 would mean saving/restoring the FP state of whatever task we
+ * interrupted, which costs more than it saves on short packets. The
+ * "wide" variants therefore run 64 bits at a time through the general
+ * registers – an unrolled pair-load loop that the A72 issues two per
+ * cycle – and the boot-time probe keeps the dispatch structure so a
+ * NEON build can slot vector variants in later.
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "memops.h"
+
+/* Unaligned 64-bit access – AArch64 handles these in hardware on
+ * normal memory, so packet buffers need no alignment games */
+typedef struct { uint64_t v; } __attribute__((packed)) u64_una_t;
+typedef struct { uint32_t v; } __attribute__((packed)) u32_una_t;
+typedef struct { uint16_t v; } __attribute__((packed)) u16_una_t;
+
+static inline uint64_t ld64(const void *p) { return ((const u64_una_t *)p)->v; }
+static inline uint32_t ld32(const void *p) { return ((const u32_una_t *)p)->v; }
+static inline uint16_t ld16(const void *p) { return ((const u16_una_t *)p)->v; }
+static inline void st64(void *p, uint64_t v) { ((u64_una_t *)p)->v = v; }
+
+/* ------------------------------------------------------------------ */
+/*  memcpy / memset                                                   */
+/* ------------------------------------------------------------------ */
+
+static void *memcpy_bytes(void *dst, const void *src, size_t n)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    while (n--) *d++ = *s++;
+    return dst;
+}
+
+static void *memcpy_wide(void *dst, const void *src, size_t n)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+
+    /* 64 bytes per iteration – eight load/store pairs */
+    while (n >= 64) {
+        uint64_t a = ld64(s),      b = ld64(s + 8);
+        uint64_t c = ld64(s + 16), e = ld64(s + 24);
+        uint64_t f = ld64(s + 32), g = ld64(s + 40);
+        uint64_t h = ld64(s + 48), i = ld64(s + 56);
+        st64(d, a);      st64(d + 8, b);
+        st64(d + 16, c); st64(d + 24, e);
+        st64(d + 32, f); st64(d + 40, g);
+        st64(d + 48, h); st64(d + 56, i);
+        d += 64; s += 64; n -= 64;
+    }
+    while (n >= 8) {
+        st64(d, ld64(s));
+        d += 8; s += 8; n -= 8;
+    }
+    while (n--) *d++ = *s++;
+    return dst;
+}
+
+static void *memset_bytes(void *dst, int c, size_t n)
+{
+    uint8_t *d = dst;
+    while (n--) *d++ = (uint8_t)c;
+    return dst;
+}
+
+static void *memset_wide(void *dst, int c, size_t n)
+{
+    uint8_t *d = dst;
+    uint64_t pat = (uint8_t)c;
+    pat |= pat << 8;
+    pat |= pat << 16;
+    pat |= pat << 32;
+
+    while (n >= 64) {
+        st64(d, pat);      st64(d + 8, pat);
+        st64(d + 16, pat); st64(d + 24, pat);
+        st64(d + 32, pat); st64(d + 40, pat);
+        st64(d + 48, pat); st64(d + 56, pat);
+        d += 64; n -= 64;
+    }
+    while (n >= 8) {
+        st64(d, pat);
+        d += 8; n -= 8;
+    }
+    while (n--) *d++ = (uint8_t)c;
+    return dst;
+}
+
+/* Dispatch pointers – byte variants until memops_init() has probed the
+ * CPU, so early boot code can already copy safely */
+static void *(*memcpy_impl)(void *, const void *, size_t) = memcpy_bytes;
+static void *(*memset_impl)(void *, int, size_t) = memset_bytes;
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+    return memcpy_impl(dst, src, n);
+}
+
+void *memset(void *s, int c, size_t n)
+{
+    return memset_impl(s, c, n);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Internet checksum                                                 */
+/* ------------------------------------------------------------------ */
+
+/* Ones-complement add: wrap the carry back in */
+static inline uint64_t csum_add64(uint64_t sum, uint64_t v)
+{
+    sum += v;
+    return sum + (sum < v);
+}
+
+uint64_t csum_partial(const void *data, size_t len, uint64_t sum)
+{
+    const uint8_t *p = data;
+
+    /* 32 bytes per iteration keeps four loads in flight */
+    while (len >= 32) {
+        sum = csum_add64(sum, ld64(p));
+        sum = csum_add64(sum, ld64(p + 8));
+        sum = csum_add64(sum, ld64(p + 16));
+        sum = csum_add64(sum, ld64(p + 24));
+        p += 32; len -= 32;
+    }
+    while (len >= 8) {
+        sum = csum_add64(sum, ld64(p));
+        p += 8; len -= 8;
+    }
+    if (len >= 4) {
+        sum = csum_add64(sum, ld32(p));
+        p += 4; len -= 4;
+    }
+    if (len >= 2) {
+        sum = csum_add64(sum, ld16(p));
+        p += 2; len -= 2;
+    }
+    if (len)
+        sum = csum_add64(sum, *p);
+
+    return sum;
+}
+
+uint16_t csum_fold(uint64_t sum)
+{
+    sum = (sum >> 32) + (sum & 0xFFFFFFFFULL);
+    sum = (sum >> 32) + (sum & 0xFFFFFFFFULL);
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    return (uint16_t)~sum;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Boot-time variant selection                                       */
+/* ------------------------------------------------------------------ */
+
+void memops_init(void)
+{
+    uint64_t pfr0;
+    __asm__ volatile ("mrs %0, id_aa64pfr0_el1" : "=r"(pfr0));
+
+    /* AdvSIMD field, bits [23:20]: 0xF = not implemented. Every core
+     * we target has it, but the probe keeps the dispatch honest – the
+     * kernel text itself stays general-register-only either way. */
+    int advsimd = ((pfr0 >> 20) & 0xF) != 0xF;
+
+    memcpy_impl = memcpy_wide;
+    memset_impl = memset_wide;
+
+    debug_print("memops: 64-bit wide copy/checksum selected (AdvSIMD %s)\n",
+                advsimd ? "present" : "absent");
+}
@@ -0,0 +1,27 @@
+/*
+ * memops.h – Arch-optimized bulk memory and checksum routines
+ * Variant selection happens once at boot via memops_init()
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef MEMOPS_H
+#define MEMOPS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Boot-time CPU feature probe; picks the widest variants the core and
+ * build flags allow. Safe to call before the MMU is up. */
+void memops_init(void);
+
+/* Ones-complement accumulation over 'len' bytes folded into 'sum'.
+ * Runs 64 bits wide – callers fold to 16 bits with csum_fold(). */
+uint64_t csum_partial(const void *data, size_t len, uint64_t sum);
+uint16_t csum_fold(uint64_t sum);
+
+/* Freestanding libc symbols – the compiler emits calls to these for
+ * struct copies even with -fno-builtin, so the kernel must own them */
+void *memcpy(void *dst, const void *src, size_t n);
+void *memset(void *s, int c, size_t n);
+
+#endif /* MEMOPS_H */
@@ -5,7 +5,12 @@
  */
 
 #include "kernel.h"
+#include "mmu.h"
 #include "spinlock.h"
+#include "irq.h"        /* IPI_TLB_SHOOTDOWN */
+#include "page_alloc.h"
+#include "vfs.h"
+#include "vdso.h"
 #include <stdint.h>
 #include <string.h>
 
@@ -41,19 +46,154 @@
 #define PROT_WRITE      2
 #define PROT_EXEC       4
 
+/* Kernel direct map */
+#define KERNEL_VIRT_BASE 0xFFFF000000000000ULL
+#define PHYS_MEM_MAX     (8ULL << 30)   /* Pi 5 tops out at 8GB */
+
 /* Global kernel page table – mapped at boot */
 static uint64_t *kernel_pgt_l0;
 
-/* Physical memory allocator stub */
-static uint64_t phys_alloc_page(void) {
-    // TODO: Implement real allocator
-    return (uint64_t)kmalloc(PAGE_SIZE) - KERNEL_VIRT_BASE;  // Example
+/* Per-page reference counts – shared pages (COW) bump these */
+static uint8_t page_refs[PHYS_MEM_MAX / PAGE_SIZE];
+static spinlock_t page_ref_lock = SPINLOCK_INIT;
+
+void page_ref_inc(uint64_t phys) {
+    unsigned long flags;
+    spin_lock_irqsave(&page_ref_lock, &flags);
+    page_refs[phys >> PAGE_SHIFT]++;
+    spin_unlock_irqrestore(&page_ref_lock, flags);
+}
+
+/* Drop a reference; returns the new count */
+int page_ref_dec(uint64_t phys) {
+    unsigned long flags;
+    spin_lock_irqsave(&page_ref_lock, &flags);
+    int refs = --page_refs[phys >> PAGE_SHIFT];
+    spin_unlock_irqrestore(&page_ref_lock, flags);
+    return refs;
+}
+
+int page_ref_count(uint64_t phys) {
+    return page_refs[phys >> PAGE_SHIFT];
+}
+
+static inline void *phys_to_virt(uint64_t phys) {
+    return (void*)(phys + KERNEL_VIRT_BASE);
+}
+
+/* TLB maintenance – batched shootdown.
+ * Unmapping a large space (task exit tears down the whole 8MB user
+ * stack) used to raise one broadcast invalidation per page. Invalidates
+ * are now collected into a batch: one IPI per flush epoch, remote cores
+ * walk the VA list, and anything past the threshold degrades to a
+ * single full flush. */
+#define TLB_BATCH_MAX           32
+#define TLB_FULL_FLUSH_PAGES    64
+
+typedef struct {
+    int               count;
+    int               full_flush;
+    uint64_t          va[TLB_BATCH_MAX];
+    volatile uint64_t pending_cpus;     /* Bit per core still to ack */
+} tlb_batch_t;
+
+static tlb_batch_t tlb_batch;
+static spinlock_t tlb_lock = SPINLOCK_INIT;
+
+/* Apply the current batch on the calling core */
+static void tlb_apply_batch(tlb_batch_t *batch)
+{
+    __asm__ volatile ("dsb ishst");
+    if (batch->full_flush) {
+        __asm__ volatile ("tlbi vmalle1");
+    } else {
+        for (int i = 0; i < batch->count; i++) {
+            __asm__ volatile ("tlbi vaae1, %0" :: "r"(batch->va[i] >> PAGE_SHIFT));
+        }
+    }
+    __asm__ volatile ("dsb ish\n isb");
+}
+
+/* Remote side of a shootdown. Called from ipi_handler(), and polled by
+ * cores spinning for the batch lock below – a core's ack bit makes the
+ * work idempotent, so whichever path runs first does the flush and the
+ * other finds nothing to do. */
+void mmu_shootdown_ipi(void)
+{
+    uint64_t bit = 1ULL << get_cpu_id();
+
+    if (__atomic_load_n(&tlb_batch.pending_cpus, __ATOMIC_ACQUIRE) & bit) {
+        tlb_apply_batch(&tlb_batch);
+        __atomic_and_fetch(&tlb_batch.pending_cpus, ~bit, __ATOMIC_ACQ_REL);
+    }
+}
+
+/* Take the batch lock with IRQs masked, servicing shootdowns while we
+ * spin. The holder may be waiting for our ack, and its IPI cannot land
+ * once our own IRQs are off – waiting passively here deadlocks both
+ * cores. */
+static unsigned long tlb_lock_acquire(void)
+{
+    unsigned long flags;
+
+    __asm__ volatile ("mrs %0, daif" : "=r"(flags));
+    __asm__ volatile ("msr daifset, #3" ::: "memory");
+
+    while (!spin_trylock(&tlb_lock))
+        mmu_shootdown_ipi();
+
+    return flags;
+}
+
+/* Run one flush epoch: apply locally, one IPI to everyone else, wait */
+static void tlb_run_batch(void)
+{
+    tlb_apply_batch(&tlb_batch);
+
+    uint64_t others = ((1ULL << nr_cpus) - 1) & ~(1ULL << get_cpu_id());
+    if (others) {
+        __atomic_store_n(&tlb_batch.pending_cpus, others, __ATOMIC_RELEASE);
+        send_ipi(others, IPI_TLB_SHOOTDOWN, 0);
+        while (__atomic_load_n(&tlb_batch.pending_cpus, __ATOMIC_ACQUIRE))
+            ;
+    }
+
+    tlb_batch.count = 0;
+    tlb_batch.full_flush = 0;
+}
+
+void mmu_tlb_invalidate_all(void)
+{
+    unsigned long flags = tlb_lock_acquire();
+    tlb_batch.full_flush = 1;
+    tlb_run_batch();
+    spin_unlock_irqrestore(&tlb_lock, flags);
 }
 
-static void phys_free_page(uint64_t page) {
-    // TODO: Implement
+void mmu_tlb_invalidate_addr(uint64_t virt, uint64_t size)
+{
+    uint64_t npages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    unsigned long flags = tlb_lock_acquire();
+
+    if (npages > TLB_FULL_FLUSH_PAGES) {
+        tlb_batch.full_flush = 1;
+    } else {
+        uint64_t va = virt & PAGE_MASK;
+        for (uint64_t i = 0; i < npages; i++, va += PAGE_SIZE) {
+            if (tlb_batch.count == TLB_BATCH_MAX) {
+                /* Batch full mid-range – flush what we have and refill */
+                tlb_run_batch();
+            }
+            tlb_batch.va[tlb_batch.count++] = va;
+        }
+    }
+    tlb_run_batch();
+
+    spin_unlock_irqrestore(&tlb_lock, flags);
 }
 
+/* Physical pages come from the buddy allocator (page_alloc.c) */
+
 /* Allocate new page table level */
 static uint64_t *pt_alloc_level(void) {
     uint64_t *pt = kmalloc(PAGE_SIZE);
@@ -97,17 +237,21 @@ static uint64_t *mmu_walk_pte(task_t *task, uint64_t va, int create)
         pte = (uint64_t*)(pmd[idx] & PAGE_MASK);
     }
 
-    // L3
+    // L3 – hand back the slot; the caller decides what backs it
     idx = (va >> L3_SHIFT) & (PT_ENTRIES - 1);
-    if (!(pte[idx] & PTE_VALID)) {
-        if (!create) return NULL;
-        uint64_t page = phys_alloc_page();
-        pte[idx] = page | PTE_VALID | PTE_PAGE | PTE_AF | PTE_SH_INNER | PTE_USER | PTE_RW;  // Default RW
-    }
-
     return &pte[idx];
 }
 
+/* Resolve a user VA to its physical address through the task's page
+ * tables. Returns 0 when the page isn't mapped. Used by futex keys so
+ * the same lock word hashes identically across address spaces. */
+uint64_t mmu_virt_to_phys(task_t *task, uint64_t va)
+{
+    uint64_t *pte = mmu_walk_pte(task, va, 0);
+    if (!pte || !(*pte & PTE_VALID)) return 0;
+    return (*pte & PAGE_MASK) | (va & (PAGE_SIZE - 1));
+}
+
 /* Walk page table and free all levels */
 static void pt_free(uint64_t *l0) {
     for (int i = 0; i < PT_ENTRIES; i++) {
@@ -191,27 +335,136 @@ void mmu_init_task(task_t *task) {
     // Guard page below stack
     mmu_map(task, stack_base - USER_STACK_SIZE - PAGE_SIZE, PAGE_SIZE, PROT_NONE, 1);
 
+    // vDSO data page – read-only, same VA in every task
+    if (vdso_page_phys()) {
+        mmu_map_phys(task, VDSO_VA, vdso_page_phys(), PAGE_SIZE, PROT_READ);
+    }
+
     debug_print("MMU: Task %s page table initialized\n", task->name);
 }
 
-/* Map virtual range in task table */
+#define BLOCK_SIZE_2M   (1ULL << L2_SHIFT)
+#define BLOCK_MASK_2M   (BLOCK_SIZE_2M - 1)
+#define BLOCK_ORDER_2M  9   /* 512 x 4KB pages */
+
+static uint64_t mmu_make_attr(int prot)
+{
+    uint64_t attr = PTE_VALID | PTE_AF | PTE_SH_INNER | PTE_USER;
+    if (prot & PROT_WRITE) attr |= PTE_RW;
+    else attr |= PTE_RO;
+    if (!(prot & PROT_EXEC)) attr |= PTE_UXN;
+    return attr;
+}
+
+/* Walk to the L2 entry for a VA – for 2MB block mappings */
+static uint64_t *mmu_walk_pmd(task_t *task, uint64_t va)
+{
+    uint64_t *pgd = task->pgtable_l0;
+    uint64_t *pud, *pmd;
+
+    uint64_t idx = (va >> L0_SHIFT) & (PT_ENTRIES - 1);
+    if (!(pgd[idx] & PTE_VALID)) {
+        pud = pt_alloc_level();
+        pgd[idx] = (uint64_t)pud | PTE_VALID | PTE_TABLE;
+    } else {
+        pud = (uint64_t*)(pgd[idx] & PAGE_MASK);
+    }
+
+    idx = (va >> L1_SHIFT) & (PT_ENTRIES - 1);
+    if (!(pud[idx] & PTE_VALID)) {
+        pmd = pt_alloc_level();
+        pud[idx] = (uint64_t)pmd | PTE_VALID | PTE_TABLE;
+    } else {
+        pmd = (uint64_t*)(pud[idx] & PAGE_MASK);
+    }
+
+    return &pmd[(va >> L2_SHIFT) & (PT_ENTRIES - 1)];
+}
+
+/* Map one 2MB L2 block entry */
+static int mmu_map_block(task_t *task, uint64_t virt, int prot)
+{
+    uint64_t phys = phys_alloc_pages(BLOCK_ORDER_2M);
+    if (!phys) return -1;
+
+    uint64_t *pmd = mmu_walk_pmd(task, virt);
+    if (!pmd || (*pmd & PTE_VALID)) {
+        phys_free_pages(phys, BLOCK_ORDER_2M);
+        return -1;
+    }
+
+    page_ref_inc(phys);
+    *pmd = phys | (mmu_make_attr(prot) & ~PTE_TABLE) | PTE_BLOCK;
+    return 0;
+}
+
+/* Map virtual range in task table.
+ * Size- and alignment-eligible stretches use 2MB L2 block entries so
+ * big regions (heap, framebuffers) stop burning one TLB entry per 4KB. */
 int mmu_map(task_t *task, uint64_t virt, uint64_t size, int prot, int guard)
 {
+    uint64_t start = virt;
     uint64_t end = virt + size;
 
-    for (; virt < end; virt += PAGE_SIZE) {
+    while (virt < end) {
+        if (!guard && !(virt & BLOCK_MASK_2M) && end - virt >= BLOCK_SIZE_2M) {
+            if (mmu_map_block(task, virt, prot) == 0) {
+                virt += BLOCK_SIZE_2M;
+                continue;
+            }
+            /* No contiguous run available – fall through to 4KB pages */
+        }
+
         uint64_t *pte = mmu_walk_pte(task, virt, 1);
         if (!pte) return -1;
 
         uint64_t phys = phys_alloc_page();
         page_ref_inc(phys);  // Initial refcount = 1
 
-        uint64_t attr = PTE_VALID | PTE_PAGE | PTE_AF | PTE_SH_INNER | PTE_USER;
-        if (prot & PROT_WRITE) attr |= PTE_RW;
-        if (!(prot & PROT_EXEC)) attr |= PTE_UXN;
+        uint64_t attr = mmu_make_attr(prot) | PTE_PAGE;
         if (guard) attr &= ~PTE_VALID;  // Invalid for fault
 
         *pte = phys | attr;
+        virt += PAGE_SIZE;
+    }
+
+    mmu_tlb_invalidate_addr(start, size);
+    return 0;
+}
+
+/* Map an existing physical range into a task's tables – shared memory
+ * regions land in several address spaces this way. Pages are
+ * refcounted per mapping so the backing survives until the last
+ * unmap. */
+int mmu_map_phys(task_t *task, uint64_t virt, uint64_t phys, uint64_t size, int prot)
+{
+    uint64_t start = virt;
+    uint64_t end = virt + size;
+
+    while (virt < end) {
+        uint64_t *pte = mmu_walk_pte(task, virt, 1);
+        if (!pte) return -1;
+
+        page_ref_inc(phys);
+        *pte = phys | mmu_make_attr(prot) | PTE_PAGE;
+
+        virt += PAGE_SIZE;
+        phys += PAGE_SIZE;
+    }
+
+    mmu_tlb_invalidate_addr(start, size);
+    return 0;
+}
+
+/* Explicit huge mapping: the whole range must be 2MB aligned and sized.
+ * For callers that want guaranteed block entries (GPU textures, NVMe
+ * queue memory) rather than best-effort promotion. */
+int mmu_map_huge(task_t *task, uint64_t virt, uint64_t size, int prot)
+{
+    if ((virt & BLOCK_MASK_2M) || (size & BLOCK_MASK_2M)) return -1;
+
+    for (uint64_t va = virt; va < virt + size; va += BLOCK_SIZE_2M) {
+        if (mmu_map_block(task, va, prot) != 0) return -1;
     }
 
     mmu_tlb_invalidate_addr(virt, size);
@@ -239,7 +492,7 @@ int mmu_duplicate_pagetable(task_t *parent, task_t *child)
                         // Recurse lower levels (L2/L3)
                         uint64_t *old_l2 = (uint64_t*)(old_l1[j] & PAGE_MASK);
                         uint64_t *new_l2 = pt_alloc_level();
-                        old_l1[j] = (uint64_t)new_l2 | PTE_VALID | PTE_TABLE;
+                        new_l1[j] = (uint64_t)new_l2 | PTE_VALID | PTE_TABLE;
 
                         for (int k = 0; k < PT_ENTRIES; k++) {
                             if (old_l2[k] & PTE_VALID) {
@@ -247,8 +500,332 @@ int mmu_duplicate_pagetable(task_t *parent, task_t *child)
                                     // L3
                                     uint64_t *old_l3 = (uint64_t*)(old_l2[k] & PAGE_MASK);
                                     uint64_t *new_l3 = pt_alloc_level();
-                                    old_l2[k] = (uint64_t)new_l3 | PTE_VALID | PTE_TABLE;
+                                    new_l2[k] = (uint64_t)new_l3 | PTE_VALID | PTE_TABLE;
 
                                     for (int m = 0; m < PT_ENTRIES; m++) {
                                         if (old_l3[m] & PTE_VALID) {
-                                            new_l3[m]
\ No newline at end of file
+                                            /* Share the page read-only in BOTH
+                                             * address spaces and mark it COW –
+                                             * no data is copied here */
+                                            old_l3[m] |= PTE_RO | PTE_COW;
+                                            new_l3[m] = old_l3[m];
+                                            page_ref_inc(old_l3[m] & PAGE_MASK);
+                                        }
+                                    }
+                                } else {
+                                    new_l2[k] = old_l2[k];  // 2MB block – shared
+                                }
+                            }
+                        }
+                    } else {
+                        new_l1[j] = old_l1[j];
+                    }
+                }
+            }
+        }
+    }
+
+    child->pgtable_l0 = new_l0;
+
+    /* Parent PTEs just lost write permission – flush stale entries */
+    mmu_tlb_invalidate_all();
+    return 0;
+}
+
+/* COW write fault: copy the page only when it is actually shared */
+static void mmu_cow_fault(task_t *task, uint64_t va, uint64_t *pte)
+{
+    uint64_t old_phys = *pte & PAGE_MASK;
+
+    if (page_ref_count(old_phys) == 1) {
+        /* Sole owner now – just restore write permission */
+        *pte &= ~(PTE_RO | PTE_COW);
+    } else {
+        uint64_t new_phys = phys_alloc_page();
+        memcpy(phys_to_virt(new_phys), phys_to_virt(old_phys), PAGE_SIZE);
+        page_ref_inc(new_phys);
+        page_ref_dec(old_phys);
+        *pte = new_phys | ((*pte & ~PAGE_MASK & ~(PTE_RO | PTE_COW)));
+    }
+
+    mmu_tlb_invalidate_addr(va, PAGE_SIZE);
+    debug_print("MMU: COW fault resolved for %s at 0x%llx\n", task->name, va);
+}
+
+/* ==================== Demand paging (VMAs) ==================== */
+
+#define MMAP_BASE   0x0000400000000000ULL
+
+/* Record a demand-paged region; no pages are populated here */
+vma_t *vma_create(task_t *task, uint64_t start, uint64_t length, int prot,
+                  void *file, uint64_t file_off, uint64_t file_len)
+{
+    vma_t *vma = kmalloc(sizeof(vma_t));
+    if (!vma) return NULL;
+
+    vma->start = start & PAGE_MASK;
+    vma->end = (start + length + PAGE_SIZE - 1) & PAGE_MASK;
+    vma->prot = prot;
+    vma->flags = 0;
+    vma->file = file;
+    vma->file_off = file_off;
+    vma->file_len = file_len;
+
+    vma->next = task->vma_list;
+    task->vma_list = vma;
+    return vma;
+}
+
+static vma_t *vma_find(task_t *task, uint64_t addr)
+{
+    for (vma_t *vma = task->vma_list; vma; vma = vma->next) {
+        if (addr >= vma->start && addr < vma->end) return vma;
+    }
+    return NULL;
+}
+
+/* ==================== Shared text pages ==================== */
+
+/* Read-only file-backed pages (program text and rodata) are identical
+ * for every task running the same binary, so they are faulted in once
+ * and shared: a second NetSurf64 maps the first one's pages instead of
+ * reading megabytes again. Keyed by (inode, byte offset of the page in
+ * the file); sharing rides the ordinary page refcounts – the table
+ * holds one reference of its own and entries are reclaimed lazily once
+ * no mapping is left. Writable data never lands here. */
+#define TEXT_HASH_BUCKETS   256
+
+typedef struct text_page {
+    struct text_page *next;
+    void     *inode;            /* inode_t* – stable across file_t's */
+    uint64_t  off;              /* Offset of the page within the file */
+    uint64_t  phys;
+} text_page_t;
+
+static text_page_t *text_hash[TEXT_HASH_BUCKETS];
+static spinlock_t text_lock = SPINLOCK_INIT;
+
+static inline int text_bucket(void *inode, uint64_t off)
+{
+    uint64_t h = (uint64_t)inode ^ (off >> PAGE_SHIFT);
+    return (int)((h ^ (h >> 16)) & (TEXT_HASH_BUCKETS - 1));
+}
+
+/* Look up a shared page; on a hit the caller owns a new reference */
+static uint64_t text_page_lookup(void *inode, uint64_t off)
+{
+    unsigned long flags;
+    uint64_t phys = 0;
+
+    spin_lock_irqsave(&text_lock, &flags);
+    for (text_page_t *tp = text_hash[text_bucket(inode, off)]; tp; tp = tp->next) {
+        if (tp->inode == inode && tp->off == off) {
+            phys = tp->phys;
+            page_ref_inc(phys);
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&text_lock, flags);
+    return phys;
+}
+
+/* Publish a freshly read page. Two tasks can fault the same page at
+ * once; whoever inserts second frees their copy and takes the winner's
+ * instead. Returns the physical page the caller must map (with the
+ * caller's reference already accounted). */
+static uint64_t text_page_insert(void *inode, uint64_t off, uint64_t phys)
+{
+    int bucket = text_bucket(inode, off);
+    unsigned long flags;
+
+    spin_lock_irqsave(&text_lock, &flags);
+
+    /* Reap stale entries in this chain: refcount 1 means only the
+     * table still holds the page – every mapping is gone */
+    text_page_t **link = &text_hash[bucket];
+    while (*link) {
+        text_page_t *tp = *link;
+        if (page_ref_count(tp->phys) == 1) {
+            *link = tp->next;
+            page_ref_dec(tp->phys);
+            phys_free_page(tp->phys);
+            kfree(tp);
+            continue;
+        }
+        if (tp->inode == inode && tp->off == off) {
+            /* Lost the race – adopt the published page */
+            uint64_t winner = tp->phys;
+            page_ref_inc(winner);
+            spin_unlock_irqrestore(&text_lock, flags);
+            if (page_ref_dec(phys) == 0) phys_free_page(phys);
+            return winner;
+        }
+        link = &tp->next;
+    }
+
+    text_page_t *tp = kmalloc(sizeof(text_page_t));
+    if (tp) {
+        tp->inode = inode;
+        tp->off = off;
+        tp->phys = phys;
+        page_ref_inc(phys);         /* The table's own reference */
+        tp->next = text_hash[bucket];
+        text_hash[bucket] = tp;
+    }
+    /* kmalloc failure just means this page stays private – harmless */
+
+    spin_unlock_irqrestore(&text_lock, flags);
+    return phys;
+}
+
+/* mmap(): create the VMA only – pages fault in lazily, and file-backed
+ * pages read their blocks through the VFS the first time they are hit */
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+    task_t *task = current_task;
+    file_t *file = NULL;
+
+    if (!(flags & MAP_ANONYMOUS)) {
+        if (fd < 0 || fd >= MAX_FD || !task->files[fd]) return MAP_FAILED;
+        file = task->files[fd];
+    }
+
+    uint64_t start = (uint64_t)addr;
+    if (!start) {
+        if (!task->mmap_next) task->mmap_next = MMAP_BASE;
+        start = task->mmap_next;
+        task->mmap_next += (length + PAGE_SIZE - 1) & PAGE_MASK;
+    }
+
+    uint64_t file_len = file ? length : 0;
+    if (!vma_create(task, start, length, prot, file, offset, file_len)) {
+        return MAP_FAILED;
+    }
+
+    debug_print("mmap: %s 0x%llx +%ld for %s\n",
+                file ? "file" : "anon", start, length, task->name);
+    return (void *)start;
+}
+
+/* First touch of a demand-paged address: allocate the page, pull in the
+ * backing file blocks if any, and wire up the PTE. Read-only file pages
+ * go through the shared text table so instances of the same binary
+ * resolve to one physical copy. */
+static int mmu_demand_fault(task_t *task, uint64_t far)
+{
+    vma_t *vma = vma_find(task, far);
+    if (!vma) return -1;
+
+    uint64_t va = far & PAGE_MASK;
+    uint64_t page_off = va - vma->start;
+    int shareable = vma->file && !(vma->prot & PROT_WRITE);
+    void *inode = shareable ? ((file_t *)vma->file)->f_inode : NULL;
+
+    /* Another instance may already have paid for the read */
+    uint64_t phys = shareable
+        ? text_page_lookup(inode, vma->file_off + page_off) : 0;
+
+    if (!phys) {
+        phys = phys_alloc_page();
+        if (!phys) return -1;
+        page_ref_inc(phys);
+
+        if (vma->file && page_off < vma->file_len) {
+            size_t want = vma->file_len - page_off;
+            if (want > PAGE_SIZE) want = PAGE_SIZE;
+
+            file_t *file = vma->file;
+            vfs_seek(file, vma->file_off + page_off, SEEK_SET);
+            vfs_read(file, phys_to_virt(phys), want);
+        }
+        /* Remainder of the page is already zero (buddy clears on alloc) */
+
+        if (shareable) {
+            phys = text_page_insert(inode, vma->file_off + page_off, phys);
+        }
+    }
+
+
+    uint64_t *pte = mmu_walk_pte(task, va, 1);
+    if (!pte) {
+        if (page_ref_dec(phys) == 0) phys_free_page(phys);
+        return -1;
+    }
+
+    uint64_t attr = PTE_VALID | PTE_PAGE | PTE_AF | PTE_SH_INNER | PTE_USER;
+    if (vma->prot & PROT_WRITE) attr |= PTE_RW;
+    else attr |= PTE_RO;
+    if (!(vma->prot & PROT_EXEC)) attr |= PTE_UXN;
+
+    *pte = phys | attr;
+    mmu_tlb_invalidate_addr(va, PAGE_SIZE);
+    return 0;
+}
+
+/* Data abort entry – from the EL1 exception vectors */
+#define ESR_EC_SHIFT    26
+#define ESR_WNR         (1ULL << 6)   /* Write, not read */
+
+void data_abort_handler(uint64_t esr, uint64_t far)
+{
+    task_t *task = current_task;
+
+    if (task) {
+        uint64_t *pte = mmu_walk_pte(task, far, 0);
+
+        /* COW write to a shared page */
+        if ((esr & ESR_WNR) && pte && (*pte & PTE_VALID) && (*pte & PTE_COW)) {
+            mmu_cow_fault(task, far & PAGE_MASK, pte);
+            return;
+        }
+
+        /* Translation fault inside a VMA – demand page it in */
+        if ((!pte || !(*pte & PTE_VALID)) && mmu_demand_fault(task, far) == 0) {
+            return;
+        }
+    }
+
+    debug_print("MMU: unhandled data abort ESR=0x%llx FAR=0x%llx in %s\n",
+                esr, far, task ? task->name : "?");
+    halt_system();
+}
+
+/* Free all user mappings (lower half), dropping page references */
+void mmu_free_usermemory(task_t *task)
+{
+    uint64_t *l0 = task->pgtable_l0;
+    for (int i = 0; i < 256; i++) {
+        if (l0[i] & PTE_VALID) {
+            uint64_t *l1 = (uint64_t*)(l0[i] & PAGE_MASK);
+            for (int j = 0; j < PT_ENTRIES; j++) {
+                if (!(l1[j] & PTE_VALID) || !(l1[j] & PTE_TABLE)) continue;
+                uint64_t *l2 = (uint64_t*)(l1[j] & PAGE_MASK);
+                for (int k = 0; k < PT_ENTRIES; k++) {
+                    if (!(l2[k] & PTE_VALID) || !(l2[k] & PTE_TABLE)) continue;
+                    uint64_t *l3 = (uint64_t*)(l2[k] & PAGE_MASK);
+                    for (int m = 0; m < PT_ENTRIES; m++) {
+                        if (l3[m] & PTE_VALID) {
+                            uint64_t phys = l3[m] & PAGE_MASK;
+                            if (page_ref_dec(phys) == 0) {
+                                phys_free_page(phys);
+                            }
+                        }
+                    }
+                    kfree(l3);
+                }
+                kfree(l2);
+            }
+            kfree(l1);
+            l0[i] = 0;
+        }
+    }
+    mmu_tlb_invalidate_all();
+}
+
+/* Free entire page table including user memory */
+void mmu_free_pagetable(task_t *task)
+{
+    mmu_free_usermemory(task);
+    kfree(task->pgtable_l0);
+    task->pgtable_l0 = NULL;
+}
\ No newline at end of file
@@ -4,8 +4,14 @@
 void mmu_init(void);
 void mmu_init_task(task_t *task);
 int mmu_map(task_t *task, uint64_t virt, uint64_t size, int prot, int guard);
+int mmu_map_huge(task_t *task, uint64_t virt, uint64_t size, int prot);
+int mmu_map_phys(task_t *task, uint64_t virt, uint64_t phys, uint64_t size, int prot);
 int mmu_duplicate_pagetable(task_t *parent, task_t *child);
+uint64_t mmu_virt_to_phys(task_t *task, uint64_t va);
 void mmu_free_usermemory(task_t *task);
 void data_abort_handler(uint64_t esr, uint64_t far);
+void mmu_shootdown_ipi(void);
+void mmu_tlb_invalidate_all(void);
+void mmu_tlb_invalidate_addr(uint64_t virt, uint64_t size);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,189 @@
+/*
+ * page_alloc.c – Buddy physical page allocator for RISC OS Phoenix
+ * Replaces the kmalloc-backed phys_alloc_page() stub: real physical
+ * pages, real frees, and contiguous runs for DMA (NVMe PRP lists, GPU
+ * buffers). Free pages carry their own list nodes via the direct map.
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "spinlock.h"
+#include "page_alloc.h"
+#include <string.h>
+
+#define KERNEL_VIRT_BASE    0xFFFF000000000000ULL
+#define PHYS_MEM_MAX        (8ULL << 30)
+#define MAX_PFN             (PHYS_MEM_MAX / PAGE_SIZE)
+
+#define PCPU_PAGE_CACHE     32   /* Order-0 pages cached per CPU */
+
+/* Free pages are linked through their own first word (direct map) */
+typedef struct free_page {
+    struct free_page *next;
+} free_page_t;
+
+static free_page_t *free_lists[BUDDY_MAX_ORDER + 1];
+static spinlock_t buddy_lock = SPINLOCK_INIT;
+
+/* Per-PFN state: bit 7 = free, bits 0..6 = order the block was carved at */
+#define PFN_FREE    0x80
+static uint8_t pfn_state[MAX_PFN];
+
+static uint64_t managed_base;
+static uint64_t managed_end;
+static uint64_t free_pages_count;
+
+/* Per-CPU order-0 caches – owner CPU only, no lock */
+static uint64_t pcpu_pages[MAX_CPUS][PCPU_PAGE_CACHE];
+static int pcpu_fill[MAX_CPUS];
+
+static inline void *buddy_virt(uint64_t phys) {
+    return (void*)(phys + KERNEL_VIRT_BASE);
+}
+
+static inline uint64_t pfn_of(uint64_t phys) {
+    return phys >> 12;
+}
+
+static void list_push(int order, uint64_t phys) {
+    free_page_t *fp = buddy_virt(phys);
+    fp->next = free_lists[order];
+    free_lists[order] = fp;
+    pfn_state[pfn_of(phys)] = PFN_FREE | order;
+}
+
+static uint64_t list_pop(int order) {
+    free_page_t *fp = free_lists[order];
+    if (!fp) return 0;
+    free_lists[order] = fp->next;
+    uint64_t phys = (uint64_t)fp - KERNEL_VIRT_BASE;
+    pfn_state[pfn_of(phys)] = order;  /* Allocated, remember the order */
+    return phys;
+}
+
+/* Unlink a specific block (buddy merge path) */
+static int list_remove(int order, uint64_t phys) {
+    free_page_t *want = buddy_virt(phys);
+    free_page_t **p = &free_lists[order];
+    while (*p) {
+        if (*p == want) {
+            *p = want->next;
+            return 1;
+        }
+        p = &(*p)->next;
+    }
+    return 0;
+}
+
+/* Seed the free lists from the usable RAM window. The memory map comes
+ * from boot: everything between the end of the kernel image/heap and
+ * the top of RAM reported for the board. */
+void page_alloc_init(uint64_t phys_base, uint64_t phys_size)
+{
+    managed_base = (phys_base + PAGE_SIZE - 1) & PAGE_MASK;
+    managed_end = (phys_base + phys_size) & PAGE_MASK;
+    if (managed_end > PHYS_MEM_MAX) managed_end = PHYS_MEM_MAX;
+
+    uint64_t phys = managed_base;
+    while (phys < managed_end) {
+        int order = BUDDY_MAX_ORDER;
+        uint64_t span;
+        /* Largest aligned block that still fits */
+        while (order > 0) {
+            span = (uint64_t)PAGE_SIZE << order;
+            if (!(phys & (span - 1)) && phys + span <= managed_end) break;
+            order--;
+        }
+        span = (uint64_t)PAGE_SIZE << order;
+        list_push(order, phys);
+        free_pages_count += 1ULL << order;
+        phys += span;
+    }
+
+    debug_print("buddy: managing %lld pages (0x%llx – 0x%llx)\n",
+                free_pages_count, managed_base, managed_end);
+}
+
+/* Allocate 2^order contiguous pages */
+uint64_t phys_alloc_pages(int order)
+{
+    if (order < 0 || order > BUDDY_MAX_ORDER) return 0;
+
+    unsigned long flags;
+    spin_lock_irqsave(&buddy_lock, &flags);
+
+    int o = order;
+    while (o <= BUDDY_MAX_ORDER && !free_lists[o]) o++;
+    if (o > BUDDY_MAX_ORDER) {
+        spin_unlock_irqrestore(&buddy_lock, flags);
+        debug_print("buddy: out of memory (order %d)\n", order);
+        return 0;
+    }
+
+    uint64_t phys = list_pop(o);
+
+    /* Split down, pushing the upper halves back */
+    while (o > order) {
+        o--;
+        list_push(o, phys + ((uint64_t)PAGE_SIZE << o));
+    }
+    pfn_state[pfn_of(phys)] = order;
+    free_pages_count -= 1ULL << order;
+
+    spin_unlock_irqrestore(&buddy_lock, flags);
+
+    memset(buddy_virt(phys), 0, (uint64_t)PAGE_SIZE << order);
+    return phys;
+}
+
+/* Free 2^order contiguous pages, merging buddies upward */
+void phys_free_pages(uint64_t phys, int order)
+{
+    if (!phys || order < 0 || order > BUDDY_MAX_ORDER) return;
+
+    unsigned long flags;
+    spin_lock_irqsave(&buddy_lock, &flags);
+
+    free_pages_count += 1ULL << order;
+
+    while (order < BUDDY_MAX_ORDER) {
+        uint64_t buddy = phys ^ ((uint64_t)PAGE_SIZE << order);
+        if (buddy < managed_base || buddy >= managed_end) break;
+        if (pfn_state[pfn_of(buddy)] != (PFN_FREE | order)) break;
+        if (!list_remove(order, buddy)) break;
+
+        if (buddy < phys) phys = buddy;
+        order++;
+    }
+    list_push(order, phys);
+
+    spin_unlock_irqrestore(&buddy_lock, flags);
+}
+
+/* Single-page fast path: pop from the per-CPU cache, refill in batches */
+uint64_t phys_alloc_page(void)
+{
+    int cpu = get_cpu_id();
+
+    if (pcpu_fill[cpu] == 0) {
+        for (int i = 0; i < PCPU_PAGE_CACHE / 2; i++) {
+            uint64_t phys = phys_alloc_pages(0);
+            if (!phys) break;
+            pcpu_pages[cpu][pcpu_fill[cpu]++] = phys;
+        }
+        if (pcpu_fill[cpu] == 0) return 0;
+    }
+
+    return pcpu_pages[cpu][--pcpu_fill[cpu]];
+}
+
+void phys_free_page(uint64_t phys)
+{
+    int cpu = get_cpu_id();
+
+    if (pcpu_fill[cpu] < PCPU_PAGE_CACHE) {
+        pcpu_pages[cpu][pcpu_fill[cpu]++] = phys;
+    } else {
+        phys_free_pages(phys, 0);
+    }
+}
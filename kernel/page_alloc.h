@@ -0,0 +1,24 @@
+/*
+ * page_alloc.h – Buddy physical page allocator for RISC OS Phoenix
+ * Order-0..10 free lists (4KB..4MB contiguous runs) + per-CPU page caches
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef PAGE_ALLOC_H
+#define PAGE_ALLOC_H
+
+#include <stdint.h>
+
+#define BUDDY_MAX_ORDER     10   /* 2^10 pages = 4MB largest run */
+
+void page_alloc_init(uint64_t phys_base, uint64_t phys_size);
+
+/* Contiguous run of 2^order pages – for DMA, PRP lists, GPU buffers */
+uint64_t phys_alloc_pages(int order);
+void phys_free_pages(uint64_t phys, int order);
+
+/* Single page fast path through the per-CPU cache */
+uint64_t phys_alloc_page(void);
+void phys_free_page(uint64_t phys);
+
+#endif /* PAGE_ALLOC_H */
@@ -0,0 +1,390 @@
+/*
+ * pagecache.c – Block-Layer Page Cache for RISC OS Phoenix
+ * Every vfs_block_read/vfs_block_write goes through a cache of whole
+ * 4KB pages keyed by (device unit, LBA): radix-tree lookup, LRU
+ * eviction when full, and write-back via a background flusher task.
+ * FileCore directory walks that used to hit NVMe for the same blocks
+ * over and over now resolve from memory.
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "blockdriver.h"
+#include "pagecache.h"
+#include "page_alloc.h"
+#include "spinlock.h"
+#include <string.h>
+
+#define KERNEL_VIRT_BASE    0xFFFF000000000000ULL
+
+/* 4096 pages = 16MB of cache, enough for the hot FileCore metadata */
+#define PC_MAX_PAGES        4096
+
+/* Key layout: device unit in the top bits, page index (LBA / blocks
+ * per page) below. 40 bits of page index covers 4PB per device. */
+#define PC_KEY(unit, pgidx) (((uint64_t)(unit) << 40) | (pgidx))
+
+/* Radix tree: 8 bits per level, 6 levels = 48-bit key space */
+#define RADIX_BITS          8
+#define RADIX_SLOTS         (1 << RADIX_BITS)
+#define RADIX_LEVELS        6
+
+typedef struct radix_node {
+    void *slots[RADIX_SLOTS];
+} radix_node_t;
+
+typedef struct cache_page {
+    uint64_t            key;
+    blockdev_t         *dev;
+    uint64_t            first_lba;      /* First LBA covered by this page */
+    uint8_t            *data;           /* PAGE_SIZE bytes */
+    int                 dirty;
+    struct cache_page  *lru_prev;
+    struct cache_page  *lru_next;
+} cache_page_t;
+
+static radix_node_t *pc_root;
+static cache_page_t *lru_head;          /* Most recently used */
+static cache_page_t *lru_tail;          /* Eviction candidate */
+static int pc_nr_pages;
+static spinlock_t pc_lock = SPINLOCK_INIT;
+
+/* Cache effectiveness counters */
+static uint64_t pc_hits, pc_misses, pc_writebacks;
+
+static inline uint32_t blocks_per_page(blockdev_t *dev)
+{
+    return PAGE_SIZE / dev->block_size;
+}
+
+/* ==================== Radix tree ==================== */
+
+static cache_page_t *radix_lookup(uint64_t key)
+{
+    radix_node_t *node = pc_root;
+    for (int level = RADIX_LEVELS - 1; node && level > 0; level--) {
+        node = node->slots[(key >> (level * RADIX_BITS)) & (RADIX_SLOTS - 1)];
+    }
+    if (!node) return NULL;
+    return ((radix_node_t*)node)->slots[key & (RADIX_SLOTS - 1)];
+}
+
+static int radix_insert(uint64_t key, cache_page_t *page)
+{
+    if (!pc_root) {
+        pc_root = kmalloc(sizeof(radix_node_t));
+        if (!pc_root) return -1;
+        memset(pc_root, 0, sizeof(radix_node_t));
+    }
+
+    radix_node_t *node = pc_root;
+    for (int level = RADIX_LEVELS - 1; level > 0; level--) {
+        int slot = (key >> (level * RADIX_BITS)) & (RADIX_SLOTS - 1);
+        if (!node->slots[slot]) {
+            radix_node_t *child = kmalloc(sizeof(radix_node_t));
+            if (!child) return -1;
+            memset(child, 0, sizeof(radix_node_t));
+            node->slots[slot] = child;
+        }
+        node = node->slots[slot];
+    }
+    node->slots[key & (RADIX_SLOTS - 1)] = page;
+    return 0;
+}
+
+/* Clear the leaf slot; intermediate nodes stay for reuse */
+static void radix_delete(uint64_t key)
+{
+    radix_node_t *node = pc_root;
+    for (int level = RADIX_LEVELS - 1; node && level > 0; level--) {
+        node = node->slots[(key >> (level * RADIX_BITS)) & (RADIX_SLOTS - 1)];
+    }
+    if (node) node->slots[key & (RADIX_SLOTS - 1)] = NULL;
+}
+
+/* ==================== LRU list ==================== */
+
+static void lru_unlink(cache_page_t *page)
+{
+    if (page->lru_prev) page->lru_prev->lru_next = page->lru_next;
+    else lru_head = page->lru_next;
+    if (page->lru_next) page->lru_next->lru_prev = page->lru_prev;
+    else lru_tail = page->lru_prev;
+    page->lru_prev = page->lru_next = NULL;
+}
+
+static void lru_push_front(cache_page_t *page)
+{
+    page->lru_prev = NULL;
+    page->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = page;
+    lru_head = page;
+    if (!lru_tail) lru_tail = page;
+}
+
+static void lru_touch(cache_page_t *page)
+{
+    if (page == lru_head) return;
+    lru_unlink(page);
+    lru_push_front(page);
+}
+
+/* ==================== Page lifecycle ==================== */
+
+/* Flush one page to its device. Called with pc_lock held; the lock is
+ * dropped around the device write so the cache stays usable. */
+static void page_writeback(cache_page_t *page, unsigned long *flags)
+{
+    page->dirty = 0;
+    pc_writebacks++;
+    spin_unlock_irqrestore(&pc_lock, *flags);
+    blockdev_write(page->dev, page->first_lba, blocks_per_page(page->dev),
+                   page->data);
+    spin_lock_irqsave(&pc_lock, flags);
+}
+
+/* Drop the least recently used page to make room (with pc_lock held) */
+static void pc_evict_one(unsigned long *flags)
+{
+    cache_page_t *victim = lru_tail;
+    if (!victim) return;
+
+    if (victim->dirty) {
+        page_writeback(victim, flags);
+        /* The lock was dropped: someone may have touched the page.
+         * Evicting it anyway is safe – it is clean now. */
+    }
+
+    lru_unlink(victim);
+    radix_delete(victim->key);
+    pc_nr_pages--;
+
+    phys_free_page((uint64_t)victim->data - KERNEL_VIRT_BASE);
+    kfree(victim);
+}
+
+/* Find the page covering 'lba', faulting it in from the device on a
+ * miss. Returns with the page at the head of the LRU, pc_lock held. */
+static cache_page_t *pc_get_page(blockdev_t *dev, uint64_t lba,
+                                 unsigned long *flags)
+{
+    uint64_t pgidx = lba / blocks_per_page(dev);
+    uint64_t key = PC_KEY(dev->unit, pgidx);
+
+    cache_page_t *page = radix_lookup(key);
+    if (page) {
+        pc_hits++;
+        lru_touch(page);
+        return page;
+    }
+    pc_misses++;
+
+    while (pc_nr_pages >= PC_MAX_PAGES) {
+        pc_evict_one(flags);
+    }
+
+    page = kmalloc(sizeof(cache_page_t));
+    if (!page) return NULL;
+
+    uint64_t phys = phys_alloc_page();
+    if (!phys) {
+        kfree(page);
+        return NULL;
+    }
+
+    page->key = key;
+    page->dev = dev;
+    page->first_lba = pgidx * blocks_per_page(dev);
+    page->data = (uint8_t*)(phys + KERNEL_VIRT_BASE);
+    page->dirty = 0;
+    page->lru_prev = page->lru_next = NULL;
+
+    /* Fill from the device without holding the lock */
+    spin_unlock_irqrestore(&pc_lock, *flags);
+    ssize_t got = blockdev_read(dev, page->first_lba, blocks_per_page(dev),
+                                page->data);
+    spin_lock_irqsave(&pc_lock, flags);
+
+    if (got < 0) {
+        phys_free_page(phys);
+        kfree(page);
+        return NULL;
+    }
+
+    /* A racing reader may have inserted the same page while we slept */
+    cache_page_t *raced = radix_lookup(key);
+    if (raced) {
+        phys_free_page(phys);
+        kfree(page);
+        lru_touch(raced);
+        return raced;
+    }
+
+    if (radix_insert(key, page) != 0) {
+        phys_free_page(phys);
+        kfree(page);
+        return NULL;
+    }
+    lru_push_front(page);
+    pc_nr_pages++;
+    return page;
+}
+
+/* ==================== Cached block I/O ==================== */
+
+ssize_t vfs_block_read(blockdev_t *dev, uint64_t lba, uint32_t count, void *buf)
+{
+    if (!dev) return -1;
+
+    uint8_t *dst = buf;
+    uint32_t bpp = blocks_per_page(dev);
+    uint32_t done = 0;
+    unsigned long flags;
+
+    spin_lock_irqsave(&pc_lock, &flags);
+    while (done < count) {
+        cache_page_t *page = pc_get_page(dev, lba + done, &flags);
+        if (!page) break;
+
+        uint32_t in_page = (lba + done) % bpp;
+        uint32_t chunk = bpp - in_page;
+        if (chunk > count - done) chunk = count - done;
+
+        memcpy(dst + done * dev->block_size,
+               page->data + in_page * dev->block_size,
+               chunk * dev->block_size);
+        done += chunk;
+    }
+    spin_unlock_irqrestore(&pc_lock, flags);
+
+    return done ? (ssize_t)(done * dev->block_size) : -1;
+}
+
+ssize_t vfs_block_write(blockdev_t *dev, uint64_t lba, uint32_t count, const void *buf)
+{
+    if (!dev) return -1;
+
+    const uint8_t *src = buf;
+    uint32_t bpp = blocks_per_page(dev);
+    uint32_t done = 0;
+    unsigned long flags;
+
+    spin_lock_irqsave(&pc_lock, &flags);
+    while (done < count) {
+        cache_page_t *page = pc_get_page(dev, lba + done, &flags);
+        if (!page) break;
+
+        uint32_t in_page = (lba + done) % bpp;
+        uint32_t chunk = bpp - in_page;
+        if (chunk > count - done) chunk = count - done;
+
+        memcpy(page->data + in_page * dev->block_size,
+               src + done * dev->block_size,
+               chunk * dev->block_size);
+        page->dirty = 1;        /* Flusher or eviction writes it back */
+        done += chunk;
+    }
+    spin_unlock_irqrestore(&pc_lock, flags);
+
+    return done ? (ssize_t)(done * dev->block_size) : -1;
+}
+
+/* Write back every dirty page (dev == NULL means all devices).
+ * Pages are collected under the lock, sorted by LBA and batched into
+ * scatter-gather bios, so the device sees a few large sequential
+ * writes instead of scattered 4KB ones – what the archive-tier disks
+ * want, and cheap for NVMe too. */
+#define PC_FLUSH_BATCH  128
+
+void pagecache_sync(blockdev_t *dev)
+{
+    cache_page_t *batch[PC_FLUSH_BATCH];
+    int n;
+    unsigned long flags;
+
+    do {
+        /* Collect a round of dirty pages and mark them clean while
+         * still under the lock */
+        n = 0;
+        spin_lock_irqsave(&pc_lock, &flags);
+        for (cache_page_t *page = lru_head; page && n < PC_FLUSH_BATCH;
+             page = page->lru_next) {
+            if (page->dirty && (!dev || page->dev == dev)) {
+                page->dirty = 0;
+                batch[n++] = page;
+            }
+        }
+        spin_unlock_irqrestore(&pc_lock, flags);
+        if (n == 0) break;
+
+        /* Sort by (device, LBA) – insertion sort, the batch is small */
+        for (int i = 1; i < n; i++) {
+            cache_page_t *key = batch[i];
+            int j = i - 1;
+            while (j >= 0 && (batch[j]->dev > key->dev ||
+                   (batch[j]->dev == key->dev && batch[j]->first_lba > key->first_lba))) {
+                batch[j + 1] = batch[j];
+                j--;
+            }
+            batch[j + 1] = key;
+        }
+
+        /* Group contiguous pages into one scatter-gather bio each */
+        int i = 0;
+        while (i < n) {
+            bio_t *bio = bio_alloc();
+            if (!bio) {
+                /* No descriptor – fall back to a plain write */
+                blockdev_write(batch[i]->dev, batch[i]->first_lba,
+                               blocks_per_page(batch[i]->dev), batch[i]->data);
+                pc_writebacks++;
+                i++;
+                continue;
+            }
+
+            blockdev_t *bdev = batch[i]->dev;
+            uint32_t bpp = blocks_per_page(bdev);
+            bio->dev = bdev;
+            bio->op = BIO_WRITE;
+            bio->lba = batch[i]->first_lba;
+            bio->waiter = current_task;
+
+            while (i < n && bio->nr_segs < BIO_MAX_SEGS &&
+                   batch[i]->dev == bdev &&
+                   batch[i]->first_lba == bio->lba + (uint64_t)bio->nr_segs * bpp) {
+                bio->segs[bio->nr_segs].buf = batch[i]->data;
+                bio->segs[bio->nr_segs].blocks = bpp;
+                bio->nr_segs++;
+                pc_writebacks++;
+                i++;
+            }
+
+            if (blockdev_submit(bio) == 0) {
+                while (!__atomic_load_n(&bio->completed, __ATOMIC_ACQUIRE)) {
+                    task_block(TASK_BLOCKED);
+                    schedule();
+                }
+            }
+            bio_free(bio);
+        }
+    } while (n == PC_FLUSH_BATCH);  // More dirty pages may remain
+}
+
+/* Background flusher – trickles dirty pages out so a crash loses
+ * seconds of data, not everything since boot */
+static void pagecache_flusher(void)
+{
+    while (1) {
+        uint64_t deadline = get_time_ns() + 1000000000ULL;  /* 1s interval */
+        while (get_time_ns() < deadline) {
+            yield();
+        }
+        pagecache_sync(NULL);
+    }
+}
+
+void pagecache_init(void)
+{
+    task_create("PageCacheFlush", pagecache_flusher, 100, 0);
+    debug_print("PageCache: %d pages max, flusher started\n", PC_MAX_PAGES);
+}
@@ -0,0 +1,23 @@
+/*
+ * pagecache.h – Block-Layer Page Cache for RISC OS Phoenix
+ * Caches whole pages of block device data between VFS/FileCore and
+ * the block drivers, keyed by (device unit, LBA)
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stdint.h>
+#include "blockdriver.h"
+
+void pagecache_init(void);
+
+/* Cached block I/O – all FileCore traffic goes through these */
+ssize_t vfs_block_read(blockdev_t *dev, uint64_t lba, uint32_t count, void *buf);
+ssize_t vfs_block_write(blockdev_t *dev, uint64_t lba, uint32_t count, const void *buf);
+
+/* Write every dirty page back to its device (NULL = all devices) */
+void pagecache_sync(blockdev_t *dev);
+
+#endif /* PAGECACHE_H */
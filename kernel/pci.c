@@ -6,7 +6,9 @@
 
 #include "kernel.h"
 #include "pci.h"
+#include "irq.h"
 #include <stdint.h>
+#include <string.h>
 
 #define PCI_CONFIG_ADDRESS  0xCF8
 #define PCI_CONFIG_DATA     0xCFC
@@ -19,6 +21,16 @@ static pci_driver_t *pci_drivers[32];
 static int num_drivers = 0;
 static spinlock_t pci_lock = SPINLOCK_INIT;
 
+/* Enumerated functions: config space is read once into these at scan
+ * time, and drivers keep pointers into the table afterwards */
+static pci_dev_t pci_devices[PCI_MAX_DEVICES];
+static int num_pci_devices = 0;
+
+/* Next free SPI in the managed MSI-X pool */
+static int pci_msix_next = PCI_MSIX_IRQ_BASE;
+
+#define GICD_SETSPI_NSR 0xFF840040  // Message address for MSI -> SPI
+
 /* Read PCI config dword */
 static uint32_t pci_config_read(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset) {
     uint32_t addr = (1ULL << 31) | (bus << 16) | (dev << 11) | (func << 8) | (offset & 0xFC);
@@ -33,31 +45,62 @@ static void pci_config_write(uint8_t bus, uint8_t dev, uint8_t func, uint8_t off
     outl(PCI_CONFIG_DATA, val);
 }
 
-/* Scan PCI bus and probe drivers */
+/* Walk the capability list once and remember where everything is */
+static void pci_cache_capabilities(pci_dev_t *pdev) {
+    uint32_t status = pci_config_read(pdev->bus, pdev->dev, pdev->func, 0x04) >> 16;
+    if (!(status & 0x10)) return;  // No capability list
+
+    uint8_t ptr = pci_config_read(pdev->bus, pdev->dev, pdev->func, 0x34) & 0xFC;
+    while (ptr) {
+        uint32_t cap = pci_config_read(pdev->bus, pdev->dev, pdev->func, ptr);
+        switch (cap & 0xFF) {
+            case PCI_CAP_PM:   pdev->cap_pm = ptr;   break;
+            case PCI_CAP_MSI:  pdev->cap_msi = ptr;  break;
+            case PCI_CAP_PCIE: pdev->cap_pcie = ptr; break;
+            case PCI_CAP_MSIX: pdev->cap_msix = ptr; break;
+        }
+        ptr = (cap >> 8) & 0xFC;
+    }
+}
+
+/* Scan PCI bus, cache config space, and probe drivers */
 void pci_scan_bus(void) {
     for (int bus = 0; bus < PCI_MAX_BUS; bus++) {
         for (int dev = 0; dev < PCI_MAX_DEV; dev++) {
             for (int func = 0; func < PCI_MAX_FUNC; func++) {
                 uint32_t vendor = pci_config_read(bus, dev, func, 0);
                 if ((vendor & 0xFFFF) == 0xFFFF) continue;
+                if (num_pci_devices >= PCI_MAX_DEVICES) return;
+
+                pci_dev_t *pdev = &pci_devices[num_pci_devices++];
+                memset(pdev, 0, sizeof(*pdev));
+                pdev->bus = bus;
+                pdev->dev = dev;
+                pdev->func = func;
+                pdev->vendor_id = vendor & 0xFFFF;
+                pdev->device_id = vendor >> 16;
+
+                uint32_t class_rev = pci_config_read(bus, dev, func, 0x08);
+                pdev->class_code = class_rev >> 8;
+                pdev->revision = class_rev & 0xFF;
 
-                pci_dev_t pdev;
-                pdev.vendor_id = vendor & 0xFFFF;
-                pdev.device_id = vendor >> 16;
-                pdev.class_code = pci_config_read(bus, dev, func, 0x08) >> 8;
+                uint32_t subsys = pci_config_read(bus, dev, func, 0x2C);
+                pdev->subsys_vendor = subsys & 0xFFFF;
+                pdev->subsys_id = subsys >> 16;
 
                 for (int bar = 0; bar < PCI_BAR_COUNT; bar++) {
-                    pdev.bar[bar] = pci_config_read(bus, dev, func, 0x10 + bar * 4);
+                    pdev->bar[bar] = pci_config_read(bus, dev, func, 0x10 + bar * 4);
                 }
 
-                pdev.irq_line = pci_config_read(bus, dev, func, 0x3C) & 0xFF;
+                pdev->irq_line = pci_config_read(bus, dev, func, 0x3C) & 0xFF;
+                pci_cache_capabilities(pdev);
 
                 // Probe drivers
                 for (int i = 0; i < num_drivers; i++) {
                     pci_driver_t *drv = pci_drivers[i];
-                    if (drv->class_code == 0xFFFFFF || drv->class_code == pdev.class_code) {
-                        if (drv->probe(&pdev) == 0) {
-                            debug_print("PCI: Probed %s (VID:0x%04x DID:0x%04x)\n", drv->name, pdev.vendor_id, pdev.device_id);
+                    if (drv->class_code == 0xFFFFFF || drv->class_code == pdev->class_code) {
+                        if (drv->probe(pdev) == 0) {
+                            debug_print("PCI: Probed %s (VID:0x%04x DID:0x%04x)\n", drv->name, pdev->vendor_id, pdev->device_id);
                         }
                     }
                 }
@@ -69,7 +112,7 @@ void pci_scan_bus(void) {
 /* Register PCI driver */
 void pci_register_driver(pci_driver_t *driver) {
     unsigned long flags;
-    spin_lock_irqsave(&pci_lock, flags);
+    spin_lock_irqsave(&pci_lock, &flags);
 
     if (num_drivers < 32) {
         pci_drivers[num_drivers++] = driver;
@@ -89,6 +132,70 @@ uint64_t pci_bar_start(pci_dev_t *dev, int bar) {
     return dev->bar[bar] & ~0xF;  // Mask flags
 }
 
+/* Allocate between min and max MSI-X vectors for a device. Programs
+ * the hardware table (message address = GIC SETSPI register, data =
+ * SPI number) and spreads delivery round-robin over the CPUs set in
+ * affinity_mask, so every driver gets per-CPU distribution without
+ * hand-rolling its own table setup. Returns the vector count. */
+int pci_alloc_vectors(pci_dev_t *dev, int min, int max, uint64_t affinity_mask) {
+    unsigned long flags;
+
+    if (!dev->cap_msix) return -1;
+
+    uint32_t ctl = pci_config_read(dev->bus, dev->dev, dev->func, dev->cap_msix);
+    int table_size = ((ctl >> 16) & 0x7FF) + 1;
+    int count = (max < table_size) ? max : table_size;
+    if (count < min) return -1;
+
+    /* Table location: BIR + offset from the second capability dword */
+    uint32_t tbl = pci_config_read(dev->bus, dev->dev, dev->func, dev->cap_msix + 4);
+    dev->msix_table = ioremap(pci_bar_start(dev, tbl & 0x7) + (tbl & ~0x7),
+                              table_size * 16);
+    if (!dev->msix_table) return -1;
+
+    spin_lock_irqsave(&pci_lock, &flags);
+    dev->vec_base = pci_msix_next;
+    pci_msix_next += count;
+    spin_unlock_irqrestore(&pci_lock, flags);
+    dev->msix_size = table_size;
+    dev->num_vectors = count;
+
+    if (!affinity_mask) affinity_mask = ~0ULL;
+    int cpu = -1;
+    for (int i = 0; i < count; i++) {
+        int vector = dev->vec_base + i;
+        dev->msix_table[i * 4 + 0] = GICD_SETSPI_NSR;
+        dev->msix_table[i * 4 + 1] = 0;
+        dev->msix_table[i * 4 + 2] = vector;
+        dev->msix_table[i * 4 + 3] = 0;        // Unmasked
+
+        do { cpu = (cpu + 1) % MAX_CPUS; } while (!(affinity_mask & (1ULL << cpu)));
+        irq_set_affinity(vector, cpu);
+    }
+
+    /* MSI-X enable, function mask clear */
+    pci_config_write(dev->bus, dev->dev, dev->func, dev->cap_msix,
+                     (ctl | (1U << 31)) & ~(1U << 30));
+    return count;
+}
+
+/* SPI number backing one allocated vector index */
+int pci_vector(pci_dev_t *dev, int index) {
+    if (index < 0 || index >= dev->num_vectors) return -1;
+    return dev->vec_base + index;
+}
+
+/* Attach a handler to an allocated vector; returns the SPI number.
+ * Drivers that want a vector on a specific core (per-queue ownership)
+ * can re-pin it with irq_set_affinity() afterwards. */
+int pci_request_irq(pci_dev_t *dev, int index, irq_handler_t handler, void *private) {
+    int vector = pci_vector(dev, index);
+    if (vector < 0) return -1;
+    irq_set_handler(vector, handler, private);
+    irq_unmask(vector);
+    return vector;
+}
+
 /* Module init – scan bus */
 _kernel_oserror *module_init(const char *arg, int podule)
 {
@@ -8,17 +8,44 @@
 #define PCI_H
 
 #include <stdint.h>
+#include "irq.h"
 
 #define PCI_MAX_DEVICES     256
 #define PCI_BAR_COUNT       6
 
+/* Capability IDs we cache at enumeration */
+#define PCI_CAP_PM          0x01
+#define PCI_CAP_MSI         0x05
+#define PCI_CAP_PCIE        0x10
+#define PCI_CAP_MSIX        0x11
+
+/* One enumerated function. Everything here is read from config space
+ * exactly once, during pci_scan_bus(); drivers work from the cached
+ * copy instead of going back through the ECAM window on every query.
+ * Entries live in a static table, so the pointer a probe receives
+ * stays valid for the life of the system. */
 typedef struct pci_dev {
+    uint8_t  bus, dev, func;
     uint16_t vendor_id;
     uint16_t device_id;
-    uint16_t class_code;
+    uint32_t class_code;        // 24-bit class/subclass/progif
+    uint8_t  revision;
+    uint16_t subsys_vendor;
+    uint16_t subsys_id;
     uint64_t bar[PCI_BAR_COUNT];
     int      irq_line;
-    // ... other fields (revision, subsystem, etc.)
+
+    /* Capability list offsets (0 = capability absent) */
+    uint8_t  cap_pm;
+    uint8_t  cap_msi;
+    uint8_t  cap_pcie;
+    uint8_t  cap_msix;
+
+    /* Managed MSI-X state (pci_alloc_vectors) */
+    volatile uint32_t *msix_table;  // Mapped hardware table
+    int      msix_size;             // Entries the hardware supports
+    int      num_vectors;           // Vectors allocated to this device
+    int      vec_base;              // First SPI number of the block
 } pci_dev_t;
 
 typedef struct pci_driver {
@@ -31,4 +58,12 @@ void pci_register_driver(pci_driver_t *driver);
 void pci_enable_busmaster(pci_dev_t *dev);
 uint64_t pci_bar_start(pci_dev_t *dev, int bar);
 
+/* Managed MSI-X: allocate between min and max vectors, program the
+ * device's table, and spread delivery round-robin over the CPUs in
+ * affinity_mask (0 = all). Returns the vector count or -1. Handlers
+ * are then attached per index with pci_request_irq(). */
+int pci_alloc_vectors(pci_dev_t *dev, int min, int max, uint64_t affinity_mask);
+int pci_request_irq(pci_dev_t *dev, int index, irq_handler_t handler, void *private);
+int pci_vector(pci_dev_t *dev, int index);
+
 #endif /* PCI_H */
\ No newline at end of file
@@ -1,26 +1,40 @@
 /*
  * pipe.c – UNIX pipes for RISC OS Phoenix
- * Implements pipe(2), read/write, poll for pipes
- * Uses ring buffer for bidirectional communication
+ * Implements pipe(2), read/write, poll, splice for pipes
+ * Buffers live in a ring of reference-counted slots so splice can
+ * move descriptors instead of bytes
  * Author:R Andrews Grok 4 – 26 Nov 2025
  */
 
 #include "kernel.h"
 #include "vfs.h"
+#include "pipe.h"
+#include "epoll.h"
 #include "spinlock.h"
 #include <stdint.h>
 #include <string.h>
 
-#define PIPE_BUFFER_SIZE 4096
+/* One buffer reference in the ring. buf+offset is the first unread
+ * byte; kmalloc-backed slots with spare room take appended writes in
+ * place, spliced-in slots are drained and dropped. */
+typedef struct pipe_slot {
+    void    *buf;
+    uint32_t offset;
+    uint32_t len;
+    uint32_t cap;       /* Allocation size – append room = cap - offset - len */
+} pipe_slot_t;
 
 typedef struct pipe_buffer {
-    uint8_t data[PIPE_BUFFER_SIZE];
-    size_t read_pos;
-    size_t write_pos;
-    size_t count;
+    pipe_slot_t *slots;
+    int      nr_slots;  /* Ring capacity – F_SETPIPE_SZ resizes */
+    int      head;      /* Oldest slot (next read) */
+    int      count;     /* Slots in use */
+    size_t   bytes;     /* Total buffered bytes */
     spinlock_t lock;
     task_t *read_waiter;
     task_t *write_waiter;
+    file_t *reader_file;    /* For epoll notification per end */
+    file_t *writer_file;
 } pipe_buffer_t;
 
 typedef struct pipe_file {
@@ -35,16 +49,19 @@ int pipe(int pipefd[2]) {
 
     memset(pipe, 0, sizeof(*pipe));
     spinlock_init(&pipe->lock);
+    pipe->slots = kmalloc(PIPE_DEF_SLOTS * sizeof(pipe_slot_t));
+    if (!pipe->slots) { kfree(pipe); return -1; }
+    pipe->nr_slots = PIPE_DEF_SLOTS;
 
     file_t *read_file = vfs_alloc_file();
-    if (!read_file) { kfree(pipe); return -1; }
+    if (!read_file) { kfree(pipe->slots); kfree(pipe); return -1; }
     read_file->f_ops = &pipe_ops;
     read_file->private = kmalloc(sizeof(pipe_file_t));
     ((pipe_file_t*)read_file->private)->pipe = pipe;
     ((pipe_file_t*)read_file->private)->is_reader = 1;
 
     file_t *write_file = vfs_alloc_file();
-    if (!write_file) { vfs_free_file(read_file); kfree(pipe); return -1; }
+    if (!write_file) { vfs_free_file(read_file); kfree(pipe->slots); kfree(pipe); return -1; }
     write_file->f_ops = &pipe_ops;
     write_file->private = kmalloc(sizeof(pipe_file_t));
     ((pipe_file_t*)write_file->private)->pipe = pipe;
@@ -52,6 +69,8 @@ int pipe(int pipefd[2]) {
 
     pipe->read_waiter = current_task;
     pipe->write_waiter = current_task;
+    pipe->reader_file = read_file;
+    pipe->writer_file = write_file;
 
     int read_fd = alloc_fd(read_file);
     int write_fd = alloc_fd(write_file);
@@ -59,6 +78,7 @@ int pipe(int pipefd[2]) {
         // Cleanup on fail
         vfs_free_file(read_file);
         vfs_free_file(write_file);
+        kfree(pipe->slots);
         kfree(pipe);
         return -1;
     }
@@ -70,6 +90,51 @@ int pipe(int pipefd[2]) {
     return 0;
 }
 
+/* Ring helpers – caller holds pipe->lock */
+static inline pipe_slot_t *pipe_head_slot(pipe_buffer_t *pipe) {
+    return &pipe->slots[pipe->head];
+}
+
+static inline pipe_slot_t *pipe_tail_slot(pipe_buffer_t *pipe) {
+    return &pipe->slots[(pipe->head + pipe->count - 1) % pipe->nr_slots];
+}
+
+static inline int pipe_ring_full(pipe_buffer_t *pipe) {
+    return pipe->count == pipe->nr_slots;
+}
+
+/* Drop the drained head slot and free its backing */
+static void pipe_drop_head(pipe_buffer_t *pipe) {
+    kfree(pipe_head_slot(pipe)->buf);
+    pipe->head = (pipe->head + 1) % pipe->nr_slots;
+    pipe->count--;
+}
+
+/* Push a filled buffer into the ring by reference. Blocks while the
+ * ring is full; takes ownership of buf. Caller holds the lock, which
+ * is held again on return. */
+static int pipe_push_slot(pipe_buffer_t *pipe, file_t *file, void *buf,
+                          uint32_t offset, uint32_t len, uint32_t cap,
+                          unsigned long *flags) {
+    while (pipe_ring_full(pipe)) {
+        if (file->f_flags & O_NONBLOCK) return -1;
+
+        pipe->write_waiter = current_task;
+        spin_unlock_irqrestore(&pipe->lock, *flags);
+        task_block(TASK_BLOCKED);
+        spin_lock_irqsave(&pipe->lock, flags);
+    }
+
+    pipe_slot_t *slot = &pipe->slots[(pipe->head + pipe->count) % pipe->nr_slots];
+    slot->buf = buf;
+    slot->offset = offset;
+    slot->len = len;
+    slot->cap = cap;
+    pipe->count++;
+    pipe->bytes += len;
+    return 0;
+}
+
 /* Read from pipe */
 ssize_t pipe_read(file_t *file, char *buf, size_t count) {
     pipe_file_t *pfile = file->private;
@@ -78,7 +143,7 @@ ssize_t pipe_read(file_t *file, char *buf, size_t count) {
     unsigned long flags;
     spin_lock_irqsave(&pipe->lock, flags);
 
-    while (pipe->count == 0) {
+    while (pipe->bytes == 0) {
         if (file->f_flags & O_NONBLOCK) {
             spin_unlock_irqrestore(&pipe->lock, flags);
             return -1;  // EAGAIN
@@ -90,29 +155,33 @@ ssize_t pipe_read(file_t *file, char *buf, size_t count) {
         spin_lock_irqsave(&pipe->lock, flags);
     }
 
-    size_t to_read = count < pipe->count ? count : pipe->count;
     size_t read = 0;
-
-    while (read < to_read) {
-        size_t avail = PIPE_BUFFER_SIZE - pipe->read_pos;
-        size_t chunk = avail > to_read - read ? to_read - read : avail;
-        memcpy(buf + read, pipe->data + pipe->read_pos, chunk);
-        pipe->read_pos = (pipe->read_pos + chunk) % PIPE_BUFFER_SIZE;
-        pipe->count -= chunk;
+    while (read < count && pipe->count > 0) {
+        pipe_slot_t *slot = pipe_head_slot(pipe);
+        size_t chunk = count - read < slot->len ? count - read : slot->len;
+
+        memcpy(buf + read, (uint8_t*)slot->buf + slot->offset, chunk);
+        slot->offset += chunk;
+        slot->len -= chunk;
+        pipe->bytes -= chunk;
         read += chunk;
 
-        // Wake writer if space now available
-        if (pipe->write_waiter && pipe->count < PIPE_BUFFER_SIZE - 1) {
-            task_wakeup(pipe->write_waiter);
-            pipe->write_waiter = NULL;
-        }
+        if (slot->len == 0) pipe_drop_head(pipe);
     }
 
+    // One wakeup for the whole batch – ring space freed up
+    if (read > 0 && pipe->write_waiter) {
+        task_wakeup(pipe->write_waiter);
+        pipe->write_waiter = NULL;
+    }
+    if (read > 0) epoll_notify(&pipe->writer_file->watchers, POLLOUT);
+
     spin_unlock_irqrestore(&pipe->lock, flags);
     return read;
 }
 
-/* Write to pipe */
+/* Write to pipe – appends into the tail slot's spare room, else takes
+ * a fresh slot per chunk */
 ssize_t pipe_write(file_t *file, const char *buf, size_t count) {
     pipe_file_t *pfile = file->private;
     pipe_buffer_t *pipe = pfile->pipe;
@@ -120,38 +189,278 @@ ssize_t pipe_write(file_t *file, const char *buf, size_t count) {
     unsigned long flags;
     spin_lock_irqsave(&pipe->lock, flags);
 
-    while (pipe->count == PIPE_BUFFER_SIZE) {
-        if (file->f_flags & O_NONBLOCK) {
-            spin_unlock_irqrestore(&pipe->lock, flags);
-            return -1;  // EAGAIN
+    size_t written = 0;
+    while (written < count) {
+        // Top up the most recent slot while it has room
+        if (pipe->count > 0) {
+            pipe_slot_t *slot = pipe_tail_slot(pipe);
+            uint32_t room = slot->cap > slot->offset + slot->len
+                                ? slot->cap - slot->offset - slot->len : 0;
+            if (room) {
+                size_t chunk = count - written < room ? count - written : room;
+                memcpy((uint8_t*)slot->buf + slot->offset + slot->len,
+                       buf + written, chunk);
+                slot->len += chunk;
+                pipe->bytes += chunk;
+                written += chunk;
+                continue;
+            }
         }
 
-        pipe->write_waiter = current_task;
+        if (pipe_ring_full(pipe) && (file->f_flags & O_NONBLOCK)) break;
+
+        size_t chunk = count - written < PIPE_CHUNK ? count - written : PIPE_CHUNK;
         spin_unlock_irqrestore(&pipe->lock, flags);
-        task_block(TASK_BLOCKED);
+        void *slot_buf = kmalloc(PIPE_CHUNK);
         spin_lock_irqsave(&pipe->lock, flags);
+        if (!slot_buf) break;
+
+        memcpy(slot_buf, buf + written, chunk);
+        if (pipe_push_slot(pipe, file, slot_buf, 0, chunk, PIPE_CHUNK, &flags) < 0) {
+            kfree(slot_buf);
+            break;
+        }
+        written += chunk;
     }
 
-    size_t to_write = count < PIPE_BUFFER_SIZE - pipe->count ? count : PIPE_BUFFER_SIZE - pipe->count;
-    size_t written = 0;
+    // Wake reader if data available
+    if (written > 0 && pipe->read_waiter) {
+        task_wakeup(pipe->read_waiter);
+        pipe->read_waiter = NULL;
+    }
+    if (written > 0) epoll_notify(&pipe->reader_file->watchers, POLLIN);
 
-    while (written < to_write) {
-        size_t avail = PIPE_BUFFER_SIZE - pipe->write_pos;
-        size_t chunk = avail > to_write - written ? to_write - written : avail;
-        memcpy(pipe->data + pipe->write_pos, buf + written, chunk);
-        pipe->write_pos = (pipe->write_pos + chunk) % PIPE_BUFFER_SIZE;
-        pipe->count += chunk;
-        written += chunk;
+    spin_unlock_irqrestore(&pipe->lock, flags);
+    return written > 0 ? (ssize_t)written : -1;
+}
+
+/* Vectored pipe read – one lock round and one waiter wakeup for the
+ * whole iovec instead of one per fragment */
+ssize_t pipe_readv(file_t *file, const iovec_t *iov, int iovcnt) {
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        ssize_t got = pipe_read(file, iov[i].iov_base, iov[i].iov_len);
+        if (got < 0) return total ? total : -1;
+        total += got;
+        if ((size_t)got < iov[i].iov_len) break;
+    }
+    return total;
+}
+
+ssize_t pipe_writev(file_t *file, const iovec_t *iov, int iovcnt) {
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        ssize_t put = pipe_write(file, iov[i].iov_base, iov[i].iov_len);
+        if (put < 0) return total ? total : -1;
+        total += put;
+        if ((size_t)put < iov[i].iov_len) break;     // Ring full – partial writev
+    }
+    return total;
+}
+
+/* fcntl-style controls – F_SETPIPE_SZ grows/shrinks the slot ring */
+long pipe_fcntl(file_t *file, int cmd, long arg) {
+    pipe_file_t *pfile = file->private;
+    pipe_buffer_t *pipe = pfile->pipe;
+    unsigned long flags;
+
+    switch (cmd) {
+    case F_GETPIPE_SZ:
+        return (long)pipe->nr_slots * PIPE_CHUNK;
+
+    case F_SETPIPE_SZ: {
+        int want = (arg + PIPE_CHUNK - 1) / PIPE_CHUNK;
+        if (want < 1) want = 1;
+        if (want > PIPE_MAX_SLOTS) want = PIPE_MAX_SLOTS;
+
+        pipe_slot_t *fresh = kmalloc(want * sizeof(pipe_slot_t));
+        if (!fresh) return -1;
+
+        spin_lock_irqsave(&pipe->lock, &flags);
+
+        if (want < pipe->count) {       // Can't drop buffered data
+            spin_unlock_irqrestore(&pipe->lock, flags);
+            kfree(fresh);
+            return -1;
+        }
+
+        // Unroll the ring into the new table, head first
+        for (int i = 0; i < pipe->count; i++) {
+            fresh[i] = pipe->slots[(pipe->head + i) % pipe->nr_slots];
+        }
+        kfree(pipe->slots);
+        pipe->slots = fresh;
+        pipe->nr_slots = want;
+        pipe->head = 0;
 
-        // Wake reader if data available
-        if (pipe->read_waiter && pipe->count > 0) {
+        // A grown ring may unblock a writer
+        if (pipe->write_waiter && !pipe_ring_full(pipe)) {
+            task_wakeup(pipe->write_waiter);
+            pipe->write_waiter = NULL;
+        }
+
+        spin_unlock_irqrestore(&pipe->lock, flags);
+        return (long)want * PIPE_CHUNK;
+    }
+    }
+    return -1;
+}
+
+/* splice(): move bytes between fd_in and fd_out without staging them
+ * in user space. Pipe-to-pipe moves slot references outright; pipe to
+ * file writes straight out of the slot buffers; file to pipe reads
+ * into fresh slots that enter the ring by reference. */
+
+static int file_is_pipe(file_t *file) {
+    return file && file->f_ops == &pipe_ops;
+}
+
+/* Pipe → pipe: descriptors change hands, no bytes move */
+static ssize_t splice_pipe_pipe(pipe_buffer_t *in, pipe_buffer_t *out, size_t len) {
+    unsigned long flags;
+    ssize_t moved = 0;
+
+    /* Lock order by address – both directions of a chain use the same rule */
+    pipe_buffer_t *first = in < out ? in : out;
+    pipe_buffer_t *second = in < out ? out : in;
+    spin_lock_irqsave(&first->lock, &flags);
+    spin_lock(&second->lock);
+
+    while ((size_t)moved < len && in->count > 0 && !pipe_ring_full(out)) {
+        pipe_slot_t *slot = pipe_head_slot(in);
+        if (slot->len > len - moved) break;     // Would need a split – stop here
+
+        pipe_slot_t *dst = &out->slots[(out->head + out->count) % out->nr_slots];
+        *dst = *slot;
+        out->count++;
+        out->bytes += slot->len;
+
+        in->bytes -= slot->len;
+        in->head = (in->head + 1) % in->nr_slots;   // Reference moved, no kfree
+        in->count--;
+        moved += slot->len;
+    }
+
+    if (moved > 0) {
+        if (out->read_waiter) {
+            task_wakeup(out->read_waiter);
+            out->read_waiter = NULL;
+        }
+        if (in->write_waiter) {
+            task_wakeup(in->write_waiter);
+            in->write_waiter = NULL;
+        }
+        epoll_notify(&out->reader_file->watchers, POLLIN);
+        epoll_notify(&in->writer_file->watchers, POLLOUT);
+    }
+
+    spin_unlock(&second->lock);
+    spin_unlock_irqrestore(&first->lock, flags);
+    return moved;
+}
+
+/* Pipe → file/socket: hand each slot's bytes to the target's write op
+ * directly, no intermediate buffer */
+static ssize_t splice_pipe_out(pipe_buffer_t *pipe, file_t *out, size_t len) {
+    unsigned long flags;
+    ssize_t moved = 0;
+
+    spin_lock_irqsave(&pipe->lock, &flags);
+
+    while ((size_t)moved < len && pipe->count > 0) {
+        pipe_slot_t *slot = pipe_head_slot(pipe);
+        uint8_t *data = (uint8_t*)slot->buf + slot->offset;
+        size_t chunk = len - moved < slot->len ? len - moved : slot->len;
+
+        /* The write may block – drop the lock around it. Single-reader
+         * pipes (ours all are) keep the head stable meanwhile. */
+        spin_unlock_irqrestore(&pipe->lock, flags);
+        ssize_t put = vfs_write(out, data, chunk);
+        spin_lock_irqsave(&pipe->lock, &flags);
+
+        if (put <= 0) break;
+
+        slot->offset += put;
+        slot->len -= put;
+        pipe->bytes -= put;
+        moved += put;
+
+        if (slot->len == 0) pipe_drop_head(pipe);
+        if ((size_t)put < chunk) break;     // Target is full
+    }
+
+    if (moved > 0 && pipe->write_waiter) {
+        task_wakeup(pipe->write_waiter);
+        pipe->write_waiter = NULL;
+    }
+    if (moved > 0) epoll_notify(&pipe->writer_file->watchers, POLLOUT);
+
+    spin_unlock_irqrestore(&pipe->lock, flags);
+    return moved;
+}
+
+/* File → pipe: read into fresh chunks that join the ring by reference */
+static ssize_t splice_in_pipe(file_t *in, file_t *pipe_file, size_t len) {
+    pipe_file_t *pfile = pipe_file->private;
+    pipe_buffer_t *pipe = pfile->pipe;
+    unsigned long flags;
+    ssize_t moved = 0;
+
+    while ((size_t)moved < len) {
+        size_t chunk = len - moved < PIPE_CHUNK ? len - moved : PIPE_CHUNK;
+
+        void *buf = kmalloc(PIPE_CHUNK);
+        if (!buf) break;
+
+        ssize_t got = vfs_read(in, buf, chunk);
+        if (got <= 0) {
+            kfree(buf);
+            break;
+        }
+
+        spin_lock_irqsave(&pipe->lock, &flags);
+        if (pipe_push_slot(pipe, pipe_file, buf, 0, got, PIPE_CHUNK, &flags) < 0) {
+            spin_unlock_irqrestore(&pipe->lock, flags);
+            kfree(buf);
+            break;
+        }
+        if (pipe->read_waiter) {
             task_wakeup(pipe->read_waiter);
             pipe->read_waiter = NULL;
         }
+        epoll_notify(&pipe->reader_file->watchers, POLLIN);
+        spin_unlock_irqrestore(&pipe->lock, flags);
+
+        moved += got;
+        if ((size_t)got < chunk) break;     // Source drained
     }
 
-    spin_unlock_irqrestore(&pipe->lock, flags);
-    return written;
+    return moved;
+}
+
+ssize_t splice(int fd_in, int fd_out, size_t len) {
+    task_t *task = current_task;
+    if (!task || fd_in < 0 || fd_in >= MAX_FD || fd_out < 0 || fd_out >= MAX_FD)
+        return -1;
+
+    file_t *in = task->files[fd_in];
+    file_t *out = task->files[fd_out];
+    if (!in || !out) return -1;
+
+    int in_pipe = file_is_pipe(in);
+    int out_pipe = file_is_pipe(out);
+
+    if (in_pipe && out_pipe) {
+        return splice_pipe_pipe(((pipe_file_t*)in->private)->pipe,
+                                ((pipe_file_t*)out->private)->pipe, len);
+    }
+    if (in_pipe) {
+        return splice_pipe_out(((pipe_file_t*)in->private)->pipe, out, len);
+    }
+    if (out_pipe) {
+        return splice_in_pipe(in, out, len);
+    }
+    return -1;      // One side must be a pipe
 }
 
 /* Poll pipe */
@@ -164,9 +473,9 @@ int pipe_poll(file_t *file) {
 
     int events = 0;
     if (pfile->is_reader) {
-        if (pipe->count > 0) events |= POLLIN;
+        if (pipe->bytes > 0) events |= POLLIN;
     } else {
-        if (pipe->count < PIPE_BUFFER_SIZE) events |= POLLOUT;
+        if (!pipe_ring_full(pipe)) events |= POLLOUT;
     }
 
     spin_unlock_irqrestore(&pipe->lock, flags);
@@ -198,7 +507,9 @@ void pipe_close(file_t *file) {
 file_ops_t pipe_ops = {
     .read = pipe_read,
     .write = pipe_write,
+    .readv = pipe_readv,
+    .writev = pipe_writev,
     .poll = pipe_poll,
     .close = pipe_close,
     .seek = NULL
-};
\ No newline at end of file
+};
@@ -0,0 +1,40 @@
+/*
+ * pipe.h – Pipe and splice interfaces for RISC OS Phoenix
+ * Slot-ring pipes, zero-copy splice between pipes and files
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <stdint.h>
+#include "vfs.h"
+
+/* Granularity of pipe buffering – one slot allocation */
+#define PIPE_CHUNK          4096
+
+/* Default ring: 16 slots = 64KB in flight before a writer blocks */
+#define PIPE_DEF_SLOTS      16
+#define PIPE_MAX_SLOTS      256
+
+/* fcntl-style pipe commands */
+#define F_GETPIPE_SZ        1
+#define F_SETPIPE_SZ        2
+
+int pipe(int pipefd[2]);
+long pipe_fcntl(file_t *file, int cmd, long arg);
+
+/* Move up to len bytes from fd_in to fd_out without staging copies;
+ * at least one side must be a pipe */
+ssize_t splice(int fd_in, int fd_out, size_t len);
+
+ssize_t pipe_read(file_t *file, char *buf, size_t count);
+ssize_t pipe_write(file_t *file, const char *buf, size_t count);
+ssize_t pipe_readv(file_t *file, const iovec_t *iov, int iovcnt);
+ssize_t pipe_writev(file_t *file, const iovec_t *iov, int iovcnt);
+int pipe_poll(file_t *file);
+void pipe_close(file_t *file);
+
+extern file_ops_t pipe_ops;
+
+#endif /* PIPE_H */
@@ -0,0 +1,108 @@
+/*
+ * rcu.c – Read-copy-update for RISC OS Phoenix
+ * Readers touch shared read-mostly structures (block device table, ARP
+ * cache) with no lock at all. Writers publish a fresh copy and hand the
+ * old one to rcu_free(), which holds it until every CPU has been through
+ * schedule() – at that point no reader can still hold a reference.
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "spinlock.h"
+#include "rcu.h"
+
+typedef struct rcu_pending {
+    struct rcu_pending *next;
+    void *ptr;
+    void (*func)(void *ptr);    /* How to release ptr */
+    uint64_t epoch;      /* Grace period this free waits for */
+} rcu_pending_t;
+
+static volatile uint64_t rcu_epoch = 1;
+static volatile uint64_t cpu_epoch[MAX_CPUS];
+static rcu_pending_t *rcu_pending_list;
+static spinlock_t rcu_lock = SPINLOCK_INIT;
+
+void rcu_init(void)
+{
+    for (int i = 0; i < MAX_CPUS; i++) {
+        cpu_epoch[i] = rcu_epoch;
+    }
+    debug_print("RCU: initialized\n");
+}
+
+/* Oldest epoch any CPU is still in */
+static uint64_t rcu_min_epoch(void)
+{
+    uint64_t min = cpu_epoch[0];
+    for (int i = 1; i < nr_cpus; i++) {
+        if (cpu_epoch[i] < min) min = cpu_epoch[i];
+    }
+    return min;
+}
+
+/* Release everything whose grace period has elapsed */
+static void rcu_reclaim(void)
+{
+    uint64_t min = rcu_min_epoch();
+    unsigned long flags;
+    spin_lock_irqsave(&rcu_lock, &flags);
+
+    rcu_pending_t **p = &rcu_pending_list;
+    while (*p) {
+        if ((*p)->epoch < min) {
+            rcu_pending_t *done = *p;
+            *p = done->next;
+            done->func(done->ptr);
+            kfree(done);
+        } else {
+            p = &(*p)->next;
+        }
+    }
+
+    spin_unlock_irqrestore(&rcu_lock, flags);
+}
+
+/* Quiescent point: this CPU holds no RCU read references right now.
+ * Cheap enough for every schedule(); CPU 0 also sweeps the pending list. */
+void rcu_quiescent(int cpu)
+{
+    cpu_epoch[cpu] = rcu_epoch;
+    if (cpu == 0 && rcu_pending_list) {
+        rcu_reclaim();
+    }
+}
+
+void rcu_free(void *ptr)
+{
+    rcu_call(ptr, kfree);
+}
+
+/* Deferred release through an arbitrary destructor – lets slab-backed
+ * objects (file_t) ride the same grace-period machinery as kmalloc'd
+ * snapshots without the caller blocking in rcu_synchronize() */
+void rcu_call(void *ptr, void (*func)(void *ptr))
+{
+    rcu_pending_t *pend = kmalloc(sizeof(rcu_pending_t));
+    if (!pend) return;  /* Leak rather than free early */
+
+    pend->ptr = ptr;
+    pend->func = func;
+    pend->epoch = __atomic_add_fetch(&rcu_epoch, 1, __ATOMIC_ACQ_REL);
+
+    unsigned long flags;
+    spin_lock_irqsave(&rcu_lock, &flags);
+    pend->next = rcu_pending_list;
+    rcu_pending_list = pend;
+    spin_unlock_irqrestore(&rcu_lock, flags);
+}
+
+/* Writer-side barrier: spin until every CPU passes the new epoch */
+void rcu_synchronize(void)
+{
+    uint64_t target = __atomic_add_fetch(&rcu_epoch, 1, __ATOMIC_ACQ_REL);
+
+    while (rcu_min_epoch() < target) {
+        yield();
+    }
+}
@@ -0,0 +1,36 @@
+/*
+ * rcu.h – Read-copy-update for RISC OS Phoenix
+ * Lock-free readers over published snapshots; writers defer frees until
+ * every CPU has passed a quiescent point (the scheduler tick)
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef RCU_H
+#define RCU_H
+
+#include <stdint.h>
+
+void rcu_init(void);
+
+/* Mark a quiescent point for this CPU – called from schedule() */
+void rcu_quiescent(int cpu);
+
+/* Publish a new version of an RCU-protected pointer */
+#define rcu_assign_pointer(p, v) \
+    __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+/* Read an RCU-protected pointer (safe without any lock) */
+#define rcu_dereference(p) \
+    __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+
+/* Free ptr with kfree() once the current grace period has elapsed */
+void rcu_free(void *ptr);
+
+/* As rcu_free, but release through func(ptr) – for slab objects and
+ * anything else kfree() can't take back */
+void rcu_call(void *ptr, void (*func)(void *ptr));
+
+/* Block until all CPUs have passed a quiescent point */
+void rcu_synchronize(void);
+
+#endif /* RCU_H */
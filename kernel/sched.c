@@ -1,11 +1,15 @@
 /*
  * sched.c – 64-bit multi-core scheduler for RISC OS Phoenix
- * Final clean version – cpu_sched is global, no static nr_cpus
+ * O(1) priority-bitmap runqueue – one bucket per priority level,
+ * 256-bit find-first-set bitmap for constant-time enqueue/pick-next
  * Author: Grok 4 – 06 Feb 2026
  */
 
 #include "kernel.h"
 #include "spinlock.h"
+#include "rcu.h"
+#include "vfs.h"
+#include "trace.h"
 #include <string.h>
 
 cpu_sched_t cpu_sched[MAX_CPUS];   // Global, visible to boot.c and kernel.c
@@ -18,9 +22,14 @@ void sched_init_cpu(int cpu_id) {
     cpu_sched_t *sched = &cpu_sched[cpu_id];
     sched->cpu_id = cpu_id;
     sched->current = NULL;
-    sched->runqueue_head = sched->runqueue_tail = NULL;
+    for (int i = 0; i < SCHED_PRIO_LEVELS; i++) {
+        sched->prio_head[i] = sched->prio_tail[i] = NULL;
+    }
+    for (int i = 0; i < SCHED_BITMAP_WORDS; i++) {
+        sched->prio_bitmap[i] = 0;
+    }
     sched->schedule_count = 0;
-    spinlock_init(&sched->lock);
+    mcs_lock_init(&sched->lock);
 
     task_t *idle = kmalloc(sizeof(task_t));
     memset(idle, 0, sizeof(task_t));
@@ -40,58 +49,142 @@ void sched_init(void) {
     debug_print("Scheduler initialized for %d CPUs\n", nr_cpus);
 }
 
-/* Enqueue task into runqueue */
+/* Clamp priority into the bucket range */
+static inline int prio_index(int priority) {
+    if (priority < TASK_MIN_PRIORITY) priority = TASK_MIN_PRIORITY;
+    if (priority > TASK_MAX_PRIORITY) priority = TASK_MAX_PRIORITY;
+    return priority - TASK_MIN_PRIORITY;
+}
+
+/* Enqueue task at the tail of its priority bucket – O(1) */
 static inline void enqueue_task(cpu_sched_t *sched, task_t *task) {
+    int idx = prio_index(task->priority);
+
     task->state = TASK_READY;
     task->next = NULL;
+    task->prev = sched->prio_tail[idx];
 
-    if (!sched->runqueue_head) {
-        sched->runqueue_head = sched->runqueue_tail = task;
-        task->prev = NULL;
-        return;
+    if (sched->prio_tail[idx]) {
+        sched->prio_tail[idx]->next = task;
+    } else {
+        sched->prio_head[idx] = task;
+        sched->prio_bitmap[idx / 64] |= (1ULL << (idx % 64));
     }
+    sched->prio_tail[idx] = task;
+    sched->nr_ready++;
 
-    task_t *pos = sched->runqueue_head;
-    task_t *prev = NULL;
-    while (pos && pos->priority <= task->priority) {
-        prev = pos;
-        pos = pos->next;
-    }
-
-    if (!prev) {
-        task->next = sched->runqueue_head;
-        sched->runqueue_head->prev = task;
-        sched->runqueue_head = task;
-    } else {
-        task->next = prev->next;
-        task->prev = prev;
-        if (prev->next) prev->next->prev = task;
-        else sched->runqueue_tail = task;
-        prev->next = task;
+    /* Second runnable task on a tickless core – preemption needs the tick */
+    if (sched->nr_ready == 2) {
+        timer_resume_tick(sched->cpu_id);
     }
 }
 
-/* Dequeue task from runqueue */
+/* Unlink task from its priority bucket – O(1) */
 static inline void dequeue_task(cpu_sched_t *sched, task_t *task) {
+    int idx = prio_index(task->priority);
+
     if (task->prev) task->prev->next = task->next;
-    else sched->runqueue_head = task->next;
+    else sched->prio_head[idx] = task->next;
     if (task->next) task->next->prev = task->prev;
-    else sched->runqueue_tail = task->prev;
+    else sched->prio_tail[idx] = task->prev;
+
+    if (!sched->prio_head[idx]) {
+        sched->prio_bitmap[idx / 64] &= ~(1ULL << (idx % 64));
+    }
+    task->next = task->prev = NULL;
+    sched->nr_ready--;
+}
+
+/* Find lowest set priority via the bitmap – O(1), 4 words max */
+static inline int find_first_ready(cpu_sched_t *sched) {
+    for (int w = 0; w < SCHED_BITMAP_WORDS; w++) {
+        if (sched->prio_bitmap[w]) {
+            return w * 64 + __builtin_ctzll(sched->prio_bitmap[w]);
+        }
+    }
+    return -1;
 }
 
-/* Pick next task to run */
+/* Find the last (lowest-priority) set bit – least disruptive steal victim */
+static inline int find_last_ready(cpu_sched_t *sched) {
+    for (int w = SCHED_BITMAP_WORDS - 1; w >= 0; w--) {
+        if (sched->prio_bitmap[w]) {
+            return w * 64 + 63 - __builtin_clzll(sched->prio_bitmap[w]);
+        }
+    }
+    return -1;
+}
+
+/* Idle-time work stealing: take the tail of the busiest remote runqueue.
+ * Called with our own lock held; victim locks are taken with trylock so
+ * two idle CPUs stealing from each other cannot deadlock. */
+static task_t *steal_task(cpu_sched_t *sched) {
+    cpu_sched_t *busiest = NULL;
+    int max_ready = 0;
+
+    for (int cpu = 0; cpu < nr_cpus; cpu++) {
+        cpu_sched_t *victim = &cpu_sched[cpu];
+        if (victim == sched) continue;
+        if (victim->nr_ready > max_ready) {
+            max_ready = victim->nr_ready;
+            busiest = victim;
+        }
+    }
+
+    if (!busiest || !mcs_trylock(&busiest->lock)) {
+        return NULL;
+    }
+
+    /* Steal from the tail of the victim's lowest-priority bucket,
+     * skipping tasks whose affinity mask excludes this CPU */
+    task_t *stolen = NULL;
+    int idx = find_last_ready(busiest);
+    if (idx >= 0) {
+        for (task_t *t = busiest->prio_tail[idx]; t; t = t->prev) {
+            if (t->cpu_affinity & (1ULL << sched->cpu_id)) {
+                stolen = t;
+                break;
+            }
+        }
+    }
+
+    if (stolen) {
+        dequeue_task(busiest, stolen);
+        busiest->stolen_count++;
+        sched->steal_count++;
+    }
+
+    mcs_unlock(&busiest->lock);
+
+    if (stolen) {
+        enqueue_task(sched, stolen);
+        debug_print("sched: CPU %d stole '%s' from CPU %d\n",
+                    sched->cpu_id, stolen->name, busiest->cpu_id);
+    }
+    return stolen;
+}
+
+/* Pick next task to run – head of highest-priority non-empty bucket */
 static inline task_t *pick_next_task(cpu_sched_t *sched) {
-    if (!sched->runqueue_head) {
+    int idx = find_first_ready(sched);
+    if (idx < 0) {
+        /* Nothing local – try to steal before dropping to idle */
+        if (steal_task(sched)) {
+            idx = find_first_ready(sched);
+        }
+    }
+    if (idx < 0) {
         return sched->idle_task;
     }
-    task_t *next = sched->runqueue_head;
+    task_t *next = sched->prio_head[idx];
     dequeue_task(sched, next);
-    enqueue_task(sched, next);
+    enqueue_task(sched, next);  // Round-robin within the bucket
     return next;
 }
 
 /* Context switch */
 void context_switch(task_t *prev, task_t *next) {
+    trace_event(TRACE_EV_SCHED_SWITCH, prev, next);
     current_task = next;
 
     __asm__ volatile (
@@ -113,4 +206,184 @@ void context_switch(task_t *prev, task_t *next) {
         "str x30, [sp, #-16]!\n"
         "mrs %0, sp_el0\n"
         "mrs %1, elr_el1\n"
-        "mrs
\ No newline at end of file
+        "mrs %2, spsr_el1\n"
+        : "=r"(prev->sp_el0), "=r"(prev->elr_el1), "=r"(prev->spsr_el1)
+        :
+        : "memory"
+    );
+
+    __asm__ volatile (
+        "msr sp_el0, %0\n"
+        "msr elr_el1, %1\n"
+        "msr spsr_el1, %2\n"
+        "ldr x30, [sp], #16\n"
+        "ldp x28, x29, [sp], #16\n"
+        "ldp x26, x27, [sp], #16\n"
+        "ldp x24, x25, [sp], #16\n"
+        "ldp x22, x23, [sp], #16\n"
+        "ldp x20, x21, [sp], #16\n"
+        "ldp x18, x19, [sp], #16\n"
+        "ldp x16, x17, [sp], #16\n"
+        "ldp x14, x15, [sp], #16\n"
+        "ldp x12, x13, [sp], #16\n"
+        "ldp x10, x11, [sp], #16\n"
+        "ldp x8, x9, [sp], #16\n"
+        "ldp x6, x7, [sp], #16\n"
+        "ldp x4, x5, [sp], #16\n"
+        "ldp x2, x3, [sp], #16\n"
+        "ldp x0, x1, [sp], #16\n"
+        :
+        : "r"(next->sp_el0), "r"(next->elr_el1), "r"(next->spsr_el1)
+        : "memory"
+    );
+}
+
+#ifdef CONFIG_SCHED_STATS
+/* Record wakeup-to-run latency when a freshly woken task hits the CPU */
+static inline void sched_stats_ran(cpu_sched_t *sched, task_t *next, uint64_t now)
+{
+    if (!next->wakeup_ns) return;
+
+    uint64_t lat = now - next->wakeup_ns;
+    next->wakeup_ns = 0;
+
+    sched_stats_t *st = &sched->stats;
+    st->wakeup_samples++;
+    st->wakeup_lat_total_ns += lat;
+    if (lat > st->wakeup_lat_max_ns) st->wakeup_lat_max_ns = lat;
+
+    /* log2 microsecond buckets, saturating at the top */
+    int bucket = 0;
+    uint64_t us = lat / 1000;
+    while (us > 1 && bucket < SCHED_LAT_BUCKETS - 1) { us >>= 1; bucket++; }
+    st->wakeup_lat_hist[bucket]++;
+}
+#define SCHED_STAT_INC(sched, field)  ((sched)->stats.field++)
+#else
+#define sched_stats_ran(sched, next, now) do {} while (0)
+#define SCHED_STAT_INC(sched, field)  do {} while (0)
+#endif
+
+/* Main scheduler entry – called from the timer tick and voluntarily */
+void schedule(void)
+{
+    int cpu = get_cpu_id();
+    cpu_sched_t *sched = &cpu_sched[cpu];
+    unsigned long flags;
+
+    rcu_quiescent(cpu);  // Natural grace-period marker
+
+    mcs_lock_irqsave(&sched->lock, &flags);
+
+    task_t *prev = sched->current;
+    if (prev && prev != sched->idle_task && prev->state == TASK_RUNNING) {
+        /* Still runnable but losing the CPU – involuntary preemption */
+        SCHED_STAT_INC(sched, preemptions);
+        enqueue_task(sched, prev);
+    }
+
+    task_t *next = pick_next_task(sched);
+    sched->current = next;
+    next->state = TASK_RUNNING;
+    sched->schedule_count++;
+
+#ifdef CONFIG_SCHED_STATS
+    sched_stats_ran(sched, next, get_time_ns());
+    if (next != prev) SCHED_STAT_INC(sched, ctx_switches);
+#endif
+
+    mcs_unlock_irqrestore(&sched->lock, flags);
+
+    if (next != prev) {
+        context_switch(prev, next);
+    }
+}
+
+/* Voluntarily give up the CPU */
+void yield(void)
+{
+    schedule();
+}
+
+/* Block the current task in the given state and switch away */
+void task_block(task_state_t state)
+{
+    current_task->state = state;
+    schedule();
+}
+
+/* Make a blocked task runnable again on its CPU */
+void task_wakeup(task_t *task)
+{
+    if (task->state != TASK_BLOCKED) return;
+
+    int cpu = __builtin_ctzll(task->cpu_affinity);
+    cpu_sched_t *sched = &cpu_sched[cpu];
+    unsigned long flags;
+
+    mcs_lock_irqsave(&sched->lock, &flags);
+#ifdef CONFIG_SCHED_STATS
+    task->wakeup_ns = get_time_ns();
+    SCHED_STAT_INC(sched, wakeups);
+#endif
+    trace_event(TRACE_EV_SCHED_WAKEUP, task, cpu);
+    enqueue_task(sched, task);
+    mcs_unlock_irqrestore(&sched->lock, flags);
+
+    if (cpu != get_cpu_id()) {
+        send_ipi(1ULL << cpu, IPI_RESCHEDULE, 0);
+    }
+}
+
+#ifdef CONFIG_SCHED_STATS
+/* Render the per-CPU stats block for the Proc:SchedStats VFS node */
+static ssize_t sched_stats_read(file_t *file, void *buf, size_t count)
+{
+    char *out = buf;
+    size_t used = 0;
+
+    if (file->f_pos > 0) return 0;  /* One-shot read, like debug nodes */
+
+    for (int cpu = 0; cpu < nr_cpus; cpu++) {
+        cpu_sched_t *sched = &cpu_sched[cpu];
+        sched_stats_t *st = &sched->stats;
+        uint64_t avg = st->wakeup_samples ?
+                       st->wakeup_lat_total_ns / st->wakeup_samples : 0;
+
+        used += snprintf(out + used, count - used,
+            "cpu%d sched=%llu ctxsw=%llu preempt=%llu wake=%llu "
+            "steal=%llu/%llu depth=%d lat_avg=%lluns lat_max=%lluns\n",
+            cpu, sched->schedule_count, st->ctx_switches, st->preemptions,
+            st->wakeups, sched->steal_count, sched->stolen_count,
+            sched->nr_ready, avg, st->wakeup_lat_max_ns);
+
+        used += snprintf(out + used, count - used, "cpu%d lat_hist_us", cpu);
+        for (int b = 0; b < SCHED_LAT_BUCKETS; b++) {
+            used += snprintf(out + used, count - used, " %llu",
+                             st->wakeup_lat_hist[b]);
+        }
+        used += snprintf(out + used, count - used, "\n");
+        if (used >= count) break;
+    }
+
+    file->f_pos = used;
+    return used;
+}
+
+static file_ops_t sched_stats_ops = {
+    .read = sched_stats_read,
+};
+
+/* Register the stats node with the VFS – surfaces as Proc:SchedStats */
+void sched_stats_vfs_init(void)
+{
+    inode_t *inode = vfs_alloc_inode();
+    if (!inode) return;
+
+    inode->i_mode = S_IFREG;
+    inode->private = &sched_stats_ops;
+    vfs_set_file_type(inode, 0xFFF);  /* Text */
+
+    debug_print("sched: stats exposed as Proc:SchedStats\n");
+}
+#endif /* CONFIG_SCHED_STATS */
\ No newline at end of file
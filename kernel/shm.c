@@ -0,0 +1,208 @@
+/*
+ * shm.c – Shared-memory IPC regions for RISC OS Phoenix
+ * Named physical regions mapped into several address spaces; the
+ * optional SPSC ring turns them into a zero-copy message channel
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "shm.h"
+#include "mmu.h"
+#include "page_alloc.h"
+#include "futex.h"
+#include "spinlock.h"
+#include <string.h>
+
+#define KERNEL_VIRT_BASE    0xFFFF000000000000ULL
+
+typedef struct shm_region {
+    char     name[SHM_NAME_MAX];
+    uint64_t phys;              /* Contiguous backing pages */
+    size_t   size;              /* Rounded up to pages */
+    int      order;             /* Buddy order of the allocation */
+    int      used;
+    int      refcount;          /* Tasks holding a mapping */
+    int      flags;
+} shm_region_t;
+
+static shm_region_t shm_regions[SHM_MAX_REGIONS];
+static spinlock_t shm_lock = SPINLOCK_INIT;
+
+static inline uint64_t shm_region_va(int id) {
+    return SHM_VA_BASE + (uint64_t)id * SHM_SLOT_SIZE;
+}
+
+/* Round a byte count up to a buddy order */
+static int shm_size_order(size_t size) {
+    int order = 0;
+    while ((PAGE_SIZE << order) < size) order++;
+    return order;
+}
+
+/* Create a named region. With SHM_RING, a ring header for rec_size
+ * records is laid over the start and sized to fill the region. */
+int shm_create(const char *name, size_t size, int flags, uint32_t rec_size) {
+    if (!name || !size || size > SHM_SLOT_SIZE) return -1;
+
+    unsigned long irq;
+    spin_lock_irqsave(&shm_lock, &irq);
+
+    int id = -1;
+    for (int i = 0; i < SHM_MAX_REGIONS; i++) {
+        if (shm_regions[i].used && strncmp(shm_regions[i].name, name, SHM_NAME_MAX) == 0) {
+            spin_unlock_irqrestore(&shm_lock, irq);
+            return -1;          /* Name taken */
+        }
+        if (!shm_regions[i].used && id < 0) id = i;
+    }
+    if (id < 0) {
+        spin_unlock_irqrestore(&shm_lock, irq);
+        return -1;
+    }
+    shm_regions[id].used = 1;   /* Reserve before dropping the lock */
+    spin_unlock_irqrestore(&shm_lock, irq);
+
+    shm_region_t *region = &shm_regions[id];
+    int order = shm_size_order(size);
+
+    region->phys = phys_alloc_pages(order);
+    if (!region->phys) {
+        region->used = 0;
+        return -1;
+    }
+
+    strncpy(region->name, name, SHM_NAME_MAX - 1);
+    region->name[SHM_NAME_MAX - 1] = '\0';
+    region->size = PAGE_SIZE << order;
+    region->order = order;
+    region->refcount = 0;
+    region->flags = flags;
+
+    void *base = (void*)(region->phys + KERNEL_VIRT_BASE);
+    memset(base, 0, region->size);
+
+    if (flags & SHM_RING) {
+        shm_ring_t *ring = base;
+        if (!rec_size) rec_size = 64;
+
+        /* Largest power-of-two record count that fits after the header */
+        uint32_t cap = 1;
+        while ((uint64_t)cap * 2 * rec_size + sizeof(shm_ring_t) <= region->size)
+            cap *= 2;
+
+        ring->magic = SHM_RING_MAGIC;
+        ring->rec_size = rec_size;
+        ring->capacity = cap;
+        ring->head = 0;
+        ring->tail = 0;
+    }
+
+    debug_print("SHM: Region '%s' created (%d KB%s)\n", region->name,
+                (int)(region->size / 1024), (flags & SHM_RING) ? ", ring" : "");
+    return id;
+}
+
+/* Look up a region by name */
+int shm_open(const char *name) {
+    unsigned long irq;
+    spin_lock_irqsave(&shm_lock, &irq);
+
+    for (int i = 0; i < SHM_MAX_REGIONS; i++) {
+        if (shm_regions[i].used && strncmp(shm_regions[i].name, name, SHM_NAME_MAX) == 0) {
+            spin_unlock_irqrestore(&shm_lock, irq);
+            return i;
+        }
+    }
+
+    spin_unlock_irqrestore(&shm_lock, irq);
+    return -1;
+}
+
+/* Map a region into the current task at its fixed slot VA. Every task
+ * sees the same address, so records may hold pointers into the region. */
+void *shm_map(int id) {
+    if (id < 0 || id >= SHM_MAX_REGIONS || !shm_regions[id].used) return NULL;
+    shm_region_t *region = &shm_regions[id];
+    task_t *task = current_task;
+    if (!task) return NULL;
+
+    uint64_t va = shm_region_va(id);
+    if (mmu_map_phys(task, va, region->phys, region->size,
+                     PROT_READ | PROT_WRITE) != 0) {
+        return NULL;
+    }
+
+    unsigned long irq;
+    spin_lock_irqsave(&shm_lock, &irq);
+    region->refcount++;
+    spin_unlock_irqrestore(&shm_lock, irq);
+
+    return (void*)va;
+}
+
+/* Ring header of a mapped SHM_RING region – kernel-side view */
+shm_ring_t *shm_ring(int id) {
+    if (id < 0 || id >= SHM_MAX_REGIONS || !shm_regions[id].used) return NULL;
+    shm_region_t *region = &shm_regions[id];
+    if (!(region->flags & SHM_RING)) return NULL;
+
+    shm_ring_t *ring = (shm_ring_t*)(region->phys + KERNEL_VIRT_BASE);
+    return ring->magic == SHM_RING_MAGIC ? ring : NULL;
+}
+
+/* Tear down a region once the last mapper is done with it */
+int shm_destroy(int id) {
+    if (id < 0 || id >= SHM_MAX_REGIONS || !shm_regions[id].used) return -1;
+    shm_region_t *region = &shm_regions[id];
+
+    unsigned long irq;
+    spin_lock_irqsave(&shm_lock, &irq);
+    if (region->refcount > 0) {
+        spin_unlock_irqrestore(&shm_lock, irq);
+        return -1;              /* Still mapped somewhere */
+    }
+    region->used = 0;
+    spin_unlock_irqrestore(&shm_lock, irq);
+
+    phys_free_pages(region->phys, region->order);
+    return 0;
+}
+
+/* ==================== SPSC ring ==================== */
+
+/* Producer side: publish one record. Returns -1 when the ring is
+ * full – the producer decides whether to drop or retry. The futex
+ * wake fires only on the empty→non-empty edge, so a saturated
+ * pipeline makes no syscalls at all. */
+int shm_ring_push(shm_ring_t *ring, const void *rec) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = ring->tail;     /* Producer owns tail */
+
+    if (tail - head >= ring->capacity) return -1;   /* Full */
+
+    memcpy(ring->data + (uint64_t)(tail & (ring->capacity - 1)) * ring->rec_size,
+           rec, ring->rec_size);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+    if (tail == head) {
+        /* Ring was empty – the consumer may be asleep on the tail word */
+        futex_wake((uint32_t*)&ring->tail, 1);
+    }
+    return 0;
+}
+
+/* Consumer side: take one record, sleeping on the tail word while the
+ * ring is empty (when block is set) */
+int shm_ring_pop(shm_ring_t *ring, void *rec, int block) {
+    uint32_t head = ring->head;     /* Consumer owns head */
+
+    while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) {
+        if (!block) return -1;      /* Empty */
+        futex_wait((uint32_t*)&ring->tail, head);
+    }
+
+    memcpy(rec, ring->data + (uint64_t)(head & (ring->capacity - 1)) * ring->rec_size,
+           ring->rec_size);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
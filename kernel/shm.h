@@ -0,0 +1,50 @@
+/*
+ * shm.h – Shared-memory IPC regions for RISC OS Phoenix
+ * Named regions mapped into multiple tasks, optional SPSC ring header
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdint.h>
+
+#define SHM_NAME_MAX    32
+#define SHM_MAX_REGIONS 64
+
+/* Every region maps at the same VA in every task, so pointers into a
+ * region are valid for all parties: slot i sits at SHM_VA_BASE + i *
+ * SHM_SLOT_SIZE, which also caps a region at 16MB */
+#define SHM_VA_BASE     0x500000000ULL
+#define SHM_SLOT_SIZE   (16ULL * 1024 * 1024)
+
+/* Creation flags */
+#define SHM_RING        0x01    /* Kernel lays an SPSC ring over the region */
+
+/* Lock-free single-producer/single-consumer ring at the start of a
+ * SHM_RING region. head/tail count records monotonically; producer
+ * owns tail, consumer owns head, steady state needs no syscalls. */
+typedef struct shm_ring {
+    uint32_t magic;             /* 'RING' */
+    uint32_t rec_size;          /* Bytes per record */
+    uint32_t capacity;          /* Records – power of two */
+    uint32_t pad;
+    volatile uint32_t head;     /* Consumer cursor */
+    volatile uint32_t tail;     /* Producer cursor – futex word when empty */
+    uint8_t  data[];
+} shm_ring_t;
+
+#define SHM_RING_MAGIC  0x52494E47  /* 'RING' */
+
+int shm_create(const char *name, size_t size, int flags, uint32_t rec_size);
+int shm_open(const char *name);
+void *shm_map(int id);
+shm_ring_t *shm_ring(int id);
+int shm_destroy(int id);
+
+/* Ring operations – producer/consumer sides, one task each.
+ * Push/pop move one record; pop blocks on the futex when empty. */
+int shm_ring_push(shm_ring_t *ring, const void *rec);
+int shm_ring_pop(shm_ring_t *ring, void *rec, int block);
+
+#endif /* SHM_H */
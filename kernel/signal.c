@@ -2,11 +2,16 @@
  * signal.c – POSIX signals for RISC OS Phoenix
  * Supports signal, sigaction, kill, sigreturn
  * Added handlers for SIGTERM, SIGINT, SIGQUIT, SIGCHLD, SIGUSR1, SIGUSR2
+ * Lock-free pending bitmap: senders coalesce repeat signals without ever
+ * touching the target's lock, and delivery drains the whole bitmap in one
+ * pass at kernel exit. signalfd() turns signal storms into one readable fd.
  * Author:R Andrews Grok 4 – 26 Nov 2025
  */
 
 #include "kernel.h"
 #include "spinlock.h"
+#include "vfs.h"
+#include "epoll.h"
 #include <stdint.h>
 #include <string.h>
 
@@ -17,6 +22,22 @@
 
 #define SIG_DFL         ((void(*)(int))0)
 #define SIG_IGN         ((void(*)(int))1)
+#define SIG_ERR         ((void(*)(int))-1)
+
+#define SIGINT          2
+#define SIGQUIT         3
+#define SIGILL          4
+#define SIGBUS          7
+#define SIGFPE          8
+#define SIGKILL         9
+#define SIGUSR1         10
+#define SIGSEGV         11
+#define SIGUSR2         12
+#define SIGTERM         15
+#define SIGCHLD         17
+#define SIGSTOP         19
+
+#define SA_SIGINFO      0x04
 
 /* Signal action structure */
 typedef struct {
@@ -32,8 +53,159 @@ typedef struct {
     uint64_t blocked;
     uint64_t old_mask;      // For sigreturn
     uint64_t sigreturn_sp;  // Saved SP for sigreturn
+    void    *sigfd;         // signalfd queue draining these signals, if any
 } signal_state_t;
 
+extern task_t *find_task_by_pid(pid_t pid);
+extern void exit(int status);
+
+/* ------------------------------------------------------------------ */
+/*  signalfd – queue siginfo records behind a single pollable fd      */
+/*                                                                    */
+/*  A supervisor fielding SIGCHLD bursts from hundreds of workers     */
+/*  doesn't want hundreds of handler invocations: it reads one fd     */
+/*  and gets the whole batch as records. Signals covered by the fd's  */
+/*  mask never reach the pending bitmap at all.                       */
+/* ------------------------------------------------------------------ */
+
+#define SIGFD_RECS      128     // Ring of queued siginfo records
+
+typedef struct {
+    int32_t ssi_signo;          // Signal number
+    int32_t ssi_pid;            // Sending PID
+} signalfd_siginfo_t;
+
+typedef struct {
+    uint64_t            mask;           // Signals routed to this fd
+    signalfd_siginfo_t  recs[SIGFD_RECS];
+    int                 head;           // Next record to read
+    int                 count;          // Queued records
+    uint64_t            overruns;       // Records dropped when full
+    spinlock_t          lock;
+    task_t             *reader;         // Task sleeping in read()
+    file_t             *file;           // Back pointer for epoll_notify
+} sigfd_t;
+
+static ssize_t sigfd_read(file_t *file, void *buf, size_t count)
+{
+    sigfd_t *sf = file->private;
+    signalfd_siginfo_t *out = buf;
+    size_t max = count / sizeof(signalfd_siginfo_t);
+
+    if (!max)
+        return -1;
+
+    spin_lock(&sf->lock);
+    while (!sf->count) {
+        if (file->f_flags & O_NONBLOCK) {
+            spin_unlock(&sf->lock);
+            return 0;
+        }
+        sf->reader = current_task;
+        spin_unlock(&sf->lock);
+        task_block(TASK_BLOCKED);
+        schedule();
+        spin_lock(&sf->lock);
+    }
+
+    /* Drain the whole batch in one read – that's the point */
+    size_t n = 0;
+    while (sf->count && n < max) {
+        out[n++] = sf->recs[sf->head];
+        sf->head = (sf->head + 1) % SIGFD_RECS;
+        sf->count--;
+    }
+    spin_unlock(&sf->lock);
+
+    return n * sizeof(signalfd_siginfo_t);
+}
+
+static int sigfd_poll(file_t *file)
+{
+    sigfd_t *sf = file->private;
+    return sf->count ? POLLIN : 0;
+}
+
+static void sigfd_close(file_t *file)
+{
+    sigfd_t *sf = file->private;
+
+    /* Detach from the owner so kill() falls back to the bitmap */
+    current_task->signal_state.sigfd = NULL;
+    kfree(sf);
+    file->private = NULL;
+}
+
+static file_ops_t sigfd_ops = {
+    .read  = sigfd_read,
+    .poll  = sigfd_poll,
+    .close = sigfd_close,
+};
+
+/* signalfd() – route 'mask' signals for the calling task into a new fd */
+int signalfd(uint64_t mask)
+{
+    sigfd_t *sf = kmalloc(sizeof(sigfd_t));
+    if (!sf)
+        return -1;
+    memset(sf, 0, sizeof(sigfd_t));
+    sf->mask = mask & ~((1ULL << SIGKILL) | (1ULL << SIGSTOP));
+
+    file_t *file = vfs_alloc_file();
+    if (!file) {
+        kfree(sf);
+        return -1;
+    }
+    file->f_ops = &sigfd_ops;
+    file->private = sf;
+    sf->file = file;
+
+    int fd = alloc_fd(file);
+    if (fd < 0) {
+        kfree(sf);
+        vfs_free_file(file);
+        return -1;
+    }
+
+    current_task->signal_state.sigfd = sf;
+    debug_print("signalfd: fd %d mask 0x%llx for PID %d\n",
+                fd, sf->mask, current_task->pid);
+    return fd;
+}
+
+/* Queue a record on the target's signalfd. Returns 0 if the signal was
+ * consumed by the fd, -1 if the caller should use the pending bitmap. */
+static int sigfd_push(task_t *target, int sig, pid_t sender)
+{
+    sigfd_t *sf = target->signal_state.sigfd;
+    if (!sf || !(sf->mask & (1ULL << sig)))
+        return -1;
+
+    spin_lock(&sf->lock);
+    if (sf->count == SIGFD_RECS) {
+        /* Full – drop and count it, like a NIC ring overrun */
+        sf->overruns++;
+        spin_unlock(&sf->lock);
+        return 0;
+    }
+    int tail = (sf->head + sf->count) % SIGFD_RECS;
+    sf->recs[tail].ssi_signo = sig;
+    sf->recs[tail].ssi_pid = sender;
+    sf->count++;
+    task_t *reader = sf->reader;
+    sf->reader = NULL;
+    spin_unlock(&sf->lock);
+
+    if (reader)
+        task_wakeup(reader);
+    epoll_notify(&sf->file->watchers, POLLIN);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Classic delivery path                                             */
+/* ------------------------------------------------------------------ */
+
 /* signal() – simple interface */
 void (*signal(int sig, void (*handler)(int)))(int)
 {
@@ -82,57 +254,84 @@ int kill(pid_t pid, int sig)
 
     if (sig == 0) return 0;  // Just check existence
 
-    __atomic_or_fetch(&target->signal_state.pending, (1ULL << sig), __ATOMIC_SEQ_CST);
+    /* signalfd first: a masked signal becomes a queued record and never
+     * touches the bitmap or wakes the delivery path */
+    if (sigfd_push(target, sig, current_task ? current_task->pid : 0) == 0)
+        return 0;
+
+    /* Atomic set with coalescing: if the bit was already pending the
+     * previous sender owns the wakeup, and we avoid bouncing the
+     * target's cache line during a signal storm */
+    uint64_t old = __atomic_fetch_or(&target->signal_state.pending,
+                                     (1ULL << sig), __ATOMIC_SEQ_CST);
+    if (old & (1ULL << sig))
+        return 0;
+
     task_wakeup(target);  // Unblock if sleeping
 
     debug_print("kill: sent signal %d to PID %d\n", sig, pid);
     return 0;
 }
 
-/* Deliver pending signals */
+/* Deliver pending signals – drains the entire unblocked bitmap in one
+ * pass at kernel exit. SIG_IGN and default actions are resolved inline;
+ * at most one user handler frame is set up per exit, the rest stay
+ * pending for the next pass. */
 static void deliver_signals(void)
 {
     task_t *task = current_task;
-    uint64_t pending = task->signal_state.pending;
-    uint64_t blocked = task->signal_state.blocked;
-
-    pending &= ~blocked;
-    if (!pending) return;
-
-    /* Find first pending signal */
-    int sig = __builtin_ctzll(pending);
-    void (*handler)(int) = task->signal_state.handlers[sig];
 
-    __atomic_and_fetch(&task->signal_state.pending, ~(1ULL << sig), __ATOMIC_SEQ_CST);
-
-    if (handler == SIG_DFL) {
-        debug_print("Signal %d: default action → terminate\n", sig);
-        exit(128 + sig);
+    for (;;) {
+        uint64_t pending = __atomic_load_n(&task->signal_state.pending,
+                                           __ATOMIC_ACQUIRE);
+        pending &= ~task->signal_state.blocked;
+        if (!pending)
+            return;
+
+        int sig = __builtin_ctzll(pending);
+        __atomic_and_fetch(&task->signal_state.pending, ~(1ULL << sig),
+                           __ATOMIC_SEQ_CST);
+
+        void (*handler)(int) = task->signal_state.handlers[sig];
+
+        if (handler == SIG_DFL) {
+            if (sig == SIGCHLD)
+                continue;   // Default for SIGCHLD is ignore
+            debug_print("Signal %d: default action → terminate\n", sig);
+            exit(128 + sig);
+        }
+        if (handler == SIG_IGN)
+            continue;       // Keep draining the batch
+
+        debug_print("Delivering signal %d to handler 0x%llx\n", sig, (uint64_t)handler);
+
+        /* Set up signal frame on user stack */
+        uint64_t sp = task->sp_el0;
+        sp -= 256;  // Signal frame
+
+        /* Save old context for sigreturn */
+        task->signal_state.old_mask = task->signal_state.blocked;
+        task->signal_state.sigreturn_sp = sp;
+
+        /* Push signal number */
+        sp -= 8;
+        *(uint64_t*)sp = sig;
+
+        /* Set up return to handler */
+        task->regs[0] = sig;           // x0 = signal number
+        task->elr_el1 = (uint64_t)handler;
+        task->sp_el0 = sp;
+
+        /* Block the signal while handling */
+        task->signal_state.blocked |= (1ULL << sig);
+        return;     // One user frame per kernel exit
     }
-    if (handler == SIG_IGN)
-        return;
-
-    debug_print("Delivering signal %d to handler 0x%llx\n", sig, (uint64_t)handler);
-
-    /* Set up signal frame on user stack */
-    uint64_t sp = task->sp_el0;
-    sp -= 256;  // Signal frame
-
-    /* Save old context for sigreturn */
-    task->signal_state.old_mask = task->blocked;
-    task->signal_state.sigreturn_sp = sp;
-
-    /* Push signal number */
-    sp -= 8;
-    *(uint64_t*)sp = sig;
-
-    /* Set up return to handler */
-    task->regs[0] = sig;           // x0 = signal number
-    task->elr_el1 = (uint64_t)handler;
-    task->sp_el0 = sp;
+}
 
-    /* Block the signal while handling */
-    task->blocked |= (1ULL << sig);
+/* Batched delivery point – called on the return-to-user path */
+void signal_deliver_pending(void)
+{
+    deliver_signals();
 }
 
 /* sigreturn() – restore context after handler */
@@ -141,9 +340,12 @@ void sigreturn(void)
     task_t *task = current_task;
 
     /* Restore saved mask and stack */
-    task->blocked = task->signal_state.old_mask;
+    task->signal_state.blocked = task->signal_state.old_mask;
     task->sp_el0 = task->signal_state.sigreturn_sp;
 
+    /* Another signal may have arrived while the handler ran */
+    deliver_signals();
+
     /* Return to original PC */
     __asm__ volatile ("eret");
 }
@@ -151,4 +353,51 @@ void sigreturn(void)
 /* Exception → signal translation */
 void handle_exception(int type, uint64_t esr, uint64_t far)
 {
-    task_t *task = current_task
\ No newline at end of file
+    task_t *task = current_task;
+    if (!task)
+        return;
+
+    int sig;
+    switch (type) {
+    case 0:  sig = SIGSEGV; break;  // Data abort
+    case 1:  sig = SIGILL;  break;  // Undefined instruction
+    case 2:  sig = SIGBUS;  break;  // Alignment fault
+    case 3:  sig = SIGFPE;  break;  // Arithmetic trap
+    default: sig = SIGKILL; break;
+    }
+
+    debug_print("Exception type %d (ESR=0x%llx FAR=0x%llx) → signal %d, PID %d\n",
+                type, esr, far, sig, task->pid);
+
+    __atomic_or_fetch(&task->signal_state.pending, (1ULL << sig), __ATOMIC_SEQ_CST);
+    deliver_signals();
+}
+
+/* Default handlers registered at boot */
+static void default_sigterm(int sig)
+{
+    debug_print("Default SIGTERM handler: PID %d exiting\n", current_task->pid);
+    exit(128 + sig);
+}
+
+static void default_sigchld(int sig)
+{
+    (void)sig;
+    /* Reaped by wait()/waitpid() */
+}
+
+void register_default_handlers(void)
+{
+    task_t *task = current_task;
+    if (!task)
+        return;
+
+    task->signal_state.handlers[SIGTERM] = default_sigterm;
+    task->signal_state.handlers[SIGINT]  = default_sigterm;
+    task->signal_state.handlers[SIGQUIT] = default_sigterm;
+    task->signal_state.handlers[SIGCHLD] = default_sigchld;
+    task->signal_state.handlers[SIGUSR1] = SIG_IGN;
+    task->signal_state.handlers[SIGUSR2] = SIG_IGN;
+
+    debug_print("Default signal handlers registered\n");
+}
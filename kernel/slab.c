@@ -0,0 +1,223 @@
+/*
+ * slab.c – Slab / object pool allocator for RISC OS Phoenix
+ * Fixed-size object caches carved straight out of the buddy allocator,
+ * with per-CPU magazine front-ends so the hot path is a pointer pop.
+ * Also provides the 32B–4KB size-class caches behind kmalloc/kfree,
+ * which used to be one contended general heap.
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "spinlock.h"
+#include "page_alloc.h"
+#include "slab.h"
+#include <string.h>
+
+#define KERNEL_VIRT_BASE    0xFFFF000000000000ULL
+#define KERNEL_STACK_SIZE   (16 * 1024)
+
+slab_cache_t task_cache;
+slab_cache_t kstack_cache;
+
+/* Static pool for kmem_cache_create – caches are never destroyed */
+#define MAX_KMEM_CACHES     32
+static slab_cache_t kmem_caches[MAX_KMEM_CACHES];
+static int nr_kmem_caches;
+static spinlock_t kmem_caches_lock = SPINLOCK_INIT;
+
+/* kmalloc size classes: 32, 64, ... 4096 bytes */
+#define KMALLOC_CLASSES     8
+#define KMALLOC_MIN_SHIFT   5
+#define KMALLOC_MAX_SIZE    4096
+static slab_cache_t kmalloc_caches[KMALLOC_CLASSES];
+
+static inline void *slab_page_virt(uint64_t phys) {
+    return (void*)(phys + KERNEL_VIRT_BASE);
+}
+
+void slab_cache_init(slab_cache_t *cache, const char *name, size_t obj_size)
+{
+    memset(cache, 0, sizeof(*cache));
+    strncpy(cache->name, name, SLAB_NAME_LEN - 1);
+    if (obj_size < sizeof(slab_obj_t)) obj_size = sizeof(slab_obj_t);
+    cache->obj_size = (obj_size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+    spinlock_init(&cache->global_lock);
+
+    debug_print("slab: cache '%s' ready (%ld bytes/obj)\n", cache->name, cache->obj_size);
+}
+
+/* Carve a fresh run of buddy pages into objects for this CPU's magazine */
+static void slab_grow(slab_cache_t *cache, int cpu)
+{
+    int order = 0;
+    while (((uint64_t)PAGE_SIZE << order) < cache->obj_size) order++;
+
+    uint64_t phys = phys_alloc_pages(order);
+    if (!phys) return;
+
+    uint8_t *base = slab_page_virt(phys);
+    size_t span = (uint64_t)PAGE_SIZE << order;
+
+    for (size_t off = 0; off + cache->obj_size <= span; off += cache->obj_size) {
+        slab_obj_t *obj = (slab_obj_t *)(base + off);
+        if (cache->ctor) cache->ctor(obj);
+        obj->next = cache->percpu_free[cpu];
+        cache->percpu_free[cpu] = obj;
+        cache->percpu_count[cpu]++;
+        cache->total_objs++;
+    }
+}
+
+/* Refill the calling CPU's magazine: global list first, then fresh pages */
+static void slab_refill(slab_cache_t *cache, int cpu)
+{
+    unsigned long flags;
+    spin_lock_irqsave(&cache->global_lock, &flags);
+
+    while (cache->percpu_count[cpu] < SLAB_BATCH && cache->global_free) {
+        slab_obj_t *obj = cache->global_free;
+        cache->global_free = obj->next;
+        obj->next = cache->percpu_free[cpu];
+        cache->percpu_free[cpu] = obj;
+        cache->percpu_count[cpu]++;
+    }
+
+    spin_unlock_irqrestore(&cache->global_lock, flags);
+
+    if (cache->percpu_count[cpu] < SLAB_BATCH) {
+        slab_grow(cache, cpu);
+    }
+}
+
+/* Spill half of an overfull magazine back to the global list */
+static void slab_spill(slab_cache_t *cache, int cpu)
+{
+    unsigned long flags;
+    spin_lock_irqsave(&cache->global_lock, &flags);
+
+    while (cache->percpu_count[cpu] > SLAB_PERCPU_MAX / 2) {
+        slab_obj_t *obj = cache->percpu_free[cpu];
+        cache->percpu_free[cpu] = obj->next;
+        cache->percpu_count[cpu]--;
+        obj->next = cache->global_free;
+        cache->global_free = obj;
+    }
+
+    spin_unlock_irqrestore(&cache->global_lock, flags);
+}
+
+void *slab_alloc(slab_cache_t *cache)
+{
+    int cpu = get_cpu_id();
+
+    if (!cache->percpu_free[cpu]) {
+        slab_refill(cache, cpu);
+        if (!cache->percpu_free[cpu]) return NULL;
+    }
+
+    slab_obj_t *obj = cache->percpu_free[cpu];
+    cache->percpu_free[cpu] = obj->next;
+    cache->percpu_count[cpu]--;
+    return obj;
+}
+
+void slab_free(slab_cache_t *cache, void *ptr)
+{
+    int cpu = get_cpu_id();
+    slab_obj_t *obj = ptr;
+
+    obj->next = cache->percpu_free[cpu];
+    cache->percpu_free[cpu] = obj;
+    cache->percpu_count[cpu]++;
+
+    if (cache->percpu_count[cpu] > SLAB_PERCPU_MAX) {
+        slab_spill(cache, cpu);
+    }
+}
+
+/* Dedicated cache for a hot struct (tcp_conn_t, timer_t, ...) */
+slab_cache_t *kmem_cache_create(const char *name, size_t obj_size,
+                                void (*ctor)(void *))
+{
+    unsigned long flags;
+    spin_lock_irqsave(&kmem_caches_lock, &flags);
+
+    if (nr_kmem_caches >= MAX_KMEM_CACHES) {
+        spin_unlock_irqrestore(&kmem_caches_lock, flags);
+        return NULL;
+    }
+    slab_cache_t *cache = &kmem_caches[nr_kmem_caches++];
+
+    spin_unlock_irqrestore(&kmem_caches_lock, flags);
+
+    slab_cache_init(cache, name, obj_size);
+    cache->ctor = ctor;
+    return cache;
+}
+
+/* ==================== kmalloc / kfree ==================== */
+
+/* Every kmalloc allocation carries one aligned header word so kfree
+ * can find its way back to the owning cache (or buddy order) */
+typedef struct {
+    slab_cache_t *cache;    /* NULL for direct buddy allocations */
+    uint64_t      order;
+    uint64_t      pad[6];   /* Keep the payload cache-line aligned */
+} kmalloc_hdr_t;
+
+void kmem_init(void)
+{
+    static const char *names[KMALLOC_CLASSES] = {
+        "kmalloc-32", "kmalloc-64", "kmalloc-128", "kmalloc-256",
+        "kmalloc-512", "kmalloc-1k", "kmalloc-2k", "kmalloc-4k"
+    };
+
+    for (int i = 0; i < KMALLOC_CLASSES; i++) {
+        slab_cache_init(&kmalloc_caches[i], names[i],
+                        1UL << (KMALLOC_MIN_SHIFT + i));
+    }
+    debug_print("kmem: %d kmalloc size classes ready\n", KMALLOC_CLASSES);
+}
+
+void *kmalloc(size_t size)
+{
+    size_t total = size + sizeof(kmalloc_hdr_t);
+    kmalloc_hdr_t *hdr;
+
+    if (total <= KMALLOC_MAX_SIZE) {
+        int cls = 0;
+        while ((1UL << (KMALLOC_MIN_SHIFT + cls)) < total) cls++;
+        hdr = slab_alloc(&kmalloc_caches[cls]);
+        if (!hdr) return NULL;
+        hdr->cache = &kmalloc_caches[cls];
+    } else {
+        int order = 0;
+        while (((uint64_t)PAGE_SIZE << order) < total) order++;
+        uint64_t phys = phys_alloc_pages(order);
+        if (!phys) return NULL;
+        hdr = slab_page_virt(phys);
+        hdr->cache = NULL;
+        hdr->order = order;
+    }
+
+    return hdr + 1;
+}
+
+void kfree(void *ptr)
+{
+    if (!ptr) return;
+
+    kmalloc_hdr_t *hdr = (kmalloc_hdr_t *)ptr - 1;
+    if (hdr->cache) {
+        slab_free(hdr->cache, hdr);
+    } else {
+        phys_free_pages((uint64_t)hdr - KERNEL_VIRT_BASE, hdr->order);
+    }
+}
+
+/* Set up the task-spawn caches – called once from kernel_main */
+void task_caches_init(void)
+{
+    slab_cache_init(&task_cache, "task_t", sizeof(task_t));
+    slab_cache_init(&kstack_cache, "kstack", KERNEL_STACK_SIZE);
+}
@@ -0,0 +1,53 @@
+/*
+ * slab.h – Slab / object pool allocator for RISC OS Phoenix
+ * Fixed-size object caches with per-CPU magazine front-ends, plus the
+ * size-class caches (32B–4KB) that back kmalloc/kfree
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SLAB_NAME_LEN       16
+#define SLAB_PERCPU_MAX     64   /* Per-CPU magazine high watermark */
+#define SLAB_BATCH          16   /* Objects moved per refill/spill */
+#define SLAB_ALIGN          64   /* Cache-line aligned objects */
+
+/* Free objects are threaded through their own first word */
+typedef struct slab_obj {
+    struct slab_obj *next;
+} slab_obj_t;
+
+typedef struct slab_cache {
+    char        name[SLAB_NAME_LEN];
+    size_t      obj_size;                /* Rounded up to SLAB_ALIGN */
+    void      (*ctor)(void *);           /* Run once per fresh object */
+    slab_obj_t *percpu_free[MAX_CPUS];   /* Magazines: owner CPU only */
+    int         percpu_count[MAX_CPUS];
+    slab_obj_t *global_free;             /* Shared overflow list */
+    spinlock_t  global_lock;
+    uint64_t    total_objs;              /* Ever carved from the buddy */
+} slab_cache_t;
+
+void slab_cache_init(slab_cache_t *cache, const char *name, size_t obj_size);
+void *slab_alloc(slab_cache_t *cache);
+void slab_free(slab_cache_t *cache, void *obj);
+
+/* Dedicated cache for a hot struct; ctor may be NULL. Objects keep
+ * their constructed state across free/alloc cycles. */
+slab_cache_t *kmem_cache_create(const char *name, size_t obj_size,
+                                void (*ctor)(void *));
+
+/* Size-class backend for kmalloc/kfree – called early from kernel_main */
+void kmem_init(void);
+
+/* Kernel-wide caches for the task hot path */
+extern slab_cache_t task_cache;
+extern slab_cache_t kstack_cache;
+
+void task_caches_init(void);
+
+#endif /* SLAB_H */
@@ -67,6 +67,26 @@ void spin_lock(spinlock_t *lock)
     } while (temp != 0);
 }
 
+/* Try to acquire spinlock once – returns 1 on success, 0 if contended */
+int spin_trylock(spinlock_t *lock)
+{
+    unsigned long temp;
+
+    __asm__ volatile (
+        "ldaxr %w0, [%1]\n"
+        "cmp %w0, #0\n"
+        "b.ne 1f\n"
+        "mov %w0, #1\n"
+        "stxr %w2, %w0, [%1]\n"
+        "1:"
+        : "=&r"(temp), "+r"(lock->value), "=&r"(temp)
+        :
+        : "memory"
+    );
+
+    return temp == 0;
+}
+
 /* Simple spinlock release */
 void spin_unlock(spinlock_t *lock)
 {
@@ -74,4 +94,91 @@ void spin_unlock(spinlock_t *lock)
         "stlr wzr, [%0]"
         : : "r"(&lock->value) : "memory"
     );
-}
\ No newline at end of file
+}
+/* ==================== MCS queued spinlock ==================== */
+
+/* Each CPU owns a small stack of queue nodes so nested MCS locks work
+ * (e.g. scheduler lock taken inside a VFS critical section) */
+#define MCS_MAX_NESTING 4
+
+static mcs_node_t mcs_nodes[MAX_CPUS][MCS_MAX_NESTING];
+static int mcs_depth[MAX_CPUS];
+
+void mcs_lock_init(mcs_lock_t *lock)
+{
+    lock->tail = NULL;
+}
+
+void mcs_lock(mcs_lock_t *lock)
+{
+    int cpu = get_cpu_id();
+    mcs_node_t *node = &mcs_nodes[cpu][mcs_depth[cpu]++];
+
+    node->next = NULL;
+    node->locked = 1;
+
+    mcs_node_t *prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+    if (prev) {
+        /* Queue behind prev and spin on OUR node only – WFE sleeps the
+         * core until the holder's stlr/sev wakes us */
+        __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+            __asm__ volatile ("wfe");
+        }
+    }
+}
+
+void mcs_unlock(mcs_lock_t *lock)
+{
+    int cpu = get_cpu_id();
+    mcs_node_t *node = &mcs_nodes[cpu][mcs_depth[cpu] - 1];
+
+    mcs_node_t *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    if (!next) {
+        /* Nobody queued – try to swing tail back to empty */
+        mcs_node_t *expected = node;
+        if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            mcs_depth[cpu]--;
+            return;
+        }
+        /* A waiter is mid-enqueue – wait for it to link in */
+        while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)))
+            ;
+    }
+
+    __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+    __asm__ volatile ("sev");
+    mcs_depth[cpu]--;
+}
+
+/* One-shot attempt – only succeeds on an uncontended lock */
+int mcs_trylock(mcs_lock_t *lock)
+{
+    int cpu = get_cpu_id();
+    mcs_node_t *node = &mcs_nodes[cpu][mcs_depth[cpu]];
+
+    node->next = NULL;
+    node->locked = 1;
+
+    mcs_node_t *expected = NULL;
+    if (__atomic_compare_exchange_n(&lock->tail, &expected, node, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        mcs_depth[cpu]++;
+        return 1;
+    }
+    return 0;
+}
+
+void mcs_lock_irqsave(mcs_lock_t *lock, unsigned long *flags)
+{
+    __asm__ volatile ("mrs %0, daif" : "=r"(*flags));
+    __asm__ volatile ("msr daifset, #3" ::: "memory");
+    mcs_lock(lock);
+}
+
+void mcs_unlock_irqrestore(mcs_lock_t *lock, unsigned long flags)
+{
+    mcs_unlock(lock);
+    __asm__ volatile ("msr daif, %0" :: "r"(flags) : "memory");
+}
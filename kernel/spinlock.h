@@ -14,8 +14,17 @@ void spinlock_init(spinlock_t *lock);
 
 void spin_lock(spinlock_t *lock);
 void spin_unlock(spinlock_t *lock);
+int  spin_trylock(spinlock_t *lock);
 
 void spin_lock_irqsave(spinlock_t *lock, unsigned long *flags);
 void spin_unlock_irqrestore(spinlock_t *lock, unsigned long flags);
 
+/* MCS queued spinlock – for contended locks (scheduler, VFS tables) */
+void mcs_lock_init(mcs_lock_t *lock);
+void mcs_lock(mcs_lock_t *lock);
+void mcs_unlock(mcs_lock_t *lock);
+int  mcs_trylock(mcs_lock_t *lock);
+void mcs_lock_irqsave(mcs_lock_t *lock, unsigned long *flags);
+void mcs_unlock_irqrestore(mcs_lock_t *lock, unsigned long flags);
+
 #endif /* SPINLOCK_H */
\ No newline at end of file
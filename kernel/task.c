@@ -7,6 +7,8 @@
 #include "mmu.h"
 #include "vfs.h"
 #include "elf64.h"
+#include "slab.h"
+#include "trace.h"
 #include <string.h>
 
 #define KERNEL_STACK_SIZE   (16 * 1024)
@@ -16,14 +18,18 @@ static volatile int next_pid = 1;
 
 task_t *task_create(const char *name, void (*entry)(void), int priority, uint64_t cpu_affinity)
 {
-    task_t *task = kmalloc(sizeof(task_t));
+    task_t *task = slab_alloc(&task_cache);
     if (!task) return NULL;
 
-    uint8_t *kernel_stack = kmalloc(KERNEL_STACK_SIZE);
-    if (!kernel_stack) { kfree(task); return NULL; }
+    uint8_t *kernel_stack = slab_alloc(&kstack_cache);
+    if (!kernel_stack) { slab_free(&task_cache, task); return NULL; }
 
     uint8_t *user_stack = kmalloc(USER_STACK_SIZE);
-    if (!user_stack) { kfree(kernel_stack); kfree(task); return NULL; }
+    if (!user_stack) {
+        slab_free(&kstack_cache, kernel_stack);
+        slab_free(&task_cache, task);
+        return NULL;
+    }
 
     memset(task, 0, sizeof(task_t));
     strncpy(task->name, name, TASK_NAME_LEN-1);
@@ -45,19 +51,28 @@ task_t *task_create(const char *name, void (*entry)(void), int priority, uint64_
     int cpu = __builtin_ctzll(task->cpu_affinity);
     cpu_sched_t *sched = &cpu_sched[cpu];
     unsigned long flags;
-    spin_lock_irqsave(&sched->lock, &flags);
+    mcs_lock_irqsave(&sched->lock, &flags);
     enqueue_task(sched, task);
-    spin_unlock_irqrestore(&sched->lock, flags);
+    mcs_unlock_irqrestore(&sched->lock, flags);
 
+    trace_event(TRACE_EV_TASK_CREATE, task, priority);
     debug_print("Task created: '%s' PID=%d on CPU %d\n", task->name, task->pid, cpu);
 
     return task;
 }
 
+/* Return a dead task's struct and kernel stack to the slab caches */
+void task_destroy(task_t *task)
+{
+    if (!task) return;
+    slab_free(&kstack_cache, (void*)(task->stack_top - KERNEL_STACK_SIZE));
+    slab_free(&task_cache, task);
+}
+
 int fork(void)
 {
     task_t *parent = current_task;
-    task_t *child = kmalloc(sizeof(task_t));
+    task_t *child = slab_alloc(&task_cache);
     if (!child) return -1;
 
     int child_pid = __atomic_add_fetch(&next_pid, 1, __ATOMIC_SEQ_CST);
@@ -69,12 +84,19 @@ int fork(void)
     strncpy(child->name, parent->name, TASK_NAME_LEN-1);
     strncat(child->name, "+", 1);
 
-    if (mmu_duplicate_pagetable(parent, child) != 0) { kfree(child); return -1; }
+    if (mmu_duplicate_pagetable(parent, child) != 0) {
+        slab_free(&task_cache, child);
+        return -1;
+    }
 
     child->regs[0] = 0;
 
-    uint8_t *new_stack = kmalloc(KERNEL_STACK_SIZE);
-    if (!new_stack) { mmu_free_pagetable(child); kfree(child); return -1; }
+    uint8_t *new_stack = slab_alloc(&kstack_cache);
+    if (!new_stack) {
+        mmu_free_pagetable(child);
+        slab_free(&task_cache, child);
+        return -1;
+    }
     memcpy(new_stack, (void*)(parent->stack_top - KERNEL_STACK_SIZE), KERNEL_STACK_SIZE);
     child->stack_top = (uint64_t)(new_stack + KERNEL_STACK_SIZE);
 
@@ -84,9 +106,9 @@ int fork(void)
     int cpu = get_cpu_id();
     cpu_sched_t *sched = &cpu_sched[cpu];
     unsigned long flags;
-    spin_lock_irqsave(&sched->lock, &flags);
+    mcs_lock_irqsave(&sched->lock, &flags);
     enqueue_task(sched, child);
-    spin_unlock_irqrestore(&sched->lock, flags);
+    mcs_unlock_irqrestore(&sched->lock, flags);
 
     return child_pid;
 }
@@ -122,32 +144,38 @@ int execve(const char *pathname, char *const argv[], char *const envp[])
         if (read_size != sizeof(phdr)) goto fail;
 
         if (phdr.p_type == PT_LOAD) {
-            size_t memsz = (phdr.p_memsz + PAGE_SIZE - 1) & PAGE_MASK;
-            void *page = kmalloc(memsz);
-            if (!page) goto fail;
-
-            vfs_seek(file, phdr.p_offset, SEEK_SET);
-            read_size = vfs_read(file, page, phdr.p_filesz);
-            if (read_size != phdr.p_filesz) {
-                kfree(page);
-                goto fail;
-            }
-
-            memset((char*)page + phdr.p_filesz, 0, phdr.p_memsz - phdr.p_filesz);
-
             int prot = 0;
             if (phdr.p_flags & PF_R) prot |= PROT_READ;
             if (phdr.p_flags & PF_W) prot |= PROT_WRITE;
             if (phdr.p_flags & PF_X) prot |= PROT_EXEC;
 
-            if (mmu_map(task, phdr.p_vaddr, phdr.p_memsz, prot, 0) != 0) {
-                kfree(page);
-                goto fail;
+            if (phdr.p_flags & PF_W) {
+                /* Writable data is small, always touched and must stay
+                 * private to this instance – map and copy it eagerly
+                 * rather than paying a fault per page. Pages come back
+                 * zeroed, so p_memsz past p_filesz (BSS) is free. */
+                uint64_t seg_start = phdr.p_vaddr & PAGE_MASK;
+                uint64_t seg_end = (phdr.p_vaddr + phdr.p_memsz
+                                    + PAGE_SIZE - 1) & PAGE_MASK;
+                if (mmu_map(task, seg_start, seg_end - seg_start, prot, 0) != 0) {
+                    goto fail;
+                }
+                vfs_seek(file, phdr.p_offset, SEEK_SET);
+                vfs_read(file, (void *)phdr.p_vaddr, phdr.p_filesz);
+            } else {
+                /* Text/rodata demand-pages: record a file-backed VMA and
+                 * let the fault handler read only the pages actually
+                 * touched, sharing them with other instances of the
+                 * same binary through the MMU's text page table. */
+                if (!vma_create(task, phdr.p_vaddr, phdr.p_memsz, prot,
+                                file, phdr.p_offset, phdr.p_filesz)) {
+                    goto fail;
+                }
             }
         }
     }
 
-    vfs_close(file);
+    /* The file stays open: segment VMAs keep reading from it lazily */
 
     // Stack setup (simplified)
     uint64_t sp = 0x0000fffffffff000ULL;
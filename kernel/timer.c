@@ -2,26 +2,45 @@
  * timer.c – ARM Generic Timer for RISC OS Phoenix
  * Provides microsecond precision timers, periodic ticks for scheduler
  * Multi-core support with per-core timers
+ * Per-CPU hierarchical timing wheel (ms/sec/min levels) – arm, cancel
+ * and expiry are all O(1), so thousands of TCP retransmit timers are fine
  * Author: R Andrews Grok 4 – 05 Feb 2026
  */
 
 #include "kernel.h"
+#include "spinlock.h"
+#include "timer.h"
 #include <stdint.h>
+#include <string.h>
 
 #define TIMER_FREQ      1000000  // 1 MHz tick (1us resolution)
 #define TICK_INTERVAL   10000    // 10ms scheduler tick
 
-typedef struct timer {
-    struct timer *next;
-    uint64_t expires_ns;
-    void (*callback)(struct timer *);
-    void *private;
-    int active;
-} timer_t;
+/* Timing wheel geometry: 3 levels of 256 slots.
+ * Level 0: 1ms/slot   → covers 256ms
+ * Level 1: 256ms/slot → covers ~65s
+ * Level 2: ~65s/slot  → covers ~4.6h (anything longer saturates) */
+#define WHEEL_LEVELS    3
+#define WHEEL_SLOTS     256
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_GRAN_NS   1000000ULL   /* Level-0 slot width: 1ms */
 
-static timer_t *timer_lists[MAX_CPUS];
+/* timer_t itself lives in timer.h so other subsystems (epoll, TCP,
+ * driver watchdogs) can embed timers in their own structures */
+
+typedef struct {
+    timer_t  *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t  last_jiffy;        /* Level-0 slot last processed */
+    int       nr_armed;
+} timer_wheel_t;
+
+static timer_wheel_t timer_wheel[MAX_CPUS];
 static spinlock_t timer_locks[MAX_CPUS] = { [0 ... MAX_CPUS-1] = SPINLOCK_INIT };
 
+/* Tickless (NOHZ) mode: set while a core has stopped its periodic tick
+ * because it runs at most one task and has no nearer timer expiry */
+static volatile int tick_stopped[MAX_CPUS];
+
 /* Read counter frequency */
 static uint64_t timer_get_freq(void) {
     uint64_t freq;
@@ -51,15 +70,74 @@ uint64_t get_time_ns(void) {
     return ticks_to_ns(timer_get_cnt());
 }
 
+/* Slot width of a wheel level in ns (1ms, 256ms, ~65s) */
+static inline uint64_t level_gran_ns(int level) {
+    return WHEEL_GRAN_NS << (8 * level);
+}
+
+/* Insert a timer into the right level/slot for its expiry – O(1).
+ * Caller holds the wheel lock. */
+static void wheel_insert(timer_wheel_t *wheel, timer_t *timer, uint64_t now_ns)
+{
+    uint64_t delta = timer->expires_ns > now_ns ? timer->expires_ns - now_ns : 0;
+    int level = 0;
+
+    while (level < WHEEL_LEVELS - 1 && delta >= level_gran_ns(level) * WHEEL_SLOTS) {
+        level++;
+    }
+
+    int slot = (timer->expires_ns / level_gran_ns(level)) & WHEEL_MASK;
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = wheel->slots[level][slot];
+    if (timer->next) timer->next->prev = timer;
+    wheel->slots[level][slot] = timer;
+    wheel->nr_armed++;
+}
+
+/* Unlink a timer from its slot – O(1). Caller holds the wheel lock. */
+static void wheel_remove(timer_wheel_t *wheel, timer_t *timer)
+{
+    if (timer->prev) timer->prev->next = timer->next;
+    else wheel->slots[timer->level][timer->slot] = timer->next;
+    if (timer->next) timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+    wheel->nr_armed--;
+}
+
+/* Earliest armed expiry on this core's wheel, 0 if none.
+ * Only called on idle transitions (tickless reprogramming), so the
+ * bounded slot scan is off the hot path. */
+static uint64_t wheel_next_expiry(timer_wheel_t *wheel, uint64_t now_ns)
+{
+    if (!wheel->nr_armed) return 0;
+
+    uint64_t best = 0;
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        for (int s = 0; s < WHEEL_SLOTS; s++) {
+            for (timer_t *t = wheel->slots[level][s]; t; t = t->next) {
+                if (!best || t->expires_ns < best) best = t->expires_ns;
+            }
+        }
+        if (best) break;  /* Lower levels always expire sooner */
+    }
+    return best;
+}
+
 /* Initialize timer for current CPU */
 void timer_init_cpu(void) {
     int cpu = get_cpu_id();
 
+    memset(&timer_wheel[cpu], 0, sizeof(timer_wheel_t));
+    timer_wheel[cpu].last_jiffy = get_time_ns() / WHEEL_GRAN_NS;
+
     // Enable timer
     __asm__ volatile ("msr cntp_ctl_el0, %0" :: "r"(1ULL));  // Enable
 
     // Set initial tick for scheduler
-    __asm__ volatile ("msr cntp_tval_el0, %0" :: "r"(ns_to_ticks(TICK_INTERVAL * 1000000ULL)));
+    __asm__ volatile ("msr cntp_tval_el0, %0" :: "r"(ns_to_ticks(TICK_INTERVAL * 1000ULL)));
 
     debug_print("Timer initialized for CPU %d\n", cpu);
 }
@@ -72,77 +150,153 @@ void timer_init(void) {
     debug_print("ARM Generic Timer initialized – freq %lld Hz\n", timer_get_freq());
 }
 
-/* Initialize a timer */
-void timer_init(timer_t *timer, void (*callback)(timer_t *), void *private) {
+/* Prepare a timer object for use */
+void timer_setup(timer_t *timer, void (*callback)(timer_t *), void *private) {
     memset(timer, 0, sizeof(*timer));
     timer->callback = callback;
     timer->private = private;
 }
 
-/* Schedule timer */
+/* Schedule timer – O(1) wheel insert */
 void timer_schedule(timer_t *timer, uint64_t ms) {
     int cpu = get_cpu_id();
     unsigned long flags;
-    spin_lock_irqsave(&timer_locks[cpu], flags);
-
-    timer->expires_ns = get_time_ns() + ms * 1000000ULL;
-    timer->active = 1;
+    spin_lock_irqsave(&timer_locks[cpu], &flags);
 
-    timer_t **p = &timer_lists[cpu];
-    while (*p && (*p)->expires_ns < timer->expires_ns) {
-        p = &(*p)->next;
+    if (timer->active) {
+        wheel_remove(&timer_wheel[timer->cpu], timer);
     }
-    timer->next = *p;
-    *p = timer;
+
+    uint64_t now = get_time_ns();
+    timer->expires_ns = now + ms * 1000000ULL;
+    timer->active = 1;
+    timer->cpu = cpu;
+    wheel_insert(&timer_wheel[cpu], timer, now);
 
     spin_unlock_irqrestore(&timer_locks[cpu], flags);
+
+    /* A tickless core may now have a nearer expiry than programmed */
+    if (tick_stopped[cpu]) {
+        timer_program_next(cpu);
+    }
 }
 
-/* Cancel timer */
+/* Cancel timer – O(1) unlink */
 void timer_cancel(timer_t *timer) {
-    int cpu = get_cpu_id();
+    int cpu = timer->cpu;
     unsigned long flags;
-    spin_lock_irqsave(&timer_locks[cpu], flags);
-
-    timer_t **p = &timer_lists[cpu];
-    while (*p) {
-        if (*p == timer) {
-            *p = timer->next;
-            timer->active = 0;
-            break;
-        }
-        p = &(*p)->next;
+    spin_lock_irqsave(&timer_locks[cpu], &flags);
+
+    if (timer->active) {
+        wheel_remove(&timer_wheel[cpu], timer);
+        timer->active = 0;
     }
 
     spin_unlock_irqrestore(&timer_locks[cpu], flags);
 }
 
+/* Fire every expired timer in one slot. Caller holds the wheel lock;
+ * it is dropped around the callback like the old list walker did. */
+static void wheel_fire_slot(timer_wheel_t *wheel, int level, int slot,
+                            uint64_t now, spinlock_t *lock, unsigned long *flags)
+{
+    timer_t *t = wheel->slots[level][slot];
+    while (t) {
+        timer_t *next = t->next;
+        if (t->expires_ns <= now) {
+            wheel_remove(wheel, t);
+            t->active = 0;
+            spin_unlock_irqrestore(lock, *flags);
+            t->callback(t);
+            spin_lock_irqsave(lock, flags);
+            /* List may have changed while unlocked – restart the slot */
+            next = wheel->slots[level][slot];
+        } else if (level > 0) {
+            /* Cascade: not yet due, re-sort into a lower level */
+            wheel_remove(wheel, t);
+            wheel_insert(wheel, t, now);
+        }
+        t = next;
+    }
+}
+
 /* Timer interrupt handler – per-core */
 void timer_irq_handler(int vector, void *private) {
     int cpu = get_cpu_id();
+    timer_wheel_t *wheel = &timer_wheel[cpu];
     uint64_t now = get_time_ns();
     unsigned long flags;
-    spin_lock_irqsave(&timer_locks[cpu], flags);
+    spin_lock_irqsave(&timer_locks[cpu], &flags);
 
-    timer_t *t = timer_lists[cpu];
-    while (t && t->expires_ns <= now) {
-        timer_t *next = t->next;
-        t->active = 0;
-        spin_unlock_irqrestore(&timer_locks[cpu], flags);
-        t->callback(t);
-        spin_lock_irqsave(&timer_locks[cpu], flags);
-        t = next;
+    /* Advance level 0 one slot at a time from where we left off */
+    uint64_t jiffy = now / WHEEL_GRAN_NS;
+    while (wheel->last_jiffy < jiffy) {
+        wheel->last_jiffy++;
+        int slot = wheel->last_jiffy & WHEEL_MASK;
+        wheel_fire_slot(wheel, 0, slot, now, &timer_locks[cpu], &flags);
+
+        /* Level-0 wrap: cascade the matching slot of each higher level */
+        if (slot == 0) {
+            uint64_t j = wheel->last_jiffy;
+            for (int level = 1; level < WHEEL_LEVELS; level++) {
+                j >>= 8;
+                wheel_fire_slot(wheel, level, j & WHEEL_MASK, now,
+                                &timer_locks[cpu], &flags);
+                if (j & WHEEL_MASK) break;
+            }
+        }
     }
-    timer_lists[cpu] = t;
 
     spin_unlock_irqrestore(&timer_locks[cpu], flags);
 
     // Reschedule
     schedule();
 
-    // Re-arm timer for next tick
-    __asm__ volatile ("msr cntp_tval_el0, %0" :: "r"(ns_to_ticks(TICK_INTERVAL * 1000000ULL)));
+    // Re-arm for the next hardware event (periodic or tickless)
+    timer_program_next(cpu);
+}
+
+/* Program the next hardware timer event for this core.
+ * With more than one runnable task the periodic tick is kept for
+ * preemption. With a single (or no) task the tick stops: the next event
+ * is the earliest armed timer, or nothing at all if the wheel is empty. */
+void timer_program_next(int cpu)
+{
+    cpu_sched_t *sched = &cpu_sched[cpu];
+    uint64_t now = get_time_ns();
+    uint64_t tick_ns = now + TICK_INTERVAL * 1000ULL;
+    uint64_t next_timer = wheel_next_expiry(&timer_wheel[cpu], now);
+
+    if (sched->nr_ready > 1) {
+        uint64_t next_ns = tick_ns;
+        if (next_timer && next_timer < next_ns) {
+            next_ns = next_timer;
+        }
+        tick_stopped[cpu] = 0;
+        __asm__ volatile ("msr cntp_cval_el0, %0" :: "r"(ns_to_ticks(next_ns)));
+        __asm__ volatile ("msr cntp_ctl_el0, %0" :: "r"(1ULL));
+    } else if (next_timer) {
+        /* Tickless: sleep until the next real expiry */
+        tick_stopped[cpu] = 1;
+        __asm__ volatile ("msr cntp_cval_el0, %0" :: "r"(ns_to_ticks(next_timer)));
+        __asm__ volatile ("msr cntp_ctl_el0, %0" :: "r"(1ULL));
+    } else {
+        /* Nothing pending at all – mask the timer completely */
+        tick_stopped[cpu] = 1;
+        __asm__ volatile ("msr cntp_ctl_el0, %0" :: "r"(2ULL));  // IMASK
+    }
 }
 
-/* Module init – register IRQ handler */
-_kernel_oserror *
\ No newline at end of file
+/* Called when a second task becomes runnable on a tickless core –
+ * restart the periodic tick so preemption works again */
+void timer_resume_tick(int cpu)
+{
+    if (!tick_stopped[cpu]) return;
+
+    if (cpu == get_cpu_id()) {
+        timer_program_next(cpu);
+    } else {
+        /* Remote core: the reschedule IPI kicks its timer handler path */
+        send_ipi(1ULL << cpu, IPI_RESCHEDULE, 0);
+    }
+}
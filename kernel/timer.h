@@ -0,0 +1,29 @@
+/*
+ * timer.h – Kernel timer API for RISC OS Phoenix
+ * One-shot timers on the per-CPU hierarchical timing wheel in timer.c;
+ * arm, cancel and expiry are all O(1)
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+typedef struct timer {
+    struct timer *next;
+    struct timer *prev;
+    uint64_t expires_ns;
+    void (*callback)(struct timer *);
+    void *private;
+    int active;
+    int level;      /* Wheel level this timer sits on */
+    int slot;       /* Slot within that level */
+    int cpu;        /* Owning CPU's wheel */
+} timer_t;
+
+void timer_setup(timer_t *timer, void (*callback)(timer_t *), void *private);
+void timer_schedule(timer_t *timer, uint64_t ms);
+void timer_cancel(timer_t *timer);
+
+#endif /* TIMER_H */
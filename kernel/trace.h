@@ -0,0 +1,40 @@
+/*
+ * trace.h – Lock-free kernel trace ring for RISC OS Phoenix
+ * Per-CPU binary event records for tracing hot paths in production
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* Event ids – payload meaning in the comments */
+#define TRACE_EV_SCHED_SWITCH   1   /* a = prev task, b = next task */
+#define TRACE_EV_SCHED_WAKEUP   2   /* a = task, b = target cpu */
+#define TRACE_EV_TASK_CREATE    3   /* a = task, b = priority */
+#define TRACE_EV_BIO_SUBMIT     4   /* a = first lba, b = op */
+#define TRACE_EV_BIO_COMPLETE   5   /* a = bio, b = status */
+
+/* One fixed-size binary record (32 bytes) */
+typedef struct trace_rec {
+    uint64_t ts;                /* get_time_ns() at emit */
+    uint32_t event;             /* TRACE_EV_*; written last to publish */
+    uint32_t cpu;
+    uint64_t a, b;              /* Two payload words */
+} trace_rec_t;
+
+#ifdef CONFIG_TRACE
+void __trace_emit(uint32_t event, uint64_t a, uint64_t b);
+void trace_vfs_init(void);
+
+/* Tracepoint: one atomic claim and one release store on the local
+ * CPU's ring – safe from any context, including interrupts */
+#define trace_event(ev, a, b) __trace_emit((ev), (uint64_t)(a), (uint64_t)(b))
+#else
+/* Compiled out entirely when tracing is disabled */
+#define trace_event(ev, a, b) do { } while (0)
+static inline void trace_vfs_init(void) { }
+#endif
+
+#endif /* TRACE_H */
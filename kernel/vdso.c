@@ -0,0 +1,45 @@
+/*
+ * vdso.c – Kernel side of the userspace fast paths
+ * Publishes counter scaling factors in a page mapped read-only into
+ * every task, so get_time_ns-equivalent reads never enter the kernel
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "vdso.h"
+#include "page_alloc.h"
+#include <string.h>
+
+#define KERNEL_VIRT_BASE    0xFFFF000000000000ULL
+
+static uint64_t vdso_phys;
+
+uint64_t vdso_page_phys(void) {
+    return vdso_phys;
+}
+
+/* Fill the data page once at boot. shift = 24 keeps the multiplier in
+ * range for any realistic cntfrq (1MHz-1GHz) while (ticks * mult)
+ * stays inside 128 bits for centuries of uptime. */
+void vdso_init(void) {
+    vdso_phys = phys_alloc_page();
+    if (!vdso_phys) {
+        debug_print("vDSO: No page available\n");
+        return;
+    }
+
+    vdso_data_t *vd = (vdso_data_t*)(vdso_phys + KERNEL_VIRT_BASE);
+    memset(vd, 0, PAGE_SIZE);
+
+    uint64_t freq;
+    __asm__ volatile ("mrs %0, cntfrq_el0" : "=r"(freq));
+
+    vd->cntfrq = freq;
+    vd->shift = 24;
+    vd->mult = ((__uint128_t)1000000000ULL << vd->shift) / freq;
+    vd->epoch_off_ns = 0;       /* Counter zero == boot epoch, same as
+                                   the kernel's get_time_ns() */
+    vd->magic = VDSO_MAGIC;
+
+    debug_print("vDSO: Data page at %lx (cntfrq %ld Hz)\n", vdso_phys, freq);
+}
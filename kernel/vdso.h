@@ -0,0 +1,45 @@
+/*
+ * vdso.h – Userspace fast paths for RISC OS Phoenix
+ * Kernel-published data page readable from EL0; timestamps without
+ * trapping
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <stdint.h>
+
+/* Fixed read-only mapping in every task, just below the stack guard
+ * region – mmu_init_task wires it up */
+#define VDSO_VA         0x00007FFFFFFF0000ULL
+
+#define VDSO_MAGIC      0x56445330  /* 'VDS0' */
+
+/* Contents of the vDSO data page. Written once at boot; the scaling
+ * factors are precomputed so the userspace path needs no division. */
+typedef struct vdso_data {
+    uint32_t magic;
+    uint32_t pad;
+    uint64_t cntfrq;            /* Counter frequency (Hz) */
+    uint64_t mult;              /* ns = (ticks * mult) >> shift */
+    uint32_t shift;
+    uint32_t pad2;
+    int64_t  epoch_off_ns;      /* Offset from counter zero to boot epoch */
+} vdso_data_t;
+
+void vdso_init(void);
+uint64_t vdso_page_phys(void);
+
+/* Userspace helper – reads the counter directly at EL0 and scales it
+ * with the published factors. Same result as the kernel's
+ * get_time_ns(), no trap. */
+static inline uint64_t vdso_time_ns(void) {
+    const vdso_data_t *vd = (const vdso_data_t*)VDSO_VA;
+    uint64_t cnt;
+    __asm__ volatile ("isb; mrs %0, cntpct_el0" : "=r"(cnt));
+    return (uint64_t)(((__uint128_t)cnt * vd->mult) >> vd->shift)
+           + vd->epoch_off_ns;
+}
+
+#endif /* VDSO_H */
@@ -8,56 +8,33 @@
 #include "kernel.h"
 #include "vfs.h"
 #include "pipe.h"
+#include "slab.h"
+#include "rcu.h"
 #include <string.h>
 
-#define MAX_INODES      1024
-#define MAX_FILES       1024
-
-typedef struct inode inode_t;
-typedef struct file file_t;
-
-struct inode {
-    uint64_t i_mode;        // S_IFREG, S_IFDIR, etc.
-    uint64_t i_size;
-    uint64_t i_blocks;
-    uint16_t file_type;     // RISC OS file type (0xFFF for Text, etc.)
-    // ... other fields (timestamps, permissions)
-    void *private;          // FS-specific data
-};
-
-struct file {
-    inode_t *f_inode;
-    uint64_t f_pos;
-    int f_flags;
-    file_ops_t *f_ops;
-};
-
-static inode_t inodes[MAX_INODES];
-static int num_inodes = 0;
-static spinlock_t inode_lock = SPINLOCK_INIT;
-
-static file_t files[MAX_FILES];
-static int num_files = 0;
-static spinlock_t file_lock = SPINLOCK_INIT;
+/* inode_t / file_t layouts live in vfs.h – shared with the FS code.
+ * Both come from slab caches now: the old inodes[1024]/files[1024]
+ * arrays burned their memory at boot, hit a hard wall under the
+ * file-server workload, and could never give a slot back. The slab's
+ * per-CPU magazines are the free list. */
+static slab_cache_t inode_cache;
+static slab_cache_t file_cache;
 
 /* Allocate new inode */
 inode_t *vfs_alloc_inode(void) {
-    unsigned long flags;
-    spin_lock_irqsave(&inode_lock, flags);
-
-    if (num_inodes >= MAX_INODES) {
-        spin_unlock_irqrestore(&inode_lock, flags);
-        return NULL;
-    }
+    inode_t *inode = slab_alloc(&inode_cache);
+    if (!inode) return NULL;
 
-    inode_t *inode = &inodes[num_inodes++];
     memset(inode, 0, sizeof(*inode));
     inode->file_type = 0xFFF;  // Default Text
-
-    spin_unlock_irqrestore(&inode_lock, flags);
     return inode;
 }
 
+/* Return an inode once the FS has dropped its last reference */
+void vfs_free_inode(inode_t *inode) {
+    if (inode) slab_free(&inode_cache, inode);
+}
+
 /* Set RISC OS file type */
 void vfs_set_file_type(inode_t *inode, uint16_t type) {
     inode->file_type = type & 0xFFF;  // 12-bit code
@@ -65,19 +42,197 @@ void vfs_set_file_type(inode_t *inode, uint16_t type) {
 
 /* Open file */
 file_t *vfs_open(const char *path, int flags) {
-    unsigned long fl;
-    spin_lock_irqsave(&file_lock, fl);
+    // Resolve path to inode (stub – implement path resolution)
+    inode_t *inode = resolve_path(path);
+    if (!inode) return NULL;
 
-    if (num_files >= MAX_FILES) {
-        spin_unlock_irqrestore(&file_lock, fl);
-        return NULL;
+    file_t *file = slab_alloc(&file_cache);
+    if (!file) return NULL;
+
+    memset(file, 0, sizeof(*file));
+    file->f_inode = inode;
+    file->f_pos = 0;
+    file->f_flags = flags;
+    file->f_ops = get_fs_ops(inode);
+    return file;
+}
+
+/* Close file */
+void vfs_close(file_t *file) {
+    if (!file) return;
+    if (file->f_ops && file->f_ops->close) {
+        file->f_ops->close(file);
     }
+    file->f_inode = NULL;
+}
 
-    // Resolve path to inode (stub – implement path resolution)
-    inode_t *inode = resolve_path(path);
-    if (!inode) {
-        spin_unlock_irqrestore(&file_lock, fl);
-        return NULL;
+/* Read through the file's ops */
+ssize_t vfs_read(file_t *file, void *buf, size_t count) {
+    if (!file || !file->f_ops || !file->f_ops->read) return -1;
+    ssize_t got = file->f_ops->read(file, buf, count);
+    if (got > 0) file->f_pos += got;
+    return got;
+}
+
+/* Write through the file's ops */
+ssize_t vfs_write(file_t *file, const void *buf, size_t count) {
+    if (!file || !file->f_ops || !file->f_ops->write) return -1;
+    ssize_t put = file->f_ops->write(file, buf, count);
+    if (put > 0) file->f_pos += put;
+    return put;
+}
+
+/* Vectored read: one dispatch for the whole iovec when the FS can
+ * take it, otherwise a loop over the scalar op */
+ssize_t vfs_readv(file_t *file, const iovec_t *iov, int iovcnt) {
+    if (!file || !file->f_ops) return -1;
+
+    if (file->f_ops->readv) {
+        ssize_t got = file->f_ops->readv(file, iov, iovcnt);
+        if (got > 0) file->f_pos += got;
+        return got;
+    }
+
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        ssize_t got = vfs_read(file, iov[i].iov_base, iov[i].iov_len);
+        if (got < 0) return total ? total : -1;
+        total += got;
+        if ((size_t)got < iov[i].iov_len) break;    // Short read
+    }
+    return total;
+}
+
+/* Vectored write – same shape as vfs_readv */
+ssize_t vfs_writev(file_t *file, const iovec_t *iov, int iovcnt) {
+    if (!file || !file->f_ops) return -1;
+
+    if (file->f_ops->writev) {
+        ssize_t put = file->f_ops->writev(file, iov, iovcnt);
+        if (put > 0) file->f_pos += put;
+        return put;
+    }
+
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        ssize_t put = vfs_write(file, iov[i].iov_base, iov[i].iov_len);
+        if (put < 0) return total ? total : -1;
+        total += put;
+        if ((size_t)put < iov[i].iov_len) break;    // Short write
     }
+    return total;
+}
+
+/* Seek */
+off_t vfs_seek(file_t *file, off_t offset, int whence) {
+    if (!file) return -1;
+    if (file->f_ops && file->f_ops->seek) {
+        return file->f_ops->seek(file, offset, whence);
+    }
+    switch (whence) {
+        case SEEK_SET: file->f_pos = offset; break;
+        case SEEK_CUR: file->f_pos += offset; break;
+        case SEEK_END: file->f_pos = file->f_inode->i_size + offset; break;
+    }
+    return file->f_pos;
+}
+
+/* Poll */
+int vfs_poll(file_t *file) {
+    if (!file || !file->f_ops || !file->f_ops->poll) return 0;
+    return file->f_ops->poll(file);
+}
+
+/* Durability point – no-op for files without write-back state */
+int vfs_fsync(file_t *file) {
+    if (!file || !file->f_ops || !file->f_ops->fsync) return 0;
+    return file->f_ops->fsync(file);
+}
+
+/* Allocate a bare file_t (pipes, sockets, FS internals) */
+file_t *vfs_alloc_file(void) {
+    file_t *file = slab_alloc(&file_cache);
+    if (!file) return NULL;
+    memset(file, 0, sizeof(*file));
+    return file;
+}
+
+/* Drop a file_t. Lock-free readers (select's poll sweep) may still be
+ * holding the pointer they loaded from an fd table, so defer the slab
+ * free past the grace period instead of stalling every close() in
+ * rcu_synchronize() – the caller returns immediately and the object
+ * goes back to the slab from the reclaim sweep. */
+static void vfs_file_reclaim(void *ptr) {
+    slab_free(&file_cache, ptr);
+}
+
+void vfs_free_file(file_t *file) {
+    if (!file) return;
+    rcu_call(file, vfs_file_reclaim);
+}
 
-    file_t *file = &files
\ No newline at end of file
+/* Install a file in the current task's descriptor table. The table is
+ * per task and only its owner installs or clears entries; publication
+ * is a release store so lock-free readers see a fully built file_t. */
+int alloc_fd(file_t *file) {
+    task_t *task = current_task;
+    if (!task) return -1;
+
+    for (int fd = 0; fd < MAX_FD; fd++) {
+        if (!task->files[fd]) {
+            rcu_assign_pointer(task->files[fd], file);
+            return fd;
+        }
+    }
+    return -1;
+}
+
+/* Remove an fd and release its file. Readers racing the teardown
+ * either miss the entry or keep a pointer that stays valid until the
+ * grace period in vfs_free_file has passed – no file_lock needed. */
+void free_fd(int fd) {
+    task_t *task = current_task;
+    if (!task || fd < 0 || fd >= MAX_FD || !task->files[fd]) return;
+
+    file_t *file = task->files[fd];
+    rcu_assign_pointer(task->files[fd], NULL);
+    vfs_close(file);
+    vfs_free_file(file);
+}
+
+/* Lock-free fd lookup – one acquire load per fd, so select()'s sweep
+ * over a thousand descriptors takes no lock at all */
+file_t *task_get_file(task_t *task, int fd) {
+    if (!task || fd < 0 || fd >= MAX_FD) return NULL;
+    return rcu_dereference(task->files[fd]);
+}
+
+/* Root inode registered by the filesystem at mount time */
+static inode_t *vfs_root_inode;
+
+void vfs_set_root(inode_t *inode) {
+    vfs_root_inode = inode;
+}
+
+/* Resolve path to inode (stub – full component walk pending, every
+ * path lands on the mounted root for now) */
+inode_t *resolve_path(const char *path) {
+    (void)path;
+    return vfs_root_inode;
+}
+
+/* FS ops for an inode – FileCore is the only disk FS so far */
+file_ops_t *get_fs_ops(inode_t *inode) {
+    extern file_ops_t fcore_ops;
+    if (inode && (inode->i_mode & (S_IFREG | S_IFDIR))) {
+        return &fcore_ops;
+    }
+    return NULL;
+}
+
+/* Module init */
+void vfs_init(void) {
+    slab_cache_init(&inode_cache, "inode_t", sizeof(inode_t));
+    slab_cache_init(&file_cache, "file_t", sizeof(file_t));
+    debug_print("VFS initialized (slab-backed inode/file tables)\n");
+}
@@ -16,6 +16,7 @@
 #define O_RDWR          0x0002
 #define O_NONBLOCK      0x0004
 #define O_CREAT         0x0008
+#define O_TRUNC         0x0010
 
 #define S_IFIFO         (1ULL << 12)  // Pipe
 #define S_IFREG         (1ULL << 13)  // Regular file
@@ -26,6 +27,12 @@ typedef struct inode inode_t;
 typedef struct file file_t;
 typedef struct file_ops file_ops_t;
 
+/* One fragment of a vectored transfer */
+typedef struct iovec {
+    void   *iov_base;
+    size_t  iov_len;
+} iovec_t;
+
 struct inode {
     uint64_t i_mode;        // File type/mode (S_IFREG etc.)
     uint64_t i_size;        // File size
@@ -41,25 +48,46 @@ struct file {
     int f_flags;            // Open flags (O_RDONLY etc.)
     file_ops_t *f_ops;      // File operations
     void *private;          // FS-specific private data
+    void *watchers;         // epoll watcher chain (epitem list)
 };
 
 struct file_ops {
     ssize_t (*read)(file_t *file, void *buf, size_t count);
     ssize_t (*write)(file_t *file, const void *buf, size_t count);
+    /* Vectored ops – optional; the VFS falls back to looping the
+     * scalar ops when they are NULL */
+    ssize_t (*readv)(file_t *file, const iovec_t *iov, int iovcnt);
+    ssize_t (*writev)(file_t *file, const iovec_t *iov, int iovcnt);
     off_t (*seek)(file_t *file, off_t offset, int whence);
     int (*poll)(file_t *file);
+    int (*fsync)(file_t *file);     /* Durability point: flush write-back state */
     void (*close)(file_t *file);
 };
 
 inode_t *vfs_alloc_inode(void);
+void vfs_free_inode(inode_t *inode);
 void vfs_set_file_type(inode_t *inode, uint16_t type);
 
 file_t *vfs_open(const char *path, int flags);
 void vfs_close(file_t *file);
 ssize_t vfs_read(file_t *file, void *buf, size_t count);
 ssize_t vfs_write(file_t *file, const void *buf, size_t count);
+ssize_t vfs_readv(file_t *file, const iovec_t *iov, int iovcnt);
+ssize_t vfs_writev(file_t *file, const iovec_t *iov, int iovcnt);
 off_t vfs_seek(file_t *file, off_t offset, int whence);
 int vfs_poll(file_t *file);
+int vfs_fsync(file_t *file);
+
+file_t *vfs_alloc_file(void);
+void vfs_free_file(file_t *file);
+int alloc_fd(file_t *file);
+void free_fd(int fd);
+
+/* Lock-free fd lookup (RCU): safe from any context without file_lock */
+file_t *task_get_file(task_t *task, int fd);
+void vfs_set_root(inode_t *inode);
+inode_t *resolve_path(const char *path);
+void vfs_init(void);
 
 file_ops_t *get_fs_ops(inode_t *inode);
 
@@ -6,9 +6,17 @@ typedef struct wimp_window_def wimp_window_def;
 typedef struct bbox bbox_t;
 typedef struct wimp_event wimp_event_t;
 
+typedef struct wimp_icon {
+    int x0, y0, x1, y1;
+    char *text;
+    int flags;
+} wimp_icon;
+
 struct wimp_window_def {
     int x0, y0, x1, y1;
+    int width, height;
     char *title;
+    wimp_icon *icons;
     int icon_count;
 };
 
@@ -26,4 +34,73 @@ struct wimp_event {
     } u;
 };
 
+/* Phoenix extension – raw pointer motion, coalesced to the latest
+ * position in the event queue (no such reason code in the classic Wimp) */
+#define wimp_POINTER_MOVE  26
+
+/* Dirty rectangles kept per window between redraws. Overlapping damage
+ * is merged on insert; if the list fills up it collapses to one
+ * bounding box, which degrades to a full-window redraw at worst. */
+#define WIMP_DAMAGE_MAX  16
+
+struct window {
+    wimp_window_def def;
+    struct gpu_texture *texture;    // GPU backing store
+    int visible;
+    struct menu *context_menu;
+
+    bbox_t damage[WIMP_DAMAGE_MAX];
+    int damage_count;
+    int redraw_queued;              // A redraw event is already in flight
+
+    void *gpu_cmd;                  // Reusable secondary command buffer
+    int gpu_cmd_valid;              // Recording can be replayed as-is
+
+    int *icon_sorted;               // Icon indices ordered by x0
+    int icon_max_w;                 // Widest icon – bounds the hit scan
+};
+
+void wimp_add_damage(window_t *win, const bbox_t *r);
+void wimp_composite_frame(void);
+void wimp_draw_title_bar(window_t *win);
+void wimp_window_moved(window_t *win);
+
+/* Window backing store. The GPU tiers reference vk_image or gl_id;
+ * the software raster tier composites straight from pixels. */
+struct gpu_texture {
+    int width, height;
+    uint32_t gl_id;             // GLES texture name
+    void *vk_image;             // Vulkan image handle
+    uint32_t *pixels;           // CPU-side copy (software tier)
+};
+
+/* Textured quad – destination on screen, source in the texture */
+typedef struct gpu_quad {
+    int dx0, dy0, dx1, dy1;
+    int sx0, sy0, sx1, sy1;
+} gpu_quad_t;
+
+/* Glyph atlas text (wimp/glyph.c) – rasterized once, drawn batched */
+void gpu_draw_text(int x, int y, const char *text, uint32_t color);
+void gpu_draw_text_sized(int x, int y, const char *text, uint32_t color,
+                         int size);
+
+/* Frame recording API (drivers/gpu/gpu.c) – one queue submit per frame */
+int gpu_frame_begin(void);
+void gpu_frame_record_window(window_t *win);
+void gpu_frame_record_batch(window_t **wins, int n, int rerecord);
+void gpu_frame_end(void);
+void gpu_screen_size(int *w, int *h);
+int gpu_scanout(window_t *win);
+
+/* Software raster tier (drivers/gpu/raster.c) */
+int raster_probe(void);
+void raster_fill_rect(int x, int y, int w, int h, uint32_t color);
+void raster_copy_rect(int dx, int dy, int sx, int sy, int w, int h);
+void raster_blit_a(int dx, int dy, const uint32_t *src, int src_pitch,
+                   int w, int h);
+void raster_blit_tinted(int dx, int dy, const uint32_t *src, int src_pitch,
+                        int w, int h, uint32_t color);
+void raster_redraw_window(window_t *win);
+
 #endif
\ No newline at end of file
@@ -7,10 +7,10 @@
 #include "kernel.h"
 #include "net.h"
 #include "ethernet.h"
+#include "rcu.h"
 #include <stdint.h>
 #include <string.h>
 
-#define ARP_CACHE_SIZE  128
 #define ARP_TIMEOUT     3600000  // 1 hour in ms
 
 #define ARP_HW_ETHER    1
@@ -29,21 +29,127 @@ typedef struct arp_hdr {
     uint32_t dst_ip;
 } arp_hdr_t;
 
-typedef struct arp_entry {
-    uint32_t ip;
+/* ------------------------------------------------------------------ */
+/*  Neighbor cache – shared by ARP and IPv6 ND                        */
+/*                                                                    */
+/*  Hash buckets with RCU-protected chains: the per-packet lookup     */
+/*  takes no lock at all, it walks a published chain and reads an     */
+/*  immutable entry. Writers (cache updates, eviction) serialise on   */
+/*  neigh_lock and retire replaced entries through rcu_free(), so a   */
+/*  reader mid-walk never sees freed memory. Capacity eviction is LRU */
+/*  by a last-used stamp readers update with a plain atomic store.    */
+/* ------------------------------------------------------------------ */
+
+#define NEIGH_HASH_BUCKETS  256
+#define NEIGH_CACHE_MAX     2048    // ~1000 hosts on our segment, 2x slack
+#define NEIGH_ADDR_MAX      16      // IPv4 uses 4 bytes, IPv6 all 16
+
+typedef struct neigh_entry {
+    struct neigh_entry *hash_next;
+    uint8_t  addr[NEIGH_ADDR_MAX];
+    int      addrlen;
     uint8_t  mac[6];
-    uint64_t expire_time;
-} arp_entry_t;
+    uint64_t expire_time;           // ms
+    uint64_t last_used;             // ms, stamped by lock-free readers
+} neigh_entry_t;
+
+static neigh_entry_t *neigh_hash[NEIGH_HASH_BUCKETS];
+static int neigh_count = 0;
+static spinlock_t neigh_lock = SPINLOCK_INIT;
+
+static inline uint32_t neigh_hash_fn(const uint8_t *addr, int addrlen) {
+    uint64_t key = 0;
+    for (int i = 0; i < addrlen; i++)
+        key = (key << 8) | addr[i];
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 56) & (NEIGH_HASH_BUCKETS - 1);
+}
+
+/* Lock-free lookup – RCU read side. Copies the MAC out so the entry
+ * can be retired the instant we return. */
+int neigh_lookup(const uint8_t *addr, int addrlen, uint8_t *mac) {
+    uint32_t h = neigh_hash_fn(addr, addrlen);
+
+    for (neigh_entry_t *e = rcu_dereference(neigh_hash[h]); e;
+         e = rcu_dereference(e->hash_next)) {
+        if (e->addrlen == addrlen && memcmp(e->addr, addr, addrlen) == 0) {
+            if (get_time_ms() >= e->expire_time)
+                return -1;
+            memcpy(mac, e->mac, 6);
+            __atomic_store_n(&e->last_used, get_time_ms(), __ATOMIC_RELAXED);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Evict the least-recently-used entry. Called with neigh_lock held;
+ * runs only when the cache is full, never on the packet path. */
+static void neigh_evict_lru(void) {
+    neigh_entry_t **victim_pp = NULL;
+    uint64_t oldest = ~0ULL;
+
+    for (int h = 0; h < NEIGH_HASH_BUCKETS; h++) {
+        for (neigh_entry_t **pp = &neigh_hash[h]; *pp; pp = &(*pp)->hash_next) {
+            uint64_t used = __atomic_load_n(&(*pp)->last_used, __ATOMIC_RELAXED);
+            if (used < oldest) {
+                oldest = used;
+                victim_pp = pp;
+            }
+        }
+    }
+
+    if (victim_pp) {
+        neigh_entry_t *victim = *victim_pp;
+        rcu_assign_pointer(*victim_pp, victim->hash_next);
+        rcu_free(victim);
+        neigh_count--;
+    }
+}
+
+/* Insert or refresh a neighbor. Entries are immutable once published:
+ * a refresh builds a replacement and swings the chain pointer, so
+ * lock-free readers only ever see complete entries. */
+void neigh_update(const uint8_t *addr, int addrlen, const uint8_t *mac) {
+    uint32_t h = neigh_hash_fn(addr, addrlen);
+
+    neigh_entry_t *e = kmalloc(sizeof(neigh_entry_t));
+    if (!e) return;
+    memset(e->addr, 0, NEIGH_ADDR_MAX);
+    memcpy(e->addr, addr, addrlen);
+    e->addrlen = addrlen;
+    memcpy(e->mac, mac, 6);
+    e->expire_time = get_time_ms() + ARP_TIMEOUT;
+    e->last_used = get_time_ms();
+
+    unsigned long flags;
+    spin_lock_irqsave(&neigh_lock, &flags);
+
+    /* Replace an existing entry for this address in place */
+    for (neigh_entry_t **pp = &neigh_hash[h]; *pp; pp = &(*pp)->hash_next) {
+        neigh_entry_t *old = *pp;
+        if (old->addrlen == addrlen && memcmp(old->addr, addr, addrlen) == 0) {
+            e->hash_next = old->hash_next;
+            rcu_assign_pointer(*pp, e);
+            rcu_free(old);
+            spin_unlock_irqrestore(&neigh_lock, flags);
+            return;
+        }
+    }
 
-static arp_entry_t arp_cache[ARP_CACHE_SIZE];
-static int arp_cache_count = 0;
-static spinlock_t arp_lock = SPINLOCK_INIT;
+    if (neigh_count >= NEIGH_CACHE_MAX)
+        neigh_evict_lru();
+
+    e->hash_next = neigh_hash[h];
+    rcu_assign_pointer(neigh_hash[h], e);
+    neigh_count++;
+    spin_unlock_irqrestore(&neigh_lock, flags);
+}
 
 /* ARP input – from Ethernet */
-void arp_input(netdev_t *dev, void *data, size_t len) {
-    arp_hdr_t *arp = (arp_hdr_t*)(data + ETH_HDR_SIZE);
+void arp_input(netdev_t *dev, pbuf_t *pb) {
+    arp_hdr_t *arp = (arp_hdr_t*)((uint8_t*)pbuf_data(pb) + ETH_HDR_SIZE);
 
-    if (len < sizeof(arp_hdr_t) || ntohs(arp->hw_type) != ARP_HW_ETHER ||
+    if (pbuf_len(pb) < ETH_HDR_SIZE + sizeof(arp_hdr_t) || ntohs(arp->hw_type) != ARP_HW_ETHER ||
         ntohs(arp->proto_type) != ETH_P_IP || arp->hw_len != 6 ||
         arp->proto_len != 4) return;
 
@@ -80,18 +186,8 @@ void arp_send_reply(netdev_t *dev, uint32_t dst_ip, uint8_t *dst_mac) {
 
 /* Resolve IP to MAC – request if not cached */
 int arp_resolve(netdev_t *dev, uint32_t ip, uint8_t *mac) {
-    unsigned long flags;
-    spin_lock_irqsave(&arp_lock, flags);
-
-    for (int i = 0; i < arp_cache_count; i++) {
-        if (arp_cache[i].ip == ip && get_time_ms() < arp_cache[i].expire_time) {
-            memcpy(mac, arp_cache[i].mac, 6);
-            spin_unlock_irqrestore(&arp_lock, flags);
-            return 0;
-        }
-    }
-
-    spin_unlock_irqrestore(&arp_lock, flags);
+    if (neigh_lookup((const uint8_t *)&ip, 4, mac) == 0)
+        return 0;
 
     // Send ARP request
     uint8_t buf[ETH_HDR_LEN + sizeof(arp_hdr_t)];
@@ -118,15 +214,8 @@ int arp_resolve(netdev_t *dev, uint32_t ip, uint8_t *mac) {
     uint64_t end = get_time_ms() + 1000;
     while (get_time_ms() < end) {
         yield();
-        spin_lock_irqsave(&arp_lock, flags);
-        for (int i = 0; i < arp_cache_count; i++) {
-            if (arp_cache[i].ip == ip) {
-                memcpy(mac, arp_cache[i].mac, 6);
-                spin_unlock_irqrestore(&arp_lock, flags);
-                return 0;
-            }
-        }
-        spin_unlock_irqrestore(&arp_lock, flags);
+        if (neigh_lookup((const uint8_t *)&ip, 4, mac) == 0)
+            return 0;
     }
 
     return -1;  // Timeout
@@ -134,37 +223,13 @@ int arp_resolve(netdev_t *dev, uint32_t ip, uint8_t *mac) {
 
 /* Update ARP cache */
 void arp_cache_update(uint32_t ip, uint8_t *mac) {
-    unsigned long flags;
-    spin_lock_irqsave(&arp_lock, flags);
-
-    for (int i = 0; i < arp_cache_count; i++) {
-        if (arp_cache[i].ip == ip) {
-            memcpy(arp_cache[i].mac, mac, 6);
-            arp_cache[i].expire_time = get_time_ms() + ARP_TIMEOUT;
-            spin_unlock_irqrestore(&arp_lock, flags);
-            return;
-        }
-    }
-
-    if (arp_cache_count < ARP_CACHE_SIZE) {
-        arp_cache[arp_cache_count].ip = ip;
-        memcpy(arp_cache[arp_cache_count].mac, mac, 6);
-        arp_cache[arp_cache_count].expire_time = get_time_ms() + ARP_TIMEOUT;
-        arp_cache_count++;
-    } else {
-        // Evict oldest (stub – FIFO)
-        memmove(arp_cache, arp_cache + 1, (ARP_CACHE_SIZE - 1) * sizeof(arp_entry_t));
-        arp_cache[ARP_CACHE_SIZE - 1].ip = ip;
-        memcpy(arp_cache[ARP_CACHE_SIZE - 1].mac, mac, 6);
-        arp_cache[ARP_CACHE_SIZE - 1].expire_time = get_time_ms() + ARP_TIMEOUT;
-    }
-
-    spin_unlock_irqrestore(&arp_lock, flags);
+    neigh_update((const uint8_t *)&ip, 4, mac);
 }
 
 /* Init ARP subsystem */
 void arp_init(void) {
-    memset(arp_cache, 0, sizeof(arp_cache));
-    spinlock_init(&arp_lock);
-    debug_print("ARP initialized\n");
+    memset(neigh_hash, 0, sizeof(neigh_hash));
+    spinlock_init(&neigh_lock);
+    debug_print("ARP initialized (%d neighbor buckets, %d max entries)\n",
+                NEIGH_HASH_BUCKETS, NEIGH_CACHE_MAX);
 }
\ No newline at end of file
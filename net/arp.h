@@ -28,7 +28,7 @@ typedef struct arp_hdr {
 } arp_hdr_t;
 
 void arp_init(void);
-void arp_input(netdev_t *dev, void *data, size_t len);
+void arp_input(netdev_t *dev, pbuf_t *pb);
 int arp_resolve(netdev_t *dev, uint32_t ip, uint8_t *mac);
 
 #endif /* ARP_H */
\ No newline at end of file
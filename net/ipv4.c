@@ -5,6 +5,7 @@
  */
 
 #include "kernel.h"
+#include "memops.h"
 #include "net.h"
 #include "arp.h"
 #include "tcp.h"
@@ -16,6 +17,11 @@
 #define IP_PROTO_TCP    6
 #define IP_PROTO_UDP    17
 
+#define ICMP_ECHO_REPLY     0
+#define ICMP_DEST_UNREACH   3
+#define ICMP_ECHO_REQUEST   8
+#define ICMP_TIME_EXCEEDED  11
+
 typedef struct ipv4_hdr {
     uint8_t  ver_ihl;
     uint8_t  tos;
@@ -32,28 +38,73 @@ typedef struct ipv4_hdr {
 /* Local IP address (config stub) */
 static uint32_t local_ip = 0xC0A80101;  // 192.168.1.1
 
+void ipv4_forward(netdev_t *in_dev, pbuf_t *pb, ipv4_hdr_t *ip);
+void icmp_send_error(netdev_t *dev, ipv4_hdr_t *orig, uint8_t type, uint8_t code);
+
 /* IPv4 input – called from net_rx_packet */
-void ipv4_input(netdev_t *dev, void *data, size_t len) {
-    ipv4_hdr_t *ip = (ipv4_hdr_t*)(data + ETH_HDR_SIZE);
-    uint8_t *payload = (uint8_t*)ip + (ip->ver_ihl & 0xF) * 4;
-    size_t payload_len = ntohs(ip->total_len) - (ip->ver_ihl & 0xF) * 4;
+void ipv4_input(netdev_t *dev, pbuf_t *pb) {
+    ipv4_hdr_t *ip = (ipv4_hdr_t*)((uint8_t*)pbuf_data(pb) + ETH_HDR_SIZE);
+    size_t hdr_len = (ip->ver_ihl & 0xF) * 4;
+    size_t payload_len = ntohs(ip->total_len) - hdr_len;
 
     // Validate header
-    if ((ip->ver_ihl >> 4) != 4 || len < sizeof(ipv4_hdr_t) + payload_len) return;
+    if ((ip->ver_ihl >> 4) != 4 || pbuf_len(pb) < sizeof(ipv4_hdr_t) + payload_len) return;
 
     // Checksum
-    if (ip_checksum(ip, (ip->ver_ihl & 0xF) * 4) != 0) return;
+    if (ip_checksum(ip, hdr_len) != 0) return;
+
+    // Destination check – forward anything that isn't ours
+    if (ip->dst_ip != local_ip && ip->dst_ip != 0xFFFFFFFF) {
+        ipv4_forward(dev, pb, ip);
+        return;
+    }
 
-    // Destination check
-    if (ip->dst_ip != local_ip && ip->dst_ip != 0xFFFFFFFF) return;  // Not us or broadcast
+    // Consume Ethernet + IP headers; trim trailing padding off the frame
+    pb->offset += ETH_HDR_SIZE + hdr_len;
+    pb->len = pb->offset + payload_len;
 
     switch (ip->proto) {
-        case IP_PROTO_ICMP: icmp_input(dev, payload, payload_len); break;
-        case IP_PROTO_TCP: tcp_input(dev, payload, payload_len); break;
-        case IP_PROTO_UDP: udp_input(dev, payload, payload_len); break;
+        case IP_PROTO_ICMP: icmp_input(dev, pb); break;
+        case IP_PROTO_TCP: tcp_input(dev, pb); break;
+        case IP_PROTO_UDP: udp_input(dev, pb); break;
     }
 }
 
+/* Forward a transit packet: one FIB lookup, one (usually cached)
+ * neighbor probe, an incremental checksum fix for the TTL, and back
+ * out the route's interface. The payload is never copied. */
+void ipv4_forward(netdev_t *in_dev, pbuf_t *pb, ipv4_hdr_t *ip) {
+    if (ip->ttl <= 1) {                 // Expired
+        icmp_send_error(in_dev, ip, ICMP_TIME_EXCEEDED, 0);
+        return;
+    }
+
+    fib_route_t *rt = route_lookup4(ip->dst_ip);
+    if (!rt || !rt->dev) {              // No route
+        icmp_send_error(in_dev, ip, ICMP_DEST_UNREACH, 0);
+        return;
+    }
+
+    uint8_t dst_mac[6];
+    if (route_nexthop_mac(rt, (const uint8_t *)&ip->dst_ip, 4, dst_mac) != 0)
+        return;                         // Next hop unresolved – drop for now
+
+    /* Decrement TTL and patch the checksum incrementally (RFC 1624).
+     * Dropping the TTL subtracts 0x0100 from the big-endian (ttl,proto)
+     * word, so the complemented checksum grows by htons(0x0100); add it
+     * and fold the carry – correct on either byte order. */
+    ip->ttl--;
+    uint32_t check = ip->checksum;
+    check += htons(0x0100);
+    ip->checksum = (uint16_t)(check + (check >= 0xFFFF));
+
+    eth_hdr_t *eth = (eth_hdr_t *)pbuf_data(pb);
+    memcpy(eth->dst, dst_mac, 6);
+    memcpy(eth->src, rt->dev->mac, 6);
+
+    net_tx_packet(rt->dev, pbuf_data(pb), pbuf_len(pb));
+}
+
 /* IPv4 output – send packet */
 void ipv4_output(netdev_t *dev, uint32_t dst_ip, uint8_t proto, void *payload, size_t len) {
     uint8_t buf[ETH_MTU];
@@ -85,21 +136,124 @@ void ipv4_output(netdev_t *dev, uint32_t dst_ip, uint8_t proto, void *payload, s
     net_tx_packet(dev, buf, 14 + 20 + len);
 }
 
-/* IP checksum */
+/* IP checksum – 64-bit wide accumulation, see memops.c */
 uint16_t ip_checksum(void *data, size_t len) {
-    uint32_t sum = 0;
-    uint16_t *p = data;
+    return csum_fold(csum_partial(data, len, 0));
+}
 
-    while (len > 1) {
-        sum += *p++;
-        len -= 2;
-    }
-    if (len) sum += *(uint8_t*)p;
+/* ==================== ICMP ==================== */
+
+typedef struct icmp_hdr {
+    uint8_t  type;
+    uint8_t  code;
+    uint16_t checksum;
+    uint32_t rest;          /* Echo: identifier + sequence */
+} icmp_hdr_t;
 
+/* RFC 1624 incremental checksum update: one 16-bit word changed from
+ * 'old' to 'new' in a block covered by 'check' */
+static uint16_t csum_incremental(uint16_t check, uint16_t old, uint16_t new)
+{
+    uint32_t sum = (uint16_t)~check + (uint16_t)~old + new;
     sum = (sum >> 16) + (sum & 0xFFFF);
-    sum += (sum >> 16);
-    return ~sum;
+    return ~(sum + (sum >> 16));
 }
 
-/* ICMP input stub */
-void icmp_input(netdev_t *dev, void *data, size
\ No newline at end of file
+/* Token bucket for generated ICMP errors. Refilled on demand from the
+ * timestamp; updates are not locked – a race between RX cores just
+ * lets a token or two slip, which is fine for a limiter whose job is
+ * to stop an error storm from eating the stack. */
+#define ICMP_ERR_PER_SEC    100
+#define ICMP_ERR_BURST      20
+
+static uint32_t icmp_err_tokens = ICMP_ERR_BURST;
+static uint64_t icmp_err_stamp;
+static uint64_t icmp_err_dropped;
+
+static int icmp_err_allow(void)
+{
+    uint64_t now = get_time_ns();
+    uint64_t elapsed = now - icmp_err_stamp;
+
+    uint32_t refill = (uint32_t)(elapsed / (1000000000ULL / ICMP_ERR_PER_SEC));
+    if (refill) {
+        uint32_t t = icmp_err_tokens + refill;
+        icmp_err_tokens = t > ICMP_ERR_BURST ? ICMP_ERR_BURST : t;
+        icmp_err_stamp = now;
+    }
+
+    if (icmp_err_tokens == 0) {
+        icmp_err_dropped++;
+        return 0;
+    }
+    icmp_err_tokens--;
+    return 1;
+}
+
+/* Generate an ICMP error (unreachable, time-exceeded) for a packet we
+ * could not deliver. Quotes the offending IP header + 8 payload bytes
+ * per RFC 792; silently drops when the token bucket is empty. */
+void icmp_send_error(netdev_t *dev, ipv4_hdr_t *orig, uint8_t type, uint8_t code)
+{
+    if (orig->proto == IP_PROTO_ICMP) return;   // Never answer errors with errors
+    if (!icmp_err_allow()) return;
+
+    size_t orig_hdr = (orig->ver_ihl & 0xF) * 4;
+    size_t quote = orig_hdr + 8;
+    uint8_t msg[sizeof(icmp_hdr_t) + 60 + 8];
+
+    icmp_hdr_t *icmp = (icmp_hdr_t *)msg;
+    icmp->type = type;
+    icmp->code = code;
+    icmp->checksum = 0;
+    icmp->rest = 0;
+    memcpy(msg + sizeof(icmp_hdr_t), orig, quote);
+    icmp->checksum = ip_checksum(msg, sizeof(icmp_hdr_t) + quote);
+
+    ipv4_output(dev, orig->src_ip, IP_PROTO_ICMP, msg, sizeof(icmp_hdr_t) + quote);
+}
+
+/* ICMP input. Echo requests take a fast path: the reply is the request
+ * frame itself, rewritten in place (addresses swapped, both checksums
+ * patched incrementally) and pushed straight out the receiving
+ * interface on this CPU – no allocation, no queueing, so a 100Hz
+ * monitoring ping or a ping flood costs one header rewrite per packet. */
+void icmp_input(netdev_t *dev, pbuf_t *pb) {
+    if (pbuf_len(pb) < sizeof(icmp_hdr_t)) return;
+    icmp_hdr_t *icmp = pbuf_data(pb);
+
+    if (icmp->type != ICMP_ECHO_REQUEST) return;
+
+    /* Recover the enclosing headers – ipv4_input advanced offset past
+     * them, but they are still sitting in front of us in the pbuf.
+     * Requests carrying IP options (nobody's ping does) fall off the
+     * fast path and are dropped rather than parsed backwards. */
+    if (pb->offset < ETH_HDR_SIZE + 20) return;
+    ipv4_hdr_t *ip = (ipv4_hdr_t *)((uint8_t *)icmp - 20);
+    if (ip->ver_ihl != 0x45) return;
+    eth_hdr_t *eth = (eth_hdr_t *)((uint8_t *)ip - ETH_HDR_SIZE);
+
+    /* Echo request -> reply: only the type byte changes */
+    icmp->type = ICMP_ECHO_REPLY;
+    icmp->checksum = csum_incremental(icmp->checksum,
+                                      htons(ICMP_ECHO_REQUEST << 8),
+                                      htons(ICMP_ECHO_REPLY << 8));
+
+    /* Swapping src/dst leaves the IP checksum alone; resetting the TTL
+     * does not, so patch the (ttl,proto) word */
+    uint32_t tmp_ip = ip->src_ip;
+    ip->src_ip = ip->dst_ip;
+    ip->dst_ip = tmp_ip;
+
+    uint16_t *ttl_word = (uint16_t *)&ip->ttl;
+    uint16_t old_ttl = *ttl_word;
+    ip->ttl = 64;
+    ip->checksum = csum_incremental(ip->checksum, old_ttl, *ttl_word);
+
+    uint8_t tmp_mac[6];
+    memcpy(tmp_mac, eth->dst, 6);
+    memcpy(eth->dst, eth->src, 6);
+    memcpy(eth->src, tmp_mac, 6);
+
+    net_tx_packet(dev, eth, ETH_HDR_SIZE + 20 + pbuf_len(pb));
+}
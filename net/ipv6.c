@@ -28,21 +28,24 @@ typedef struct ipv6_hdr {
 static uint8_t local_ipv6[16] = {0x20,0x01,0x0d,0xb8,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x01};  // 2001:db8::1
 
 /* IPv6 input – called from net_rx_packet */
-void ipv6_input(netdev_t *dev, void *data, size_t len) {
-    ipv6_hdr_t *ip6 = (ipv6_hdr_t*)(data + ETH_HDR_SIZE);
-    uint8_t *payload = (uint8_t*)ip6 + 40;  // Fixed 40-byte header
+void ipv6_input(netdev_t *dev, pbuf_t *pb) {
+    ipv6_hdr_t *ip6 = (ipv6_hdr_t*)((uint8_t*)pbuf_data(pb) + ETH_HDR_SIZE);
     size_t payload_len = ntohs(ip6->payload_len);
 
     // Validate header
-    if (((ip6->ver_tc_fl >> 28) != 6) || len < 40 + payload_len) return;
+    if (((ip6->ver_tc_fl >> 28) != 6) || pbuf_len(pb) < 40 + payload_len) return;
 
     // Destination check (stub – check if matches local or multicast)
     if (memcmp(ip6->dst_ip, local_ipv6, 16) != 0 && ip6->dst_ip[0] != 0xFF) return;
 
+    // Consume Ethernet + fixed 40-byte header; trim trailing padding
+    pb->offset += ETH_HDR_SIZE + 40;
+    pb->len = pb->offset + payload_len;
+
     switch (ip6->next_hdr) {
-        case IPV6_PROTO_ICMP6: icmp6_input(dev, payload, payload_len); break;
-        case IPV6_PROTO_TCP: tcp_input(dev, payload, payload_len); break;
-        case IPV6_PROTO_UDP: udp_input(dev, payload, payload_len); break;
+        case IPV6_PROTO_ICMP6: icmp6_input(dev, pb); break;
+        case IPV6_PROTO_TCP: tcp_input(dev, pb); break;
+        case IPV6_PROTO_UDP: udp_input(dev, pb); break;
     }
 }
 
@@ -73,15 +76,18 @@ void ipv6_output(netdev_t *dev, const uint8_t *dst_ip, uint8_t next_hdr, void *p
 }
 
 /* ICMPv6 input stub (e.g., Neighbor Solicitation/Advertisement) */
-void icmp6_input(netdev_t *dev, void *data, size_t len) {
+void icmp6_input(netdev_t *dev, pbuf_t *pb) {
     // Handle ND, ping6, etc.
     // ... (implement echo reply, NS/NA)
 }
 
-/* Neighbor Discovery stub */
+/* Neighbor Discovery – backed by the shared neighbor cache in arp.c */
 int nd_resolve(netdev_t *dev, const uint8_t *ip6, uint8_t *mac) {
+    if (neigh_lookup(ip6, 16, mac) == 0)
+        return 0;
+
     // Send NS, wait for NA – similar to ARP
-    // ... (full ND implementation)
+    // ... (full NS/NA exchange; the reply path calls neigh_update(ip6, 16, mac))
     return 0;
 }
 
@@ -8,6 +8,8 @@
 #define NET_H
 
 #include <stdint.h>
+#include "pbuf.h"
+#include "vfs.h"           /* iovec_t for vectored send */
 
 #define ETH_HDR_SIZE    14
 #define ETH_MTU         1500
@@ -21,21 +23,47 @@ typedef struct eth_hdr {
     uint16_t type;
 } eth_hdr_t;
 
+typedef struct net_queue {
+    void    *packets[1024];
+    size_t   sizes[1024];
+    int      head, tail;
+    spinlock_t lock;
+    uint64_t pkt_count;     // Packets steered to this queue
+    uint64_t drop_count;    // Packets dropped because the ring was full
+    uint64_t budget_exhausted;  // Poll passes that hit NET_NAPI_BUDGET
+} net_queue_t;
+
+/* Max packets one poll pass may process before yielding the CPU */
+#define NET_NAPI_BUDGET 64
+
 typedef struct netdev {
     char     name[16];
     uint8_t  mac[6];
     net_queue_t *rx_queue;
     net_queue_t *tx_queue;
     void     (*tx_func)(struct netdev *dev, void *pkt, size_t len);
+    /* Optional: queue a whole chain of frames and ring the doorbell
+     * once. NULL means net_tx_batch falls back to tx_func per frame. */
+    void     (*tx_batch)(struct netdev *dev, void **pkts, size_t *lens, int n);
+
+    /* NAPI contract: the ISR masks RX interrupts and calls
+     * net_rx_schedule(); poll() then drains up to 'budget' frames from
+     * the hardware ring (feeding each to net_rx_packet) and returns how
+     * many it took. When it returns less than the budget the ring is
+     * empty and the stack re-enables the interrupt via irq_enable(). */
+    int      (*poll)(struct netdev *dev, int budget);
+    void     (*irq_enable)(struct netdev *dev);
+    volatile int napi_scheduled;
+    struct netdev *napi_next;       // Per-queue poll list linkage
     // IP config, MTU, etc.
 } netdev_t;
 
-typedef struct net_queue {
-    void    *packets[1024];
-    size_t   sizes[1024];
-    int      head, tail;
-    spinlock_t lock;
-} net_queue_t;
+/* One message of a batched datagram call – sendmmsg/recvmmsg style */
+typedef struct mmsg {
+    void    *buf;       // Payload in (send) or out (recv)
+    size_t   len;       // Datagram size (send) / buffer capacity (recv)
+    size_t   msg_len;   // Bytes actually transferred, filled in return
+} mmsg_t;
 
 #define AF_INET         2
 #define AF_INET6        10
@@ -57,8 +85,10 @@ typedef struct sockaddr_in {
 typedef struct socket socket_t;
 
 void netdev_register(netdev_t *dev);
-void net_rx_packet(netdev_t *dev, void *data, size_t len);
+void net_rx_packet(netdev_t *dev, pbuf_t *pb);
+void net_rx_schedule(netdev_t *dev);
 void net_tx_packet(netdev_t *dev, void *pkt, size_t len);
+void net_tx_batch(netdev_t *dev, void **pkts, size_t *lens, int n);
 
 void net_queue_init(net_queue_t *q);
 void net_queue_enqueue(net_queue_t *q, void *pkt, size_t len);
@@ -71,25 +101,61 @@ int socket_listen(socket_t *sock, int backlog);
 int socket_accept(socket_t *sock, sockaddr_t *addr, socklen_t *addrlen);
 int socket_connect(socket_t *sock, const sockaddr_t *addr, socklen_t addrlen);
 ssize_t socket_send(socket_t *sock, const void *buf, size_t len, int flags);
+ssize_t socket_sendv(socket_t *sock, const iovec_t *iov, int iovcnt, int flags);
 ssize_t socket_recv(socket_t *sock, void *buf, size_t len, int flags);
+int socket_sendmmsg(socket_t *sock, mmsg_t *msgs, int n, int flags);
+int socket_recvmmsg(socket_t *sock, mmsg_t *msgs, int n, int flags);
+void socket_close(socket_t *sock);
+socket_t *socket_find_udp(uint16_t port);
+socket_t *socket_find_listener(uint16_t port);
+socket_t *socket_find_tcp(uint64_t laddr, uint16_t lport,
+                          uint64_t raddr, uint16_t rport);
+void socket_queue_rx(socket_t *sock, pbuf_t *pb);
+void **socket_watch(socket_t *sock);
+int socket_poll_ready(socket_t *sock);
 
 void arp_init(void);
-void arp_input(netdev_t *dev, void *data, size_t len);
+void arp_input(netdev_t *dev, pbuf_t *pb);
 int arp_resolve(netdev_t *dev, uint32_t ip, uint8_t *mac);
 
+/* Generic neighbor cache (arp.c) – keyed by 4-byte IPv4 or 16-byte
+ * IPv6 address; lock-free lookups, LRU eviction */
+int neigh_lookup(const uint8_t *addr, int addrlen, uint8_t *mac);
+void neigh_update(const uint8_t *addr, int addrlen, const uint8_t *mac);
+
+/* FIB (route.c) – LPM tries with lock-free forwarding lookups */
+typedef struct fib_route {
+    uint8_t  nexthop[16];   // Gateway address, valid for nh_len bytes
+    int      nh_len;        // 4/16, or 0 for an on-link route
+    int      plen;          // Prefix length this route was added with
+    netdev_t *dev;          // Egress interface
+    uint8_t  mac[6];        // Cached next-hop MAC
+    uint64_t mac_expire;    // ms timestamp the cached MAC goes stale
+} fib_route_t;
+
+void route_init(void);
+fib_route_t *route_lookup4(uint32_t dst_ip);
+fib_route_t *route_lookup6(const uint8_t *dst_ip);
+int route_nexthop_mac(fib_route_t *rt, const uint8_t *dst, int addrlen, uint8_t *mac);
+int route_add4(uint32_t prefix, int plen, uint32_t gateway, netdev_t *dev);
+int route_del4(uint32_t prefix, int plen);
+int route_add6(const uint8_t *prefix, int plen, const uint8_t *gateway, netdev_t *dev);
+int route_del6(const uint8_t *prefix, int plen);
+
 void ipv4_init(void);
-void ipv4_input(netdev_t *dev, void *data, size_t len);
+void ipv4_input(netdev_t *dev, pbuf_t *pb);
 void ipv4_output(netdev_t *dev, uint32_t dst_ip, uint8_t proto, void *payload, size_t len);
 
 void ipv6_init(void);
-void ipv6_input(netdev_t *dev, void *data, size_t len);
+void ipv6_input(netdev_t *dev, pbuf_t *pb);
 void ipv6_output(netdev_t *dev, const uint8_t *dst_ip, uint8_t next_hdr, void *payload, size_t len);
 
 void tcp_init(void);
-void tcp_input(netdev_t *dev, void *data, size_t len);
+void tcp_input(netdev_t *dev, pbuf_t *pb);
 
 void udp_init(void);
-void udp_input(netdev_t *dev, void *data, size_t len);
+void udp_input(netdev_t *dev, pbuf_t *pb);
+int udp_send_batch(socket_t *sock, mmsg_t *msgs, int n);
 
 uint16_t ip_checksum(void *data, size_t len);
 
@@ -0,0 +1,113 @@
+/*
+ * pbuf.c – Packet Buffer Pool for RISC OS Phoenix
+ * Refcounted fixed-size buffers from a per-CPU arena, so the RX path
+ * never touches kmalloc and packets cross the stack without copying.
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "page_alloc.h"
+#include "net.h"
+#include "pbuf.h"
+#include <string.h>
+
+#define KERNEL_VIRT_BASE    0xFFFF000000000000ULL
+
+/* Buffers per CPU – 256 x 2KB = 512KB of RX headroom per core */
+#define PBUF_PER_CPU        256
+
+static pbuf_t *pbuf_free_list[MAX_CPUS];
+static int pbuf_free_count[MAX_CPUS];
+static spinlock_t pbuf_locks[MAX_CPUS];
+static int pbuf_pool_ready;
+
+/* Carve every CPU's arena out of the buddy allocator in one go.
+ * Called from netdev_register – first NIC up brings the pool up. */
+void pbuf_pool_init(void)
+{
+    if (pbuf_pool_ready) return;
+    pbuf_pool_ready = 1;
+
+    size_t stride = (sizeof(pbuf_t) + 63) & ~(size_t)63;
+    size_t arena = stride * PBUF_PER_CPU;
+    int order = 0;
+    while (((uint64_t)PAGE_SIZE << order) < arena) order++;
+
+    for (int cpu = 0; cpu < nr_cpus; cpu++) {
+        spinlock_init(&pbuf_locks[cpu]);
+
+        uint64_t phys = phys_alloc_pages(order);
+        if (!phys) {
+            debug_print("pbuf: no memory for CPU %d arena\n", cpu);
+            continue;
+        }
+
+        uint8_t *base = (uint8_t*)(phys + KERNEL_VIRT_BASE);
+        for (int i = 0; i < PBUF_PER_CPU; i++) {
+            pbuf_t *pb = (pbuf_t*)(base + i * stride);
+            pb->next = pbuf_free_list[cpu];
+            pbuf_free_list[cpu] = pb;
+        }
+        pbuf_free_count[cpu] = PBUF_PER_CPU;
+    }
+
+    debug_print("pbuf: %d buffers x %d CPUs ready (%d bytes each)\n",
+                PBUF_PER_CPU, nr_cpus, PBUF_SIZE);
+}
+
+static pbuf_t *pbuf_pop(int cpu)
+{
+    unsigned long flags;
+    spin_lock_irqsave(&pbuf_locks[cpu], &flags);
+
+    pbuf_t *pb = pbuf_free_list[cpu];
+    if (pb) {
+        pbuf_free_list[cpu] = pb->next;
+        pbuf_free_count[cpu]--;
+    }
+
+    spin_unlock_irqrestore(&pbuf_locks[cpu], flags);
+    return pb;
+}
+
+pbuf_t *pbuf_alloc(void)
+{
+    int cpu = get_cpu_id();
+    pbuf_t *pb = pbuf_pop(cpu);
+
+    /* Local arena empty – borrow from whichever CPU has buffers left */
+    if (!pb) {
+        for (int i = 0; i < nr_cpus && !pb; i++) {
+            if (i != cpu && pbuf_free_count[i] > 0) pb = pbuf_pop(i);
+        }
+    }
+    if (!pb) return NULL;
+
+    pb->next = NULL;
+    pb->dev = NULL;
+    pb->refcount = 1;
+    pb->len = 0;
+    pb->offset = 0;
+    return pb;
+}
+
+/* Take an extra reference – e.g. a socket queuing the buffer for recv */
+void pbuf_ref(pbuf_t *pb)
+{
+    __atomic_add_fetch(&pb->refcount, 1, __ATOMIC_SEQ_CST);
+}
+
+void pbuf_free(pbuf_t *pb)
+{
+    if (!pb) return;
+    if (__atomic_sub_fetch(&pb->refcount, 1, __ATOMIC_SEQ_CST) > 0) return;
+
+    /* Last reference gone – back onto the freeing CPU's list */
+    int cpu = get_cpu_id();
+    unsigned long flags;
+    spin_lock_irqsave(&pbuf_locks[cpu], &flags);
+    pb->next = pbuf_free_list[cpu];
+    pbuf_free_list[cpu] = pb;
+    pbuf_free_count[cpu]++;
+    spin_unlock_irqrestore(&pbuf_locks[cpu], flags);
+}
@@ -0,0 +1,40 @@
+/*
+ * pbuf.h – Packet Buffer Headers for RISC OS Phoenix
+ * Defines pbuf_t and the per-CPU packet buffer pool API
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#ifndef PBUF_H
+#define PBUF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct netdev;
+
+/* One fixed-size, cache-aligned, refcounted packet buffer. A packet is
+ * written into the payload once (by NIC DMA or the driver) and then
+ * travels by reference through net_rx_packet → ipv4_input → udp_input;
+ * each layer advances 'offset' past its header instead of copying.
+ * The only copy left is at the user boundary in socket_recv. */
+#define PBUF_SIZE       2048    /* Room for MTU + all headers, power of two */
+
+typedef struct pbuf {
+    struct pbuf   *next;        /* Free list / socket RX chain */
+    struct netdev *dev;         /* Receiving interface */
+    volatile int   refcount;
+    uint32_t       len;         /* Valid bytes in payload */
+    uint32_t       offset;      /* Parse position (headers consumed so far) */
+    uint8_t        payload[PBUF_SIZE] __attribute__((aligned(64)));
+} pbuf_t;
+
+/* Current parse position and bytes remaining from it */
+static inline void *pbuf_data(pbuf_t *pb) { return pb->payload + pb->offset; }
+static inline size_t pbuf_len(pbuf_t *pb) { return pb->len - pb->offset; }
+
+void pbuf_pool_init(void);
+pbuf_t *pbuf_alloc(void);
+void pbuf_ref(pbuf_t *pb);
+void pbuf_free(pbuf_t *pb);
+
+#endif /* PBUF_H */
@@ -0,0 +1,208 @@
+/*
+ * route.c – FIB with stride-8 LPM tries for RISC OS Phoenix
+ * Routing between the three edge networks: IPv4 and IPv6 prefixes live
+ * in multibit tries (8-bit stride, controlled prefix expansion), so a
+ * lookup is at most 4 (IPv4) or 16 (IPv6) indexed loads with no lock.
+ * Writers serialise on fib_lock and publish with RCU; replaced routes
+ * are retired through rcu_free so forwarding never sees freed memory.
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "net.h"
+#include "rcu.h"
+#include <stdint.h>
+#include <string.h>
+
+#define FIB_STRIDE      256     // 8-bit stride per trie level
+
+typedef struct fib_node {
+    struct fib_node  *child[FIB_STRIDE];
+    fib_route_t      *route[FIB_STRIDE];    // Longest prefix covering the slot
+} fib_node_t;
+
+static fib_node_t *fib4_root;
+static fib_node_t *fib6_root;
+static spinlock_t fib_lock = SPINLOCK_INIT;
+
+static fib_node_t *fib_node_alloc(void) {
+    fib_node_t *n = kmalloc(sizeof(fib_node_t));
+    if (n) memset(n, 0, sizeof(fib_node_t));
+    return n;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Lookup – the forwarding path. Lock-free: walk published levels,   */
+/*  remember the deepest route seen. Expansion at insert time means   */
+/*  the longest match is simply the last non-NULL route slot.         */
+/* ------------------------------------------------------------------ */
+
+static fib_route_t *fib_lookup(fib_node_t *root, const uint8_t *addr, int addrlen) {
+    fib_node_t *node = rcu_dereference(root);
+    fib_route_t *best = NULL;
+
+    for (int i = 0; node && i < addrlen; i++) {
+        uint8_t b = addr[i];
+        fib_route_t *r = rcu_dereference(node->route[b]);
+        if (r) best = r;
+        node = rcu_dereference(node->child[b]);
+    }
+    return best;
+}
+
+fib_route_t *route_lookup4(uint32_t dst_ip) {
+    return fib_lookup(fib4_root, (const uint8_t *)&dst_ip, 4);
+}
+
+fib_route_t *route_lookup6(const uint8_t *dst_ip) {
+    return fib_lookup(fib6_root, dst_ip, 16);
+}
+
+/* Next-hop MAC for a route – one trie lookup plus one neighbor-cache
+ * probe, and the probe result is cached on the route for 60s */
+int route_nexthop_mac(fib_route_t *rt, const uint8_t *dst, int addrlen, uint8_t *mac) {
+    uint64_t now = get_time_ms();
+    if (rt->mac_expire > now) {
+        memcpy(mac, rt->mac, 6);
+        return 0;
+    }
+
+    /* On-link routes resolve the destination itself, gatewayed routes
+     * resolve the gateway */
+    const uint8_t *target = rt->nh_len ? rt->nexthop : dst;
+    int tlen = rt->nh_len ? rt->nh_len : addrlen;
+    if (neigh_lookup(target, tlen, mac) != 0)
+        return -1;
+
+    memcpy(rt->mac, mac, 6);
+    __atomic_store_n(&rt->mac_expire, now + 60000, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Route add/delete                                                  */
+/* ------------------------------------------------------------------ */
+
+/* Install 'rt' into the slots [lo, hi) of the final level, but only
+ * over routes less specific than it (controlled prefix expansion) */
+static void fib_fill(fib_node_t *node, int lo, int hi, fib_route_t *rt) {
+    for (int s = lo; s < hi; s++) {
+        fib_route_t *old = node->route[s];
+        if (!old || old->plen <= rt->plen)
+            rcu_assign_pointer(node->route[s], rt);
+    }
+}
+
+static int fib_insert(fib_node_t *root, const uint8_t *prefix, int plen,
+                      const uint8_t *nexthop, int nh_len, netdev_t *dev) {
+    fib_route_t *rt = kmalloc(sizeof(fib_route_t));
+    if (!rt) return -1;
+    memset(rt, 0, sizeof(fib_route_t));
+    if (nexthop && nh_len) {
+        memcpy(rt->nexthop, nexthop, nh_len);
+        rt->nh_len = nh_len;
+    }
+    rt->dev = dev;
+    rt->plen = plen;
+
+    unsigned long flags;
+    spin_lock_irqsave(&fib_lock, &flags);
+
+    fib_node_t *node = root;
+    int depth = 0;
+    while (plen - depth * 8 > 8) {
+        uint8_t b = prefix[depth];
+        if (!node->child[b]) {
+            fib_node_t *child = fib_node_alloc();
+            if (!child) {
+                spin_unlock_irqrestore(&fib_lock, flags);
+                kfree(rt);
+                return -1;
+            }
+            rcu_assign_pointer(node->child[b], child);
+        }
+        node = node->child[b];
+        depth++;
+    }
+
+    /* Final level: expand the remaining bits into a slot range */
+    int rem = plen - depth * 8;             // 1..8 bits (0 for default route)
+    int lo, hi;
+    if (rem == 0) {
+        lo = 0; hi = FIB_STRIDE;
+    } else {
+        int span = 1 << (8 - rem);
+        lo = prefix[depth] & ~(span - 1);
+        hi = lo + span;
+    }
+    fib_fill(node, lo, hi, rt);
+
+    spin_unlock_irqrestore(&fib_lock, flags);
+    return 0;
+}
+
+static int fib_remove(fib_node_t *root, const uint8_t *prefix, int plen) {
+    unsigned long flags;
+    spin_lock_irqsave(&fib_lock, &flags);
+
+    fib_node_t *node = root;
+    int depth = 0;
+    while (node && plen - depth * 8 > 8) {
+        node = node->child[prefix[depth]];
+        depth++;
+    }
+    if (!node) {
+        spin_unlock_irqrestore(&fib_lock, flags);
+        return -1;
+    }
+
+    int rem = plen - depth * 8;
+    int lo, hi;
+    if (rem == 0) {
+        lo = 0; hi = FIB_STRIDE;
+    } else {
+        int span = 1 << (8 - rem);
+        lo = prefix[depth] & ~(span - 1);
+        hi = lo + span;
+    }
+
+    fib_route_t *victim = NULL;
+    for (int s = lo; s < hi; s++) {
+        fib_route_t *r = node->route[s];
+        if (r && r->plen == plen) {
+            victim = r;
+            rcu_assign_pointer(node->route[s], NULL);
+        }
+    }
+
+    spin_unlock_irqrestore(&fib_lock, flags);
+
+    if (!victim) return -1;
+    rcu_free(victim);
+    return 0;
+}
+
+int route_add4(uint32_t prefix, int plen, uint32_t gateway, netdev_t *dev) {
+    return fib_insert(fib4_root, (const uint8_t *)&prefix, plen,
+                      gateway ? (const uint8_t *)&gateway : NULL,
+                      gateway ? 4 : 0, dev);
+}
+
+int route_del4(uint32_t prefix, int plen) {
+    return fib_remove(fib4_root, (const uint8_t *)&prefix, plen);
+}
+
+int route_add6(const uint8_t *prefix, int plen, const uint8_t *gateway, netdev_t *dev) {
+    return fib_insert(fib6_root, prefix, plen, gateway, gateway ? 16 : 0, dev);
+}
+
+int route_del6(const uint8_t *prefix, int plen) {
+    return fib_remove(fib6_root, prefix, plen);
+}
+
+/* Init the FIB – empty tries, routes come from config/ND/RA later */
+void route_init(void) {
+    fib4_root = fib_node_alloc();
+    fib6_root = fib_node_alloc();
+    debug_print("FIB initialized (stride-8 LPM tries)\n");
+}
@@ -8,6 +8,7 @@
 #include "net.h"
 #include "tcp.h"
 #include "udp.h"
+#include "epoll.h"
 #include <string.h>
 
 #define MAX_SOCKETS     1024
@@ -22,33 +23,89 @@ typedef struct socket {
     uint64_t remote_addr;
     uint16_t remote_port;
     tcp_conn_t *tcp_conn;  // For TCP
-    // UDP queue stub
-    ring_buffer rx_queue;
+    // Received pbufs waiting for recv() – payload stays in the pool
+    // buffer until the user copies it out
+    pbuf_t *rx_head;
+    pbuf_t *rx_tail;
+    task_t *task;          // Task blocked in recv(), if any
+    void *watchers;        // epoll watcher chain
     spinlock_t lock;
+    struct socket *port_next;   // Port hash chain (UDP + listeners)
+    struct socket *tuple_next;  // 4-tuple hash chain (established TCP)
 } socket_t;
 
 static socket_t sockets[MAX_SOCKETS];
-static int num_sockets = 0;
 static spinlock_t socket_lock = SPINLOCK_INIT;
 
+/* Free-slot bitmap – bit set means the slot is live. Allocation is a
+ * find-first-zero over 16 words instead of num_sockets++, so closed
+ * slots get reused. */
+static uint64_t socket_used[MAX_SOCKETS / 64];
+
+/* Demux hash tables – inbound packets must resolve their socket in
+ * constant time or RX drops at load. Chains are per-bucket singly
+ * linked through the socket itself, no allocation on the fast path. */
+#define SOCKET_HASH_BUCKETS 256
+
+static socket_t *udp_hash[SOCKET_HASH_BUCKETS];      // Bound SOCK_DGRAM, by local port
+static socket_t *listen_hash[SOCKET_HASH_BUCKETS];   // TCP listeners, by local port
+static socket_t *tuple_hash[SOCKET_HASH_BUCKETS];    // Established TCP, by 4-tuple
+
+static inline uint32_t port_hash(uint16_t port) {
+    return (uint32_t)((port * 0x9E3779B97F4A7C15ULL) >> 56) & (SOCKET_HASH_BUCKETS - 1);
+}
+
+static inline uint32_t tuple_hash_fn(uint64_t laddr, uint16_t lport,
+                                     uint64_t raddr, uint16_t rport) {
+    uint64_t key = laddr ^ (raddr << 1) ^ ((uint64_t)lport << 32) ^ ((uint64_t)rport << 48);
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 56) & (SOCKET_HASH_BUCKETS - 1);
+}
+
+/* Called with socket_lock held */
+static void hash_insert(socket_t **bucket, socket_t *sock, int tuple) {
+    if (tuple) {
+        sock->tuple_next = *bucket;
+    } else {
+        sock->port_next = *bucket;
+    }
+    *bucket = sock;
+}
+
+static void hash_remove(socket_t **bucket, socket_t *sock, int tuple) {
+    for (socket_t **pp = bucket; *pp; pp = tuple ? &(*pp)->tuple_next
+                                                 : &(*pp)->port_next) {
+        if (*pp == sock) {
+            *pp = tuple ? sock->tuple_next : sock->port_next;
+            return;
+        }
+    }
+}
+
 /* Create new socket */
 int socket_create(int domain, int type, int protocol) {
     unsigned long flags;
     spin_lock_irqsave(&socket_lock, flags);
 
-    if (num_sockets >= MAX_SOCKETS) {
+    int fd = -1;
+    for (int w = 0; w < MAX_SOCKETS / 64; w++) {
+        if (~socket_used[w]) {
+            int bit = __builtin_ctzll(~socket_used[w]);
+            socket_used[w] |= (1ULL << bit);
+            fd = w * 64 + bit;
+            break;
+        }
+    }
+    if (fd < 0) {
         spin_unlock_irqrestore(&socket_lock, flags);
         return -1;
     }
 
-    int fd = num_sockets++;
     socket_t *sock = &sockets[fd];
-
+    memset(sock, 0, sizeof(socket_t));
     sock->domain = domain;
     sock->type = type;
     sock->protocol = protocol;
     sock->state = SOCK_OPEN;
-    ring_init(&sock->rx_queue, 65536);
     spinlock_init(&sock->lock);
 
     spin_unlock_irqrestore(&socket_lock, flags);
@@ -58,10 +115,62 @@ int socket_create(int domain, int type, int protocol) {
 
 /* Get socket by FD */
 socket_t *socket_get(int fd) {
-    if (fd < 0 || fd >= num_sockets) return NULL;
+    if (fd < 0 || fd >= MAX_SOCKETS) return NULL;
+    if (!(socket_used[fd / 64] & (1ULL << (fd % 64)))) return NULL;
     return &sockets[fd];
 }
 
+/* Close socket – unhash, drop queued pbufs, free the slot for reuse */
+void socket_close(socket_t *sock) {
+    int fd = (int)(sock - sockets);
+    unsigned long flags;
+    spin_lock_irqsave(&socket_lock, &flags);
+
+    if (sock->type == SOCK_DGRAM && sock->state >= SOCK_BOUND)
+        hash_remove(&udp_hash[port_hash(sock->local_port)], sock, 0);
+    if (sock->type == SOCK_STREAM && sock->state == SOCK_LISTEN)
+        hash_remove(&listen_hash[port_hash(sock->local_port)], sock, 0);
+    if (sock->type == SOCK_STREAM && sock->state == SOCK_CONNECTED)
+        hash_remove(&tuple_hash[tuple_hash_fn(sock->local_addr, sock->local_port,
+                                              sock->remote_addr, sock->remote_port)],
+                    sock, 1);
+
+    while (sock->rx_head) {
+        pbuf_t *pb = sock->rx_head;
+        sock->rx_head = pb->next;
+        pbuf_free(pb);
+    }
+    sock->rx_tail = NULL;
+    sock->state = SOCK_OPEN;
+
+    socket_used[fd / 64] &= ~(1ULL << (fd % 64));
+    spin_unlock_irqrestore(&socket_lock, flags);
+    debug_print("Socket closed: FD=%d\n", fd);
+}
+
+/* Demux lookups – one bucket walk each, called per inbound packet */
+socket_t *socket_find_udp(uint16_t port) {
+    for (socket_t *s = udp_hash[port_hash(port)]; s; s = s->port_next)
+        if (s->local_port == port) return s;
+    return NULL;
+}
+
+socket_t *socket_find_listener(uint16_t port) {
+    for (socket_t *s = listen_hash[port_hash(port)]; s; s = s->port_next)
+        if (s->local_port == port) return s;
+    return NULL;
+}
+
+socket_t *socket_find_tcp(uint64_t laddr, uint16_t lport,
+                          uint64_t raddr, uint16_t rport) {
+    uint32_t h = tuple_hash_fn(laddr, lport, raddr, rport);
+    for (socket_t *s = tuple_hash[h]; s; s = s->tuple_next)
+        if (s->local_port == lport && s->remote_port == rport &&
+            s->local_addr == laddr && s->remote_addr == raddr)
+            return s;
+    return NULL;
+}
+
 /* Bind socket to address */
 int socket_bind(socket_t *sock, const struct sockaddr *addr, socklen_t addrlen) {
     if (sock->state != SOCK_OPEN) return -1;
@@ -75,6 +184,14 @@ int socket_bind(socket_t *sock, const struct sockaddr *addr, socklen_t addrlen)
     } else return -1;
 
     sock->state = SOCK_BOUND;
+
+    if (sock->type == SOCK_DGRAM) {
+        unsigned long flags;
+        spin_lock_irqsave(&socket_lock, &flags);
+        hash_insert(&udp_hash[port_hash(sock->local_port)], sock, 0);
+        spin_unlock_irqrestore(&socket_lock, flags);
+    }
+
     debug_print("Socket bound to port %d\n", ntohs(sock->local_port));
     return 0;
 }
@@ -84,6 +201,12 @@ int tcp_listen(socket_t *sock, int backlog) {
     if (sock->state != SOCK_BOUND || sock->type != SOCK_STREAM) return -1;
 
     sock->state = SOCK_LISTEN;
+
+    unsigned long flags;
+    spin_lock_irqsave(&socket_lock, &flags);
+    hash_insert(&listen_hash[port_hash(sock->local_port)], sock, 0);
+    spin_unlock_irqrestore(&socket_lock, flags);
+
     // Setup TCP listen queue (stub – full in tcp.c)
     tcp_listen_init(sock, backlog);
 
@@ -108,6 +231,13 @@ int tcp_accept(socket_t *sock, struct sockaddr *addr, socklen_t *addrlen) {
     new_sock->tcp_conn = new_conn;
     new_sock->state = SOCK_CONNECTED;
 
+    unsigned long irq_flags;
+    spin_lock_irqsave(&socket_lock, &irq_flags);
+    hash_insert(&tuple_hash[tuple_hash_fn(new_sock->local_addr, new_sock->local_port,
+                                          new_sock->remote_addr, new_sock->remote_port)],
+                new_sock, 1);
+    spin_unlock_irqrestore(&socket_lock, irq_flags);
+
     // Fill addr
     if (addr) {
         // Copy remote addr/port
@@ -136,6 +266,13 @@ int tcp_connect(socket_t *sock, const struct sockaddr *addr, socklen_t addrlen)
     sock->tcp_conn = conn;
     sock->state = SOCK_CONNECTED;
 
+    unsigned long flags;
+    spin_lock_irqsave(&socket_lock, flags);
+    hash_insert(&tuple_hash[tuple_hash_fn(sock->local_addr, sock->local_port,
+                                          sock->remote_addr, sock->remote_port)],
+                sock, 1);
+    spin_unlock_irqrestore(&socket_lock, flags);
+
     debug_print("Socket connected to port %d\n", ntohs(sock->remote_port));
     return 0;
 }
@@ -147,4 +284,148 @@ ssize_t socket_send(socket_t *sock, const void *buf, size_t len, int flags) {
     if (sock->type == SOCK_STREAM) {
         return tcp_send(sock->tcp_conn, buf, len, flags);
     } else if (sock->type == SOCK_DGRAM) {
-        return udp_send(sock, buf, len, flags
\ No newline at end of file
+        return udp_send(sock, buf, len, flags);
+    }
+    return -1;
+}
+
+/* Vectored send: gather the fragments once and hand the protocol a
+ * single buffer, so a header+payload pair becomes one packet and one
+ * trip down the stack instead of two */
+ssize_t socket_sendv(socket_t *sock, const iovec_t *iov, int iovcnt, int flags) {
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) total += iov[i].iov_len;
+
+    uint8_t *gather = kmalloc(total);
+    if (!gather) return -1;
+
+    size_t off = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(gather + off, iov[i].iov_base, iov[i].iov_len);
+        off += iov[i].iov_len;
+    }
+
+    ssize_t sent = socket_send(sock, gather, total, flags);
+    kfree(gather);
+    return sent;
+}
+
+/* Queue a received pbuf on a socket – called from udp_input. The socket
+ * takes its own reference; the RX path's reference is dropped back in
+ * net_rx_packet. */
+void socket_queue_rx(socket_t *sock, pbuf_t *pb) {
+    pbuf_ref(pb);
+    pb->next = NULL;
+
+    unsigned long flags;
+    spin_lock_irqsave(&sock->lock, &flags);
+    if (sock->rx_tail) sock->rx_tail->next = pb;
+    else sock->rx_head = pb;
+    sock->rx_tail = pb;
+    spin_unlock_irqrestore(&sock->lock, flags);
+
+    epoll_notify(&sock->watchers, POLLIN);
+}
+
+/* epoll integration – watcher chain anchor and current readiness */
+void **socket_watch(socket_t *sock) {
+    return &sock->watchers;
+}
+
+int socket_poll_ready(socket_t *sock) {
+    int events = POLLOUT;       // Sends don't block yet – always writable
+    if (sock->rx_head) events |= POLLIN;
+    return events;
+}
+
+/* Receive data – the ONLY copy on the RX path happens here */
+ssize_t socket_recv(socket_t *sock, void *buf, size_t len, int flags) {
+    if (sock->type == SOCK_STREAM) {
+        return tcp_recv(sock->tcp_conn, buf, len, flags);
+    }
+
+    // Datagram: block until a pbuf is queued, then copy out and release
+    unsigned long irq_flags;
+    spin_lock_irqsave(&sock->lock, irq_flags);
+    while (!sock->rx_head) {
+        sock->task = current_task;
+        spin_unlock_irqrestore(&sock->lock, irq_flags);
+        task_block(TASK_BLOCKED);
+        schedule();
+        spin_lock_irqsave(&sock->lock, irq_flags);
+    }
+
+    pbuf_t *pb = sock->rx_head;
+    sock->rx_head = pb->next;
+    if (!sock->rx_head) sock->rx_tail = NULL;
+    spin_unlock_irqrestore(&sock->lock, irq_flags);
+
+    size_t copy = pbuf_len(pb);
+    if (copy > len) copy = len;         // Excess datagram bytes are dropped
+    memcpy(buf, pbuf_data(pb), copy);
+
+    pbuf_free(pb);
+    return copy;
+}
+
+/* Batched send – one kernel crossing for a whole array of datagrams.
+ * UDP goes through udp_send_batch so headers are built in one pass and
+ * the NIC sees one doorbell; other types fall back to a send loop. */
+int socket_sendmmsg(socket_t *sock, mmsg_t *msgs, int n, int flags) {
+    if (sock->state != SOCK_CONNECTED) return -1;
+
+    if (sock->type == SOCK_DGRAM)
+        return udp_send_batch(sock, msgs, n);
+
+    int sent = 0;
+    for (int i = 0; i < n; i++) {
+        ssize_t ret = socket_send(sock, msgs[i].buf, msgs[i].len, flags);
+        if (ret < 0) break;
+        msgs[i].msg_len = ret;
+        sent++;
+    }
+    return sent;
+}
+
+/* Batched receive – blocks for the first datagram only, then drains
+ * whatever else is already queued into the remaining buffers */
+int socket_recvmmsg(socket_t *sock, mmsg_t *msgs, int n, int flags) {
+    if (sock->type != SOCK_DGRAM || n <= 0) return -1;
+
+    ssize_t first = socket_recv(sock, msgs[0].buf, msgs[0].len, flags);
+    if (first < 0) return -1;
+    msgs[0].msg_len = first;
+    int filled = 1;
+
+    unsigned long irq_flags;
+    spin_lock_irqsave(&sock->lock, irq_flags);
+    while (filled < n && sock->rx_head) {
+        pbuf_t *pb = sock->rx_head;
+        sock->rx_head = pb->next;
+        if (!sock->rx_head) sock->rx_tail = NULL;
+        spin_unlock_irqrestore(&sock->lock, irq_flags);
+
+        size_t copy = pbuf_len(pb);
+        if (copy > msgs[filled].len) copy = msgs[filled].len;
+        memcpy(msgs[filled].buf, pbuf_data(pb), copy);
+        msgs[filled].msg_len = copy;
+        pbuf_free(pb);
+        filled++;
+
+        spin_lock_irqsave(&sock->lock, irq_flags);
+    }
+    spin_unlock_irqrestore(&sock->lock, irq_flags);
+
+    return filled;
+}
+
+/* Module init – reset the socket table and lookup structures */
+void socket_init(void) {
+    memset(sockets, 0, sizeof(sockets));
+    memset(socket_used, 0, sizeof(socket_used));
+    memset(udp_hash, 0, sizeof(udp_hash));
+    memset(listen_hash, 0, sizeof(listen_hash));
+    memset(tuple_hash, 0, sizeof(tuple_hash));
+    debug_print("Sockets initialized (%d max, %d hash buckets)\n",
+                MAX_SOCKETS, SOCKET_HASH_BUCKETS);
+}
@@ -13,6 +13,7 @@
 #include "tcp.h"
 #include "udp.h"
 #include "socket.h"
+#include <string.h>
 
 #define NET_RX_QUEUES   4
 #define NET_TX_QUEUES   4
@@ -21,9 +22,59 @@
 static net_queue_t rx_queue[NET_RX_QUEUES];
 static net_queue_t tx_queue[NET_TX_QUEUES];
 
+/* One protocol-processing task per RX queue, pinned to its CPU so a
+ * flow's TCP/socket state always warms the same cache */
+static task_t *rx_worker[NET_RX_QUEUES];
+
+/* Devices in poll mode, chained per queue. A NIC joins the list when
+ * its ISR calls net_rx_schedule and leaves when a poll pass drains its
+ * ring below the budget. */
+static netdev_t *napi_head[NET_RX_QUEUES];
+static spinlock_t napi_lock[NET_RX_QUEUES];
+
+/* Queue primitives – 1024-slot ring, drops counted when full */
+void net_queue_init(net_queue_t *q)
+{
+    q->head = q->tail = 0;
+    q->pkt_count = q->drop_count = 0;
+    spinlock_init(&q->lock);
+}
+
+void net_queue_enqueue(net_queue_t *q, void *pkt, size_t len)
+{
+    spin_lock(&q->lock);
+    int next = (q->head + 1) % 1024;
+    if (next == q->tail) {
+        q->drop_count++;
+        spin_unlock(&q->lock);
+        pbuf_free(pkt);
+        return;
+    }
+    q->packets[q->head] = pkt;
+    q->sizes[q->head] = len;
+    q->head = next;
+    q->pkt_count++;
+    spin_unlock(&q->lock);
+}
+
+int net_queue_dequeue(net_queue_t *q, void **pkt, size_t *len)
+{
+    spin_lock(&q->lock);
+    if (q->tail == q->head) {
+        spin_unlock(&q->lock);
+        return -1;
+    }
+    *pkt = q->packets[q->tail];
+    *len = q->sizes[q->tail];
+    q->tail = (q->tail + 1) % 1024;
+    spin_unlock(&q->lock);
+    return 0;
+}
+
 /* Network device registration */
 void netdev_register(netdev_t *dev)
 {
+    pbuf_pool_init();           // First NIC brings up the packet buffer pool
     dev->rx_queue = &rx_queue[get_cpu_id() % NET_RX_QUEUES];
     dev->tx_queue = &tx_queue[get_cpu_id() % NET_TX_QUEUES];
     debug_print("Net: %s registered (MAC %02x:%02x:%02x:%02x:%02x:%02x)\n",
@@ -32,16 +83,170 @@ void netdev_register(netdev_t *dev)
                 dev->mac[3], dev->mac[4], dev->mac[5]);
 }
 
-/* Packet receive – called from NIC driver */
-void net_rx_packet(netdev_t *dev, void *data, size_t len)
+/* RSS flow hash – 4-tuple for TCP/UDP, src/dst IP otherwise, so every
+ * packet of a flow lands on the same queue and the same CPU */
+static int net_rx_steer(pbuf_t *pb)
+{
+    eth_hdr_t *eth = pbuf_data(pb);
+    if (htons(eth->type) != ETH_P_IP)
+        return -1;              // ARP/IPv6: process inline
+
+    uint8_t *ip = (uint8_t *)pbuf_data(pb) + ETH_HDR_SIZE;
+    uint8_t proto = ip[9];
+    uint64_t key;
+    memcpy(&key, ip + 12, 8);   // src_ip | dst_ip
+
+    if (proto == 6 || proto == 17) {
+        size_t hdr_len = (ip[0] & 0xF) * 4;
+        uint32_t ports;
+        memcpy(&ports, ip + hdr_len, 4);
+        key ^= (uint64_t)ports << 13;
+    }
+
+    return (int)((key * 0x9E3779B97F4A7C15ULL) >> 56) % NET_RX_QUEUES;
+}
+
+/* Deliver one frame to the protocol layers on the current CPU */
+static void net_rx_deliver(netdev_t *dev, pbuf_t *pb)
 {
-    eth_hdr_t *eth = data;
+    eth_hdr_t *eth = pbuf_data(pb);
 
     switch (htons(eth->type)) {
-        case ETH_P_ARP:  arp_input(dev, data, len); break;
-        case ETH_P_IP:   ipv4_input(dev, data, len); break;
-        case ETH_P_IPV6: ipv6_input(dev, data, len); break;
+        case ETH_P_ARP:  arp_input(dev, pb); break;
+        case ETH_P_IP:   ipv4_input(dev, pb); break;
+        case ETH_P_IPV6: ipv6_input(dev, pb); break;
     }
+
+    pbuf_free(pb);
+}
+
+/* NAPI scheduling – called from the NIC ISR after it masked its RX
+ * interrupt. First caller wins; further interrupts shouldn't arrive
+ * while masked, but the flag keeps a racing second queue attempt out. */
+void net_rx_schedule(netdev_t *dev)
+{
+    if (__atomic_exchange_n(&dev->napi_scheduled, 1, __ATOMIC_ACQ_REL))
+        return;
+
+    int q = get_cpu_id() % NET_RX_QUEUES;
+    spin_lock(&napi_lock[q]);
+    dev->napi_next = napi_head[q];
+    napi_head[q] = dev;
+    spin_unlock(&napi_lock[q]);
+
+    if (rx_worker[q])
+        task_wakeup(rx_worker[q]);
+}
+
+/* One poll pass over every device in poll mode on this queue. A device
+ * that fills its whole budget stays on the list (and bumps the
+ * budget-exhausted counter); one that comes up short has an empty ring,
+ * so it leaves poll mode and gets its interrupt back. */
+static int net_napi_poll(int q)
+{
+    /* Detach the whole list first: the ISR prepends to napi_head while
+     * a device polls with the lock dropped, so a cursor held into the
+     * shared list across poll() could unlink the wrong device. */
+    spin_lock(&napi_lock[q]);
+    netdev_t *list = napi_head[q];
+    napi_head[q] = NULL;
+    spin_unlock(&napi_lock[q]);
+
+    netdev_t *again = NULL;
+    int active = 0;
+
+    while (list) {
+        netdev_t *dev = list;
+        list = dev->napi_next;
+
+        int done = dev->poll ? dev->poll(dev, NET_NAPI_BUDGET) : 0;
+
+        if (done >= NET_NAPI_BUDGET) {
+            rx_queue[q].budget_exhausted++;
+            active = 1;
+            dev->napi_next = again;
+            again = dev;
+        } else {
+            __atomic_store_n(&dev->napi_scheduled, 0, __ATOMIC_RELEASE);
+            if (dev->irq_enable)
+                dev->irq_enable(dev);
+        }
+    }
+
+    if (again) {
+        /* Splice the still-active devices back in front of whatever
+         * the ISR queued while we polled */
+        spin_lock(&napi_lock[q]);
+        netdev_t **tail = &again;
+        while (*tail)
+            tail = &(*tail)->napi_next;
+        *tail = napi_head[q];
+        napi_head[q] = again;
+        spin_unlock(&napi_lock[q]);
+    }
+
+    return active;
+}
+
+/* Per-queue protocol worker – drains steered packets and polls NAPI
+ * devices, sleeps when both are empty */
+static void net_rx_work(void)
+{
+    int q = get_cpu_id() % NET_RX_QUEUES;
+
+    while (1) {
+        void *pkt;
+        size_t len;
+        while (net_queue_dequeue(&rx_queue[q], &pkt, &len) == 0) {
+            pbuf_t *pb = pkt;
+            net_rx_deliver(pb->dev, pb);
+        }
+
+        if (net_napi_poll(q)) {
+            yield();        // Still under load – stay runnable
+            continue;
+        }
+
+        task_block(TASK_BLOCKED);
+        schedule();
+    }
+}
+
+/* Packet receive – called from NIC driver with a pool pbuf. The buffer
+ * travels by reference; layers that keep it (UDP socket queues) take
+ * their own reference, so dropping ours here frees unclaimed packets.
+ * The flow hash steers each flow to one consistent queue; a packet for
+ * another CPU's queue is handed to that queue's worker rather than
+ * processed here. */
+void net_rx_packet(netdev_t *dev, pbuf_t *pb)
+{
+    pb->dev = dev;
+
+    int q = net_rx_steer(pb);
+    if (q < 0 || q == get_cpu_id() % NET_RX_QUEUES || !rx_worker[q]) {
+        net_rx_deliver(dev, pb);
+        return;
+    }
+
+    net_queue_enqueue(&rx_queue[q], pb, pbuf_len(pb));
+    task_wakeup(rx_worker[q]);
+}
+
+/* Frame transmit – single frame, and batched with one doorbell */
+void net_tx_packet(netdev_t *dev, void *pkt, size_t len)
+{
+    if (dev->tx_func)
+        dev->tx_func(dev, pkt, len);
+}
+
+void net_tx_batch(netdev_t *dev, void **pkts, size_t *lens, int n)
+{
+    if (dev->tx_batch) {
+        dev->tx_batch(dev, pkts, lens, n);
+        return;
+    }
+    for (int i = 0; i < n; i++)
+        net_tx_packet(dev, pkts[i], lens[i]);
 }
 
 /* Socket API */
@@ -92,15 +297,41 @@ ssize_t recv(int sockfd, void *buf, size_t len, int flags)
     return socket_recv(sock, buf, len, flags);
 }
 
+/* Batched datagram calls – many messages per kernel crossing */
+int sendmmsg(int sockfd, mmsg_t *msgs, int n, int flags)
+{
+    socket_t *sock = socket_get(sockfd);
+    if (!sock) return -1;
+    return socket_sendmmsg(sock, msgs, n, flags);
+}
+
+int recvmmsg(int sockfd, mmsg_t *msgs, int n, int flags)
+{
+    socket_t *sock = socket_get(sockfd);
+    if (!sock) return -1;
+    return socket_recvmmsg(sock, msgs, n, flags);
+}
+
 /* Module init – start networking */
 _kernel_oserror *module_init(const char *arg, int podule)
 {
-    for (int i = 0; i < NET_RX_QUEUES; i++)
+    for (int i = 0; i < NET_RX_QUEUES; i++) {
         net_queue_init(&rx_queue[i]);
+        napi_head[i] = NULL;
+        spinlock_init(&napi_lock[i]);
+    }
     for (int i = 0; i < NET_TX_QUEUES; i++)
         net_queue_init(&tx_queue[i]);
 
+    /* One pinned worker per RX queue – queue i runs on CPU i */
+    static const char *worker_names[NET_RX_QUEUES] = {
+        "NetRX0", "NetRX1", "NetRX2", "NetRX3"
+    };
+    for (int i = 0; i < NET_RX_QUEUES; i++)
+        rx_worker[i] = task_create(worker_names[i], net_rx_work, 5, (1ULL << i));
+
     arp_init();
+    route_init();
     ipv4_init();
     ipv6_init();
     tcp_init();
@@ -5,6 +5,7 @@
  */
 
 #include "kernel.h"
+#include "memops.h"
 #include "net.h"
 #include "ipv4.h"
 #include "ipv6.h"
@@ -19,23 +20,26 @@ typedef struct udp_hdr {
 } udp_hdr_t;
 
 /* UDP input – from IP layer */
-void udp_input(netdev_t *dev, void *data, size_t len) {
-    udp_hdr_t *udp = data;
+void udp_input(netdev_t *dev, pbuf_t *pb) {
+    udp_hdr_t *udp = pbuf_data(pb);
     uint16_t src_port = ntohs(udp->src_port);
     uint16_t dst_port = ntohs(udp->dst_port);
     uint16_t udp_len = ntohs(udp->length);
 
-    if (udp_len < sizeof(udp_hdr_t) || udp_len > len) return;
+    if (udp_len < sizeof(udp_hdr_t) || udp_len > pbuf_len(pb)) return;
 
     // Validate checksum (optional for IPv4, mandatory for IPv6)
-    if (udp_checksum(data, udp_len, dev->ip_version) != 0) return;
+    if (udp_checksum(udp, udp_len, dev->ip_version) != 0) return;
 
     // Find socket
     socket_t *sock = socket_find_udp(dst_port);
     if (!sock) return;
 
-    // Enqueue data
-    ring_write(&sock->rx_queue, (uint8_t*)udp + sizeof(udp_hdr_t), udp_len - sizeof(udp_hdr_t));
+    // Hand the buffer itself to the socket – the payload is copied out
+    // only when the task calls recv()
+    pb->offset += sizeof(udp_hdr_t);
+    pb->len = pb->offset + (udp_len - sizeof(udp_hdr_t));
+    socket_queue_rx(sock, pb);
 
     // Wake waiting task
     task_wakeup(sock->task);
@@ -68,10 +72,85 @@ int udp_send(socket_t *sock, const void *buf, size_t len, int flags) {
     return len;
 }
 
+/* Batched UDP send – build every frame in one pass and hand the NIC
+ * the whole chain with a single doorbell. All datagrams of the batch
+ * share the connection's 4-tuple, so the Ethernet header, the fixed IP
+ * fields, the UDP ports, and the checksum pseudo-sum are computed once;
+ * per message only lengths, checksums, and payload differ. */
+#define UDP_BATCH_MAX   64
+
+int udp_send_batch(socket_t *sock, mmsg_t *msgs, int n) {
+    if (sock->type != SOCK_DGRAM || sock->domain != AF_INET) return -1;
+    if (n > UDP_BATCH_MAX) n = UDP_BATCH_MAX;
+
+    netdev_t *dev = sock->dev;
+    uint8_t dst_mac[6];
+    if (arp_resolve(dev, sock->remote_addr, dst_mac) != 0) return -1;
+
+    /* Shared pieces, computed once per batch */
+    uint64_t pseudo_base = 0;
+    pseudo_base += (sock->remote_addr >> 16) + (sock->remote_addr & 0xFFFF);
+    pseudo_base += (sock->local_addr >> 16) + (sock->local_addr & 0xFFFF);
+    pseudo_base += IP_PROTO_UDP;
+    pseudo_base += htons(sock->local_port) + htons(sock->remote_port);
+
+    void *pkts[UDP_BATCH_MAX];
+    size_t lens[UDP_BATCH_MAX];
+    int built = 0;
+
+    for (int i = 0; i < n; i++) {
+        size_t dlen = msgs[i].len;
+        size_t frame_len = ETH_HDR_SIZE + 20 + sizeof(udp_hdr_t) + dlen;
+        uint8_t *frame = kmalloc(frame_len);
+        if (!frame) break;
+
+        eth_hdr_t *eth = (eth_hdr_t *)frame;
+        uint8_t *ip = frame + ETH_HDR_SIZE;
+        udp_hdr_t *udp = (udp_hdr_t *)(ip + 20);
+
+        memcpy(eth->dst, dst_mac, 6);
+        memcpy(eth->src, dev->mac, 6);
+        eth->type = htons(ETH_P_IP);
+
+        ip[0] = (4 << 4) | 5;   // IPv4, 20-byte header
+        ip[1] = 0;
+        *(uint16_t *)(ip + 2) = htons(20 + sizeof(udp_hdr_t) + dlen);
+        *(uint16_t *)(ip + 4) = 0;
+        *(uint16_t *)(ip + 6) = 0;
+        ip[8] = 64;             // TTL
+        ip[9] = IP_PROTO_UDP;
+        *(uint16_t *)(ip + 10) = 0;
+        *(uint32_t *)(ip + 12) = sock->local_addr;
+        *(uint32_t *)(ip + 16) = sock->remote_addr;
+        *(uint16_t *)(ip + 10) = ip_checksum(ip, 20);
+
+        udp->src_port = htons(sock->local_port);
+        udp->dst_port = htons(sock->remote_port);
+        udp->length = htons(sizeof(udp_hdr_t) + dlen);
+        udp->checksum = 0;
+        memcpy((uint8_t *)udp + sizeof(udp_hdr_t), msgs[i].buf, dlen);
+
+        uint64_t sum = pseudo_base + udp->length + udp->length;
+        udp->checksum = csum_fold(csum_partial((uint8_t *)udp + sizeof(udp_hdr_t),
+                                               dlen, sum));
+
+        pkts[built] = frame;
+        lens[built] = frame_len;
+        msgs[i].msg_len = dlen;
+        built++;
+    }
+
+    if (built)
+        net_tx_batch(dev, pkts, lens, built);
+    for (int i = 0; i < built; i++)
+        kfree(pkts[i]);
+
+    return built;
+}
+
 /* UDP checksum (IPv4 pseudo-header) */
 uint16_t udp_checksum(void *data, size_t len, int ip_ver) {
-    uint32_t sum = 0;
-    uint16_t *p = data;
+    uint64_t sum = 0;
 
     // Pseudo-header for IPv4
     if (ip_ver == 4) {
@@ -83,24 +162,7 @@ uint16_t udp_checksum(void *data, size_t len, int ip_ver) {
         // IPv6 pseudo-header (stub)
     }
 
-    while (len > 1) {
-        sum += *p++;
-        len -= 2;
-    }
-    if (len) sum += *(uint8_t*)p;
-
-    sum = (sum >> 16) + (sum & 0xFFFF);
-    sum += (sum >> 16);
-    return ~sum;
-}
-
-/* Find UDP socket by port */
-socket_t *socket_find_udp(uint16_t port) {
-    for (int i = 0; i < num_sockets; i++) {
-        socket_t *s = &sockets[i];
-        if (s->type == SOCK_DGRAM && s->local_port == port) return s;
-    }
-    return NULL;
+    return csum_fold(csum_partial(data, len, sum));
 }
 
 /* Init UDP subsystem */
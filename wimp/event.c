@@ -39,7 +39,10 @@ void wimp_dispatch_event(wimp_event_t *event)
             break;
 
         case wimp_REDRAW_WINDOW_REQUEST:
-            gpu_redraw_window(event->redraw.window);
+            /* Clear the coalescing flag before the blit so damage that
+             * lands mid-redraw queues a fresh event for next frame */
+            event->redraw.window->redraw_queued = 0;
+            wimp_composite_frame();
             break;
 
         case wimp_MENU_SELECTION:
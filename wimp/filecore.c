@@ -8,7 +8,7 @@
 
 #include "kernel.h"
 #include "vfs.h"
-#include "blockdev.h"
+#include "blockdriver.h"
 #include "filecore.h"
 #include <string.h>
 
@@ -196,7 +196,8 @@ int fcore_exec(const char *path)
 _kernel_oserror *module_init(const char *arg, int podule)
 {
     // Auto-mount on all block devices (stub)
-    for (int i = 0; i < blockdev_count; i++) {
-        fcore_mount(blockdev_list[i], "/");
+    blockdev_snap_t *snap = blockdev_snapshot();
+    for (int i = 0; snap && i < snap->count; i++) {
+        fcore_mount(snap->devs[i], "/");
     }
     debug_print("FileCore loaded –
\ No newline at end of file
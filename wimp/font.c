@@ -0,0 +1,117 @@
+/*
+ * font.c – Built-in bitmap font engine for RISC OS Phoenix Wimp
+ * 8x8 ROM glyphs scaled by pixel replication into 8-bit coverage
+ * bitmaps; backs the glyph atlas in glyph.c until an outline font
+ * manager lands
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include <stdint.h>
+
+/* One byte per row, MSB on the left. Lowercase maps onto uppercase;
+ * anything the ROM does not cover renders as a hollow box. */
+
+static const uint8_t font_upper[26][8] = {
+    {0x18,0x3C,0x66,0x66,0x7E,0x66,0x66,0x00},  // A
+    {0x7C,0x66,0x66,0x7C,0x66,0x66,0x7C,0x00},  // B
+    {0x3C,0x66,0x60,0x60,0x60,0x66,0x3C,0x00},  // C
+    {0x78,0x6C,0x66,0x66,0x66,0x6C,0x78,0x00},  // D
+    {0x7E,0x60,0x60,0x78,0x60,0x60,0x7E,0x00},  // E
+    {0x7E,0x60,0x60,0x78,0x60,0x60,0x60,0x00},  // F
+    {0x3C,0x66,0x60,0x6E,0x66,0x66,0x3C,0x00},  // G
+    {0x66,0x66,0x66,0x7E,0x66,0x66,0x66,0x00},  // H
+    {0x3C,0x18,0x18,0x18,0x18,0x18,0x3C,0x00},  // I
+    {0x1E,0x0C,0x0C,0x0C,0x0C,0x6C,0x38,0x00},  // J
+    {0x66,0x6C,0x78,0x70,0x78,0x6C,0x66,0x00},  // K
+    {0x60,0x60,0x60,0x60,0x60,0x60,0x7E,0x00},  // L
+    {0x63,0x77,0x7F,0x6B,0x63,0x63,0x63,0x00},  // M
+    {0x66,0x76,0x7E,0x7E,0x6E,0x66,0x66,0x00},  // N
+    {0x3C,0x66,0x66,0x66,0x66,0x66,0x3C,0x00},  // O
+    {0x7C,0x66,0x66,0x7C,0x60,0x60,0x60,0x00},  // P
+    {0x3C,0x66,0x66,0x66,0x66,0x3C,0x0E,0x00},  // Q
+    {0x7C,0x66,0x66,0x7C,0x78,0x6C,0x66,0x00},  // R
+    {0x3C,0x66,0x60,0x3C,0x06,0x66,0x3C,0x00},  // S
+    {0x7E,0x18,0x18,0x18,0x18,0x18,0x18,0x00},  // T
+    {0x66,0x66,0x66,0x66,0x66,0x66,0x3C,0x00},  // U
+    {0x66,0x66,0x66,0x66,0x66,0x3C,0x18,0x00},  // V
+    {0x63,0x63,0x63,0x6B,0x7F,0x77,0x63,0x00},  // W
+    {0x66,0x66,0x3C,0x18,0x3C,0x66,0x66,0x00},  // X
+    {0x66,0x66,0x66,0x3C,0x18,0x18,0x18,0x00},  // Y
+    {0x7E,0x06,0x0C,0x18,0x30,0x60,0x7E,0x00},  // Z
+};
+
+static const uint8_t font_digit[10][8] = {
+    {0x3C,0x66,0x6E,0x76,0x66,0x66,0x3C,0x00},  // 0
+    {0x18,0x38,0x18,0x18,0x18,0x18,0x7E,0x00},  // 1
+    {0x3C,0x66,0x06,0x0C,0x18,0x30,0x7E,0x00},  // 2
+    {0x3C,0x66,0x06,0x1C,0x06,0x66,0x3C,0x00},  // 3
+    {0x0C,0x1C,0x3C,0x6C,0x7E,0x0C,0x0C,0x00},  // 4
+    {0x7E,0x60,0x7C,0x06,0x06,0x66,0x3C,0x00},  // 5
+    {0x1C,0x30,0x60,0x7C,0x66,0x66,0x3C,0x00},  // 6
+    {0x7E,0x06,0x0C,0x18,0x30,0x30,0x30,0x00},  // 7
+    {0x3C,0x66,0x66,0x3C,0x66,0x66,0x3C,0x00},  // 8
+    {0x3C,0x66,0x66,0x3E,0x06,0x0C,0x38,0x00},  // 9
+};
+
+static const uint8_t font_blank[8] = {0};
+static const uint8_t font_box[8] =
+    {0x7E,0x42,0x42,0x42,0x42,0x42,0x7E,0x00};
+
+static const uint8_t font_punct[][8] = {
+    {0x18,0x18,0x18,0x18,0x18,0x00,0x18,0x00},  // !
+    {0x00,0x00,0x00,0x00,0x00,0x18,0x18,0x00},  // .
+    {0x00,0x00,0x00,0x00,0x00,0x18,0x18,0x30},  // ,
+    {0x00,0x18,0x18,0x00,0x00,0x18,0x18,0x00},  // :
+    {0x00,0x18,0x18,0x00,0x00,0x18,0x18,0x30},  // ;
+    {0x00,0x00,0x00,0x7E,0x00,0x00,0x00,0x00},  // -
+    {0x00,0x18,0x18,0x7E,0x18,0x18,0x00,0x00},  // +
+    {0x00,0x00,0x7E,0x00,0x7E,0x00,0x00,0x00},  // =
+    {0x00,0x06,0x0C,0x18,0x30,0x60,0x00,0x00},  // /
+    {0x0C,0x18,0x30,0x30,0x30,0x18,0x0C,0x00},  // (
+    {0x30,0x18,0x0C,0x0C,0x0C,0x18,0x30,0x00},  // )
+    {0x3C,0x66,0x06,0x0C,0x18,0x00,0x18,0x00},  // ?
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x7E},  // _
+};
+
+static const char font_punct_map[] = "!.,:;-+=/()?_";
+
+static const uint8_t *font_rom_glyph(uint32_t ch)
+{
+    if (ch >= 'a' && ch <= 'z') ch -= 'a' - 'A';
+    if (ch >= 'A' && ch <= 'Z') return font_upper[ch - 'A'];
+    if (ch >= '0' && ch <= '9') return font_digit[ch - '0'];
+    if (ch == ' ') return font_blank;
+
+    for (int i = 0; font_punct_map[i]; i++)
+        if ((uint32_t)font_punct_map[i] == ch)
+            return font_punct[i];
+
+    return font_box;
+}
+
+/* Rasterize one glyph at the requested pixel size into an 8-bit
+ * coverage bitmap. ROM rows are replicated by an integer scale, so
+ * sizes snap to multiples of 8; the caller's buffer is at least
+ * GLYPH_BITMAP_MAX (64x64), which caps the scale at 8. */
+int font_rasterize_glyph(uint32_t ch, int size, uint8_t *buf,
+                         int *w, int *h, int *advance)
+{
+    int scale = size / 8;
+    if (scale < 1) scale = 1;
+    if (scale > 8) scale = 8;
+
+    const uint8_t *rows = font_rom_glyph(ch);
+    int dim = 8 * scale;
+
+    for (int y = 0; y < dim; y++) {
+        uint8_t bits = rows[y / scale];
+        for (int x = 0; x < dim; x++)
+            buf[y * dim + x] = (bits & (0x80 >> (x / scale))) ? 255 : 0;
+    }
+
+    *w = dim;
+    *h = dim;
+    *advance = dim;     // The ROM face is monospaced
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * glyph.c – Glyph atlas cache for RISC OS Phoenix Wimp
+ * Rasterizes each (character, size) pair once into a shared GPU atlas;
+ * strings render as batched textured quads through the blit pipeline
+ * Author: R Andrews Grok 4 – 31 Aug 2026
+ */
+
+#include "kernel.h"
+#include "wimp.h"
+#include "gpu.h"
+#include <string.h>
+
+#define GLYPH_ATLAS_W       1024
+#define GLYPH_ATLAS_H       1024
+#define GLYPH_MAX           1024
+#define GLYPH_HASH_BUCKETS  512
+#define GLYPH_BITMAP_MAX    (64 * 64)   // Largest glyph we rasterize
+#define GLYPH_BATCH_MAX     128         // Quads flushed per draw
+
+/* Font engine – rasterizes one glyph into an 8-bit coverage bitmap */
+extern int font_rasterize_glyph(uint32_t ch, int size, uint8_t *buf,
+                                int *w, int *h, int *advance);
+
+typedef struct glyph {
+    struct glyph *hash_next;
+    uint32_t ch;
+    int size;
+    int x, y, w, h;         // Location in the atlas
+    int advance;
+} glyph_t;
+
+static glyph_t glyph_pool[GLYPH_MAX];
+static int glyph_count;
+static glyph_t *glyph_hash[GLYPH_HASH_BUCKETS];
+
+static struct gpu_texture *glyph_atlas;
+
+/* Shelf packer state – glyphs fill left to right, shelves stack down */
+static int shelf_x, shelf_y, shelf_h;
+
+/* Upload staging – coverage expanded to the atlas's 32-bit format,
+ * white with coverage in alpha so draws tint it with the text colour */
+static uint32_t glyph_stage[GLYPH_BITMAP_MAX];
+
+/* All text comes from the Wimp task, so the cache needs no locking */
+
+static uint32_t glyph_hash_fn(uint32_t ch, int size)
+{
+    uint64_t key = ((uint64_t)size << 32) | ch;
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 55) % GLYPH_HASH_BUCKETS;
+}
+
+/* Atlas full – throw everything away and repack. Happens once per
+ * lifetime of a typical desktop's character set, if at all. */
+static void glyph_cache_reset(void)
+{
+    memset(glyph_hash, 0, sizeof(glyph_hash));
+    glyph_count = 0;
+    shelf_x = shelf_y = shelf_h = 0;
+    debug_print("Glyph: atlas reset\n");
+}
+
+/* Look up a (character, size) pair, rasterizing and uploading it on
+ * first use. Every later hit is a hash probe – no CPU rasterization,
+ * no texture upload. */
+static glyph_t *glyph_get(uint32_t ch, int size)
+{
+    uint32_t b = glyph_hash_fn(ch, size);
+    for (glyph_t *g = glyph_hash[b]; g; g = g->hash_next)
+        if (g->ch == ch && g->size == size)
+            return g;
+
+    if (!glyph_atlas) {
+        glyph_atlas = gpu_create_texture(GLYPH_ATLAS_W, GLYPH_ATLAS_H);
+        if (!glyph_atlas) return NULL;
+    }
+
+    uint8_t bitmap[GLYPH_BITMAP_MAX];
+    int w, h, advance;
+    if (font_rasterize_glyph(ch, size, bitmap, &w, &h, &advance) != 0)
+        return NULL;
+
+    if (glyph_count >= GLYPH_MAX)
+        glyph_cache_reset();
+
+    /* Shelf packing: next slot on the current shelf, or a new shelf */
+    if (shelf_x + w > GLYPH_ATLAS_W) {
+        shelf_y += shelf_h;
+        shelf_x = shelf_h = 0;
+    }
+    if (shelf_y + h > GLYPH_ATLAS_H) {
+        glyph_cache_reset();
+        b = glyph_hash_fn(ch, size);
+    }
+
+    glyph_t *g = &glyph_pool[glyph_count++];
+    g->ch = ch;
+    g->size = size;
+    g->x = shelf_x;
+    g->y = shelf_y;
+    g->w = w;
+    g->h = h;
+    g->advance = advance;
+
+    shelf_x += w;
+    if (h > shelf_h) shelf_h = h;
+
+    for (int i = 0; i < w * h; i++)
+        glyph_stage[i] = ((uint32_t)bitmap[i] << 24) | 0x00FFFFFF;
+    gpu_texture_update(glyph_atlas, g->x, g->y, w, h, glyph_stage);
+
+    g->hash_next = glyph_hash[b];
+    glyph_hash[b] = g;
+    return g;
+}
+
+/* Render a string as batched quads from the atlas – one draw call per
+ * GLYPH_BATCH_MAX characters instead of one upload per character */
+void gpu_draw_text_sized(int x, int y, const char *text, uint32_t color,
+                         int size)
+{
+    gpu_quad_t quads[GLYPH_BATCH_MAX];
+    int n = 0;
+    int pen = x;
+
+    for (const char *p = text; *p; p++) {
+        glyph_t *g = glyph_get((uint32_t)(uint8_t)*p, size);
+        if (!g) continue;
+
+        quads[n].dx0 = pen;
+        quads[n].dy0 = y;
+        quads[n].dx1 = pen + g->w;
+        quads[n].dy1 = y + g->h;
+        quads[n].sx0 = g->x;
+        quads[n].sy0 = g->y;
+        quads[n].sx1 = g->x + g->w;
+        quads[n].sy1 = g->y + g->h;
+        n++;
+
+        pen += g->advance;
+
+        if (n == GLYPH_BATCH_MAX) {
+            gpu_draw_quad_batch(glyph_atlas, quads, n, color);
+            n = 0;
+        }
+    }
+
+    if (n > 0)
+        gpu_draw_quad_batch(glyph_atlas, quads, n, color);
+}
+
+/* Default text size used by menus and window furniture */
+void gpu_draw_text(int x, int y, const char *text, uint32_t color)
+{
+    gpu_draw_text_sized(x, y, text, color, 16);
+}
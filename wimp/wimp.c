@@ -22,61 +22,129 @@
 #define MOUSE_MENU      2   // Middle button → context menu
 #define MOUSE_ADJUST    4   // Right button
 
+/* Lock-free MPSC event ring. Producers are IRQ handlers and kernel
+ * tasks on any core; the only consumer is the Wimp poll loop. Each
+ * slot carries a sequence number: seq == pos means free for the
+ * producer that claims pos, seq == pos+1 means the event is written
+ * and visible to the consumer. Claiming a slot is one CAS on head, so
+ * input interrupts never spin on a lock held by a redraw generator. */
 typedef struct wimp_event_queue {
     wimp_event_t events[MAX_EVENTS];
-    int head, tail;
-    spinlock_t lock;
+    volatile uint32_t seq[MAX_EVENTS];
+    volatile uint32_t head;             // Next slot producers claim
+    volatile uint32_t tail;             // Next slot the consumer reads
+    uint32_t high_water;                // Deepest the queue has been
+    uint32_t drops;                     // Events lost to a full ring
 } wimp_event_queue_t;
 
 static wimp_event_queue_t event_queue;
 
+/* Pointer moves arrive faster than any app repaints; only the latest
+ * position matters. One ring entry stands for "pointer moved" and the
+ * payload lives in a side slot overwritten in place. (Redraw events
+ * get the same treatment upstream via win->redraw_queued.) */
+static wimp_event_t pointer_latest;
+static volatile int pointer_pending;
+
 static window_t windows[MAX_WINDOWS];
 static int num_windows = 0;
 
 static void wimp_init(void) {
     memset(windows, 0, sizeof(windows));
     memset(&event_queue, 0, sizeof(event_queue));
-    spinlock_init(&event_queue.lock);
+    for (uint32_t i = 0; i < MAX_EVENTS; i++)
+        event_queue.seq[i] = i;
     gpu_init();  // Initialize GPU acceleration
     debug_print("Wimp initialized – desktop ready\n");
 }
 
 /* Poll for events – cooperative at app level */
 int Wimp_Poll(int mask, wimp_event_t *event) {
-    unsigned long flags;
-    spin_lock_irqsave(&event_queue.lock, flags);
+    uint32_t pos = event_queue.tail;
+    uint32_t s = __atomic_load_n(&event_queue.seq[pos % MAX_EVENTS],
+                                 __ATOMIC_ACQUIRE);
 
-    if (event_queue.head == event_queue.tail) {
-        spin_unlock_irqrestore(&event_queue.lock, flags);
-        yield();  // Allow kernel preemption while idle
+    if ((int32_t)(s - (pos + 1)) < 0) {
+        yield();  // Empty – allow kernel preemption while idle
         return wimp_NULL_REASON_CODE;
     }
 
-    *event = event_queue.events[event_queue.tail % MAX_EVENTS];
-    event_queue.tail++;
+    *event = event_queue.events[pos % MAX_EVENTS];
+
+    /* Recycle the slot for the producer one lap ahead */
+    __atomic_store_n(&event_queue.seq[pos % MAX_EVENTS],
+                     pos + MAX_EVENTS, __ATOMIC_RELEASE);
+    event_queue.tail = pos + 1;
+
+    if (event->type == wimp_POINTER_MOVE) {
+        /* Drop the coalescing flag first so a move landing after the
+         * copy queues a fresh entry rather than being lost */
+        __atomic_store_n(&pointer_pending, 0, __ATOMIC_RELEASE);
+        *event = pointer_latest;
+    }
 
-    spin_unlock_irqrestore(&event_queue.lock, flags);
     return event->type;
 }
 
-/* Internal event enqueue */
+/* Internal event enqueue – any context, never blocks */
 void wimp_enqueue_event(wimp_event_t *event) {
-    unsigned long flags;
-    spin_lock_irqsave(&event_queue.lock, flags);
+    if (event->type == wimp_POINTER_MOVE) {
+        pointer_latest = *event;    // Single producer (pointer IRQ)
+        if (__atomic_exchange_n(&pointer_pending, 1, __ATOMIC_ACQ_REL))
+            return;                 // Entry already queued – updated in place
+    }
 
-    if ((event_queue.head - event_queue.tail) >= MAX_EVENTS) {
-        debug_print("Wimp: Event queue overflow\n");
-        spin_unlock_irqrestore(&event_queue.lock, flags);
-        return;
+    uint32_t pos = __atomic_load_n(&event_queue.head, __ATOMIC_RELAXED);
+    for (;;) {
+        uint32_t s = __atomic_load_n(&event_queue.seq[pos % MAX_EVENTS],
+                                     __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(s - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&event_queue.head, &pos, pos + 1,
+                                            1, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;              // Slot claimed – pos is ours
+        } else if (diff < 0) {
+            __atomic_fetch_add(&event_queue.drops, 1, __ATOMIC_RELAXED);
+            debug_print("Wimp: Event queue overflow (%u dropped)\n",
+                        event_queue.drops);
+            return;                 // Consumer a full lap behind
+        } else {
+            pos = __atomic_load_n(&event_queue.head, __ATOMIC_RELAXED);
+        }
     }
 
-    event_queue.events[event_queue.head % MAX_EVENTS] = *event;
-    event_queue.head++;
+    event_queue.events[pos % MAX_EVENTS] = *event;
+    __atomic_store_n(&event_queue.seq[pos % MAX_EVENTS], pos + 1,
+                     __ATOMIC_RELEASE);
+
+    uint32_t depth = pos + 1 - event_queue.tail;
+    if (depth > event_queue.high_water)
+        event_queue.high_water = depth;     // Racy but only a statistic
 
-    spin_unlock_irqrestore(&event_queue.lock, flags);
     task_wakeup(wimp_task);  // Wake Wimp task if blocked
 }
 
+/* Queue pressure counters for diagnostics */
+void wimp_queue_stats(uint32_t *depth, uint32_t *high_water, uint32_t *drops)
+{
+    if (depth)      *depth = event_queue.head - event_queue.tail;
+    if (high_water) *high_water = event_queue.high_water;
+    if (drops)      *drops = event_queue.drops;
+}
+
+/* Pointer move handler – from input driver, coalesced to the latest */
+void input_mouse_move(int x, int y) {
+    wimp_event_t event;
+    event.type = wimp_POINTER_MOVE;
+    event.mouse.x = x;
+    event.mouse.y = y;
+    event.mouse.button = 0;
+
+    wimp_enqueue_event(&event);
+}
+
 /* Create window */
 window_t *wimp_create_window(wimp_window_def *def) {
     if (num_windows >= MAX_WINDOWS) return NULL;
@@ -91,8 +159,15 @@ window_t *wimp_create_window(wimp_window_def *def) {
     return win;
 }
 
-/* Redraw window request – enqueue event */
+/* Redraw window request – accumulate damage on the window, enqueue
+ * at most one redraw event per window until it is serviced */
 void wimp_redraw_request(window_t *win, bbox_t *clip) {
+    bbox_t full = { win->def.x0, win->def.y0, win->def.x1, win->def.y1 };
+    wimp_add_damage(win, clip ? clip : &full);
+
+    if (win->redraw_queued) return;     // One is already in flight
+    win->redraw_queued = 1;
+
     wimp_event_t event;
     event.type = wimp_REDRAW_WINDOW_REQUEST;
     event.redraw.window = win;
@@ -187,7 +262,8 @@ void wimp_task(void) {
 
         switch (code) {
             case wimp_REDRAW_WINDOW_REQUEST:
-                gpu_redraw_window(event.redraw.window);  // GPU accelerated redraw
+                event.redraw.window->redraw_queued = 0;
+                wimp_composite_frame();  // One recorded frame, one submit
                 break;
 
             case wimp_MOUSE_CLICK:
@@ -17,6 +17,80 @@ static window_t windows[MAX_WINDOWS];
 static int num_windows = 0;
 static window_t *focus_window = NULL;
 
+/* Spatial index: a uniform grid over desktop coordinates. Each cell
+ * lists the windows whose bbox touches it, in z-order, so a pointer
+ * lookup is one cell probe and a handful of bbox checks instead of a
+ * scan over all 256 windows. Rebuilt on create/move/resize/raise –
+ * rare next to the hundreds of pointer events per second. */
+#define GRID_SHIFT  8               // 256px cells
+#define GRID_W      16              // Covers a 4096x4096 desktop
+#define GRID_H      16
+#define GRID_CAP    16              // Windows listed per cell
+
+static window_t *grid[GRID_W * GRID_H][GRID_CAP];
+static int grid_n[GRID_W * GRID_H];
+
+static void grid_rebuild(void)
+{
+    memset(grid_n, 0, sizeof(grid_n));
+
+    /* Bottom to top, so the topmost hit is the last entry in a cell */
+    for (int i = 0; i < num_windows; i++) {
+        window_t *win = &windows[i];
+        if (!win->visible) continue;
+
+        int cx0 = win->def.x0 >> GRID_SHIFT, cx1 = win->def.x1 >> GRID_SHIFT;
+        int cy0 = win->def.y0 >> GRID_SHIFT, cy1 = win->def.y1 >> GRID_SHIFT;
+        if (cx0 < 0) cx0 = 0;
+        if (cy0 < 0) cy0 = 0;
+        if (cx1 >= GRID_W) cx1 = GRID_W - 1;
+        if (cy1 >= GRID_H) cy1 = GRID_H - 1;
+
+        for (int cy = cy0; cy <= cy1; cy++)
+            for (int cx = cx0; cx <= cx1; cx++) {
+                int cell = cy * GRID_W + cx;
+                if (grid_n[cell] < GRID_CAP)
+                    grid[cell][grid_n[cell]++] = win;
+            }
+    }
+}
+
+/* Sort a window's icons by x0 for binary-searched hit tests */
+static void icons_sort(window_t *win)
+{
+    int n = win->def.icon_count;
+    if (n == 0) return;
+
+    if (!win->icon_sorted)
+        win->icon_sorted = kmalloc(n * sizeof(int));
+
+    win->icon_max_w = 0;
+    for (int i = 0; i < n; i++) {
+        win->icon_sorted[i] = i;
+        int w = win->def.icons[i].x1 - win->def.icons[i].x0;
+        if (w > win->icon_max_w) win->icon_max_w = w;
+    }
+
+    /* Insertion sort – icon sets are small and nearly ordered */
+    for (int i = 1; i < n; i++) {
+        int idx = win->icon_sorted[i];
+        int key = win->def.icons[idx].x0;
+        int j = i - 1;
+        while (j >= 0 && win->def.icons[win->icon_sorted[j]].x0 > key) {
+            win->icon_sorted[j + 1] = win->icon_sorted[j];
+            j--;
+        }
+        win->icon_sorted[j + 1] = idx;
+    }
+}
+
+/* Call after moving, resizing or restacking a window */
+void wimp_window_moved(window_t *win)
+{
+    (void)win;
+    grid_rebuild();
+}
+
 /* Create a new window */
 window_t *wimp_create_window(wimp_window_def *def)
 {
@@ -40,42 +114,91 @@ window_t *wimp_create_window(wimp_window_def *def)
     win->visible = 1;
     win->context_menu = NULL;  // Default no context menu
 
+    icons_sort(win);
+    grid_rebuild();
+    wimp_draw_title_bar(win);
+
     debug_print("Wimp: Window created – handle %p, size %dx%d\n", 
                 win, def->width, def->height);
 
     return win;
 }
 
-/* Find window at screen coordinates */
+/* Find window at screen coordinates – one grid cell, topmost first */
 window_t *wimp_find_window_at(int x, int y)
 {
-    for (int i = num_windows - 1; i >= 0; i--) {  // Topmost first
-        window_t *win = &windows[i];
-        if (!win->visible) continue;
+    int cx = x >> GRID_SHIFT, cy = y >> GRID_SHIFT;
 
+    if (cx < 0 || cx >= GRID_W || cy < 0 || cy >= GRID_H) {
+        /* Off the indexed desktop – fall back to the full scan */
+        for (int i = num_windows - 1; i >= 0; i--) {
+            window_t *win = &windows[i];
+            if (win->visible &&
+                x >= win->def.x0 && x <= win->def.x1 &&
+                y >= win->def.y0 && y <= win->def.y1)
+                return win;
+        }
+        return NULL;
+    }
+
+    int cell = cy * GRID_W + cx;
+    for (int i = grid_n[cell] - 1; i >= 0; i--) {
+        window_t *win = grid[cell][i];
         if (x >= win->def.x0 && x <= win->def.x1 &&
-            y >= win->def.y0 && y <= win->def.y1) {
+            y >= win->def.y0 && y <= win->def.y1)
             return win;
-        }
     }
     return NULL;
 }
 
-/* Find icon at window-relative coordinates */
+/* Find icon at window-relative coordinates. Icons are sorted by x0:
+ * binary-search the last icon starting at or left of x, then walk left
+ * no further than the widest icon could still reach. */
 int wimp_find_icon_at(window_t *win, int x, int y)
 {
-    if (!win) return -1;
+    if (!win || win->def.icon_count == 0) return -1;
 
-    for (int i = 0; i < win->def.icon_count; i++) {
-        wimp_icon *icon = &win->def.icons[i];
-        if (x >= icon->x0 && x <= icon->x1 &&
-            y >= icon->y0 && y <= icon->y1) {
-            return i;
+    if (!win->icon_sorted) {
+        for (int i = 0; i < win->def.icon_count; i++) {
+            wimp_icon *icon = &win->def.icons[i];
+            if (x >= icon->x0 && x <= icon->x1 &&
+                y >= icon->y0 && y <= icon->y1)
+                return i;
         }
+        return -1;
+    }
+
+    int lo = 0, hi = win->def.icon_count - 1, last = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (win->def.icons[win->icon_sorted[mid]].x0 <= x) {
+            last = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    for (int i = last; i >= 0; i--) {
+        int idx = win->icon_sorted[i];
+        wimp_icon *icon = &win->def.icons[idx];
+        if (icon->x0 < x - win->icon_max_w)
+            break;              // Nothing further left can reach x
+        if (x >= icon->x0 && x <= icon->x1 &&
+            y >= icon->y0 && y <= icon->y1)
+            return idx;
     }
     return -1;
 }
 
+/* Title-bar text – same glyph atlas as the menus, so reopening or
+ * retitling a window never re-rasterizes characters already seen */
+void wimp_draw_title_bar(window_t *win)
+{
+    if (!win || !win->def.title) return;
+    gpu_draw_text(win->def.x0 + 8, win->def.y0 + 4, win->def.title, 0x00000000);
+}
+
 /* Get currently focused window */
 window_t *wimp_get_focus_window(void)
 {
@@ -89,20 +212,132 @@ void wimp_set_focus_window(window_t *win)
     debug_print("Wimp: Focus set to window %p\n", win);
 }
 
-/* Redraw window request – enqueue event */
+/* Accumulate a dirty rectangle on a window. A rect that touches an
+ * existing one is merged into its bounding box rather than stored
+ * separately; a full list collapses to a single bounding box. */
+void wimp_add_damage(window_t *win, const bbox_t *r)
+{
+    for (int i = 0; i < win->damage_count; i++) {
+        bbox_t *d = &win->damage[i];
+        if (r->x0 <= d->x1 && r->x1 >= d->x0 &&
+            r->y0 <= d->y1 && r->y1 >= d->y0) {
+            if (r->x0 < d->x0) d->x0 = r->x0;
+            if (r->y0 < d->y0) d->y0 = r->y0;
+            if (r->x1 > d->x1) d->x1 = r->x1;
+            if (r->y1 > d->y1) d->y1 = r->y1;
+            return;
+        }
+    }
+
+    if (win->damage_count >= WIMP_DAMAGE_MAX) {
+        bbox_t *d = &win->damage[0];
+        for (int i = 1; i < win->damage_count; i++) {
+            if (win->damage[i].x0 < d->x0) d->x0 = win->damage[i].x0;
+            if (win->damage[i].y0 < d->y0) d->y0 = win->damage[i].y0;
+            if (win->damage[i].x1 > d->x1) d->x1 = win->damage[i].x1;
+            if (win->damage[i].y1 > d->y1) d->y1 = win->damage[i].y1;
+        }
+        if (r->x0 < d->x0) d->x0 = r->x0;
+        if (r->y0 < d->y0) d->y0 = r->y0;
+        if (r->x1 > d->x1) d->x1 = r->x1;
+        if (r->y1 > d->y1) d->y1 = r->y1;
+        win->damage_count = 1;
+        return;
+    }
+
+    win->damage[win->damage_count++] = *r;
+}
+
+/* One window's bbox fully inside another's */
+static int window_covers(window_t *over, window_t *under)
+{
+    return over->def.x0 <= under->def.x0 && over->def.y0 <= under->def.y0 &&
+           over->def.x1 >= under->def.x1 && over->def.y1 >= under->def.y1;
+}
+
+/* Composite one frame. The windows array is z-order (topmost last);
+ * walking it top-down culls any window whose bbox sits entirely under
+ * a window above it, and a topmost window covering the whole screen
+ * short-circuits to the direct scanout path with no composition work
+ * at all. The surviving set is drawn back to front as one instanced
+ * batch, re-recorded only when the set or its content changed. Falls
+ * back to per-window redraws when frame recording is unavailable
+ * (GLES path). */
+void wimp_composite_frame(void)
+{
+    window_t *vis[MAX_WINDOWS];
+    int n = 0, dirty = 0;
+    int sw, sh;
+    gpu_screen_size(&sw, &sh);
+
+    for (int i = num_windows - 1; i >= 0; i--) {
+        window_t *win = &windows[i];
+        if (!win->visible) continue;
+
+        /* Full-screen on top – kiosk case, skip the compositor */
+        if (n == 0 &&
+            win->def.x0 <= 0 && win->def.y0 <= 0 &&
+            win->def.x1 >= sw && win->def.y1 >= sh) {
+            if (gpu_scanout(win) == 0)
+                return;
+        }
+
+        int occluded = 0;
+        for (int j = 0; j < n; j++) {
+            if (window_covers(vis[j], win)) {
+                occluded = 1;
+                break;
+            }
+        }
+        if (occluded) continue;
+
+        vis[n++] = win;
+        if (win->damage_count > 0) dirty = 1;
+    }
+
+    /* A changed visible set (open/close/raise) also invalidates the
+     * cached batch recording */
+    static window_t *last_vis[MAX_WINDOWS];
+    static int last_n = -1;
+    if (n != last_n || memcmp(vis, last_vis, n * sizeof(window_t *)) != 0) {
+        dirty = 1;
+        memcpy(last_vis, vis, n * sizeof(window_t *));
+        last_n = n;
+    }
+
+    if (gpu_frame_begin() != 0) {
+        for (int i = n - 1; i >= 0; i--)
+            if (vis[i]->damage_count > 0)
+                gpu_redraw_window(vis[i]);
+        return;
+    }
+
+    /* Reverse into draw order – instance 0 is the bottom window */
+    for (int i = 0; i < n / 2; i++) {
+        window_t *t = vis[i];
+        vis[i] = vis[n - 1 - i];
+        vis[n - 1 - i] = t;
+    }
+
+    gpu_frame_record_batch(vis, n, dirty);
+    gpu_frame_end();
+}
+
+/* Redraw window request – accumulate damage, enqueue at most one
+ * redraw event per window until it is serviced */
 void wimp_redraw_request(window_t *win, bbox_t *clip)
 {
+    bbox_t full = { win->def.x0, win->def.y0, win->def.x1, win->def.y1 };
+    wimp_add_damage(win, clip ? clip : &full);
+
+    if (win->redraw_queued)
+        return;             // Already one in the queue – it covers this too
+    win->redraw_queued = 1;
+
     wimp_event_t event;
     event.type = wimp_REDRAW_WINDOW_REQUEST;
     event.redraw.window = win;
-    if (clip) {
-        event.redraw.clip = *clip;
-    } else {
-        event.redraw.clip.x0 = win->def.x0;
-        event.redraw.clip.y0 = win->def.y0;
-        event.redraw.clip.x1 = win->def.x1;
-        event.redraw.clip.y1 = win->def.y1;
-    }
+    event.redraw.clip = clip ? *clip : full;
 
     wimp_enqueue_event(&event);
 }
@@ -130,5 +365,6 @@ void window_init(void)
 {
     num_windows = 0;
     focus_window = NULL;
+    memset(grid_n, 0, sizeof(grid_n));
     debug_print("Window subsystem initialized\n");
 }
\ No newline at end of file